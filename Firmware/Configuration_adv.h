@@ -22,6 +22,31 @@
   #define AUTOTEMP_OLDWEIGHT 0.98
 #endif
 
+//hotend power feed-forward: the power needed to melt the filament planned for extrusion within the
+//next HOTEND_FF_HORIZON seconds is added to the output of the hotend PID, so that the heater is
+//boosted before a long high-flow move starts instead of reacting to the temperature sag afterwards.
+//#define HOTEND_FEEDFORWARD
+#ifdef HOTEND_FEEDFORWARD
+  #define HOTEND_FF_HORIZON 2.0     // planner look-ahead window (s), close to the heater transport delay
+  #define HOTEND_FF_HEAT 0.0022     // volumetric heat of the filament including melting (J/mm^3/K)
+  #define HOTEND_FF_AMBIENT 25      // temperature of the incoming filament (C)
+  #ifdef TEMP_MODEL_P
+    #define HOTEND_FF_HEATER_P TEMP_MODEL_P
+  #else
+    #define HOTEND_FF_HEATER_P 40.  // heater power (W)
+  #endif
+  #define HOTEND_FF_MAX 96          // feed-forward limit (in PID_MAX units)
+#endif
+
+//soft PWM driven by an edge schedule: the main loop sorts the heater and fan duties into a list of
+//output edges which the ISR takes over at the start of the next PWM frame, so that the soft PWM tick
+//is reduced to a single compare and the outputs are written only when they change. Requires
+//SOFT_PWM_SCALE 0.
+//#define SOFT_PWM_EDGES
+//sigma-delta dithering of the print fan and heatbed duty: the fan gets the full 8bit resolution
+//instead of FAN_SOFT_PWM_BITS and the bed keeps the LSB of its PID output. Requires SOFT_PWM_EDGES.
+//#define SOFT_PWM_DITHER
+
 //Show Temperature ADC value
 //The M105 command return, besides traditional information, the ADC value read from temperature sensors.
 //#define SHOW_TEMP_ADC_VALUES
@@ -58,7 +83,7 @@
  * bit 0 = Auto-report temperatures
  * bit 1 = Auto-report fans
  * bit 2 = Auto-report position
- * bit 3 = free
+ * bit 3 = Thermal telemetry stream (THERMAL_TELEMETRY), M155 C8 R<Hz>
  * bit 4 = free
  * bit 5 = free
  * bit 6 = free
@@ -66,6 +91,15 @@
 */
 #define AUTO_REPORT
 
+//compact thermal telemetry: fixed-point, delta-encoded frames of the heater, target, PWM and model
+//error values sent as base64 "TLM:" lines, see tools/telemetry_decode
+//#define THERMAL_TELEMETRY
+#ifdef THERMAL_TELEMETRY
+  #define THERMAL_TELEMETRY_RATE 10     // default frame rate (Hz)
+  #define THERMAL_TELEMETRY_MAX_RATE 20 // highest frame rate of M155 R (Hz)
+  #define THERMAL_TELEMETRY_KEYFRAME 50 // frames between the key frames with absolute values
+#endif
+
 //===========================================================================
 //=============================Mechanical Settings===========================
 //===========================================================================
@@ -212,11 +246,12 @@
 *
 * By default...
 *
-*  - Use the slowest -but safest- method for sorting.
+*  - The names are reread from the card, only the entry indices are kept in RAM.
 *  - Folders are sorted to the top.
 *  - The sort key is statically allocated.
 *  - No added G-code (M34) support.
-*  - 40 item sorting limit. (Items after the first 40 are unsorted.)
+*  - No item sorting limit. The sorted order is selected SDSORT_LIMIT items
+*    at a time by a pass over the directory when the menu shows them.
 *
 * SD sorting uses static allocation (as set by SDSORT_LIMIT), allowing the
 * compiler to calculate the worst-case usage and throw an error if the SRAM
@@ -229,18 +264,103 @@
 	  #define SD_SORT_TIME 0
 	  #define SD_SORT_ALPHA 1
 	  #define SD_SORT_NONE 2
-	  #define INSERTSORT
-	  // #define SORTING_DUMP
-	  // #define SORTING_SPEEDTEST
 	
-	  #define SDSORT_LIMIT       100    // Maximum number of sorted items (10-256).
+	  #define SDSORT_LIMIT       64     // Number of items sorted by a pass over the directory (10-256), 6 bytes of RAM each.
 	  #define FOLDER_SORTING     -1     // -1=above  0=none  1=below
+
+	  // Keep the sorted order of the last visited directories in RAM (2 bytes per item, 9 bytes per
+	  // directory), a revisited directory is shown sorted without reading it. The index is dropped
+	  // when the card is initialized or written. Otherwise the order is built by the SD menu in
+	  // steps of SDSORT_INDEX_STEP ms; the items of a directory beyond SDSORT_INDEX_SIZE are
+	  // listed unsorted after the rest.
+	  //#define SDSORT_INDEX
+	  #define SDSORT_INDEX_SIZE  300    // Number of items of all the indexed directories
+	  #define SDSORT_INDEX_DIRS  4      // Number of indexed directories
+	  #define SDSORT_INDEX_STEP  20     // [ms]
+	  // Also store the sorted order in a SDSORT.IDX file in the directory, so it's listed sorted
+	  // right away after a restart or a card change, and a directory beyond SDSORT_INDEX_SIZE is
+	  // indexed too. Writes to the card on the first visit of a directory. The index is checked by
+	  // the first cluster of the directory, the count of its entries and a hash of its first block;
+	  // an item deleted further in the directory by a PC is found when it's listed or counted.
+	  //#define SDSORT_INDEX_FILE
+
+	  // Keep the names of the last listed items, redrawing the SD menu doesn't access the card.
+	  //#define SD_NAME_CACHE
+	  #define SD_NAME_CACHE_SIZE 5      // the rows of the menu and the one scrolled out
 	#endif
 	
 	#if defined(SDCARD_SORT_ALPHA)
 	  #define HAS_FOLDER_SORTING (FOLDER_SORTING)
 	#endif
 
+// Map the cluster chain of the printed file into runs of consecutive clusters when it is opened,
+// so that the seeks (print resume, M26) and the cluster transitions don't walk the FAT.
+// Takes 6 bytes of RAM per run, the FAT is used past the last mapped run of a fragmented file.
+//#define SD_EXTENT_MAP
+#ifdef SD_EXTENT_MAP
+  #define SD_EXTENT_MAP_SIZE 8
+#endif
+
+// Read the FAT into a cache of its own, so that following a cluster chain doesn't evict the file data
+// from the block cache. Each block of the cache (least recently used is replaced) takes 512 bytes of RAM.
+//#define SD_FAT_CACHE
+#ifdef SD_FAT_CACHE
+  #define SD_FAT_CACHE_BLOCKS 1
+#endif
+
+// Read the printed file in a multiple block read (CMD18) kept open while the blocks are sequential,
+// instead of a command per block. Any other access to the card closes it.
+//#define SD_MULTIBLOCK_READ
+
+// Write the file uploaded by the PRUSA M28 into clusters reserved for its announced size in a
+// multiple block write (CMD25), the FAT is updated when the file is closed.
+//#define SD_MULTIBLOCK_WRITE
+
+// Print the binary files written by tools/gcode2bin: the moves are read from the card as fixed-point
+// records and planned directly, without formatting and parsing their text. M26 L seeks to a layer.
+//#define SD_BINARY_GCODE
+
+// Keep the coefficients of the mesh bed leveling interpolation for each cell of the mesh, so that the
+// correction of a planned move takes a few multiplications. Takes 16 bytes of RAM per cell.
+//#define MBL_CELL_COEFFICIENTS
+
+// Interpolate the mesh bed leveling correction by a smooth bicubic (Catmull-Rom) surface through the
+// mesh points instead of the bilinear cells, which follows a warped bed without probing more points.
+// The surface is sampled into a grid MBL_BICUBIC_FACTOR times denser than the mesh after G80, kept as
+// int16 [um]: 722 bytes of RAM for a 7x7 mesh and the factor 3. Replaces MBL_CELL_COEFFICIENTS.
+// The moves are split at the lines of the grid, up to MBL_BICUBIC_FACTOR times more segments.
+//#define MBL_BICUBIC
+#ifdef MBL_BICUBIC
+  #define MBL_BICUBIC_FACTOR 3
+#endif
+
+// G80 X Y W H probes only the points of the 7x7 mesh around the print area (e.g. the first layer
+// bounding box from the slicer), merged into the previous complete mesh.
+//#define MBL_PROBE_AREA
+
+// A full 7x7 G80 stores its mesh in the EEPROM for the active sheet. G80 C then probes only 3 to 5
+// check points and reuses the stored mesh, shifted by their mean change, if none of them moved by
+// more than MBL_STORED_MESH_TOLERANCE from the others. Otherwise the full mesh is probed again.
+//#define MBL_STORED_MESH
+#ifdef MBL_STORED_MESH
+  #define MBL_STORED_MESH_TOLERANCE 0.03 // [mm]
+  #define MBL_STORED_MESH_PINDA_RANGE 5 // [C] PINDA temperature difference to the stored mesh
+#endif
+
+// The XYZ calibration scans each calibration point coarsely first, every other pixel of every other
+// row in a serpentine, then the 16x16 pixels around the point found in it at the full resolution.
+// Takes 768 pixel measurements instead of 2048, falls back to the full scan if no point is found.
+//#define XYZCAL_COARSE_TO_FINE
+
+// Split the G2/G3 arcs into chords which deviate from the arc by ARC_CHORD_ERROR at most, instead of
+// the segment length set by M214 P R F. The chords are between M214 S and ARC_CHORD_MAX_LENGTH long,
+// so the large radii of arc-fitted G-code take fewer segments. M214 N isn't used, the radius vector
+// is rotated by the exact angle of a segment.
+//#define ARC_CHORD_ERROR 0.01 // [mm]
+#ifdef ARC_CHORD_ERROR
+  #define ARC_CHORD_MAX_LENGTH 10 // [mm]
+#endif
+
 // Enabe this option to get a pretty message whenever the endstop gets hit (as in the position at which the endstop got triggered)
 //#define VERBOSE_CHECK_HIT_ENDSTOPS
 
@@ -337,6 +457,15 @@ const unsigned int dropsegments=5; //everything with less than this number of st
   #define BLOCK_BUFFER_SIZE 16 // maximize block buffer
 #endif
 
+// Keep the lengths of the planned SD commands for the power panic in a ring of checkpoints, one for
+// each block ending a command, instead of in every planner block, and the length of the SD commands
+// in the command queue as a running total. The resume position is then computed without walking
+// the queues. A checkpoint takes 3 bytes of RAM and the ring 4 more, in place of the 2 bytes of
+// block_t::sdlen in each block: 8 checkpoints take 28 bytes instead of 32, BLOCK_BUFFER_SIZE of them
+// 52 bytes. With fewer checkpoints than blocks, the newest one takes the following commands while
+// all are in use, and the print resumes up to a planner queue of commands earlier than needed.
+//#define SD_CHECKPOINTS 8
+
 
 //The ASCII buffer for receiving from the serial:
 #define MAX_CMD_SIZE 96
@@ -188,6 +188,7 @@ void dcode_3()
 #include "adc.h"
 #include "temperature.h"
 #include <avr/wdt.h>
+#include <util/atomic.h>
 #include "bootapp.h"
 
 #if 0
@@ -572,6 +573,22 @@ void dcode_9()
 	{
 		for (uint8_t i = 0; i < ADC_CHAN_CNT; i++)
 			printf_P(PSTR("\tADC%d=%4d\t(%S)\n"), i, dcode_9_ADC_val(i) >> 4, dcode_9_ADC_name(i));
+
+		// sampling configuration and statistics
+		adc_stats_t stats;
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+			stats = *(adc_stats_t*)&adc_stats;
+		}
+		for (uint8_t i = 0; i < ADC_CHAN_CNT; i++)
+		{
+#ifdef ADC_CHAN_CFG
+			printf_P(PSTR("\tADC%d samples=%d filter=%d\n"), i, adc_chan_samples(i), adc_chan_filter(i));
+#else
+			printf_P(PSTR("\tADC%d samples=%d\n"), i, adc_chan_samples(i));
+#endif //ADC_CHAN_CFG
+		}
+		printf_P(PSTR("\tcycles=%u last=%ums max=%ums stamp=%lu\n"),
+			stats.cycles, stats.duration, stats.duration_max, stats.timestamp);
 	}
 #if 0
 	else
@@ -53,12 +53,13 @@
 #ifdef ENABLE_AUTO_BED_LEVELING
 #include "vector_3.h"
   #ifdef AUTO_BED_LEVELING_GRID
-    #include "qr_solve.h"
+    #include "least_squares.h"
   #endif
 #endif // ENABLE_AUTO_BED_LEVELING
 
 #ifdef MESH_BED_LEVELING
   #include "mesh_bed_leveling.h"
+  #include "mesh_line_walk.h"
   #include "mesh_bed_calibration.h"
 #endif
 
@@ -395,7 +396,7 @@ class AutoReportFeatures {
             uint8_t temp : 1; //Temperature flag
             uint8_t fans : 1; //Fans flag
             uint8_t pos: 1;   //Position flag
-            uint8_t ar4 : 1;  //Unused
+            uint8_t tlm : 1;  //Thermal telemetry flag
             uint8_t ar5 : 1;  //Unused
             uint8_t ar6 : 1;  //Unused
             uint8_t ar7 : 1;  //Unused
@@ -422,6 +423,8 @@ public:
     inline bool Pos()const { return arFunctionsActive.bits.pos != 0; }
     inline void SetPos(uint8_t v){ arFunctionsActive.bits.pos = v; }
     
+    inline bool Telemetry()const { return arFunctionsActive.bits.tlm != 0; }
+
     inline void SetMask(uint8_t mask){ arFunctionsActive.byte = mask; }
     
     /// sets the autoreporting timer's period
@@ -768,6 +771,10 @@ static void factory_reset(char level)
 		eeprom_write_byte((uint8_t*)EEPROM_WIZARD_ACTIVE, 2); //run wizard
 		farm_mode = false;
 		eeprom_update_byte((uint8_t*)EEPROM_FARM_MODE, farm_mode);
+#ifdef MBL_STORED_MESH
+		for (uint8_t i = 0; i < MAX_SHEETS; ++i)
+			mbl_stored_invalidate(i);
+#endif //MBL_STORED_MESH
 
 #ifdef FILAMENT_SENSOR
 		fsensor_enable();
@@ -1735,6 +1742,9 @@ void serial_read_stream() {
 
     // make it a uint32
     memcpy(&bytesToReceive, &bytesToReceiveBuffer, 4);
+#ifdef SD_MULTIBLOCK_WRITE
+    card.reserveFileWrite(bytesToReceive);
+#endif //SD_MULTIBLOCK_WRITE
 
     // we're ready, notify the sender
     MYSERIAL.write('+');
@@ -1874,6 +1884,9 @@ void loop()
     {
 
         get_command();
+#ifdef SD_BINARY_GCODE
+        get_binary_command();
+#endif //SD_BINARY_GCODE
 
   #ifdef SDSUPPORT
   card.checkautostart(false);
@@ -1905,44 +1918,7 @@ void loop()
 
     if (! cmdbuffer_front_already_processed && buflen)
     {
-      // ptr points to the start of the block currently being processed.
-      // The first character in the block is the block type.      
-      char *ptr = cmdbuffer + bufindr;
-      if (*ptr == CMDBUFFER_CURRENT_TYPE_SDCARD) {
-        // To support power panic, move the lenght of the command on the SD card to a planner buffer.
-        union {
-          struct {
-              char lo;
-              char hi;
-          } lohi;
-          uint16_t value;
-        } sdlen;
-        sdlen.value = 0;
-        {
-          // This block locks the interrupts globally for 3.25 us,
-          // which corresponds to a maximum repeat frequency of 307.69 kHz.
-          // This blocking is safe in the context of a 10kHz stepper driver interrupt
-          // or a 115200 Bd serial line receive interrupt, which will not trigger faster than 12kHz.
-          cli();
-          // Reset the command to something, which will be ignored by the power panic routine,
-          // so this buffer length will not be counted twice.
-          *ptr ++ = CMDBUFFER_CURRENT_TYPE_TO_BE_REMOVED;
-          // Extract the current buffer length.
-          sdlen.lohi.lo = *ptr ++;
-          sdlen.lohi.hi = *ptr;
-          // and pass it to the planner queue.
-          planner_add_sd_length(sdlen.value);
-          sei();
-        }
-	  }
-	  else if((*ptr == CMDBUFFER_CURRENT_TYPE_USB_WITH_LINENR) && !IS_SD_PRINTING){ 
-		  
-		  cli();
-          *ptr ++ = CMDBUFFER_CURRENT_TYPE_TO_BE_REMOVED;
-          // and one for each command to previous block in the planner queue.
-          planner_add_sd_length(1);
-          sei();
-	  }
+      cmdqueue_pass_sd_length();
       // Now it is safe to release the already processed command block. If interrupted by the power panic now,
       // this block's SD card length will not be counted twice as its command type has been replaced 
       // by CMDBUFFER_CURRENT_TYPE_TO_BE_REMOVED.
@@ -2028,7 +2004,7 @@ static void clean_up_after_endstop_move(int original_feedmultiply) {
 
 #ifdef ENABLE_AUTO_BED_LEVELING
 #ifdef AUTO_BED_LEVELING_GRID
-static void set_bed_level_equation_lsq(double *plane_equation_coefficients)
+static void set_bed_level_equation_lsq(const float *plane_equation_coefficients)
 {
     vector_3 planeNormal = vector_3(-plane_equation_coefficients[0], -plane_equation_coefficients[1], 1);
     planeNormal.debug("planeNormal");
@@ -2992,6 +2968,98 @@ static void gcode_G28(bool home_x_axis, bool home_y_axis, bool home_z_axis)
 }
 
 
+#ifdef MBL_PROBE_AREA
+static uint8_t gcode_G80_index(float u, float lo, float hi)
+{
+    return (u < lo) ? lo : (u > hi) ? hi : u;
+}
+
+//! @brief Mesh points of the print area given by the G80 parameters X, Y, W and H [mm]
+//!
+//! The area is covered by the cells of the 7x7 mesh it touches, the points of these cells are probed.
+//! @return false if the full mesh is to be probed: no area was given or it doesn't save any points
+static bool gcode_G80_area(uint8_t nMeasPoints, uint8_t &ix0, uint8_t &iy0, uint8_t &ix1, uint8_t &iy1)
+{
+    float x, y, w, h;
+    if (!code_seen('X')) return false;
+    x = code_value();
+    if (!code_seen('Y')) return false;
+    y = code_value();
+    if (!code_seen('W')) return false;
+    w = code_value();
+    if (!code_seen('H')) return false;
+    h = code_value();
+#ifdef MBL_BICUBIC
+    // the surface of a cell depends on the points around it too
+    const uint8_t margin = 1;
+#else
+    const uint8_t margin = 0;
+#endif //MBL_BICUBIC
+    uint8_t i0 = gcode_G80_index(floor((x - MESH_MIN_X) / MESH_X_DIST) - margin, 0, MESH_NUM_X_POINTS - 2);
+    uint8_t i1 = gcode_G80_index(ceil((x + w - MESH_MIN_X) / MESH_X_DIST) + margin, i0 + 1, MESH_NUM_X_POINTS - 1);
+    uint8_t j0 = gcode_G80_index(floor((y - MESH_MIN_Y) / MESH_Y_DIST) - margin, 0, MESH_NUM_Y_POINTS - 2);
+    uint8_t j1 = gcode_G80_index(ceil((y + h - MESH_MIN_Y) / MESH_Y_DIST) + margin, j0 + 1, MESH_NUM_Y_POINTS - 1);
+    if ((i1 - i0 + 1) * (j1 - j0 + 1) >= nMeasPoints * nMeasPoints)
+        return false;
+    ix0 = i0;
+    ix1 = i1;
+    iy0 = j0;
+    iy1 = j1;
+    return true;
+}
+
+//! @brief Complete the mesh around the probed area
+//!
+//! The points of a previous complete mesh are kept, shifted by the mean change of the probed
+//! points (e.g. a different PINDA temperature). Without a previous mesh the edges of the area are
+//! carried outwards, the print doesn't reach there.
+static void gcode_G80_merge(uint8_t ix0, uint8_t iy0, uint8_t ix1, uint8_t iy1, bool merge, float drift)
+{
+    for (uint8_t iy = 0; iy < MESH_NUM_Y_POINTS; ++ iy) {
+        for (uint8_t ix = 0; ix < MESH_NUM_X_POINTS; ++ ix) {
+            if (ix >= ix0 && ix <= ix1 && iy >= iy0 && iy <= iy1)
+                continue;
+            if (merge)
+                mbl.z_values[iy][ix] += drift;
+            else
+                mbl.z_values[iy][ix] = mbl.z_values[(iy < iy0) ? iy0 : (iy > iy1) ? iy1 : iy][(ix < ix0) ? ix0 : (ix > ix1) ? ix1 : ix];
+        }
+    }
+}
+#endif //MBL_PROBE_AREA
+
+#ifdef MBL_STORED_MESH
+//! check points of G80 C, in the order of probing, indices of the 3x3 mesh
+static const uint8_t gcode_G80_check_points[5][2] PROGMEM = {{0, 0}, {2, 0}, {2, 2}, {0, 2}, {1, 1}};
+
+//! @brief Replace the probed check points by the mesh stored for the active sheet
+//!
+//! The check points may move together, e.g. after the Z calibration, the mesh is shifted by their mean change.
+//! @return false if a check point moved by more than MBL_STORED_MESH_TOLERANCE from the others
+static bool gcode_G80_reuse(uint8_t check)
+{
+    float dz[5];
+    float drift = 0;
+    for (uint8_t i = 0; i < check; ++ i) {
+        uint8_t ix = pgm_read_byte(&gcode_G80_check_points[i][0]);
+        uint8_t iy = pgm_read_byte(&gcode_G80_check_points[i][1]);
+        dz[i] = mbl.z_values[iy][ix] - mbl_stored_z(ix * 3, iy * 3);
+        drift += dz[i];
+    }
+    drift /= check;
+    float deviation = 0;
+    for (uint8_t i = 0; i < check; ++ i)
+        if (fabs(dz[i] - drift) > deviation)
+            deviation = fabs(dz[i] - drift);
+    if (deviation > MBL_STORED_MESH_TOLERANCE)
+        return false;
+    for (uint8_t iy = 0; iy < MESH_NUM_Y_POINTS; ++ iy)
+        for (uint8_t ix = 0; ix < MESH_NUM_X_POINTS; ++ ix)
+            mbl.z_values[iy][ix] = mbl_stored_z(ix, iy) + drift;
+    return true;
+}
+#endif //MBL_STORED_MESH
+
 // G80 - Automatic mesh bed leveling
 static void gcode_G80()
 {
@@ -3003,6 +3071,9 @@ static void gcode_G80()
 #ifndef PINDA_THERMISTOR
     static bool run = false; // thermistor-less PINDA temperature compensation is running
 #endif // ndef PINDA_THERMISTOR
+#ifdef MBL_STORED_MESH
+    static bool rejected = false; // the check points didn't match the stored mesh, probe the full mesh
+#endif //MBL_STORED_MESH
 
 #ifdef SUPPORT_VERBOSITY
     int8_t verbosity_level = 0;
@@ -3045,6 +3116,44 @@ static void gcode_G80()
     }
     bool magnet_elimination = (eeprom_read_byte((uint8_t*)EEPROM_MBL_MAGNET_ELIMINATION) > 0);
 
+#ifdef MBL_STORED_MESH
+    // number of the check points of the stored mesh, 0 to probe the mesh
+    uint8_t check = 0;
+    if (code_seen('C')) {
+        if (!rejected && mbl_stored_valid()) {
+            check = code_value_uint8();
+            if (check < 3 || check > 5)
+                check = 5;
+            nMeasPoints = 3; // the check points are points of the 3x3 mesh
+        }
+        else
+            nMeasPoints = MESH_NUM_X_POINTS; // the full mesh is stored for the next G80 C
+    }
+#endif //MBL_STORED_MESH
+
+    // probed points of the mesh, all of them unless a print area is given
+    uint8_t ix0 = 0, iy0 = 0;
+    uint8_t ix1 = nMeasPoints - 1, iy1 = nMeasPoints - 1;
+#ifdef MBL_PROBE_AREA
+#ifdef MBL_STORED_MESH
+    bool area = !check && gcode_G80_area(nMeasPoints, ix0, iy0, ix1, iy1);
+#else
+    bool area = gcode_G80_area(nMeasPoints, ix0, iy0, ix1, iy1);
+#endif //MBL_STORED_MESH
+    if (area)
+        nMeasPoints = MESH_NUM_X_POINTS;
+    // a partial mesh is merged into the previous complete one
+    bool merge = area && mbl.full;
+    float drift = 0;
+    uint8_t drift_points = 0;
+#endif //MBL_PROBE_AREA
+    uint8_t nx = ix1 - ix0 + 1;
+    uint8_t npoints = nx * (iy1 - iy0 + 1);
+#ifdef MBL_STORED_MESH
+    if (check)
+        npoints = check;
+#endif //MBL_STORED_MESH
+
 #ifndef PINDA_THERMISTOR
     if (run == false && eeprom_read_byte((uint8_t *)EEPROM_TEMP_CAL_ACTIVE) && calibration_status_pinda() == true && target_temperature_bed >= 50)
     {
@@ -3060,9 +3169,15 @@ static void gcode_G80()
     CustomMsg custom_message_type_old = custom_message_type;
     uint8_t custom_message_state_old = custom_message_state;
     custom_message_type = CustomMsg::MeshBedLeveling;
-    custom_message_state = (nMeasPoints * nMeasPoints) + 10;
+    custom_message_state = npoints + 10;
     lcd_update(1);
 
+#ifdef MBL_PROBE_AREA
+    if (merge) {
+        mbl.active = 0; //keep the mesh for the points outside of the area
+        mbl.full = false; //until the merge is done, a failed G80 is repeated without it
+    } else
+#endif //MBL_PROBE_AREA
     mbl.reset(); //reset mesh bed leveling
 
     // Reset baby stepping to zero, if the babystepping has already been loaded before.
@@ -3073,8 +3188,8 @@ static void gcode_G80()
     current_position[Z_AXIS] = MESH_HOME_Z_SEARCH;
     plan_buffer_line_curposXYZE(homing_feedrate[Z_AXIS] / 60);
     // The move to the first calibration point.
-    current_position[X_AXIS] = BED_X0;
-    current_position[Y_AXIS] = BED_Y0;
+    current_position[X_AXIS] = BED_X(ix0, nMeasPoints);
+    current_position[Y_AXIS] = BED_Y(iy0, nMeasPoints);
 
 #ifdef SUPPORT_VERBOSITY
     if (verbosity_level >= 1)
@@ -3106,21 +3221,34 @@ static void gcode_G80()
     }
 #endif // SUPPORT_VERBOSITY
     int l_feedmultiply = setup_for_endstop_move(false); //save feedrate and feedmultiply, sets feedmultiply to 100
-    while (mesh_point != nMeasPoints * nMeasPoints) {
+    while (mesh_point != npoints) {
         // Get coords of a measuring point.
-        uint8_t ix = mesh_point % nMeasPoints; // from 0 to MESH_NUM_X_POINTS - 1
-        uint8_t iy = mesh_point / nMeasPoints;
+        uint8_t ix = mesh_point % nx; // from 0 to MESH_NUM_X_POINTS - 1
+        uint8_t iy = mesh_point / nx;
         /*if (!mbl_point_measurement_valid(ix, iy, nMeasPoints, true)) {
           printf_P(PSTR("Skipping point [%d;%d] \n"), ix, iy);
           custom_message_state--;
           mesh_point++;
           continue; //skip
           }*/
-        if (iy & 1) ix = (nMeasPoints - 1) - ix; // Zig zag
+        if (iy & 1) ix = (nx - 1) - ix; // Zig zag
+        ix += ix0;
+        iy += iy0;
+#ifdef MBL_STORED_MESH
+        if (check) {
+            ix = pgm_read_byte(&gcode_G80_check_points[mesh_point][0]);
+            iy = pgm_read_byte(&gcode_G80_check_points[mesh_point][1]);
+        }
+#endif //MBL_STORED_MESH
         if (nMeasPoints == 7) //if we have 7x7 mesh, compare with Z-calibration for points which are in 3x3 mesh
         {
             has_z = ((ix % 3 == 0) && (iy % 3 == 0)) && is_bed_z_jitter_data_valid();
         }
+#ifdef MBL_PROBE_AREA
+        // the Z-calibration data is relative to the first point of the full mesh
+        if (area)
+            has_z = false;
+#endif //MBL_PROBE_AREA
         float z0 = 0.f;
         if (has_z && (mesh_point > 0)) {
             uint16_t z_offset_u = 0;
@@ -3139,7 +3267,7 @@ static void gcode_G80()
         }
 
         // Move Z up to MESH_HOME_Z_SEARCH.
-        if((ix == 0) && (iy == 0)) current_position[Z_AXIS] = MESH_HOME_Z_SEARCH;
+        if(mesh_point == 0) current_position[Z_AXIS] = MESH_HOME_Z_SEARCH;
         else current_position[Z_AXIS] += 2.f / nMeasPoints; //use relative movement from Z coordinate where PINDa triggered on previous point. This makes calibration faster.
         float init_z_bckp = current_position[Z_AXIS];
         plan_buffer_line_curposXYZE(Z_LIFT_FEEDRATE);
@@ -3222,6 +3350,12 @@ static void gcode_G80()
                     SERIAL_ECHOLNPGM("");
                     }*/
         //			#endif // SUPPORT_VERBOSITY
+#ifdef MBL_PROBE_AREA
+        if (merge && !(magnet_elimination && !mbl_point_measurement_valid(ix, iy, nMeasPoints, false))) {
+            drift -= mbl.z_values[iy][ix];
+            ++ drift_points;
+        }
+#endif //MBL_PROBE_AREA
         mbl.set_z(ix, iy, current_position[Z_AXIS] - offset_z); //store measured z values z_values[iy][ix] = z - offset_z;
 
         custom_message_state--;
@@ -3238,7 +3372,7 @@ static void gcode_G80()
 #endif // SUPPORT_VERBOSITY
     plan_buffer_line_curposXYZE(Z_LIFT_FEEDRATE);
     st_synchronize();
-    if (mesh_point != nMeasPoints * nMeasPoints) {
+    if (mesh_point != npoints) {
         Sound_MakeSound(e_SOUND_TYPE_StandardAlert);
         bool bState;
         do   {                             // repeat until Z-leveling o.k.
@@ -3278,6 +3412,23 @@ static void gcode_G80()
     }
     clean_up_after_endstop_move(l_feedmultiply);
     //		SERIAL_ECHOLNPGM("clean up finished ");
+#ifdef MBL_STORED_MESH
+    if (check) {
+        if (!gcode_G80_reuse(check)) {
+            rejected = true;
+            custom_message_type = custom_message_type_old;
+            custom_message_state = custom_message_state_old;
+            repeatcommand_front(); // re-run G80 to probe the full mesh
+            return;
+        }
+        // continue as after a full 7x7 mesh
+        nMeasPoints = MESH_NUM_X_POINTS;
+        ix1 = iy1 = nMeasPoints - 1;
+    }
+    else if (npoints == MESH_NUM_X_POINTS * MESH_NUM_Y_POINTS)
+        mbl_stored_save(); //the raw mesh, the corrections below are applied when it's reused
+    rejected = false;
+#endif //MBL_STORED_MESH
 
 #ifndef PINDA_THERMISTOR
     if(eeprom_read_byte((uint8_t *)EEPROM_TEMP_CAL_ACTIVE) && calibration_status_pinda() == true) temp_compensation_apply(); //apply PINDA temperature compensation
@@ -3315,29 +3466,29 @@ static void gcode_G80()
             float offset = float(correction) * 0.001f;
             switch (i) {
             case 0:
-                for (uint8_t row = 0; row < nMeasPoints; ++row) {
-                    for (uint8_t col = 0; col < nMeasPoints - 1; ++col) {
+                for (uint8_t row = iy0; row <= iy1; ++row) {
+                    for (uint8_t col = ix0; col <= ix1 && col < nMeasPoints - 1; ++col) {
                         mbl.z_values[row][col] += offset * (nMeasPoints - 1 - col) / (nMeasPoints - 1);
                     }
                 }
                 break;
             case 1:
-                for (uint8_t row = 0; row < nMeasPoints; ++row) {
-                    for (uint8_t col = 1; col < nMeasPoints; ++col) {
+                for (uint8_t row = iy0; row <= iy1; ++row) {
+                    for (uint8_t col = (ix0 ? ix0 : 1); col <= ix1; ++col) {
                         mbl.z_values[row][col] += offset * col / (nMeasPoints - 1);
                     }
                 }
                 break;
             case 2:
-                for (uint8_t col = 0; col < nMeasPoints; ++col) {
-                    for (uint8_t row = 0; row < nMeasPoints; ++row) {
+                for (uint8_t col = ix0; col <= ix1; ++col) {
+                    for (uint8_t row = iy0; row <= iy1; ++row) {
                         mbl.z_values[row][col] += offset * (nMeasPoints - 1 - row) / (nMeasPoints - 1);
                     }
                 }
                 break;
             case 3:
-                for (uint8_t col = 0; col < nMeasPoints; ++col) {
-                    for (uint8_t row = 1; row < nMeasPoints; ++row) {
+                for (uint8_t col = ix0; col <= ix1; ++col) {
+                    for (uint8_t row = (iy0 ? iy0 : 1); row <= iy1; ++row) {
                         mbl.z_values[row][col] += offset * row / (nMeasPoints - 1);
                     }
                 }
@@ -3346,6 +3497,16 @@ static void gcode_G80()
         }
     }
     //		SERIAL_ECHOLNPGM("Bed leveling correction finished");
+#ifdef MBL_PROBE_AREA
+    if (area) {
+        for (uint8_t iy = iy0; iy <= iy1; ++ iy)
+            for (uint8_t ix = ix0; ix <= ix1; ++ ix)
+                if (merge && !(magnet_elimination && !mbl_point_measurement_valid(ix, iy, nMeasPoints, false)))
+                    drift += mbl.z_values[iy][ix];
+        gcode_G80_merge(ix0, iy0, ix1, iy1, merge, drift_points ? drift / drift_points : 0);
+    }
+    mbl.full = !area || merge;
+#endif //MBL_PROBE_AREA
     if (nMeasPoints == 3) {
         mbl.upsample_3x3(); //interpolation from 3x3 to 7x7 points using largrangian polynomials while using the same array z_values[iy][ix] for storing (just coppying measured data to new destination and interpolating between them)
     }
@@ -3385,6 +3546,7 @@ static void gcode_G80()
       }
     */
     //		SERIAL_ECHOLNPGM("Upsample finished");
+    mbl.update(); //the corrections and the interpolation above write z_values directly
     mbl.active = 1; //activate mesh bed leveling
     //		SERIAL_ECHOLNPGM("Mesh bed leveling activated");
     go_home_with_z_lift();
@@ -4877,10 +5039,9 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
             // the normal vector to the plane is formed by the coefficients of the plane equation in the standard form, which is Vx*x+Vy*y+Vz*z+d = 0
             // so Vx = -a Vy = -b Vz = 1 (we want the vector facing towards positive Z
 
-            // "A" matrix of the linear system of equations
-            double eqnAMatrix[AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS*3];
-            // "B" vector of Z points
-            double eqnBVector[AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS];
+            // normal equations A^T A x = A^T B of the linear system, accumulated point by point
+            float eqnNormalMatrix[3][3] = {};
+            float plane_equation_coefficients[3] = {};
 
 
             int probePointCounter = 0;
@@ -4918,11 +5079,8 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
 
                 float measured_z = probe_pt(xProbe, yProbe, z_before);
 
-                eqnBVector[probePointCounter] = measured_z;
-
-                eqnAMatrix[probePointCounter + 0*AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS] = xProbe;
-                eqnAMatrix[probePointCounter + 1*AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS] = yProbe;
-                eqnAMatrix[probePointCounter + 2*AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS] = 1;
+                const float eqnRow[3] = { float(xProbe), float(yProbe), 1.f };
+                ls_add_row<3>(eqnNormalMatrix, plane_equation_coefficients, eqnRow, measured_z, 1.f);
                 probePointCounter++;
                 xProbe += xInc;
               }
@@ -4930,7 +5088,13 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
             clean_up_after_endstop_move(l_feedmultiply);
 
             // solve lsq problem
-            double *plane_equation_coefficients = qr_solve(AUTO_BED_LEVELING_GRID_POINTS*AUTO_BED_LEVELING_GRID_POINTS, 3, eqnAMatrix, eqnBVector);
+            if (!ls_solve<3>(eqnNormalMatrix, plane_equation_coefficients))
+            {
+                // the probed points don't define a plane, keep the identity bed level matrix
+                SERIAL_ERROR_START;
+                SERIAL_ERRORLNPGM("G29 plane fit failed");
+                break;
+            }
 
             SERIAL_PROTOCOLPGM("Eqn coefficients: a: ");
             SERIAL_PROTOCOL(plane_equation_coefficients[0]);
@@ -4942,8 +5106,6 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
 
             set_bed_level_equation_lsq(plane_equation_coefficients);
 
-            free(plane_equation_coefficients);
-
 #else // AUTO_BED_LEVELING_GRID not defined
 
             // Probe at 3 arbitrary points
@@ -5353,7 +5515,7 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
     Default 3x3 grid can be changed on MK2.5/s and MK3/s to 7x7 grid.
     #### Usage
 	  
-          G80 [ N | R | V | L | R | F | B ]
+          G80 [ N | R | V | L | R | F | B | X | Y | W | H | C ]
       
 	#### Parameters
       - `N` - Number of mesh points on x axis. Default is 3. Valid values are 3 and 7.
@@ -5366,6 +5528,15 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
       - `R` - Right Bed Level correct value in um.
       - `F` - Front Bed Level correct value in um.
       - `B` - Back Bed Level correct value in um.
+    #### Print area parameters (MBL_PROBE_AREA)
+      Only the points of the 7x7 mesh around the area are probed, the other points are kept from the previous complete mesh.
+      - `X` - Left edge of the area in mm.
+      - `Y` - Front edge of the area in mm.
+      - `W` - Width of the area in mm.
+      - `H` - Height of the area in mm.
+    #### Stored mesh parameters (MBL_STORED_MESH)
+      A full 7x7 G80 stores the mesh for the active sheet.
+      - `C` - Probe 3 to 5 check points (default 5) and reuse the stored mesh if they match it, otherwise probe the 7x7 mesh and store it.
     */
   
 	/*
@@ -5698,6 +5869,7 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
 	
 	#### Parameters
 	  - `S` - Index in bytes
+	  - `L` - Layer of a binary G-code file (SD_BINARY_GCODE)
     */
     case 26: 
       if(card.cardOK && code_seen('S')) {
@@ -5707,6 +5879,15 @@ eeprom_update_word((uint16_t*)EEPROM_NOZZLE_DIAMETER_uM,0xFFFF);
         // as we expect, that SD card print is not active in this moment
         sdpos_atomic = index;
       }
+#ifdef SD_BINARY_GCODE
+      else if(card.cardOK && code_seen('L')) {
+        uint32_t index;
+        if (card.binaryLayerPosition(code_value_long(), &index)) {
+          card.setIndex(index);
+          sdpos_atomic = index;
+        }
+      }
+#endif //SD_BINARY_GCODE
       break;
 
     /*!
@@ -6383,17 +6564,18 @@ Sigma_Exit:
 	### M155 - Automatically send status <a href="https://reprap.org/wiki/G-code#M155:_Automatically_send_temperatures">M155: Automatically send temperatures</a>
 	#### Usage
 	
-		M155 [ S ] [ C ]
+		M155 [ S ] [ C ] [ R ]
 	
 	#### Parameters
 	
 	- `S` - Set autoreporting interval in seconds. 0 to disable. Maximum: 255
 	- `C` - Activate auto-report function (bit mask). Default is temperature.
+	- `R` - Thermal telemetry frame rate in Hz (THERMAL_TELEMETRY only), 1 to THERMAL_TELEMETRY_MAX_RATE (20). Default is 10. 0 is rejected, higher rates are clamped.
 
           bit 0 = Auto-report temperatures
           bit 1 = Auto-report fans
           bit 2 = Auto-report position
-          bit 3 = free
+          bit 3 = Thermal telemetry stream, independent of `S` (THERMAL_TELEMETRY only)
           bit 4 = free
           bit 5 = free
           bit 6 = free
@@ -6401,6 +6583,18 @@ Sigma_Exit:
      */
     case 155:
     {
+#ifdef THERMAL_TELEMETRY
+        uint8_t telemetry_rate = THERMAL_TELEMETRY_RATE;
+        if (code_seen('R')){
+            const long rate = code_value_long();
+            if (rate < 1){
+                SERIAL_ERROR_START;
+                SERIAL_ERRORLNPGM("M155 R must be at least 1");
+                break;
+            }
+            telemetry_rate = (rate > THERMAL_TELEMETRY_MAX_RATE) ? THERMAL_TELEMETRY_MAX_RATE : rate;
+        }
+#endif //THERMAL_TELEMETRY
         if (code_seen('S')){
             autoReportFeatures.SetPeriod( code_value_uint8() );
         }
@@ -6409,6 +6603,9 @@ Sigma_Exit:
         } else{
             autoReportFeatures.SetMask(1); //Backwards compability to host systems like Octoprint to send only temp if paramerter `C`isn't used.
         }
+#ifdef THERMAL_TELEMETRY
+        thermal_telemetry_set_rate(autoReportFeatures.Telemetry() ? telemetry_rate : 0);
+#endif //THERMAL_TELEMETRY
    }
     break;
 #endif //AUTO_REPORT
@@ -9113,6 +9310,10 @@ Sigma_Exit:
         - `5` - Ambient temperature
         - `6` - BED voltage
     - `V` Value to be written as simulated
+
+    Without parameters, the channel values are followed by the per-channel sample count (and filter
+    with ADC_CHAN_CFG) and by the cycle statistics: completed cycles, last/longest cycle duration
+    and the timestamp of the last sample.
     */
 	case 9:
 		dcode_9(); break;
@@ -9479,44 +9680,67 @@ void clamp_to_software_endstops(float target[3])
     }
 }
 
+static uint16_t restore_interrupted_move() {
+    if (saved_start_position[0] != SAVED_START_POSITION_UNSET) {
+        memcpy(current_position, saved_start_position, sizeof(current_position));
+        saved_start_position[0] = SAVED_START_POSITION_UNSET;
+        return saved_segment_idx;
+    }
+    else
+        return 1; //begin with the first segment
+}
+
 uint16_t restore_interrupted_gcode() {
     // When recovering from a previous print move, restore the originally
     // calculated start position on the first USB/SD command. This accounts
     // properly for relative moves
     if (
-        (saved_start_position[0] != SAVED_START_POSITION_UNSET) && (
-            (CMDBUFFER_CURRENT_TYPE == CMDBUFFER_CURRENT_TYPE_SDCARD) ||
-            (CMDBUFFER_CURRENT_TYPE == CMDBUFFER_CURRENT_TYPE_USB_WITH_LINENR)
-        )
-    ) {
-        memcpy(current_position, saved_start_position, sizeof(current_position));
-        saved_start_position[0] = SAVED_START_POSITION_UNSET;
-        return saved_segment_idx;
-    }
+        (CMDBUFFER_CURRENT_TYPE == CMDBUFFER_CURRENT_TYPE_SDCARD) ||
+        (CMDBUFFER_CURRENT_TYPE == CMDBUFFER_CURRENT_TYPE_USB_WITH_LINENR)
+    )
+        return restore_interrupted_move();
     else
         return 1; //begin with the first segment
 }
 
-#ifdef MESH_BED_LEVELING
-void mesh_plan_buffer_line(const float &x, const float &y, const float &z, const float &e, const float &feed_rate, const uint8_t extruder, uint16_t start_segment_idx = 0) {
-        float dx = x - current_position[X_AXIS];
-        float dy = y - current_position[Y_AXIS];
-        uint16_t n_segments = 0;
-
-        if (mbl.active) {
-            float len = fabs(dx) + fabs(dy);
-            if (len > 0)
-                // Split to 3cm segments or shorter.
-                n_segments = uint16_t(ceil(len / 30.f));
-        }
+#ifdef SD_BINARY_GCODE
+// Plans a move record of a binary G-code file, in place of G1 with the coordinates of the command.
+void gcode_binary_move(uint8_t tag, const uint8_t *payload)
+{
+    // The moves come from the SD card, the first one restores the position after a power panic.
+    uint16_t start_segment_idx = restore_interrupted_move();
+    uint16_t f = card.binary_position.move(tag, payload, current_position, destination);
+    if (f) feedrate = f;
+    float emult = extruder_multiplier[active_extruder];
+    if (emult != 1.)
+        destination[E_AXIS] = current_position[E_AXIS] + (destination[E_AXIS] - current_position[E_AXIS]) * emult;
 
-        if (n_segments > 1 && start_segment_idx) {
+    if (total_filament_used > ((current_position[E_AXIS] - destination[E_AXIS]) * 100)) { //protection against total_filament_used overflow
+        total_filament_used = total_filament_used + ((destination[E_AXIS] - current_position[E_AXIS]) * 100);
+    }
+    prepare_move(start_segment_idx);
+}
+#endif //SD_BINARY_GCODE
 
+#ifdef MESH_BED_LEVELING
+void mesh_plan_buffer_line(const float &x, const float &y, const float &z, const float &e, const float &feed_rate, const uint8_t extruder, uint16_t start_segment_idx = 0) {
+        if (mbl.active && start_segment_idx) {
+            // The planner corrects the ends of a segment, the correction is bilinear in each cell of the mesh
+            // (of the denser grid with MBL_BICUBIC). Split the move where it crosses the cell boundaries, the
+            // segments are numbered from 1 so that a print resumed from the same start position plans the
+            // same segments.
+            float dx = x - current_position[X_AXIS];
+            float dy = y - current_position[Y_AXIS];
             float dz = z - current_position[Z_AXIS];
             float de = e - current_position[E_AXIS];
+            mesh_line_split split(
+                mesh_line_walk(current_position[X_AXIS], dx, MESH_MIN_X, MESH_GRID_X_DIST, MESH_GRID_NUM_X_POINTS),
+                mesh_line_walk(current_position[Y_AXIS], dy, MESH_MIN_Y, MESH_GRID_Y_DIST, MESH_GRID_NUM_Y_POINTS));
 
-            for (uint16_t i = start_segment_idx; i < n_segments; ++ i) {
-                float t = float(i) / float(n_segments);
+            float t;
+            for (uint16_t i = 1; split.next(t); ++ i) {
+                if (i < start_segment_idx)
+                    continue;
                 plan_buffer_line(current_position[X_AXIS] + t * dx,
                                  current_position[Y_AXIS] + t * dy,
                                  current_position[Z_AXIS] + t * dz,
@@ -11252,6 +11476,7 @@ bool recover_machine_state_after_power_panic()
       mbl_was_active = true;
     mbl.z_values[iy][ix] = float(v) * 0.001f;
   }
+  mbl.update();
 
   // Recover the physical coordinate of the Z axis at the time of the power panic.
   // The current position after power panic is moved to the next closest 0th full step.
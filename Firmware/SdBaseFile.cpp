@@ -91,7 +91,13 @@ dir_t* SdBaseFile::cacheDirEntry(uint8_t action) {
  * Reasons for failure include no file is open or an I/O error.
  */
 bool SdBaseFile::close() {
+#ifdef SD_MULTIBLOCK_WRITE
+  // free the reserved clusters which haven't been written
+  bool rtn = unreserve();
+  rtn = sync() && rtn;
+#else  // SD_MULTIBLOCK_WRITE
   bool rtn = sync();
+#endif  // SD_MULTIBLOCK_WRITE
   type_ = FAT_FILE_TYPE_CLOSED;
   return rtn;
 }
@@ -1713,6 +1719,26 @@ bool SdBaseFile::truncate(uint32_t length) {
  fail:
   return false;
 }
+#ifdef SD_MULTIBLOCK_WRITE
+//------------------------------------------------------------------------------
+/** End the reservation made by SdFile::reserve() and free the clusters which
+ * haven't been written.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+bool SdBaseFile::unreserve() {
+  if (!isOpen() || vol_->reserveOwner_ != this) return true;
+  vol_->reserveOwner_ = 0;
+  // write the last block in the range
+  if (!vol_->cacheFlush() || !vol_->writeRange(0, 0)) return false;
+  if (fileSize_) return truncate(fileSize_);
+  if (!vol_->freeChain(firstCluster_)) return false;
+  firstCluster_ = 0;
+  flags_ |= F_FILE_DIR_DIRTY;
+  return sync();
+}
+#endif  // SD_MULTIBLOCK_WRITE
 //------------------------------------------------------------------------------
 /** Write data to an open file.
  *
@@ -319,6 +319,9 @@ public:
    */
   uint8_t type() const {return type_;}
   bool truncate(uint32_t size);
+#ifdef SD_MULTIBLOCK_WRITE
+  bool unreserve();
+#endif  // SD_MULTIBLOCK_WRITE
   /** \return SdVolume that contains this file. */
   SdVolume* volume() const {return vol_;}
   int16_t write(const void* buf, uint16_t nbyte);
@@ -31,8 +31,17 @@
 SdFile::SdFile(const char* path, uint8_t oflag) : SdBaseFile(path, oflag) {
 }
 
+#ifdef SD_EXTENT_MAP
+SdFile::Extent SdFile::gfExtents[SD_EXTENT_MAP_SIZE];
+uint8_t SdFile::gfExtentCount;
+const SdFile *SdFile::gfExtentOwner;
+#endif //SD_EXTENT_MAP
+
 bool SdFile::openFilteredGcode(SdBaseFile* dirFile, const char* path){
     if( open(dirFile, path, O_READ) ){
+#ifdef SD_EXTENT_MAP
+        gfMapExtents();
+#endif //SD_EXTENT_MAP
         // compute the block to start with
         if( ! gfComputeNextFileBlock() )
             return false;
@@ -44,7 +53,28 @@ bool SdFile::openFilteredGcode(SdBaseFile* dirFile, const char* path){
 }
 
 bool SdFile::seekSetFilteredGcode(uint32_t pos){
-    if(! seekSet(pos) )return false;
+#ifdef SD_EXTENT_MAP
+    uint32_t cluster = 0;
+    // leave the same state as seekSet() - the cluster holding the byte before pos
+    if( isOpen() && gfExtentsValid() && pos <= fileSize_
+     && ( pos == 0 || gfClusterAt((pos - 1) >> (vol_->clusterSizeShift_ + 9), &cluster) ) ){
+        curPosition_ = pos;
+        curCluster_ = cluster;
+    } else
+#endif //SD_EXTENT_MAP
+    {
+        // gfComputeNextFileBlock() moves to the next cluster as soon as the previous one has been read,
+        // while seekSet() expects the cluster of the byte before curPosition_ there
+        filepos_t current;
+        getpos(&current);
+        if( curPosition_ && (curPosition_ & 0x1FF) == 0 && vol_->blockOfCluster(curPosition_) == 0 )
+            ++curPosition_;
+        if(! seekSet(pos) ){
+            // a failed seek leaves the file where it was
+            setpos(&current);
+            return false;
+        }
+    }
     if(! gfComputeNextFileBlock() )return false;
     gfReset();
     return true;
@@ -65,6 +95,7 @@ void __attribute__((noinline)) SdFile::gfUpdateCurrentPosition(uint16_t inc){
     curPosition_ += inc;
 }
 
+#ifdef __AVR__
 #define find_endl(resultP, startP) \
 __asm__ __volatile__ (  \
 "cycle:          \n" \
@@ -75,6 +106,10 @@ __asm__ __volatile__ (  \
 : "z" (startP)   /* input of the ASM code - in our case the Z register as well (R30:R31) */ \
 : "r22"          /* modifying register R22 - so that the compiler knows */ \
 )
+#else //__AVR__
+#define find_endl(resultP, startP) \
+do { resultP = startP; while (*resultP++ != '\n'); } while (0)
+#endif //__AVR__
 
 // avoid calling the default heavy-weight read() for just one byte
 int16_t SdFile::readFilteredGcode(){
@@ -181,7 +216,12 @@ bool SdFile::gfEnsureBlock(){
     // this comparison is heavy-weight, especially when there is another one inside cacheRawBlock
     // but it is necessary to avoid computing of terminateOfs if not needed
     if( gfBlock != vol_->cacheBlockNumber_ ){
+#ifdef SD_MULTIBLOCK_READ
+        // the file is read sequentially, keep the card streaming the blocks
+        if ( ! vol_->cacheStreamBlock(gfBlock)){
+#else //SD_MULTIBLOCK_READ
         if ( ! vol_->cacheRawBlock(gfBlock, SdVolume::CACHE_FOR_READ)){
+#endif //SD_MULTIBLOCK_READ
             return false;
         }
         // terminate with a '\n'
@@ -208,6 +248,10 @@ bool SdFile::gfComputeNextFileBlock() {
             if (curPosition_ == 0) {
                 // use first cluster in file
                 curCluster_ = firstCluster_;
+#ifdef SD_EXTENT_MAP
+            } else if (gfExtentsValid() && gfClusterAt(curPosition_ >> (vol_->clusterSizeShift_ + 9), &curCluster_)) {
+                // next cluster from the extent map
+#endif //SD_EXTENT_MAP
             } else {
                 // get next cluster from FAT
                 if (!vol_->fatGet(curCluster_, &curCluster_)) return false;
@@ -218,6 +262,52 @@ bool SdFile::gfComputeNextFileBlock() {
     return true;
 }
 
+#ifdef SD_EXTENT_MAP
+/// Build the extent map of the file, walking its cluster chain once.
+/// The chain is mapped up to SD_EXTENT_MAP_SIZE runs, the rest is looked up in the FAT.
+void SdFile::gfMapExtents(){
+    gfExtentOwner = this;
+    gfExtentCount = 0;
+    if( firstCluster_ == 0 )return; // empty file
+    const uint8_t shift = vol_->clusterSizeShift_ + 9;
+    const uint32_t clusters = (fileSize_ + (1UL << shift) - 1) >> shift;
+    Extent *e = gfExtents;
+    e->cluster = firstCluster_;
+    e->count = 1;
+    uint32_t c = firstCluster_;
+    for( uint32_t n = 1; n < clusters; ++n ){
+        uint32_t next;
+        if( ! vol_->fatGet(c, &next) )break; // keep the part mapped so far
+        if( next == c + 1 && e->count != 0xFFFF ){
+            ++e->count;
+        } else {
+            if( e == gfExtents + SD_EXTENT_MAP_SIZE - 1 )break;
+            ++e;
+            e->cluster = next;
+            e->count = 1;
+        }
+        c = next;
+    }
+    gfExtentCount = e - gfExtents + 1;
+}
+
+/// Get the cluster at an index in the file from the extent map
+/// @param index cluster index, 0 is the first cluster of the file
+/// @param cluster cluster number
+/// @return false if the index is past the mapped part of the file
+bool SdFile::gfClusterAt(uint32_t index, uint32_t *cluster) const {
+    const Extent *e = gfExtents;
+    for( uint8_t i = gfExtentCount; i; --i, ++e ){
+        if( index < e->count ){
+            *cluster = e->cluster + index;
+            return true;
+        }
+        index -= e->count;
+    }
+    return false;
+}
+#endif //SD_EXTENT_MAP
+
 //------------------------------------------------------------------------------
 /** Write data to an open file.
  *
@@ -235,8 +325,85 @@ bool SdFile::gfComputeNextFileBlock() {
  *
  */
 int16_t SdFile::write(const void* buf, uint16_t nbyte) {
+#ifdef SD_MULTIBLOCK_WRITE
+  if (isFile() && vol_->reserveOwner_ == this && curPosition_ == fileSize_ && nbyte) {
+    return wrWrite(reinterpret_cast<const uint8_t*>(buf), nbyte);
+  }
+#endif //SD_MULTIBLOCK_WRITE
   return SdBaseFile::write(buf, nbyte);
 }
+#ifdef SD_MULTIBLOCK_WRITE
+//------------------------------------------------------------------------------
+/** Reserve contiguous clusters for the data of a new file.
+ *
+ * The data written into the reserved clusters goes to the card in a multiple
+ * block write and the FAT isn't touched until the file is closed, when the
+ * clusters past the end of the data are freed. Writing past the reserved size
+ * continues in the usual way.
+ *
+ * \param[in] size Expected size of the file in bytes.
+ *
+ * \return true if the clusters have been reserved, false if the file isn't
+ * open for writing, isn't empty or there's no contiguous free space for it.
+ */
+bool SdFile::reserve(uint32_t size) {
+  if (!isFile() || !(flags_ & O_WRITE) || firstCluster_ || fileSize_ || !size) {
+    return false;
+  }
+  uint8_t shift = vol_->clusterSizeShift_ + 9;
+  uint32_t count = ((size - 1) >> shift) + 1;
+  if (!vol_->allocContiguous(count, &firstCluster_)) {
+    firstCluster_ = 0;
+    return false;
+  }
+  // the directory entry owns the clusters from now on
+  flags_ |= F_FILE_DIR_DIRTY;
+  if (!sync()) return false;
+  vol_->reserveBlock_ = vol_->clusterStartBlock(firstCluster_);
+  vol_->reserveSize_ = count << shift;
+  if (!vol_->writeRange(vol_->reserveBlock_, count << vol_->clusterSizeShift_)) return false;
+  vol_->reserveOwner_ = this;
+  return true;
+}
+//------------------------------------------------------------------------------
+// Append to the reserved clusters. The block cache is filled without reading
+// the card, the previous block is written by cacheFlush() in the multiple
+// block write.
+int16_t SdFile::wrWrite(const uint8_t* src, uint16_t nbyte) {
+  uint8_t shift = vol_->clusterSizeShift_ + 9;
+  uint16_t nToWrite = nbyte;
+  while (nToWrite && curPosition_ < vol_->reserveSize_) {
+    uint16_t blockOffset = curPosition_ & 0X1FF;
+    uint32_t block = vol_->reserveBlock_ + (curPosition_ >> 9);
+    if (blockOffset == 0) {
+      if (!vol_->cacheFlush()) goto fail;
+      vol_->cacheSetBlockNumber(block, true);
+    } else if (!vol_->cacheRawBlock(block, SdVolume::CACHE_FOR_WRITE)) {
+      goto fail;
+    }
+    uint16_t n = 512 - blockOffset;
+    if (n > nToWrite) n = nToWrite;
+    memcpy(vol_->cache()->data + blockOffset, src, n);
+    curPosition_ += n;
+    src += n;
+    nToWrite -= n;
+  }
+  fileSize_ = curPosition_;
+  curCluster_ = firstCluster_ + ((curPosition_ - 1) >> shift);
+  flags_ |= F_FILE_DIR_DIRTY;
+  if (nToWrite) {
+    // the file is larger than announced
+    vol_->reserveOwner_ = 0;
+    if (!vol_->cacheFlush() || !vol_->writeRange(0, 0)) goto fail;
+    if (SdBaseFile::write(src, nToWrite) < 0) return -1;
+  }
+  return nbyte;
+
+ fail:
+  writeError = true;
+  return -1;
+}
+#endif //SD_MULTIBLOCK_WRITE
 //------------------------------------------------------------------------------
 /** Write a byte to a file. Required by the Arduino Print class.
  * \param[in] b the byte to be written.
@@ -245,12 +412,12 @@ int16_t SdFile::write(const void* buf, uint16_t nbyte) {
 #if ARDUINO >= 100
 size_t SdFile::write(uint8_t b)
 {
-    return SdBaseFile::write(&b, 1);
+    return write(&b, 1);
 }
 #else
 void SdFile::write(uint8_t b)
 {
-    SdBaseFile::write(&b, 1);
+    write(&b, 1);
 }
 #endif
 //------------------------------------------------------------------------------
@@ -259,7 +426,7 @@ void SdFile::write(uint8_t b)
  * Use writeError to check for errors.
  */
 void SdFile::write(const char* str) {
-  SdBaseFile::write(str, strlen(str));
+  write(str, strlen(str));
 }
 //------------------------------------------------------------------------------
 /** Write a PROGMEM string to a file.
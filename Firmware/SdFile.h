@@ -51,6 +51,29 @@ class SdFile : public SdBaseFile/*, public Print*/ {
   bool gfEnsureBlock();
   bool gfComputeNextFileBlock();
   void gfUpdateCurrentPosition(uint16_t inc);
+
+#ifdef SD_EXTENT_MAP
+  // Cluster chain of the file opened by openFilteredGcode as runs of consecutive clusters.
+  // Only one file is printed at a time, so the map is shared to keep the SdFile instances small.
+  struct Extent {
+    uint32_t cluster; // first cluster of the run
+    uint16_t count;   // number of clusters in the run
+  };
+  static Extent gfExtents[SD_EXTENT_MAP_SIZE];
+  static uint8_t gfExtentCount;
+  static const SdFile *gfExtentOwner;
+
+  bool gfExtentsValid() const {
+    return gfExtentOwner == this && gfExtentCount && gfExtents[0].cluster == firstCluster_;
+  }
+  void gfMapExtents();
+  bool gfClusterAt(uint32_t index, uint32_t *cluster) const;
+#endif //SD_EXTENT_MAP
+#ifdef SD_MULTIBLOCK_WRITE
+  // Appends to the clusters reserved by reserve(), the reservation is kept by
+  // the volume as only one file is written at a time.
+  int16_t wrWrite(const uint8_t* src, uint16_t nbyte);
+#endif //SD_MULTIBLOCK_WRITE
 public:
   SdFile() {}
   SdFile(const char* name, uint8_t oflag);
@@ -63,7 +86,14 @@ public:
   bool openFilteredGcode(SdBaseFile* dirFile, const char* path);
   int16_t readFilteredGcode();
   bool seekSetFilteredGcode(uint32_t pos);
+#if defined(SDSORT_INDEX_FILE) || defined(SD_BINARY_GCODE)
+  //! plain read of the sort index and the binary G-code, the G-code is read by readFilteredGcode()
+  int16_t read(void* buf, uint16_t nbyte) { return SdBaseFile::read(buf, nbyte); }
+#endif //SDSORT_INDEX_FILE || SD_BINARY_GCODE
   int16_t write(const void* buf, uint16_t nbyte);
+#ifdef SD_MULTIBLOCK_WRITE
+  bool reserve(uint32_t size);
+#endif //SD_MULTIBLOCK_WRITE
   void write(const char* str);
   void write_P(PGM_P str);
   void writeln_P(PGM_P str);
@@ -29,6 +29,24 @@ cache_t  SdVolume::cacheBuffer_;       // 512 byte cache for Sd2Card
 Sd2Card* SdVolume::sdCard_;            // pointer to SD card object
 bool     SdVolume::cacheDirty_;        // cacheFlush() will write block if true
 uint32_t SdVolume::cacheMirrorBlock_;  // mirror  block for second FAT
+#ifdef SD_MULTIBLOCK_READ
+uint32_t SdVolume::readNextBlock_ = 0XFFFFFFFF;  // next block of the open multiple block read
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+uint32_t SdVolume::writeNextBlock_ = 0XFFFFFFFF; // next block of the multiple block write range
+uint32_t SdVolume::writeEndBlock_;               // end of the range
+bool     SdVolume::writeOpen_;                   // the multiple block write is open
+const SdBaseFile* SdVolume::reserveOwner_;       // file writing into the reserved clusters
+uint32_t SdVolume::reserveBlock_;                // first block of the reserved clusters
+uint32_t SdVolume::reserveSize_;                 // reserved bytes
+#endif  // SD_MULTIBLOCK_WRITE
+#ifdef SD_FAT_CACHE
+cache_t  SdVolume::fatCacheBuffer_[SD_FAT_CACHE_BLOCKS];
+uint32_t SdVolume::fatCacheBlockNumber_[SD_FAT_CACHE_BLOCKS];
+uint8_t  SdVolume::fatCacheOrder_[SD_FAT_CACHE_BLOCKS];
+uint32_t SdVolume::fatCacheHits_;
+uint32_t SdVolume::fatCacheMisses_;
+#endif  // SD_FAT_CACHE
 #endif  // USE_MULTIPLE_CARDS
 //------------------------------------------------------------------------------
 // find a contiguous group of clusters
@@ -106,6 +124,16 @@ bool SdVolume::allocContiguous(uint32_t count, uint32_t* curCluster) {
 //------------------------------------------------------------------------------
 bool SdVolume::cacheFlush() {
   if (cacheDirty_) {
+#ifdef SD_MULTIBLOCK_WRITE
+    if (cacheBlockNumber_ == writeNextBlock_ && !cacheMirrorBlock_) {
+      if (!cacheWriteStream()) goto fail;
+      cacheDirty_ = 0;
+      return true;
+    }
+#endif  // SD_MULTIBLOCK_WRITE
+#ifdef SD_MULTIBLOCK
+    if (!cardIdle()) goto fail;
+#endif  // SD_MULTIBLOCK
     if (!sdCard_->writeBlock(cacheBlockNumber_, cacheBuffer_.data)) {
       goto fail;
     }
@@ -127,15 +155,191 @@ bool SdVolume::cacheFlush() {
 bool SdVolume::cacheRawBlock(uint32_t blockNumber, bool dirty) {
   if (cacheBlockNumber_ != blockNumber) {
     if (!cacheFlush()) goto fail;
+#ifdef SD_MULTIBLOCK_READ
+    // continue the multiple block read if it is at the block, close it otherwise
+    if (readNextBlock_ == blockNumber) {
+      if (!cacheStreamBlock(blockNumber)) goto fail;
+      goto done;
+    }
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK
+    if (!cardIdle()) goto fail;
+#endif  // SD_MULTIBLOCK
     if (!sdCard_->readBlock(blockNumber, cacheBuffer_.data)) goto fail;
     cacheBlockNumber_ = blockNumber;
   }
+#ifdef SD_MULTIBLOCK_READ
+ done:
+#endif  // SD_MULTIBLOCK_READ
   if (dirty) cacheDirty_ = true;
   return true;
 
  fail:
   return false;
 }
+#ifdef SD_MULTIBLOCK_READ
+//------------------------------------------------------------------------------
+// Read a block into the cache in a multiple block read (CMD18). Sequential
+// blocks then cost no command. The read is kept open until a block out of
+// sequence or any other card access.
+bool SdVolume::cacheStreamBlock(uint32_t blockNumber) {
+  if (cacheBlockNumber_ != blockNumber) {
+    if (!cacheFlush()) goto fail;
+    if (readNextBlock_ != blockNumber) {
+      if (!cardIdle()) goto fail;
+      if (!sdCard_->readStart(blockNumber)) goto fail;
+    }
+    readNextBlock_ = 0XFFFFFFFF;
+    cacheBlockNumber_ = 0XFFFFFFFF;
+    if (!sdCard_->readData(cacheBuffer_.data)) {
+      // A block in the stream isn't retried by the card. Stop the stream, ignoring the result as
+      // the stop is part of the recovery, and read the block alone, readBlock() checks and retries
+      // it. The stream is restarted at the next block which is requested.
+      sdCard_->readStop();
+      if (!sdCard_->readBlock(blockNumber, cacheBuffer_.data)) goto fail;
+      cacheBlockNumber_ = blockNumber;
+      return true;
+    }
+    readNextBlock_ = blockNumber + 1;
+    cacheBlockNumber_ = blockNumber;
+  }
+  return true;
+
+ fail:
+  return false;
+}
+//------------------------------------------------------------------------------
+/** Close the multiple block read, if it is open.
+ *
+ * Called before any other access to the card.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+bool SdVolume::readStop() {
+  if (readNextBlock_ != 0XFFFFFFFF) {
+    readNextBlock_ = 0XFFFFFFFF;
+    return sdCard_->readStop();
+  }
+  return true;
+}
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+//------------------------------------------------------------------------------
+// Write the cached block in the multiple block write (CMD25) of the range set
+// by writeRange(). The write is opened at the first block, with the rest of the
+// range announced for pre-erase, and kept open for the following blocks.
+bool SdVolume::cacheWriteStream() {
+  if (!writeOpen_) {
+    if (!cardIdle()) goto fail;
+    if (!sdCard_->writeStart(cacheBlockNumber_, writeEndBlock_ - cacheBlockNumber_)) goto fail;
+    writeOpen_ = true;
+  }
+  if (!sdCard_->writeData(cacheBuffer_.data)) {
+    writeNextBlock_ = 0XFFFFFFFF;
+    writeOpen_ = false;
+    // ignore the result, the write error is reported
+    sdCard_->writeStop();
+    goto fail;
+  }
+  if (++writeNextBlock_ == writeEndBlock_) {
+    writeNextBlock_ = 0XFFFFFFFF;
+    if (!cardIdle()) goto fail;
+  }
+  return true;
+
+ fail:
+  return false;
+}
+//------------------------------------------------------------------------------
+/** Write the blocks of a range in a multiple block write.
+ *
+ * The blocks flushed from the cache in sequence from \a blockNumber on are
+ * written without a command each. A \a count of zero ends the range.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+bool SdVolume::writeRange(uint32_t blockNumber, uint32_t count) {
+  if (!cardIdle()) return false;
+  writeNextBlock_ = count ? blockNumber : 0XFFFFFFFF;
+  writeEndBlock_ = blockNumber + count;
+  return true;
+}
+#endif  // SD_MULTIBLOCK_WRITE
+#ifdef SD_MULTIBLOCK
+//------------------------------------------------------------------------------
+/** Close the multiple block read or write, if one is open.
+ *
+ * Called before any other access to the card.
+ *
+ * \return The value one, true, is returned for success and
+ * the value zero, false, is returned for failure.
+ */
+bool SdVolume::cardIdle() {
+#ifdef SD_MULTIBLOCK_READ
+  if (!readStop()) return false;
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+  if (writeOpen_) {
+    writeOpen_ = false;
+    return sdCard_->writeStop();
+  }
+#endif  // SD_MULTIBLOCK_WRITE
+  return true;
+}
+#endif  // SD_MULTIBLOCK
+//------------------------------------------------------------------------------
+#ifdef SD_FAT_CACHE
+// The FAT cache keeps the FAT blocks used by fatGet out of the block cache,
+// so following a cluster chain doesn't evict the file data.
+// fatPut writes through the block cache and updates the copy in the FAT cache.
+void SdVolume::fatCacheInit() {
+  for (uint8_t i = 0; i < SD_FAT_CACHE_BLOCKS; i++) {
+    fatCacheBlockNumber_[i] = 0XFFFFFFFF;
+    fatCacheOrder_[i] = i;
+  }
+  fatCacheHits_ = 0;
+  fatCacheMisses_ = 0;
+}
+//------------------------------------------------------------------------------
+// return the FAT block from the FAT cache, read it in place of the least recently used one if missing
+cache_t* SdVolume::fatCacheRead(uint32_t blockNumber) {
+  uint8_t i = 0;
+  while (i < SD_FAT_CACHE_BLOCKS && fatCacheBlockNumber_[fatCacheOrder_[i]] != blockNumber) i++;
+  if (i < SD_FAT_CACHE_BLOCKS) {
+    fatCacheHits_++;
+  } else {
+    fatCacheMisses_++;
+    i = SD_FAT_CACHE_BLOCKS - 1;
+    uint8_t slot = fatCacheOrder_[i];
+    fatCacheBlockNumber_[slot] = 0XFFFFFFFF;
+#ifdef SD_MULTIBLOCK
+    if (!cardIdle()) return 0;
+#endif  // SD_MULTIBLOCK
+    if (!sdCard_->readBlock(blockNumber, fatCacheBuffer_[slot].data)) return 0;
+    fatCacheBlockNumber_[slot] = blockNumber;
+  }
+  // move the slot to the front
+  uint8_t slot = fatCacheOrder_[i];
+  for (; i; i--) fatCacheOrder_[i] = fatCacheOrder_[i - 1];
+  fatCacheOrder_[0] = slot;
+  return &fatCacheBuffer_[slot];
+}
+//------------------------------------------------------------------------------
+// keep the FAT cache consistent with an entry stored by fatPut
+void SdVolume::fatCacheUpdate(uint32_t blockNumber, uint32_t cluster, uint32_t value) {
+  for (uint8_t i = 0; i < SD_FAT_CACHE_BLOCKS; i++) {
+    if (fatCacheBlockNumber_[i] == blockNumber) {
+      if (fatType_ == 16) {
+        fatCacheBuffer_[i].fat16[cluster & 0XFF] = value;
+      } else {
+        fatCacheBuffer_[i].fat32[cluster & 0X7F] = value;
+      }
+    }
+  }
+}
+#endif  // SD_FAT_CACHE
 //------------------------------------------------------------------------------
 // return the size in bytes of a cluster chain
 bool SdVolume::chainSize(uint32_t cluster, uint32_t* size) {
@@ -178,6 +382,18 @@ bool SdVolume::fatGet(uint32_t cluster, uint32_t* value) {
   } else {
     goto fail;
   }
+#ifdef SD_FAT_CACHE
+  {
+    // the block cache holds the current copy if the block is there, it may be dirty
+    const cache_t* fat = &cacheBuffer_;
+    if (lba != cacheBlockNumber_ && !(fat = fatCacheRead(lba))) goto fail;
+    if (fatType_ == 16) {
+      *value = fat->fat16[cluster & 0XFF];
+    } else {
+      *value = fat->fat32[cluster & 0X7F] & FAT32MASK;
+    }
+  }
+#else  // SD_FAT_CACHE
   if (lba != cacheBlockNumber_) {
     if (!cacheRawBlock(lba, CACHE_FOR_READ)) goto fail;
   }
@@ -186,6 +402,7 @@ bool SdVolume::fatGet(uint32_t cluster, uint32_t* value) {
   } else {
     *value = cacheBuffer_.fat32[cluster & 0X7F] & FAT32MASK;
   }
+#endif  // SD_FAT_CACHE
   return true;
 
  fail:
@@ -243,6 +460,9 @@ bool SdVolume::fatPut(uint32_t cluster, uint32_t value) {
   } else {
     cacheBuffer_.fat32[cluster & 0X7F] = value;
   }
+#ifdef SD_FAT_CACHE
+  fatCacheUpdate(lba, cluster, value);
+#endif  // SD_FAT_CACHE
   // mirror second FAT
   if (fatCount_ > 1) cacheMirrorBlock_ = lba + blocksPerFat_;
   return true;
@@ -332,6 +552,17 @@ bool SdVolume::init(Sd2Card* dev, uint8_t part) {
   cacheDirty_ = 0;  // cacheFlush() will write block if true
   cacheMirrorBlock_ = 0;
   cacheBlockNumber_ = 0XFFFFFFFF;
+#ifdef SD_MULTIBLOCK_READ
+  readNextBlock_ = 0XFFFFFFFF;  // the card has been reset
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+  writeNextBlock_ = 0XFFFFFFFF;
+  writeOpen_ = false;
+  reserveReset();  // the reservation belongs to the previous card
+#endif  // SD_MULTIBLOCK_WRITE
+#ifdef SD_FAT_CACHE
+  fatCacheInit();
+#endif  // SD_FAT_CACHE
 
   // if part == 0 assume super floppy with FAT boot sector in block zero
   // if part > 0 assume mbr volume with partition table
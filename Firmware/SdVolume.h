@@ -52,6 +52,12 @@ union cache_t {
            /** Used to access to a cached FAT32 FSINFO sector. */
   fat32_fsinfo_t fsinfo;
 };
+#if defined(SD_MULTIBLOCK_READ) || defined(SD_MULTIBLOCK_WRITE)
+#define SD_MULTIBLOCK
+#endif
+#ifdef SD_MULTIBLOCK_WRITE
+class SdBaseFile;
+#endif  // SD_MULTIBLOCK_WRITE
 //------------------------------------------------------------------------------
 /**
  * \class SdVolume
@@ -117,6 +123,35 @@ class SdVolume {
    * \return true for success or false for failure
    */
   bool dbgFat(uint32_t n, uint32_t* v) {return fatGet(n, v);}
+#ifdef SD_MULTIBLOCK_READ
+#if USE_MULTIPLE_CARDS
+  bool readStop();
+#else  // USE_MULTIPLE_CARDS
+  static bool readStop();
+#endif  // USE_MULTIPLE_CARDS
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK
+#if USE_MULTIPLE_CARDS
+  bool cardIdle();
+#else  // USE_MULTIPLE_CARDS
+  static bool cardIdle();
+#endif  // USE_MULTIPLE_CARDS
+#endif  // SD_MULTIBLOCK
+#ifdef SD_MULTIBLOCK_WRITE
+  /** Forget the clusters reserved by SdFile::reserve() without touching the
+   * card, it has been released or replaced. */
+#if USE_MULTIPLE_CARDS
+  void reserveReset() {reserveOwner_ = 0; reserveSize_ = 0;}
+#else  // USE_MULTIPLE_CARDS
+  static void reserveReset() {reserveOwner_ = 0; reserveSize_ = 0;}
+#endif  // USE_MULTIPLE_CARDS
+#endif  // SD_MULTIBLOCK_WRITE
+#ifdef SD_FAT_CACHE
+  /** \return Number of FAT block lookups served by the FAT cache. */
+  uint32_t fatCacheHits() const {return fatCacheHits_;}
+  /** \return Number of FAT blocks read into the FAT cache. */
+  uint32_t fatCacheMisses() const {return fatCacheMisses_;}
+#endif  // SD_FAT_CACHE
 //------------------------------------------------------------------------------
  private:
   friend class SdFile;
@@ -134,12 +169,48 @@ class SdVolume {
   Sd2Card* sdCard_;            // Sd2Card object for cache
   bool cacheDirty_;            // cacheFlush() will write block if true
   uint32_t cacheMirrorBlock_;  // block number for mirror FAT
+#ifdef SD_MULTIBLOCK_READ
+  uint32_t readNextBlock_;     // next block of the open multiple block read
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+  uint32_t writeNextBlock_;    // next block of the range written in a multiple block write
+  uint32_t writeEndBlock_;     // end of the range
+  bool writeOpen_;             // the multiple block write is open
+  const SdBaseFile* reserveOwner_;  // file writing into the clusters reserved by SdFile::reserve()
+  uint32_t reserveBlock_;      // first block of the reserved clusters
+  uint32_t reserveSize_;       // reserved bytes
+#endif  // SD_MULTIBLOCK_WRITE
+#ifdef SD_FAT_CACHE
+  cache_t fatCacheBuffer_[SD_FAT_CACHE_BLOCKS];       // FAT blocks for fatGet
+  uint32_t fatCacheBlockNumber_[SD_FAT_CACHE_BLOCKS]; // block numbers in the FAT cache
+  uint8_t fatCacheOrder_[SD_FAT_CACHE_BLOCKS];        // FAT cache slots, most recently used first
+  uint32_t fatCacheHits_;
+  uint32_t fatCacheMisses_;
+#endif  // SD_FAT_CACHE
 #else  // USE_MULTIPLE_CARDS
   static cache_t cacheBuffer_;        // 512 byte cache for device blocks
   static uint32_t cacheBlockNumber_;  // Logical number of block in the cache
   static Sd2Card* sdCard_;            // Sd2Card object for cache
   static bool cacheDirty_;            // cacheFlush() will write block if true
   static uint32_t cacheMirrorBlock_;  // block number for mirror FAT
+#ifdef SD_MULTIBLOCK_READ
+  static uint32_t readNextBlock_;     // next block of the open multiple block read
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+  static uint32_t writeNextBlock_;    // next block of the range written in a multiple block write
+  static uint32_t writeEndBlock_;     // end of the range
+  static bool writeOpen_;             // the multiple block write is open
+  static const SdBaseFile* reserveOwner_;  // file writing into the clusters reserved by SdFile::reserve()
+  static uint32_t reserveBlock_;      // first block of the reserved clusters
+  static uint32_t reserveSize_;       // reserved bytes
+#endif  // SD_MULTIBLOCK_WRITE
+#ifdef SD_FAT_CACHE
+  static cache_t fatCacheBuffer_[SD_FAT_CACHE_BLOCKS];       // FAT blocks for fatGet
+  static uint32_t fatCacheBlockNumber_[SD_FAT_CACHE_BLOCKS]; // block numbers in the FAT cache
+  static uint8_t fatCacheOrder_[SD_FAT_CACHE_BLOCKS];        // FAT cache slots, most recently used first
+  static uint32_t fatCacheHits_;
+  static uint32_t fatCacheMisses_;
+#endif  // SD_FAT_CACHE
 #endif  // USE_MULTIPLE_CARDS
   uint32_t allocSearchStart_;   // start cluster for alloc search
   uint8_t blocksPerCluster_;    // cluster size in blocks
@@ -165,9 +236,23 @@ class SdVolume {
 #if USE_MULTIPLE_CARDS
   bool cacheFlush();
   bool cacheRawBlock(uint32_t blockNumber, bool dirty);
+#ifdef SD_MULTIBLOCK_READ
+  bool cacheStreamBlock(uint32_t blockNumber);
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+  bool cacheWriteStream();
+  bool writeRange(uint32_t blockNumber, uint32_t count);
+#endif  // SD_MULTIBLOCK_WRITE
 #else  // USE_MULTIPLE_CARDS
   static bool cacheFlush();
   static bool cacheRawBlock(uint32_t blockNumber, bool dirty);
+#ifdef SD_MULTIBLOCK_READ
+  static bool cacheStreamBlock(uint32_t blockNumber);
+#endif  // SD_MULTIBLOCK_READ
+#ifdef SD_MULTIBLOCK_WRITE
+  static bool cacheWriteStream();
+  static bool writeRange(uint32_t blockNumber, uint32_t count);
+#endif  // SD_MULTIBLOCK_WRITE
 #endif  // USE_MULTIPLE_CARDS
   // used by SdBaseFile write to assign cache to SD location
   void cacheSetBlockNumber(uint32_t blockNumber, bool dirty) {
@@ -175,6 +260,11 @@ class SdVolume {
     cacheBlockNumber_  = blockNumber;
   }
   void cacheSetDirty() {cacheDirty_ |= CACHE_FOR_WRITE;}
+#ifdef SD_FAT_CACHE
+  void fatCacheInit();
+  cache_t* fatCacheRead(uint32_t blockNumber);
+  void fatCacheUpdate(uint32_t blockNumber, uint32_t cluster, uint32_t value);
+#endif  // SD_FAT_CACHE
   bool chainSize(uint32_t beginCluster, uint32_t* size);
   bool fatGet(uint32_t cluster, uint32_t* value);
   bool fatPut(uint32_t cluster, uint32_t value);
@@ -187,11 +277,19 @@ class SdVolume {
     if (fatType_ == 16) return cluster >= FAT16EOC_MIN;
     return  cluster >= FAT32EOC_MIN;
   }
+#ifdef SD_MULTIBLOCK
+  bool readBlock(uint32_t block, uint8_t* dst) {
+    return cardIdle() && sdCard_->readBlock(block, dst);}
+  bool writeBlock(uint32_t block, const uint8_t* dst) {
+    return cardIdle() && sdCard_->writeBlock(block, dst);
+  }
+#else  // SD_MULTIBLOCK
   bool readBlock(uint32_t block, uint8_t* dst) {
     return sdCard_->readBlock(block, dst);}
   bool writeBlock(uint32_t block, const uint8_t* dst) {
     return sdCard_->writeBlock(block, dst);
   }
+#endif  // SD_MULTIBLOCK
 //------------------------------------------------------------------------------
   // Deprecated functions  - suppress cpplint warnings with NOLINT comment
 #if ALLOW_DEPRECATED_FUNCTIONS && !defined(DOXYGEN)
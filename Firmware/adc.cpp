@@ -5,11 +5,33 @@
 #include <avr/pgmspace.h>
 #include <string.h>
 #include "pins.h"
+#include "system_timer.h"
 
 static uint8_t adc_count; //used for oversampling
 static uint8_t adc_channel_idx; //bitmask index
 volatile uint8_t adc_channel; //regular index
 volatile uint16_t adc_values[ADC_CHAN_CNT];
+volatile adc_stats_t adc_stats;
+static uint32_t adc_cycle_start;
+
+#ifdef ADC_CHAN_CFG
+static constexpr uint8_t adc_ovrsampl_log2[] = ADC_CHAN_OVRSAMPL_LOG2;
+static constexpr uint8_t adc_filter[] = ADC_CHAN_FILTER;
+static_assert(sizeof(adc_ovrsampl_log2) == ADC_CHAN_CNT, "ADC_CHAN_OVRSAMPL_LOG2 does not match ADC_CHAN_CNT");
+static_assert(sizeof(adc_filter) == ADC_CHAN_CNT, "ADC_CHAN_FILTER does not match ADC_CHAN_CNT");
+
+static constexpr bool adc_ovrsampl_valid(uint8_t i = 0) {
+    return (i == ADC_CHAN_CNT) || ((adc_ovrsampl_log2[i] <= 6) && adc_ovrsampl_valid(i + 1));
+}
+static_assert(adc_ovrsampl_valid(), "ADC_CHAN_OVRSAMPL_LOG2 out of range (64 samples would overflow)");
+
+static uint16_t adc_hist[ADC_CHAN_CNT][2]; //filter state: last output (IIR) or last two values (MED3)
+static bool adc_hist_valid;
+
+# define ADC_SAMPLES(ch) (1 << adc_ovrsampl_log2[ch])
+#else //ADC_CHAN_CFG
+# define ADC_SAMPLES(ch) ADC_OVRSAMPL
+#endif //ADC_CHAN_CFG
 
 static void adc_reset();
 static void adc_setmux(uint8_t ch);
@@ -48,9 +70,74 @@ static void adc_setmux(uint8_t ch)
 
 void adc_start_cycle() {
 	adc_reset();
+	adc_cycle_start = millis_nc();
 	ADCSRA |= (1 << ADSC); //start conversion
 }
 
+uint8_t adc_chan_samples(uint8_t index)
+{
+    return ADC_SAMPLES(index);
+}
+
+#ifdef ADC_CHAN_CFG
+uint8_t adc_chan_filter(uint8_t index)
+{
+    return adc_filter[index];
+}
+
+static uint16_t median3(uint16_t a, uint16_t b, uint16_t c)
+{
+    if (a > b) { uint16_t t = a; a = b; b = t; }
+    if (b > c) b = c;
+    return (a > b)? a: b;
+}
+
+//scale the accumulated values to ADC_OVRSAMPL and apply the per-channel filters
+static void adc_decimate()
+{
+    for (uint8_t i = 0; i < ADC_CHAN_CNT; i++)
+    {
+        uint16_t v = adc_values[i];
+        const uint8_t l2 = adc_ovrsampl_log2[i];
+        if (l2 > 4) v >>= (l2 - 4);
+        else v <<= (4 - l2);
+
+        uint16_t* hist = adc_hist[i];
+        if (!adc_hist_valid)
+            hist[0] = hist[1] = v;
+        switch (adc_filter[i])
+        {
+        case ADC_FILTER_IIR:
+            v = hist[0] + ((int16_t)(v - hist[0]) >> ADC_IIR_SHIFT);
+            hist[0] = v;
+            break;
+        case ADC_FILTER_MED3:
+        {
+            uint16_t m = median3(v, hist[0], hist[1]);
+            hist[1] = hist[0];
+            hist[0] = v;
+            v = m;
+            break;
+        }
+        }
+        adc_values[i] = v;
+    }
+    adc_hist_valid = true;
+}
+#endif //ADC_CHAN_CFG
+
+//publish the cycle timestamp and timing statistics
+static void adc_cycle_stats()
+{
+    const uint32_t now = millis_nc();
+    const uint32_t duration = now - adc_cycle_start;
+    adc_stats.timestamp = now;
+    adc_stats.cycles++;
+    adc_stats.duration = (duration > 0xff)? 0xff: duration;
+    if (adc_stats.duration > adc_stats.duration_max)
+        adc_stats.duration_max = adc_stats.duration;
+}
+
 #ifdef ADC_CALLBACK
 extern void ADC_CALLBACK();
 #endif //ADC_CALLBACK
@@ -58,10 +145,14 @@ extern void ADC_CALLBACK();
 ISR(ADC_vect)
 {
     adc_values[adc_channel] += ADC;
-    if (++adc_count == ADC_OVRSAMPL)
+    if (++adc_count == ADC_SAMPLES(adc_channel))
     {
         // go to the next channel
         if (++adc_channel == ADC_CHAN_CNT) {
+#ifdef ADC_CHAN_CFG
+            adc_decimate();
+#endif //ADC_CHAN_CFG
+            adc_cycle_stats();
 #ifdef ADC_CALLBACK
             ADC_CALLBACK();
 #endif
@@ -15,9 +15,27 @@ http://resnet.uoregon.edu/~gurney_j/jmpc/bitwise.html
 # error "ADC_CHAN_MSK oes not match ADC_CHAN_CNT"
 #endif
 
+//per-channel filters (ADC_CHAN_FILTER)
+#define ADC_FILTER_NONE   0 //decimated value only
+#define ADC_FILTER_IIR    1 //1st-order IIR across cycles, factor 1/(2^ADC_IIR_SHIFT)
+#define ADC_FILTER_MED3   2 //median of the last 3 cycles (spike rejection)
+
+struct adc_stats_t
+{
+    uint32_t timestamp;   //_millis() at the end of the last completed cycle
+    uint16_t cycles;      //number of completed cycles (wraps around)
+    uint8_t duration;     //duration of the last cycle [ms]
+    uint8_t duration_max; //longest cycle since boot [ms]
+};
+
 extern volatile uint8_t adc_channel;
 extern volatile uint16_t adc_values[ADC_CHAN_CNT];
+extern volatile adc_stats_t adc_stats;
 
 extern void adc_init();
 extern void adc_start_cycle(); //should be called from an atomic context only
 static inline bool adc_cycle_done() { return adc_channel >= ADC_CHAN_CNT; }
+extern uint8_t adc_chan_samples(uint8_t index); //samples per cycle of a used channel
+#ifdef ADC_CHAN_CFG
+extern uint8_t adc_chan_filter(uint8_t index);
+#endif //ADC_CHAN_CFG
@@ -0,0 +1,70 @@
+//! @file
+//! @brief Arc segmentation by the chord error
+//!
+//! An arc is split into chords which deviate from it by at most a given error, so a large radius
+//! takes long segments and a small radius short ones. The chords are generated by rotating the
+//! radius vector by the exact angle of a segment, the length of the vector is corrected every few
+//! segments so that the rounding errors don't accumulate.
+
+#ifndef ARC_CHORDS_H
+#define ARC_CHORDS_H
+
+#include <math.h>
+#include <stdint.h>
+
+//! @brief Length of the chords of the arc of @p radius
+//!
+//! The chord c deviates from the arc by the sagitta e, c = 2 sqrt(e (2 r - e)).
+//! @param max_error allowed deviation [mm]
+//! @param min_length, max_length limits of the chord length [mm]
+inline float arc_chord_length(float radius, float max_error, float min_length, float max_length)
+{
+    float length = (max_error < radius) ? 2.f * sqrt(max_error * (2.f * radius - max_error)) : max_length;
+    if (length > max_length)
+        length = max_length;
+    if (length < min_length)
+        length = min_length;
+    return length;
+}
+
+//! Radius vector of an arc rotated by the same angle for each segment
+class ArcChords
+{
+public:
+    //! segments between the corrections of the vector length
+    enum : uint8_t { RENORMALIZE = 16 };
+
+    //! @param r_x, r_y radius vector from the center to the start of the arc
+    //! @param theta angle of a segment [rad]
+    ArcChords(float r_x, float r_y, float theta)
+        : x(r_x), y(r_y), m_cos(cos(theta)), m_sin(sin(theta)), m_r2(r_x * r_x + r_y * r_y), m_count(RENORMALIZE)
+    {
+    }
+
+    //! rotate the vector to the end of the next segment
+    void next()
+    {
+        float t = x * m_sin + y * m_cos;
+        x = x * m_cos - y * m_sin;
+        y = t;
+        if (--m_count == 0)
+        {
+            m_count = RENORMALIZE;
+            if (!(m_r2 > 0))
+                return;
+            // a Newton step of r / |v|, the length drifts by a few ulps only
+            float s = 1.5f - 0.5f * (x * x + y * y) / m_r2;
+            x *= s;
+            y *= s;
+        }
+    }
+
+    float x, y; //!< radius vector [mm]
+
+private:
+    float m_cos, m_sin;
+    float m_r2; //!< square of the radius
+    uint8_t m_count;
+};
+
+#endif /* ARC_CHORDS_H */
@@ -7,16 +7,23 @@
 #include "stepper.h"
 #include "temperature.h"
 #include "language.h"
+#include <stddef.h>
 
 #ifdef SDSUPPORT
 
 #define LONGEST_FILENAME (longFilename[0] ? longFilename : filename)
+#ifdef SDSORT_INDEX_FILE
+#define SORT_INDEX_NAME "SDSORT.IDX"
+#endif //SDSORT_INDEX_FILE
 
 CardReader::CardReader()
 {
 
    #ifdef SDCARD_SORT_ALPHA
-     sort_count = 0;
+     flush_presort();
+   #ifdef SDSORT_INDEX
+     sort_dir_count = 0;
+   #endif
    #endif
 
    filesize = 0;
@@ -29,6 +36,9 @@ CardReader::CardReader()
    file_subcall_ctr=0;
    memset(workDirParents, 0, sizeof(workDirParents));
    presort_flag = false;
+#ifdef SD_BINARY_GCODE
+   binary = false;
+#endif //SD_BINARY_GCODE
 
    lastnr=0;
   //power to SD reader
@@ -199,6 +209,12 @@ void CardReader::ls(ls_param params)
 void CardReader::initsd(bool doPresort/* = true*/)
 {
   cardOK = false;
+#ifdef SDSORT_INDEX
+  presort_invalidate();
+#endif //SDSORT_INDEX
+#ifdef SD_NAME_CACHE
+  name_cache_flush();
+#endif //SD_NAME_CACHE
   if(root.isOpen())
     root.close();
 #ifdef SDSLOW
@@ -256,13 +272,24 @@ void CardReader::setroot(bool doPresort)
 	if (doPresort)
 		presort();
 	else
+	{
+#ifdef SDSORT_INDEX
+		flush_presort(); // the order being built belongs to the previous directory
+#endif //SDSORT_INDEX
 		presort_flag = true;
+	}
 #endif
 }
 void CardReader::release()
 {
   sdprinting = false;
   cardOK = false;
+#ifdef SDSORT_INDEX
+  presort_invalidate();
+#endif //SDSORT_INDEX
+#ifdef SD_MULTIBLOCK_WRITE
+  volume.reserveReset(); // the card may be removed, don't write to it at closefile()
+#endif //SD_MULTIBLOCK_WRITE
   SERIAL_ECHO_START;
   SERIAL_ECHOLNRPGM(_n("SD card released"));////MSG_SD_CARD_RELEASED
 }
@@ -446,6 +473,9 @@ void CardReader::openFileReadFilteredGcode(const char* name, bool replace_curren
         SERIAL_PROTOCOLRPGM(ofSize);////MSG_SD_SIZE
         SERIAL_PROTOCOLLN(filesize);
         sdpos = 0;
+#ifdef SD_BINARY_GCODE
+        binaryOpen();
+#endif //SD_BINARY_GCODE
         
         SERIAL_PROTOCOLLNRPGM(ofFileSelected);////MSG_SD_FILE_SELECTED
         lcd_setstatuspgm(ofFileSelected);
@@ -461,6 +491,12 @@ void CardReader::openFileWrite(const char* name)
 {
     if(!cardOK)
         return;
+#ifdef SD_NAME_CACHE
+    name_cache_flush(); // a file is added to the directory
+#endif //SD_NAME_CACHE
+#ifdef SDSORT_INDEX
+    presort_invalidate();
+#endif //SDSORT_INDEX
     if(file.isOpen()){  //replacing current file by new file, or subfile call
 #if 0
         // I doubt chained files support is necessary for file saving:
@@ -502,6 +538,9 @@ void CardReader::openFileWrite(const char* name)
     const char *fname=name;
     if (!diveSubfolder(fname))
       return;
+#ifdef SDSORT_INDEX_FILE
+    SdFile::remove(curDir, SORT_INDEX_NAME); // the new file may take the place of a deleted one
+#endif //SDSORT_INDEX_FILE
     
     //write
     if (!file.open(curDir, fname, O_CREAT | O_APPEND | O_WRITE | O_TRUNC)){
@@ -536,6 +575,12 @@ void CardReader::removeFile(const char* name)
       SERIAL_PROTOCOLPGM("File deleted:");
       SERIAL_PROTOCOLLN(fname);
       sdpos = 0;
+	  #ifdef SDSORT_INDEX
+		  presort_invalidate();
+	  #endif
+	  #ifdef SDSORT_INDEX_FILE
+		  SdFile::remove(curDir, SORT_INDEX_NAME);
+	  #endif
 	  #ifdef SDCARD_SORT_ALPHA
 		  presort();
 	  #endif
@@ -667,8 +712,22 @@ void CardReader::checkautostart(bool force)
 
 void CardReader::closefile(bool store_location)
 {
+#ifdef SD_MULTIBLOCK
+  volume.cardIdle();
+#endif //SD_MULTIBLOCK
   file.sync();
   file.close();
+#ifdef SD_BINARY_GCODE
+  binary = false;
+#endif //SD_BINARY_GCODE
+#ifdef SD_NAME_CACHE
+  if (saving)
+    name_cache_flush(); // the timestamps of the file changed
+#endif //SD_NAME_CACHE
+#ifdef SDSORT_INDEX
+  if (saving)
+    presort_invalidate();
+#endif //SDSORT_INDEX
   saving = false; 
   logging = false;
   
@@ -714,6 +773,15 @@ uint16_t CardReader::getnrfilenames()
   curDir->rewind();
   lsDive("",*curDir, NULL, LS_Count);
   //SERIAL_ECHOLN(nrFiles);
+#ifdef SDSORT_INDEX_FILE
+  if (sort_filed && nrFiles != sort_count) {
+    // the directory was changed since the index was written, build it again
+    const uint16_t count = nrFiles;
+    presort_file_drop();
+    presort();
+    return count;
+  }
+#endif //SDSORT_INDEX_FILE
   return nrFiles;
 }
 
@@ -748,7 +816,12 @@ bool CardReader::chdir(const char * relpath, bool doPresort)
 	if (doPresort)
 		presort();
 	else
+	{
+#ifdef SDSORT_INDEX
+		flush_presort(); // the order being built belongs to the previous directory
+#endif //SDSORT_INDEX
 		presort_flag = true;
+	}
 #endif
 	return 1;
   }
@@ -772,233 +845,671 @@ void CardReader::updir()
 
 #ifdef SDCARD_SORT_ALPHA
 
+#define SORT_NO_PROGRESS 0xffff
+#define SORT_PROGRESS_PASS 32 // Units of the progress bar per pass
+#define SORT_PAGE_OVERLAP (LCD_HEIGHT - 1) // Items shared by adjacent pages, the menu rows don't cross them
+
 /**
 * Get the name of a file in the current directory by sort-index
 */
 void CardReader::getfilename_sorted(const uint16_t nr, uint8_t sdSort) {
-    if (nr < sort_count)
-        getfilename_simple(sort_entries[(sdSort == SD_SORT_ALPHA) ? (sort_count - nr - 1) : nr]);
+#ifdef SD_NAME_CACHE
+    if (name_cache_get(nr, sdSort))
+        return;
+#endif //SD_NAME_CACHE
+    const uint16_t i = (sdSort == SD_SORT_ALPHA) ? (sort_count - nr - 1) : nr;
+#ifdef SDSORT_INDEX_FILE
+    if (nr < sort_count && sort_filed) {
+        if (!presort_file_get(i)) {
+            // the directory was changed since the index was written, build it again
+            presort_file_drop();
+            presort();
+            getfilename(nr);
+        }
+    }
+    else
+#endif //SDSORT_INDEX_FILE
+#ifdef SDSORT_INDEX
+    if (nr < sort_count && sort_indexed)
+        getfilename_simple(sort_index[sort_start + i]);
+    else
+#endif //SDSORT_INDEX
+    if (nr < sort_count && ((uint16_t)(i - sort_page) < sort_fill || presort_seek(i)))
+        getfilename_simple(sort_entries[i - sort_page]);
     else
-        getfilename_afterMaxSorting(nr);
+        getfilename(nr);
+#ifdef SD_NAME_CACHE
+    name_cache_put(nr, sdSort);
+#endif //SD_NAME_CACHE
 }
 
-void CardReader::getfilename_afterMaxSorting(uint16_t entry, const char * const match/*=NULL*/)
-{
-	curDir = &workDir;
-	nrFiles = entry - sort_count + 1;
-	curDir->seekSet(lastSortedFilePosition << 5);
-	lsDive("", *curDir, match, LS_GetFilename);
+#ifdef SD_NAME_CACHE
+
+//! Restore a listed item from the cache
+bool CardReader::name_cache_get(uint16_t nr, uint8_t sdSort) {
+	if (sdSort != name_cache_sort || workDir.firstCluster() != name_cache_dir)
+		return false;
+	for (uint8_t i = 0; i < name_cache_count; i++) {
+		const uint8_t slot = name_cache_order[i];
+		const NameCacheEntry &e = name_cache[slot];
+		if (e.nr != nr) continue;
+		memmove(&name_cache_order[1], &name_cache_order[0], i);
+		name_cache_order[0] = slot;
+		curDir = &workDir;
+		crmodDate = e.date;
+		crmodTime = e.time;
+		position = e.position;
+		filenameIsDir = e.dir;
+		strcpy(filename, e.filename);
+		strcpy(longFilename, e.longFilename);
+		return true;
+	}
+	return false;
+}
+
+//! Store the last read item, replacing the least recently used one
+void CardReader::name_cache_put(uint16_t nr, uint8_t sdSort) {
+	if (sdSort != name_cache_sort || workDir.firstCluster() != name_cache_dir) {
+		name_cache_flush();
+		name_cache_sort = sdSort;
+		name_cache_dir = workDir.firstCluster();
+	}
+	uint8_t slot;
+	if (name_cache_count < SD_NAME_CACHE_SIZE)
+		slot = name_cache_count++;
+	else
+		slot = name_cache_order[SD_NAME_CACHE_SIZE - 1];
+	memmove(&name_cache_order[1], &name_cache_order[0], name_cache_count - 1);
+	name_cache_order[0] = slot;
+	NameCacheEntry &e = name_cache[slot];
+	e.nr = nr;
+	e.date = crmodDate;
+	e.time = crmodTime;
+	e.position = position;
+	e.dir = filenameIsDir;
+	strcpy(e.filename, filename);
+	strcpy(e.longFilename, longFilename);
+}
+
+#endif //SD_NAME_CACHE
+
+//! Store the sort key of the last read item
+void CardReader::presort_load(uint16_t entry, SortKey &key) {
+	key.entry = entry;
+	key.date = crmodDate;
+	key.time = crmodTime;
+	key.dir = filenameIsDir;
+	strcpy(key.name, LONGEST_FILENAME);
+}
+
+/**
+* Compare a sort key with the last read item in the order of the selection pass
+*
+* @return negative if the key is selected before the item, positive if after it. The entry
+* index breaks the ties, so only the item itself compares equal.
+*/
+int8_t CardReader::presort_compare(const SortKey &key) {
+	int8_t cmp = 0;
+#if HAS_FOLDER_SORTING
+	// the menu shows the sorted items in the reverse order in the alphabetical mode
+	if (key.dir != filenameIsDir)
+		cmp = (key.dir == ((FOLDER_SORTING < 0) == (sort_mode == SD_SORT_ALPHA))) ? -1 : 1;
+	else
+#endif
+	if (sort_mode == SD_SORT_ALPHA) {
+		const int c = strcasecmp(key.name, LONGEST_FILENAME);
+		cmp = (c < 0) ? -1 : (c > 0);
+	}
+	else if (key.date != crmodDate)
+		cmp = (key.date < crmodDate) ? -1 : 1;
+	else if (key.time != crmodTime)
+		cmp = (key.time < crmodTime) ? -1 : 1;
+	const uint16_t entry = position >> 5;
+	if (cmp == 0 && key.entry != entry)
+		cmp = (key.entry < entry) ? -1 : 1;
+	return sort_reverse ? -cmp : cmp;
 }
 
 /**
-* Read all the files and produce a sort key
+* Rank of an item by its type, the folders and the files are selected in separate groups
 *
-* We can do this in 3 ways...
-*  - Minimal RAM: Read two filenames at a time sorting along...
-*  - Some RAM: Buffer the directory just for this sort
-*  - Most RAM: Buffer the directory and return filenames from RAM
+* @return 0 for the group selected first by the pass, 1 for the other one
+*/
+uint8_t CardReader::presort_rank(bool dir) {
+#if HAS_FOLDER_SORTING
+	return (dir == ((FOLDER_SORTING < 0) == (sort_mode == SD_SORT_ALPHA))) == sort_reverse;
+#else
+	(void)dir;
+	return 0;
+#endif
+}
+
+/**
+* Summary of a sort key, the order of the summaries follows the order of the keys
+*
+* The date and time in the time mode, the first 4 case folded characters of the name following
+* the common prefix of the page in the alphabetical mode. A name ending within them is complete.
+*/
+uint32_t CardReader::presort_summary(const char *name, uint16_t date, uint16_t time) {
+	if (sort_mode != SD_SORT_ALPHA)
+		return (uint32_t)date << 16 | time;
+	uint32_t summary = 0;
+	name += sort_skip;
+	for (uint8_t n = 4; n--;) {
+		summary <<= 8;
+		if (*name)
+			summary |= (uint8_t)tolower(*name++);
+	}
+	return summary;
+}
+
+/**
+* Keep the summaries of the page relative to a prefix shared with the key
+*
+* An empty page takes the prefix of the key. Otherwise the prefix is shortened to the common one,
+* the summaries of the page then start with its dropped characters.
+*/
+void CardReader::presort_prefix(const SortKey &key) {
+	if (sort_mode != SD_SORT_ALPHA) return;
+	uint8_t n = 0;
+	if (!sort_fill) {
+		while (n < SDSORT_PREFIX && key.name[n]) {
+			sort_prefix[n] = tolower(key.name[n]);
+			++n;
+		}
+		sort_skip = n;
+		return;
+	}
+	while (n < sort_skip && (char)tolower(key.name[n]) == sort_prefix[n])
+		++n;
+	const uint8_t shift = sort_skip - n;
+	if (!shift) return;
+	uint32_t head = 0;
+	for (uint8_t k = 0; k < 4; k++)
+		head = head << 8 | ((n + k < sort_skip) ? (uint8_t)sort_prefix[n + k] : 0);
+	for (uint16_t j = 0; j < sort_fill; j++)
+		sort_keys[j] = (shift >= 4) ? head : (head | sort_keys[j] >> (8 * shift));
+	sort_skip = n;
+}
+
+/**
+* Compare a sort key with the j-th item of the page in the order of the selection pass
+*
+* The summaries decide unless they are equal and incomplete, the item is reread from the card
+* then.
+* @return negative if the key is selected before the item, positive if after it
+*/
+int8_t CardReader::presort_compare_page(const SortKey &key, uint32_t summary, uint16_t j) {
+	const uint8_t rank = presort_rank(key.dir);
+	if (rank != (j >= sort_lead))
+		return rank ? 1 : -1;
+	int8_t cmp;
+	if (summary != sort_keys[j])
+		cmp = (summary < sort_keys[j]) ? -1 : 1;
+	else if (sort_mode != SD_SORT_ALPHA || !(summary & 0xff))
+		cmp = (key.entry < sort_entries[j]) ? -1 : 1;
+	else {
+		getfilename_simple(sort_entries[j]);
+		return presort_compare(key);
+	}
+	return sort_reverse ? -cmp : cmp;
+}
+
+/**
+* Select the next page of the sorted items
+*
+* A pass over the directory keeps the first SDSORT_LIMIT items following sort_bound in
+* sort_entries, the items preceding it in the reverse pass. The items of the page are compared
+* by the summaries of their keys in sort_keys, so the RAM doesn't limit the number of items and
+* the card is read mostly in the order of the directory.
+*
+* @param budget [ms] to spend before returning, 0 to finish the pass
+* @return true at the end of the pass, sort_fill items are selected in the sorted order
+*/
+bool CardReader::presort_select(uint16_t budget) {
+	SortKey bound, key;
+	if (sort_bounded) {
+		getfilename_simple(sort_bound);
+		presort_load(sort_bound, bound);
+	}
+
+	const unsigned long start = _millis();
+	do {
+		if (!IS_SD_INSERTED) return false;
+		manage_heater();
+		if (sort_pass++ == 0)
+			getfilename(0);
+		else
+			getfilename_next(sort_pos);
+		sort_pos = position;
+		if (sort_progress != SORT_NO_PROGRESS)
+			menu_progressbar_update(sort_progress + (uint32_t)sort_pass * SORT_PROGRESS_PASS / sort_total);
+
+		// skip the items of the previous pages and the ones which don't fit the page
+		if (sort_bounded && presort_compare(bound) >= 0)
+			continue;
+#ifdef SDSORT_INDEX_FILE
+		// presort_file_get() checks the first entry of the item, not the deleted ones preceding it
+		dir_t p;
+		for (workDir.seekSet(position); workDir.read(&p, sizeof(p)) == sizeof(p) && p.name[0] == DIR_NAME_DELETED;)
+			position += sizeof(p);
+#endif //SDSORT_INDEX_FILE
+		presort_load(position >> 5, key);
+		presort_prefix(key);
+		const uint32_t summary = presort_summary(key.name, key.date, key.time);
+		if (sort_fill == SDSORT_LIMIT && presort_compare_page(key, summary, SDSORT_LIMIT - 1) > 0)
+			continue;
+
+		uint16_t lo = 0, hi = sort_fill;
+		while (lo < hi) {
+			const uint16_t mid = (lo + hi) / 2;
+			if (presort_compare_page(key, summary, mid) < 0)
+				hi = mid;
+			else
+				lo = mid + 1;
+		}
+		if (!sort_fill)
+			sort_lead = 0;
+		if (sort_fill < SDSORT_LIMIT)
+			++sort_fill;
+		else if (sort_lead == SDSORT_LIMIT)
+			--sort_lead; // the last item is dropped
+		if (!presort_rank(key.dir))
+			++sort_lead;
+		memmove(&sort_entries[lo + 1], &sort_entries[lo], (sort_fill - 1 - lo) * sizeof(sort_entries[0]));
+		memmove(&sort_keys[lo + 1], &sort_keys[lo], (sort_fill - 1 - lo) * sizeof(sort_keys[0]));
+		sort_entries[lo] = key.entry;
+		sort_keys[lo] = summary;
+	} while (sort_pass < sort_total && (!budget || _millis() - start < budget));
+	if (sort_pass < sort_total) return false;
+
+	sort_pass = 0;
+	if (sort_reverse) {
+		for (uint16_t i = 0, j = sort_fill; i + 1 < j--; ++i) {
+			const uint16_t e = sort_entries[i];
+			sort_entries[i] = sort_entries[j];
+			sort_entries[j] = e;
+		}
+	}
+	return true;
+}
+
+#ifdef SDSORT_INDEX
+
+/**
+* Look up the sorted order of the current directory
+*
+* The sorted orders of the last visited directories are kept in sort_index until the card is
+* changed or written, so a directory is listed sorted on a revisit without reading it. With
+* SDSORT_INDEX_FILE the order stored in the directory is used next. Otherwise the order is built
+* by presort_step() and the listing isn't sorted until it's complete. The directories which don't
+* fit any index are sorted a page at a time by getfilename_sorted().
 */
 void CardReader::presort() {
 	// Throw away old sort index
 	flush_presort();
-	
+
 	if (farm_mode || IS_SD_INSERTED == false) return; //sorting is not used in farm mode
-	uint8_t sdSort = eeprom_read_byte((uint8_t*)EEPROM_SD_SORT);
+	sort_mode = eeprom_read_byte((uint8_t*)EEPROM_SD_SORT);
+	if (sort_mode == SD_SORT_NONE) return;
+	if (card.getFlashAirCompatible())
+		presort_invalidate(); // the files may be uploaded over the WiFi
+
+	const uint32_t cluster = workDir.firstCluster();
+	for (uint8_t d = 0; d < sort_dir_count; d++) {
+		if (sort_dirs[d].cluster == cluster && sort_dirs[d].mode == sort_mode) {
+			sort_start = sort_dirs[d].start;
+			sort_count = sort_dirs[d].count;
+			sort_indexed = true;
+			return;
+		}
+	}
+#ifdef SDSORT_INDEX_FILE
+	if (presort_file_open())
+		return;
+#endif //SDSORT_INDEX_FILE
 
 	KEEPALIVE_STATE(IN_HANDLER);
+	const uint16_t count = getnrfilenames();
+	KEEPALIVE_STATE(NOT_BUSY);
+	if (count < 2) return;
+	sort_total = count;
+#ifdef SDSORT_INDEX_FILE
+	presort_file_create(position >> 5);
+	sort_in_ram = (count <= SDSORT_INDEX_SIZE);
+	if (!sort_in_ram) {
+		if (!sort_file.isOpen())
+			sort_count = count;
+		else
+			sort_building = true;
+		return;
+	}
+#else
+	if (count > SDSORT_INDEX_SIZE) {
+		sort_count = count;
+		return;
+	}
+#endif //SDSORT_INDEX_FILE
+
+	// drop the oldest directories to make room
+	sort_start = 0;
+	while (sort_dir_count) {
+		const SortIndexDir &last = sort_dirs[sort_dir_count - 1];
+		sort_start = last.start + last.count;
+		if (sort_dir_count < SDSORT_INDEX_DIRS && sort_start + count <= SDSORT_INDEX_SIZE)
+			break;
+		const uint16_t n = sort_dirs[0].count;
+		memmove(&sort_index[0], &sort_index[n], (sort_start - n) * sizeof(sort_index[0]));
+		memmove(&sort_dirs[0], &sort_dirs[1], --sort_dir_count * sizeof(sort_dirs[0]));
+		for (uint8_t d = 0; d < sort_dir_count; d++)
+			sort_dirs[d].start -= n;
+		sort_start = 0;
+	}
 
-	// If there are files, sort up to the limit
-	uint16_t fileCnt = getnrfilenames();
-	if (fileCnt > 0) {
-		// Never sort more than the max allowed
-		// If you use folders to organize, 20 may be enough
-		if (fileCnt > SDSORT_LIMIT) {
-			if (sdSort != SD_SORT_NONE) {
-				lcd_show_fullscreen_message_and_wait_P(_i("Some files will not be sorted. Max. No. of files in 1 folder for sorting is 100."));////MSG_FILE_CNT c=20 r=6
-			}
-			fileCnt = SDSORT_LIMIT;
-		}
+	sort_building = true;
+}
 
-		sort_count = fileCnt;
-		
-		// Init sort order.
-		for (uint16_t i = 0; i < fileCnt; i++) {
-			if (!IS_SD_INSERTED) return;
-			manage_heater();
-			if (i == 0)
-				getfilename(0);
-			else
-				getfilename_next(position);
-			sort_entries[i] = position >> 5;
+/**
+* Continue building the sorted order for SDSORT_INDEX_STEP ms
+*
+* Every pass of presort_select() appends a page to the index.
+*/
+void CardReader::presort_step() {
+	if (!sort_building) return;
+	if (!presort_select(SDSORT_INDEX_STEP)) {
+		if (!IS_SD_INSERTED)
+			flush_presort();
+		return;
+	}
+
+	// append the page to the index
+	if (sort_fill) {
+#ifdef SDSORT_INDEX_FILE
+		const int16_t size = sort_fill * sizeof(sort_entries[0]);
+		if (sort_file.isOpen() && sort_file.write(sort_entries, size) != size)
+			presort_file_drop();
+		if (!sort_in_ram && !sort_file.isOpen()) {
+			// sort the directory a page at a time
+			const uint16_t count = sort_total;
+			flush_presort();
+			sort_total = sort_count = count;
+			return;
 		}
+		if (sort_in_ram)
+#endif //SDSORT_INDEX_FILE
+		memcpy(&sort_index[sort_start + sort_done], sort_entries, sort_fill * sizeof(sort_entries[0]));
+		sort_done += sort_fill;
+		sort_bound = sort_entries[sort_fill - 1];
+		sort_bounded = true;
+	}
+	const bool complete = (sort_done >= sort_total || !sort_fill);
+	sort_fill = 0;
+	if (complete) {
+#ifdef SDSORT_INDEX_FILE
+		if (sort_file.isOpen() && !presort_file_finish())
+			presort_file_drop();
+		if (!sort_in_ram) {
+			const uint16_t count = sort_total;
+			flush_presort();
+			if (!presort_file_open())
+				sort_total = sort_count = count;
+			return;
+		}
+#endif //SDSORT_INDEX_FILE
+		SortIndexDir &dir = sort_dirs[sort_dir_count++];
+		dir.cluster = workDir.firstCluster();
+		dir.start = sort_start;
+		dir.count = sort_done;
+		dir.mode = sort_mode;
+		sort_building = false;
+		sort_indexed = true;
+		sort_count = sort_done;
+#ifdef SD_NAME_CACHE
+		name_cache_flush(); // the items were listed unsorted
+#endif //SD_NAME_CACHE
+	}
+}
 
-		if ((fileCnt > 1) && (sdSort != SD_SORT_NONE)) {
+//! Forget the sorted order of all the directories, the card has been changed or written
+void CardReader::presort_invalidate() {
+	flush_presort();
+	sort_dir_count = 0;
+}
 
-#ifdef SORTING_SPEEDTEST
-			LongTimer sortingSpeedtestTimer;
-			sortingSpeedtestTimer.start();
-#endif //SORTING_SPEEDTEST
-			lastSortedFilePosition = position >> 5;
+#ifdef SDSORT_INDEX_FILE
 
-			// By default re-read the names from SD for every compare
-			// retaining only two filenames at a time. This is very
-			// slow but is safest and uses minimal RAM.
-			char name1[LONG_FILENAME_LENGTH];
-			uint16_t crmod_time_bckp;
-			uint16_t crmod_date_bckp;
+#define SORT_INDEX_FAT_NAME "SDSORT  IDX"
+#define SORT_INDEX_MAGIC 0x32495353UL // "SSI2"
 
-#ifdef INSERTSORT
+//! Header of SDSORT.IDX, followed by the entry indices of the sorted items
+struct SortIndexHeader
+{
+	uint32_t magic;
+	uint32_t cluster;         //!< first cluster of the directory
+	uint32_t check;           //!< presort_dir_check() of the directory
+	uint16_t end;             //!< count of the directory entries up to the first free one
+	uint16_t count;
+	uint8_t mode;
+};
+
+static uint32_t fnv1a(uint32_t hash, const void *data, uint8_t size)
+{
+	for (const uint8_t *p = (const uint8_t*)data; size--; ++p)
+		hash = (hash ^ *p) * 16777619UL;
+	return hash;
+}
 
-#define _SORT_CMP_NODIR() (strcasecmp(name1, name2) < 0) //true if lowercase(name1) < lowercase(name2)
-#define _SORT_CMP_TIME_NODIR() (((crmod_date_bckp == crmodDate) && (crmod_time_bckp > crmodTime)) || (crmod_date_bckp > crmodDate))
+//! Count of the entries of the current directory up to the first free one, from the entry @p from on
+uint16_t CardReader::presort_dir_end(uint16_t from) {
+	dir_t p;
+	if (!workDir.seekSet((uint32_t)from << 5)) return 0;
+	while (workDir.read(&p, sizeof(p)) == sizeof(p) && p.name[0] != DIR_NAME_FREE)
+		++from;
+	return from;
+}
 
-#if HAS_FOLDER_SORTING
-#define _SORT_CMP_DIR(fs) ((dir1 == filenameIsDir) ? _SORT_CMP_NODIR() : (fs < 0 ? dir1 : !dir1))
-#define _SORT_CMP_TIME_DIR(fs) ((dir1 == filenameIsDir) ? _SORT_CMP_TIME_NODIR() : (fs < 0 ? dir1 : !dir1))
-#endif
+//! Hash of the first block of the current directory, the entry of SDSORT.IDX itself left out
+uint32_t CardReader::presort_dir_check() {
+	uint32_t hash = 2166136261UL;
+	dir_t p;
+	workDir.seekSet(0);
+	for (uint8_t n = 512 / sizeof(p); n-- && workDir.read(&p, sizeof(p)) == sizeof(p);) {
+		if (memcmp(p.name, SORT_INDEX_FAT_NAME, sizeof(p.name)) != 0)
+			hash = fnv1a(hash, &p, sizeof(p));
+	}
+	return hash;
+}
 
-      uint16_t counter = 0;
-      menu_progressbar_init(fileCnt * fileCnt / 2, _i("Sorting files"));
-
-      for (uint16_t i = 1; i < fileCnt; ++i){
-        // if (!IS_SD_INSERTED) return;
-        menu_progressbar_update(counter);
-        counter += i;
-
-        /// pop the position
-        const uint16_t o1 = sort_entries[i];
-        getfilename_simple(o1);
-        strcpy(name1, LONGEST_FILENAME); // save (or getfilename below will trounce it)
-        crmod_date_bckp = crmodDate;
-        crmod_time_bckp = crmodTime;
-        #if HAS_FOLDER_SORTING
-        bool dir1 = filenameIsDir;
-        #endif
-
-        /// find proper place
-        uint16_t j = i;
-        for (; j > 0; --j){
-          if (!IS_SD_INSERTED) return;
-          
-          #ifdef SORTING_DUMP
-          for (uint16_t z = 0; z < fileCnt; z++){
-            printf_P(PSTR("%2u "), sort_entries[z]);
-          }
-          MYSERIAL.println();
-          #endif
-          
-          manage_heater();
-          const uint16_t o2 = sort_entries[j - 1];
-
-          getfilename_simple(o2);
-          char *name2 = LONGEST_FILENAME; // use the string in-place
-
-          // Sort the current pair according to settings.
-          if (
-          #if HAS_FOLDER_SORTING
-            (sdSort == SD_SORT_TIME && _SORT_CMP_TIME_DIR(FOLDER_SORTING)) || (sdSort == SD_SORT_ALPHA && !_SORT_CMP_DIR(FOLDER_SORTING))
-          #else
-            (sdSort == SD_SORT_TIME && _SORT_CMP_TIME_NODIR()) || (sdSort == SD_SORT_ALPHA && !_SORT_CMP_NODIR())
-          #endif
-            )
-          {
-            break;
-          } else {
-            #ifdef SORTING_DUMP
-            puts_P(PSTR("shift"));
-            #endif            
-            sort_entries[j] = o2;
-          }
-        }
-        /// place the position
-        sort_entries[j] = o1;
-      }
+/**
+* Open the SDSORT.IDX of the current directory if it holds its sorted order
+*
+* FAT doesn't update the modification time of a directory. The index is checked against the first
+* cluster of the directory, the count of its entries and the hash of its first block instead,
+* which takes a few block reads besides the lookup of the file. Items deleted further in the
+* directory are found by presort_file_get() when they are listed.
+*/
+bool CardReader::presort_file_open() {
+	SortIndexHeader header;
+	if (sort_file.open(&workDir, SORT_INDEX_NAME, O_READ)
+		&& sort_file.read(&header, sizeof(header)) == sizeof(header)
+		&& header.magic == SORT_INDEX_MAGIC
+		&& header.cluster == workDir.firstCluster()
+		&& header.mode == sort_mode
+		&& sort_file.fileSize() == sizeof(header) + 2ul * header.count
+		&& header.end && presort_dir_end(header.end - 1) == header.end
+		&& header.check == presort_dir_check()) {
+		sort_count = header.count;
+		sort_filed = true;
+		return true;
+	}
+	sort_file.close();
+	return false;
+}
 
-#else //Bubble Sort
+/**
+* Start a new SDSORT.IDX in the current directory
+*
+* @param from directory entry where the count of the entries continues, it takes the entry of the
+* created file into account
+*/
+void CardReader::presort_file_create(uint16_t from) {
+	const SortIndexHeader header = {};
+	if (!sort_file.open(&workDir, SORT_INDEX_NAME, O_RDWR | O_CREAT | O_TRUNC)
+		|| sort_file.write(&header, sizeof(header)) != sizeof(header)) {
+		presort_file_drop();
+		return;
+	}
+	sort_end = presort_dir_end(from);
+}
 
-#define _SORT_CMP_NODIR() (strcasecmp(name1, name2) < 0) //true if lowercase(name1) < lowercase(name2)
-#define _SORT_CMP_TIME_NODIR() (((crmod_date_bckp == crmodDate) && (crmod_time_bckp > crmodTime)) || (crmod_date_bckp > crmodDate))
+//! Complete the header of SDSORT.IDX once all the items were appended
+bool CardReader::presort_file_finish() {
+	SortIndexHeader header;
+	header.magic = SORT_INDEX_MAGIC;
+	header.cluster = workDir.firstCluster();
+	header.check = presort_dir_check();
+	header.end = sort_end;
+	header.count = sort_done;
+	header.mode = sort_mode;
+	return sort_file.seekSet(0)
+		&& sort_file.write(&header, sizeof(header)) == sizeof(header)
+		&& sort_file.close();
+}
 
-#if HAS_FOLDER_SORTING
-#define _SORT_CMP_DIR(fs) ((dir1 == filenameIsDir) ? _SORT_CMP_NODIR() : (fs < 0 ? dir1 : !dir1))
-#define _SORT_CMP_TIME_DIR(fs) ((dir1 == filenameIsDir) ? _SORT_CMP_TIME_NODIR() : (fs < 0 ? dir1 : !dir1))
-#endif
+/**
+* Read the i-th item of the index
+*
+* @return false if the directory entry doesn't hold an item anymore
+*/
+bool CardReader::presort_file_get(uint16_t i) {
+	uint16_t entry;
+	dir_t p;
+	if (!sort_file.seekSet(sizeof(SortIndexHeader) + 2ul * i)
+		|| sort_file.read(&entry, sizeof(entry)) != sizeof(entry)
+		|| !workDir.seekSet((uint32_t)entry << 5)
+		|| workDir.read(&p, sizeof(p)) != sizeof(p)
+		|| p.name[0] == DIR_NAME_FREE || p.name[0] == DIR_NAME_DELETED)
+		return false;
+	getfilename_simple(entry);
+	return true;
+}
 
-			uint16_t counter = 0;
-			menu_progressbar_init(0.5*(fileCnt - 1)*(fileCnt), _i("Sorting files"));
-
-			for (uint16_t i = fileCnt; --i;) {
-				if (!IS_SD_INSERTED) return;
-				bool didSwap = false;
-
-				menu_progressbar_update(counter);
-				counter++;
-
-				for (uint16_t j = 0; j < i; ++j) {
-					if (!IS_SD_INSERTED) return;
-					#ifdef SORTING_DUMP
-					for (uint16_t z = 0; z < fileCnt; z++)
-					{
-						printf_P(PSTR("%2u "), sort_entries[z]);
-					}
-					MYSERIAL.println();
-					#endif
-					manage_heater();
-					const uint16_t o1 = sort_entries[j], o2 = sort_entries[j + 1];
-
-					counter++;
-					getfilename_simple(o1);
-					strcpy(name1, LONGEST_FILENAME); // save (or getfilename below will trounce it)
-					crmod_date_bckp = crmodDate;
-					crmod_time_bckp = crmodTime;
-					#if HAS_FOLDER_SORTING
-					bool dir1 = filenameIsDir;
-					#endif
-					getfilename_simple(o2);
-					char *name2 = LONGEST_FILENAME; // use the string in-place
-
-													// Sort the current pair according to settings.
-					if (
-					#if HAS_FOLDER_SORTING
-						(sdSort == SD_SORT_TIME && _SORT_CMP_TIME_DIR(FOLDER_SORTING)) || (sdSort == SD_SORT_ALPHA && !_SORT_CMP_DIR(FOLDER_SORTING))
-					#else
-						(sdSort == SD_SORT_TIME && _SORT_CMP_TIME_NODIR()) || (sdSort == SD_SORT_ALPHA && !_SORT_CMP_NODIR())
-					#endif
-						)
-					{
-						#ifdef SORTING_DUMP
-						puts_P(PSTR("swap"));
-						#endif
-						
-						sort_entries[j] = o2;
-						sort_entries[j + 1] = o1;
-						didSwap = true;
-					}
-				}
-				if (!didSwap) break;
-			} //end of bubble sort loop
-#endif
-			
-#ifdef SORTING_SPEEDTEST
-			printf_P(PSTR("sortingSpeedtestTimer:%lu\n"), sortingSpeedtestTimer.elapsed());
-#endif //SORTING_SPEEDTEST
-			
-			#ifdef SORTING_DUMP
-			for (uint16_t z = 0; z < fileCnt; z++)
-				printf_P(PSTR("%2u "), sort_entries[z]);
-			SERIAL_PROTOCOLLN();
-			#endif
-
-			menu_progressbar_finish();
+//! Remove the SDSORT.IDX of the current directory, it's stale or it can't be written
+void CardReader::presort_file_drop() {
+	sort_file.close();
+	sort_filed = false;
+	SdFile::remove(&workDir, SORT_INDEX_NAME);
+	SERIAL_ECHO_START;
+	SERIAL_ECHOLNPGM("Sort index dropped");
+}
+
+#endif //SDSORT_INDEX_FILE
+
+#else
+
+/**
+* Count the items of the current directory
+*
+* The sorted order is selected a page at a time by getfilename_sorted().
+*/
+void CardReader::presort() {
+	// Throw away old sort index
+	flush_presort();
+
+	if (farm_mode || IS_SD_INSERTED == false) return; //sorting is not used in farm mode
+	sort_mode = eeprom_read_byte((uint8_t*)EEPROM_SD_SORT);
+	if (sort_mode == SD_SORT_NONE) return;
+
+	sort_total = sort_count = getnrfilenames();
+}
+
+#endif //SDSORT_INDEX
+
+/**
+* Select the page holding the i-th sorted item
+*
+* The page is reached by passes following the current page or from either end of the sorted
+* order, whichever takes less of them. Scrolling the menu across a page boundary takes a single
+* pass over the directory. The adjacent pages overlap by SORT_PAGE_OVERLAP items, so the rows
+* of the menu are always shown from a single page.
+*
+* The passes block the menu, their progress is shown and the menu is redrawn after them.
+*
+* @return false if the item can't be selected
+*/
+bool CardReader::presort_seek(uint16_t i) {
+	KEEPALIVE_STATE(IN_HANDLER);
+	const uint16_t step = SDSORT_LIMIT - SORT_PAGE_OVERLAP;
+	const uint16_t fromStart = i / step, fromEnd = (sort_count - 1 - i) / step;
+	sort_reverse = fromEnd < fromStart;
+	uint16_t passes = sort_reverse ? fromEnd : fromStart;
+	if (sort_fill && i >= sort_page + sort_fill && (i - sort_page - sort_fill) / step <= passes) {
+		sort_reverse = false;
+		passes = (i - sort_page - sort_fill) / step;
+	}
+	else if (sort_fill && i < sort_page && (sort_page - 1 - i) / step <= passes) {
+		sort_reverse = true;
+		passes = (sort_page - 1 - i) / step;
+	}
+	else {
+		// start over from the end
+		sort_fill = 0;
+		sort_page = sort_reverse ? sort_count : 0;
+	}
+
+	menu_progressbar_init((passes + 1) * SORT_PROGRESS_PASS, _i("Sorting files"));////MSG_SORTING_FILES c=20
+	sort_progress = 0;
+	sort_pass = 0;
+	while ((uint16_t)(i - sort_page) >= sort_fill) {
+		sort_bounded = sort_fill;
+		if (sort_bounded) {
+			const uint16_t overlap = (sort_fill > SORT_PAGE_OVERLAP) ? SORT_PAGE_OVERLAP : sort_fill - 1;
+			if (sort_reverse) {
+				sort_bound = sort_entries[overlap];
+				sort_page += overlap;
+			}
+			else {
+				sort_bound = sort_entries[sort_fill - 1 - overlap];
+				sort_page += sort_fill - overlap;
+			}
+			sort_fill = 0;
 		}
+		if (!presort_select(0) || !sort_fill) {
+			// the card was removed or the directory changed
+			flush_presort();
+			break;
+		}
+		if (sort_reverse)
+			sort_page -= sort_fill;
+		sort_progress += SORT_PROGRESS_PASS;
 	}
+	sort_progress = SORT_NO_PROGRESS;
+	lcd_draw_update = 2;
 
 	KEEPALIVE_STATE(NOT_BUSY);
+	return sort_fill;
 }
 
 void CardReader::flush_presort() {
+#ifdef SD_NAME_CACHE
+	name_cache_flush();
+#endif //SD_NAME_CACHE
 	sort_count = 0;
-	lastSortedFilePosition = 0;
+	sort_fill = 0;
+	sort_pass = 0;
+	sort_reverse = false;
+	sort_page = 0;
+	sort_progress = SORT_NO_PROGRESS;
+#ifdef SDSORT_INDEX
+	sort_building = false;
+	sort_indexed = false;
+	sort_done = 0;
+	sort_bounded = false;
+#ifdef SDSORT_INDEX_FILE
+	sort_file.close();
+	sort_filed = false;
+#endif //SDSORT_INDEX_FILE
+#endif //SDSORT_INDEX
 }
 
 #endif // SDCARD_SORT_ALPHA
@@ -1032,9 +1543,92 @@ void CardReader::printingHasFinished()
     }
 }
 
+#ifdef SD_BINARY_GCODE
+//! Recognizes the binary G-code container by its header. The print still starts at position 0,
+//! readBinaryRecord() skips the header and the layer index.
+void CardReader::binaryOpen()
+{
+    GcodeBinaryHeader header;
+    binary = file.read(&header, sizeof(header)) == (int16_t)sizeof(header)
+        && !memcmp(header.magic, GCODE_BINARY_MAGIC, sizeof(header.magic))
+        && header.version == GCODE_BINARY_VERSION;
+    if (binary)
+    {
+        binary_index = header.index;
+        binary_data = header.data;
+        binary_layers = header.layers;
+        binary_position.invalidate();
+        file.seekSet(0);
+        SERIAL_ECHO_START;
+        SERIAL_ECHOPGM("Binary G-code, layers: ");
+        SERIAL_ECHO(binary_layers);
+        SERIAL_ECHOPGM(", print time: ");
+        SERIAL_ECHOLN(header.print_time);
+    }
+    else
+        file.seekSetFilteredGcode(0);
+}
+
+//! @brief Read the next record of a binary G-code file
+//! @param payload receives the payload of the record, MAX_CMD_SIZE bytes, the text of a command
+//!  is terminated
+//! @return tag of the record, -1 if the file is damaged
+int16_t CardReader::readBinaryRecord(uint8_t *payload)
+{
+    uint8_t tag, n = 0;
+    if (sdpos < binary_data)
+    {
+        sdpos = binary_data;
+        if (!file.seekSet(sdpos))
+            goto fail;
+    }
+    if (file.read(&tag, 1) != 1)
+        goto fail;
+    if (tag == GB_COMMAND)
+    {
+        if (file.read(&n, 1) != 1 || n >= MAX_CMD_SIZE)
+            goto fail;
+        payload[n] = 0;
+        // the command may move the printer
+        binary_position.invalidate();
+    }
+    else if (tag & GB_COMMAND)
+    {
+        if (tag != GB_LAYER)
+            goto fail;
+    }
+    else
+        n = gcode_binary_move_size(tag);
+    if (file.read(payload, n) != n)
+        goto fail;
+    sdpos = file.curPosition();
+    return tag;
+
+fail:
+    SERIAL_ERROR_START;
+    SERIAL_ERRORLNPGM("Invalid binary G-code");
+    sdpos = filesize;
+    return -1;
+}
+
+//! @brief Position of a layer of a binary G-code file, for M26 L
+//! @return false if the file isn't binary or doesn't have the layer
+bool CardReader::binaryLayerPosition(uint16_t layer, uint32_t *pos)
+{
+    bool ok = binary && layer < binary_layers && file.seekSet(binary_index + 4ul * layer)
+        && file.read(pos, 4) == 4;
+    file.seekSet(sdpos);
+    return ok;
+}
+#endif //SD_BINARY_GCODE
+
 bool CardReader::ToshibaFlashAir_GetIP(uint8_t *ip)
 {
     memset(ip, 0, 4);
+#ifdef SD_MULTIBLOCK
+    if (!volume.cardIdle())
+        return false;
+#endif //SD_MULTIBLOCK
     return card.readExtMemory(1, 1, 0x400+0x150, 4, ip);
 }
 
@@ -6,8 +6,12 @@
 #ifdef SDSUPPORT
 
 #define MAX_DIR_DEPTH 6
+#define SDSORT_PREFIX 16 // Length of the common prefix of the names of the sorted page
 
 #include "SdFile.h"
+#ifdef SD_BINARY_GCODE
+#include "gcode_binary.h"
+#endif //SD_BINARY_GCODE
 class CardReader
 {
 public:
@@ -35,6 +39,11 @@ public:
 
   void checkautostart(bool x); 
   void openFileWrite(const char* name);
+#ifdef SD_MULTIBLOCK_WRITE
+  //! Reserves contiguous clusters for the announced size of the file being saved, the file is
+  //! written in the usual way if it fails.
+  bool reserveFileWrite(uint32_t size) { return saving && file.reserve(size); }
+#endif //SD_MULTIBLOCK_WRITE
   void openFileReadFilteredGcode(const char* name, bool replace_current = false);
   void openLogFile(const char* name);
   void removeFile(const char* name);
@@ -64,7 +73,11 @@ public:
   #ifdef SDCARD_SORT_ALPHA
      void presort();
      void getfilename_sorted(const uint16_t nr, uint8_t sdSort);
-     void getfilename_afterMaxSorting(uint16_t entry, const char * const match = NULL);
+  #ifdef SDSORT_INDEX
+     void presort_step();
+     //! the sort index of the current directory is being built, the listing isn't sorted yet
+     bool presort_busy() const { return sort_building; }
+  #endif //SDSORT_INDEX
   #endif
 
   FORCE_INLINE bool isFileOpen() { return file.isOpen(); }
@@ -75,7 +88,20 @@ public:
       sdpos = file.curPosition();
       return c;
   };
+#ifdef SD_BINARY_GCODE
+  void setIndex(long index) {
+    sdpos = index;
+    if (binary) {
+      file.seekSet(index);
+      binary_position.invalidate();
+    } else
+      file.seekSetFilteredGcode(index);
+  };
+  int16_t readBinaryRecord(uint8_t *payload);
+  bool binaryLayerPosition(uint16_t layer, uint32_t *pos);
+#else //SD_BINARY_GCODE
   void setIndex(long index) {sdpos = index;file.seekSetFilteredGcode(index);};
+#endif //SD_BINARY_GCODE
   FORCE_INLINE uint8_t percentDone(){if(!isFileOpen()) return 0; if(filesize) return sdpos/((filesize+99)/100); else return 0;};
   FORCE_INLINE char* getWorkDirName(){workDir.getFilename(filename);return filename;};
   FORCE_INLINE uint32_t get_sdpos() { if (!isFileOpen()) return 0; else return(sdpos); };
@@ -83,6 +109,10 @@ public:
   bool ToshibaFlashAir_isEnabled() const { return card.getFlashAirCompatible(); }
   void ToshibaFlashAir_enable(bool enable) { card.setFlashAirCompatible(enable); }
   bool ToshibaFlashAir_GetIP(uint8_t *ip);
+#ifdef SD_FAT_CACHE
+  uint32_t fatCacheHits() const { return volume.fatCacheHits(); }
+  uint32_t fatCacheMisses() const { return volume.fatCacheMisses(); }
+#endif //SD_FAT_CACHE
 
 public:
   bool saving;
@@ -101,16 +131,106 @@ public:
   bool presort_flag;
 #endif // SDCARD_SORT_ALPHA
   char dir_names[MAX_DIR_DEPTH][9];
+#ifdef SD_BINARY_GCODE
+  bool binary; //!< the selected file is a binary G-code container, read by readBinaryRecord()
+  GcodeBinaryPosition binary_position;
+#endif //SD_BINARY_GCODE
 private:
   SdFile root,*curDir,workDir,workDirParents[MAX_DIR_DEPTH];
   uint8_t workDirDepth;
 
   // Sort files and folders alphabetically.
 #ifdef SDCARD_SORT_ALPHA
+  //! sort key of a directory entry
+  struct SortKey
+  {
+    uint16_t entry;
+    uint16_t date, time;
+    bool dir;
+    char name[LONG_FILENAME_LENGTH];
+  };
   uint16_t sort_count;        // Count of sorted items in the current directory
-  uint16_t sort_entries[SDSORT_LIMIT];
-  uint16_t lastSortedFilePosition;
+  uint16_t sort_entries[SDSORT_LIMIT]; // Page of the sorted items
+  uint32_t sort_keys[SDSORT_LIMIT]; // Summaries of their sort keys, see presort_summary()
+  uint16_t sort_lead;         // Count of the items of the page in the group selected first
+  uint8_t sort_skip;          // Length of the common prefix of the names of the page
+  char sort_prefix[SDSORT_PREFIX]; // The prefix, case folded
+  uint16_t sort_progress;     // Progress bar at the start of the pass
+  uint8_t sort_mode;
+  uint16_t sort_total;        // Count of items visited by a pass
+  uint16_t sort_fill;         // Count of items in the page
+  uint16_t sort_pass;         // Count of items visited by the current pass
+  uint16_t sort_bound;        // Item preceding the page, following it in the reverse pass
+  bool sort_bounded;          // The page doesn't start at the first (last) item
+  bool sort_reverse;
+  uint32_t sort_pos;          // Directory position of the last visited item
+#ifdef SDSORT_INDEX
+  //! sorted order of a visited directory
+  struct SortIndexDir
+  {
+    uint32_t cluster;         //!< first cluster of the directory
+    uint16_t start;           //!< first item in sort_index
+    uint16_t count;
+    uint8_t mode;
+  };
+  uint16_t sort_index[SDSORT_INDEX_SIZE]; // Sorted items of the indexed directories, back to back
+  SortIndexDir sort_dirs[SDSORT_INDEX_DIRS]; // Indexed directories, the oldest first
+  uint8_t sort_dir_count;
+  uint16_t sort_start;        // First item of the current directory in sort_index
+  bool sort_building;
+  bool sort_indexed;          // The current directory is sorted in sort_index
+  uint16_t sort_done;         // Count of items added to the index
+#ifdef SDSORT_INDEX_FILE
+  SdFile sort_file;           // SDSORT.IDX of the current directory
+  bool sort_filed;            // The current directory is sorted in sort_file
+  bool sort_in_ram;           // The order being built is also added to sort_index
+  uint16_t sort_end;          // Count of the directory entries up to the first free one
+#endif //SDSORT_INDEX_FILE
+#endif //SDSORT_INDEX
+  uint16_t sort_page;         // Sorted position of the first item of the page
+
+  void presort_load(uint16_t entry, SortKey &key);
+  int8_t presort_compare(const SortKey &key);
+  uint8_t presort_rank(bool dir);
+  uint32_t presort_summary(const char *name, uint16_t date, uint16_t time);
+  void presort_prefix(const SortKey &key);
+  int8_t presort_compare_page(const SortKey &key, uint32_t summary, uint16_t j);
+  bool presort_select(uint16_t budget);
+  bool presort_seek(uint16_t i);
+#ifdef SDSORT_INDEX
+  void presort_invalidate();
+#ifdef SDSORT_INDEX_FILE
+  uint16_t presort_dir_end(uint16_t from);
+  uint32_t presort_dir_check();
+  bool presort_file_open();
+  void presort_file_create(uint16_t from);
+  bool presort_file_finish();
+  bool presort_file_get(uint16_t i);
+  void presort_file_drop();
+#endif //SDSORT_INDEX_FILE
+#endif //SDSORT_INDEX
+
+#ifdef SD_NAME_CACHE
+  //! listed item
+  struct NameCacheEntry
+  {
+    uint16_t nr;
+    uint16_t date, time;
+    uint32_t position;
+    bool dir;
+    char filename[13];
+    char longFilename[LONG_FILENAME_LENGTH];
+  };
+  NameCacheEntry name_cache[SD_NAME_CACHE_SIZE];
+  uint8_t name_cache_order[SD_NAME_CACHE_SIZE]; // Slots in use, most recently used first
+  uint8_t name_cache_count;
+  uint8_t name_cache_sort;    // Sort order of the cached items
+  uint32_t name_cache_dir;    // First cluster of their directory
 
+  bool name_cache_get(uint16_t nr, uint8_t sdSort);
+  void name_cache_put(uint16_t nr, uint8_t sdSort);
+  void name_cache_flush() { name_cache_count = 0; }
+#endif //SD_NAME_CACHE
 #endif // SDCARD_SORT_ALPHA
 
 #ifdef DEBUG_SD_SPEED_TEST
@@ -138,6 +258,12 @@ private:
 #ifdef SDCARD_SORT_ALPHA
   void flush_presort();
 #endif
+#ifdef SD_BINARY_GCODE
+  uint32_t binary_index;  // file offset of the layer index
+  uint32_t binary_data;   // file offset of the first record
+  uint16_t binary_layers;
+  void binaryOpen();
+#endif //SD_BINARY_GCODE
 };
 extern bool Stopped;
 extern CardReader card;
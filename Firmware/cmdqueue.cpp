@@ -1,6 +1,7 @@
 #include "cmdqueue.h"
 #include "cardreader.h"
 #include "ultralcd.h"
+#include "planner.h"
 
 // Reserve BUFSIZE lines of length MAX_CMD_SIZE plus CMDBUFFER_RESERVE_FRONT.
 char cmdbuffer[BUFSIZE * (MAX_CMD_SIZE + 1) + CMDBUFFER_RESERVE_FRONT];
@@ -31,6 +32,11 @@ long gcode_LastN = 0;
 
 uint32_t sdpos_atomic = 0;
 
+#ifdef SD_CHECKPOINTS
+// Length of the SD commands in the queue, updated together with the queue instead of walking it.
+static uint16_t cmdqueue_sd_length = 0;
+#endif //SD_CHECKPOINTS
+
 
 // Pop the currently processed command from the queue.
 // It is expected, that there is at least one command in the queue.
@@ -53,6 +59,16 @@ bool cmdqueue_pop_front()
         SERIAL_ECHO(sizeof(cmdbuffer));
         SERIAL_ECHOLNPGM("");
 #endif /* CMDBUFFER_DEBUG */
+#ifdef SD_CHECKPOINTS
+        if (cmdbuffer[bufindr] == CMDBUFFER_CURRENT_TYPE_SDCARD) {
+            // The command leaves the queue without passing its length to the planner.
+            uint16_t sdlen;
+            memcpy(&sdlen, cmdbuffer + bufindr + 1, sizeof(sdlen));
+            CRITICAL_SECTION_START;
+            cmdqueue_sd_length -= sdlen;
+            CRITICAL_SECTION_END;
+        }
+#endif //SD_CHECKPOINTS
         if (-- buflen == 0) {
             // Empty buffer.
             if (serial_count == 0)
@@ -89,6 +105,52 @@ bool cmdqueue_pop_front()
     return false;
 }
 
+// Pass the SD card length of the command processed by the main loop to the planner queue,
+// before the command is released by cmdqueue_pop_front().
+void cmdqueue_pass_sd_length()
+{
+    // ptr points to the start of the block currently being processed.
+    // The first character in the block is the block type.
+    char *ptr = cmdbuffer + bufindr;
+    if (*ptr == CMDBUFFER_CURRENT_TYPE_SDCARD) {
+        // To support power panic, move the lenght of the command on the SD card to a planner buffer.
+        union {
+            struct {
+                char lo;
+                char hi;
+            } lohi;
+            uint16_t value;
+        } sdlen;
+        sdlen.value = 0;
+        {
+            // This block locks the interrupts globally for 3.25 us,
+            // which corresponds to a maximum repeat frequency of 307.69 kHz.
+            // This blocking is safe in the context of a 10kHz stepper driver interrupt
+            // or a 115200 Bd serial line receive interrupt, which will not trigger faster than 12kHz.
+            cli();
+            // Reset the command to something, which will be ignored by the power panic routine,
+            // so this buffer length will not be counted twice.
+            *ptr ++ = CMDBUFFER_CURRENT_TYPE_TO_BE_REMOVED;
+            // Extract the current buffer length.
+            sdlen.lohi.lo = *ptr ++;
+            sdlen.lohi.hi = *ptr;
+            // and pass it to the planner queue.
+            planner_add_sd_length(sdlen.value);
+#ifdef SD_CHECKPOINTS
+            cmdqueue_sd_length -= sdlen.value;
+#endif //SD_CHECKPOINTS
+            sei();
+        }
+    }
+    else if((*ptr == CMDBUFFER_CURRENT_TYPE_USB_WITH_LINENR) && !IS_SD_PRINTING){
+        cli();
+        *ptr ++ = CMDBUFFER_CURRENT_TYPE_TO_BE_REMOVED;
+        // and one for each command to previous block in the planner queue.
+        planner_add_sd_length(1);
+        sei();
+    }
+}
+
 void cmdqueue_reset()
 {
 	while (buflen)
@@ -377,6 +439,45 @@ void proc_commands() {
 	}
 }
 
+#ifdef SDSUPPORT
+//! The whole file has been read.
+static void get_command_sd_eof()
+{
+    // file was fully buffered, but commands might still need to be planned!
+    // do *not* clear sdprinting until all SD commands are consumed to ensure
+    // SD state can be resumed from a saved printing state. sdprinting is only
+    // cleared by printingHasFinished after peforming all remaining moves.
+    if(!cmdqueue_calc_sd_length())
+    {
+        // queue is complete, but before we process EOF commands prevent
+        // re-entry by disabling SD processing from any st_synchronize call
+        card.closefile();
+
+        SERIAL_PROTOCOLLNRPGM(_n("Done printing file"));////MSG_FILE_PRINTED
+        stoptime=_millis();
+        char time[30];
+        unsigned long t=(stoptime-starttime-pause_time)/1000;
+        pause_time = 0;
+        int hours, minutes;
+        minutes=(t/60)%60;
+        hours=t/60/60;
+        save_statistics(total_filament_used, t);
+        sprintf_P(time, PSTR("%i hours %i minutes"),hours, minutes);
+        SERIAL_ECHO_START;
+        SERIAL_ECHOLN(time);
+        lcd_setstatus(time);
+        card.printingHasFinished();
+        card.checkautostart(true);
+
+        if (farm_mode)
+        {
+            prusa_statistics(6);
+            lcd_commands_type = LcdCommands::FarmModeConfirm;
+        }
+    }
+}
+#endif //SDSUPPORT
+
 void get_command()
 {
     // Test and reserve space for the new command string.
@@ -549,6 +650,11 @@ void get_command()
     // continuing with the serial line.
      return;
   }
+#ifdef SD_BINARY_GCODE
+  // The records of a binary file are read by get_binary_command() from the main loop only.
+  if (card.binary)
+     return;
+#endif //SD_BINARY_GCODE
 
   //'#' stops reading from SD to the buffer prematurely, so procedural macro calls are possible
   // if it occurs, stop_buffering is triggered and the buffer is ran dry.
@@ -604,6 +710,9 @@ void get_command()
 //      MYSERIAL.print(cmdbuffer);
 //      SERIAL_ECHOPGM("buflen:");
 //      MYSERIAL.print(buflen+1);
+#ifdef SD_CHECKPOINTS
+      uint16_t sdlen = sd_count.value;
+#endif //SD_CHECKPOINTS
       sd_count.value = 0;
 
       cli();
@@ -614,6 +723,9 @@ void get_command()
       ++ buflen;
       bufindw += len;
       sdpos_atomic = card.get_sdpos();
+#ifdef SD_CHECKPOINTS
+      cmdqueue_sd_length += sdlen;
+#endif //SD_CHECKPOINTS
       if (bufindw == sizeof(cmdbuffer))
           bufindw = 0;
       sei();
@@ -634,46 +746,64 @@ void get_command()
     }
   }
   if(card.eof())
-  {
-      // file was fully buffered, but commands might still need to be planned!
-      // do *not* clear sdprinting until all SD commands are consumed to ensure
-      // SD state can be resumed from a saved printing state. sdprinting is only
-      // cleared by printingHasFinished after peforming all remaining moves.
-      if(!cmdqueue_calc_sd_length())
-      {
-          // queue is complete, but before we process EOF commands prevent
-          // re-entry by disabling SD processing from any st_synchronize call
-          card.closefile();
-
-          SERIAL_PROTOCOLLNRPGM(_n("Done printing file"));////MSG_FILE_PRINTED
-          stoptime=_millis();
-          char time[30];
-          unsigned long t=(stoptime-starttime-pause_time)/1000;
-          pause_time = 0;
-          int hours, minutes;
-          minutes=(t/60)%60;
-          hours=t/60/60;
-          save_statistics(total_filament_used, t);
-          sprintf_P(time, PSTR("%i hours %i minutes"),hours, minutes);
-          SERIAL_ECHO_START;
-          SERIAL_ECHOLN(time);
-          lcd_setstatus(time);
-          card.printingHasFinished();
-          card.checkautostart(true);
-
-          if (farm_mode)
-          {
-              prusa_statistics(6);
-              lcd_commands_type = LcdCommands::FarmModeConfirm;
-          }
-      }
-  }
+      get_command_sd_eof();
 
   #endif //SDSUPPORT
 }
 
+#ifdef SD_BINARY_GCODE
+// Reads the records of a binary G-code file. The moves skip the command queue and go to the planner
+// directly, once the commands read before them are done. This is called from the main loop only,
+// a wait for the planner (st_synchronize) would never end if it was fed from manage_inactivity().
+void get_binary_command()
+{
+  if(!card.sdprinting || !card.isFileOpen() || !card.binary || serial_count!=0)
+    return;
+  if (! cmdqueue_could_enqueue_back(MAX_CMD_SIZE - 1, true))
+    return;
+  uint8_t payload[MAX_CMD_SIZE];
+  while (buflen == 0 && !card.eof() && moves_planned() < BLOCK_BUFFER_SIZE - 1) {
+    int16_t tag = card.readBinaryRecord(payload);
+    if (tag < 0)
+      break;
+    if (tag == GB_LAYER)
+      continue; // its length goes to the following record
+    // The length of the record, including the preceding layer records, is accounted for
+    // the power panic like the length of a command.
+    uint16_t sdlen = card.get_sdpos() - sdpos_atomic;
+    if (tag == GB_COMMAND) {
+      cmdbuffer[bufindw] = CMDBUFFER_CURRENT_TYPE_SDCARD;
+      memcpy(cmdbuffer + bufindw + 1, &sdlen, sizeof(sdlen));
+      strcpy(cmdbuffer + bufindw + CMDHDRSIZE, (const char*)payload);
+      uint8_t len = strlen(cmdbuffer + bufindw + CMDHDRSIZE) + (1 + CMDHDRSIZE);
+      cli();
+      ++ buflen;
+      bufindw += len;
+      sdpos_atomic = card.get_sdpos();
+#ifdef SD_CHECKPOINTS
+      cmdqueue_sd_length += sdlen;
+#endif //SD_CHECKPOINTS
+      if (bufindw == sizeof(cmdbuffer))
+          bufindw = 0;
+      sei();
+      break;
+    }
+    gcode_binary_move(tag, payload);
+    cli();
+    planner_add_sd_length(sdlen);
+    sdpos_atomic = card.get_sdpos();
+    sei();
+  }
+  if(card.eof())
+      get_command_sd_eof();
+}
+#endif //SD_BINARY_GCODE
+
 uint16_t cmdqueue_calc_sd_length()
 {
+#ifdef SD_CHECKPOINTS
+    return cmdqueue_sd_length;
+#else //SD_CHECKPOINTS
     if (buflen == 0)
         return 0;
     union {
@@ -703,4 +833,5 @@ uint16_t cmdqueue_calc_sd_length()
         }
     }
     return sdlen;
+#endif //SD_CHECKPOINTS
 }
@@ -56,6 +56,7 @@ extern long gcode_N;
 extern long gcode_LastN;
 
 extern bool cmdqueue_pop_front();
+extern void cmdqueue_pass_sd_length();
 extern void cmdqueue_reset();
 #ifdef CMDBUFFER_DEBUG
 extern void cmdqueue_dump_to_serial_single_line(int nr, const char *p);
@@ -66,6 +67,9 @@ extern void enquecommand(const char *cmd, bool from_progmem = false);
 extern void enquecommand_front(const char *cmd, bool from_progmem = false);
 extern void repeatcommand_front();
 extern void get_command();
+#ifdef SD_BINARY_GCODE
+extern void get_binary_command();
+#endif //SD_BINARY_GCODE
 extern uint16_t cmdqueue_calc_sd_length();
 
 // Return True if a character was found
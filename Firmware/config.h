@@ -23,6 +23,24 @@
 #define ADC_OVRSAMPL      16        //oversampling multiplier
 #define ADC_CALLBACK      adc_callback //callback function ()
 
+//per-channel oversampling and filtering (values passed to ADC_CALLBACK are always scaled to ADC_OVRSAMPL)
+//#define ADC_CHAN_CFG
+#ifdef ADC_CHAN_CFG
+//log2 of the sample count per cycle, for each used channel in ADC_CHAN_MSK order (0..6 ~ 1..64 samples)
+//filter applied to the decimated value of each cycle (ADC_FILTER_NONE/IIR/MED3, see adc.h)
+//filters add latency to the min/max temperature checks, keep the hotend unfiltered
+#ifndef IR_SENSOR_ANALOG
+//           HEATER0 HEATER1 BED  PINDA VOLT_PWR AMBIENT VOLT_BED
+#define ADC_CHAN_OVRSAMPL_LOG2 { 4, 4, 5, 6, 2, 5, 2 }
+#define ADC_CHAN_FILTER { ADC_FILTER_NONE, ADC_FILTER_NONE, ADC_FILTER_IIR, ADC_FILTER_MED3, ADC_FILTER_NONE, ADC_FILTER_IIR, ADC_FILTER_NONE }
+#else //!IR_SENSOR_ANALOG
+//           HEATER0 HEATER1 BED  PINDA VOLT_PWR AMBIENT VOLT_IR VOLT_BED
+#define ADC_CHAN_OVRSAMPL_LOG2 { 4, 4, 5, 6, 2, 5, 2, 2 }
+#define ADC_CHAN_FILTER { ADC_FILTER_NONE, ADC_FILTER_NONE, ADC_FILTER_IIR, ADC_FILTER_MED3, ADC_FILTER_NONE, ADC_FILTER_IIR, ADC_FILTER_NONE, ADC_FILTER_NONE }
+#endif //!IR_SENSOR_ANALOG
+#define ADC_IIR_SHIFT     2         //IIR filter factor 1/(2^ADC_IIR_SHIFT)
+#endif //ADC_CHAN_CFG
+
 //SWI2C configuration
 //#define SWI2C_SDA         20 //SDA on P3
 //#define SWI2C_SCL         21 //SCL on P3
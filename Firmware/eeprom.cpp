@@ -98,6 +98,14 @@ void eeprom_init()
 if (eeprom_read_byte((uint8_t*)EEPROM_PINDA_TEMP_COMPENSATION) == 0xff) eeprom_update_byte((uint8_t *)EEPROM_PINDA_TEMP_COMPENSATION, 0);
 #endif //PINDA_TEMP_COMP
 
+    // the stored meshes may be left over by another firmware after an upgrade
+    if (eeprom_read_byte((uint8_t*)EEPROM_MBL_STORED_INIT) != EEPROM_MBL_STORED_INIT_MAGIC)
+    {
+        for (uint_least8_t i = 0; i < MAX_SHEETS; ++i)
+            eeprom_update_byte((uint8_t*)EEPROM_MBL_STORED_MESH + (i + 1) * EEPROM_MBL_STORED_SIZEOF - 1, EEPROM_EMPTY_VALUE);
+        eeprom_update_byte((uint8_t*)EEPROM_MBL_STORED_INIT, EEPROM_MBL_STORED_INIT_MAGIC);
+    }
+
 	if (eeprom_read_dword((uint32_t*)EEPROM_JOB_ID) == EEPROM_EMPTY_VALUE32)
 		eeprom_update_dword((uint32_t*)EEPROM_JOB_ID, 0);
 
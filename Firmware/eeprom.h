@@ -333,6 +333,10 @@ static_assert(sizeof(Sheets) == EEPROM_SHEETS_SIZEOF, "Sizeof(Sheets) is not EEP
 | ^					| ^			| ^										| 03h 3			| ^						| bad_isr											| ^				| ^
 | ^					| ^			| ^										| 04h 4			| ^						| bad_pullup_temp_isr								| ^				| ^
 | ^					| ^			| ^										| 05h 5			| ^						| bad_pullup_step_isr								| ^				| ^
+| 0x0995 2453		| uint8		| EEPROM_MBL_STORED_INIT				| a5h 165		| ffh 255				| Stored meshes initialized, the slots are invalidated otherwise | eeprom_init | D3 Ax0995 C1
+| 0x0996 2454		| int16[49]	| EEPROM_MBL_STORED_MESH				| ???			| ff ffh 65535			| Stored mesh of the 1st sheet [um] 				| G80 C			| D3 Ax0996 C98
+| 0x09F8 2552		| uint8		| ^										| 00h 0 - 64h 100	| ffh 255			| Stored mesh of the 1st sheet - PINDA temp, ffh no mesh | ^		| D3 Ax09f8 C1
+| ^					| ^			| ^										| ???			| ^						| 2nd to 8th sheet follow, 99 bytes each			| ^				| D3 Ax0996 C792
 
 | Address begin		| Bit/Type 	| Name 									| Valid values	| Default/FactoryReset	| Description 										| Gcode/Function| Debug code
 | :--:				| :--: 		| :--: 									| :--:			| :--:					| :--:												| :--:			| :--:
@@ -556,8 +560,14 @@ static Sheets * const EEPROM_Sheets_base = (Sheets*)(EEPROM_SHEETS_BASE);
 #define EEPROM_TEMP_MODEL_W (EEPROM_TEMP_MODEL_Ta_corr-4) // float
 #define EEPROM_TEMP_MODEL_E (EEPROM_TEMP_MODEL_W-4) // float
 
+// Mesh of the last full G80 of each sheet: int16_t[7*7] [um] followed by the uint8_t PINDA temperature [°C], ffh if no mesh
+#define EEPROM_MBL_STORED_SIZEOF (7*7*2+1)
+#define EEPROM_MBL_STORED_MESH (EEPROM_TEMP_MODEL_E-MAX_SHEETS*EEPROM_MBL_STORED_SIZEOF)
+#define EEPROM_MBL_STORED_INIT (EEPROM_MBL_STORED_MESH-1) // uint8
+#define EEPROM_MBL_STORED_INIT_MAGIC 0xA5
+
 //This is supposed to point to last item to allow EEPROM overrun check. Please update when adding new items.
-#define EEPROM_LAST_ITEM EEPROM_TEMP_MODEL_E
+#define EEPROM_LAST_ITEM EEPROM_MBL_STORED_INIT
 // !!!!!
 // !!!!! this is end of EEPROM section ... all updates MUST BE inserted before this mark !!!!!
 // !!!!!
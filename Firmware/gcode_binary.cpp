@@ -0,0 +1,47 @@
+//! @file
+//! @brief Binary G-code container printed from the SD card
+
+#include <math.h>
+#include <string.h>
+
+#include "gcode_binary.h"
+
+uint16_t GcodeBinaryPosition::move(uint8_t tag, const uint8_t *payload, const float *current, float *target)
+{
+    static const float scale[4] = {GCODE_BINARY_XYZ_SCALE, GCODE_BINARY_XYZ_SCALE, GCODE_BINARY_XYZ_SCALE, GCODE_BINARY_E_SCALE};
+    if (!m_known)
+    {
+        for (uint8_t i = 0; i < 4; ++i)
+            m_pos[i] = lroundf(current[i] * scale[i]);
+        m_known = true;
+    }
+    for (uint8_t i = 0; i < 4; ++i)
+    {
+        target[i] = current[i];
+        if (!(tag & (GB_X << i)))
+            continue;
+        int32_t v;
+        if (tag & (GB_WIDE | GB_ABS))
+        {
+            memcpy(&v, payload, sizeof(v));
+            payload += sizeof(v);
+        }
+        else
+        {
+            int16_t d;
+            memcpy(&d, payload, sizeof(d));
+            payload += sizeof(d);
+            v = d;
+        }
+        int32_t pos = ((tag & GB_ABS) && i != 3) ? v : m_pos[i] + v;
+        if (i == 3)
+            target[i] = current[i] + (pos - m_pos[i]) / scale[i];
+        else
+            target[i] = pos / scale[i];
+        m_pos[i] = pos;
+    }
+    uint16_t feedrate = 0;
+    if (tag & GB_F)
+        memcpy(&feedrate, payload, sizeof(feedrate));
+    return feedrate;
+}
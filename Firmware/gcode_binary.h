@@ -0,0 +1,83 @@
+//! @file
+//! @brief Binary G-code container printed from the SD card
+//!
+//! Written by tools/gcode2bin. The file starts with a GcodeBinaryHeader, followed by the index of
+//! the layers (a little endian uint32 file offset of each layer record) and the records. A record
+//! starts with a tag byte:
+//!  - a move (bit 7 clear): bits 0-3 select the X, Y, Z and E values which follow, in this order,
+//!    as little endian int16 deltas of the quantized position, int32 deltas with GB_WIDE or int32
+//!    absolute X, Y and Z positions with GB_ABS (E is always a delta). With GB_F the feedrate
+//!    follows as uint16 [mm/min].
+//!  - GB_COMMAND: a length byte and the text of any other command, executed as usual.
+//!  - GB_LAYER: start of a layer, no payload.
+
+#ifndef GCODE_BINARY_H
+#define GCODE_BINARY_H
+
+#include <stdint.h>
+
+#define GCODE_BINARY_MAGIC "PGBC"
+#define GCODE_BINARY_VERSION 1
+//! quantization of the X, Y and Z positions [1/mm]
+#define GCODE_BINARY_XYZ_SCALE 1000
+//! quantization of the E position [1/mm]
+#define GCODE_BINARY_E_SCALE 10000
+
+enum GcodeBinaryTag : uint8_t
+{
+    GB_X = 0x01,
+    GB_Y = 0x02,
+    GB_Z = 0x04,
+    GB_E = 0x08,
+    GB_F = 0x10,
+    GB_WIDE = 0x20,
+    GB_ABS = 0x40,
+    GB_COMMAND = 0x80,
+    GB_LAYER = 0x81,
+};
+
+struct __attribute__((packed)) GcodeBinaryHeader
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t flags;       //!< reserved
+    uint16_t layers;     //!< number of entries of the layer index
+    uint32_t print_time; //!< print time estimate of the slicer [s], 0 if unknown
+    uint32_t index;      //!< file offset of the layer index
+    uint32_t data;       //!< file offset of the first record
+};
+
+//! @return size of the payload of a move record
+inline uint8_t gcode_binary_move_size(uint8_t tag)
+{
+    uint8_t axes = (tag & GB_X ? 1 : 0) + (tag & GB_Y ? 1 : 0) + (tag & GB_Z ? 1 : 0) + (tag & GB_E ? 1 : 0);
+    return axes * ((tag & (GB_WIDE | GB_ABS)) ? 4 : 2) + ((tag & GB_F) ? 2 : 0);
+}
+
+//! @brief Quantized position of the moves
+//!
+//! The deltas are applied to the quantized position of the file, so they don't accumulate
+//! rounding errors. After a command the position is taken over from the printer again.
+class GcodeBinaryPosition
+{
+public:
+    GcodeBinaryPosition() : m_known(false) {}
+
+    //! the position of the file is not known after a command or a seek
+    void invalidate() { m_known = false; }
+
+    //! @brief Decode a move record
+    //! @param tag move tag
+    //! @param payload payload of the record, gcode_binary_move_size() bytes
+    //! @param current current position of the printer [mm]
+    //! @param target receives the end of the move [mm], the E value is relative to @p current
+    //!  so the printer E position doesn't have to match the file
+    //! @return feedrate of the move [mm/min], 0 if not set by the record
+    uint16_t move(uint8_t tag, const uint8_t *payload, const float *current, float *target);
+
+private:
+    int32_t m_pos[4];
+    bool m_known;
+};
+
+#endif /* GCODE_BINARY_H */
@@ -1,5 +1,9 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include "Configuration.h"
+#ifdef SOFT_PWM_DITHER
+#include "soft_pwm.h"
+#endif //SOFT_PWM_DITHER
 
 // All this is about silencing the heat bed, as it behaves like a loudspeaker.
 // Basically, we want the PWM heating switched at 30Hz (or so) which is a well ballanced
@@ -78,6 +82,14 @@ static uint8_t pwm = 0;
 ///! Set in the whole firmware at various places
 extern unsigned char soft_pwm_bed;
 
+#ifdef SOFT_PWM_DITHER
+///! The bed PID output in 8.8 fixed point, set together with soft_pwm_bed
+extern uint16_t soft_pwm_bed_fine;
+
+///! Dithers the fine duty into the 8bit duty of the slow PWM cycles
+static SigmaDelta pwmDither;
+#endif //SOFT_PWM_DITHER
+
 /// fastMax - how many fast PWM steps to do in RISE and FALL states
 /// 16 is a good compromise between silenced bed ("smooth" edges)
 /// and not burning the switching MOSFET
@@ -100,6 +112,13 @@ ISR(TIMER0_OVF_vect)          // timer compare interrupt service routine
 	switch(state){
 	case States::ZERO_START:
 		if (bedPWMDisabled) return; // stay in the OFF state and do not change the output pin
+#ifdef SOFT_PWM_DITHER
+		// soft_pwm_bed is set directly at various places, use the fine duty only if it matches
+		// and never dither a bed which was turned off
+		if( soft_pwm_bed != 0 && (soft_pwm_bed_fine >> 9) == soft_pwm_bed )
+			pwm = pwmDither.step(soft_pwm_bed_fine, 8);
+		else
+#endif //SOFT_PWM_DITHER
 		pwm = soft_pwm_bed << 1;// expecting soft_pwm_bed to be 7bit!
 		if( pwm != 0 ){
 			state = States::ZERO;     // do nothing, let it tick once again after the 30Hz period
@@ -0,0 +1,28 @@
+//! @file
+
+#include "hotend_ff.h"
+
+//! @brief Account for one planned move
+//! @param e_mm filament length extruded by the move [mm], 0 for travels and retractions
+//! @param millimeters length of the move [mm]
+//! @param nominal_speed feed rate of the move [mm/s]
+//! @param area filament cross-section [mm^2]
+//! @retval true the look-ahead window is not full yet, continue with the next move
+//! @retval false the look-ahead window is full
+bool HotendFFEstimator::add(float e_mm, float millimeters, float nominal_speed, float area)
+{
+    if (!(millimeters > 0) || !(nominal_speed > 0))
+        return true;
+    float t = millimeters / nominal_speed;
+    float remaining = m_horizon - m_time;
+    if (t >= remaining)
+    {
+        // only the part of the move which falls within the window counts
+        m_volume += e_mm * area * (remaining / t);
+        m_time = m_horizon;
+        return false;
+    }
+    m_volume += e_mm * area;
+    m_time += t;
+    return true;
+}
@@ -0,0 +1,39 @@
+//! @file
+//! @brief Extrusion-rate based hotend power feed-forward
+//!
+//! Estimates the power required to melt the filament which is about to be extruded, so that the
+//! hotend heater can be pre-boosted before the PID regulator sees the temperature sag.
+
+#ifndef HOTEND_FF_H
+#define HOTEND_FF_H
+
+#include <stdint.h>
+
+//! @brief Time-windowed volumetric flow accumulator
+//!
+//! Feed the planned moves in execution order via add() until it returns false.
+//! The result is the mean volumetric flow over the look-ahead window. The part of the window
+//! which is not covered by the queued moves is assumed to be idle.
+class HotendFFEstimator
+{
+public:
+    explicit HotendFFEstimator(float horizon) : m_horizon(horizon), m_time(0), m_volume(0) {}
+    bool add(float e_mm, float millimeters, float nominal_speed, float area);
+    float flow() const { return m_volume / m_horizon; } //!< mean flow over the window [mm^3/s]
+private:
+    float m_horizon; //!< look-ahead window [s]
+    float m_time;    //!< time covered so far [s]
+    float m_volume;  //!< filament volume extruded within the window so far [mm^3]
+};
+
+//! @brief Power needed to heat up filament
+//! @param flow volumetric flow [mm^3/s]
+//! @param heat volumetric heat capacity of the filament including melting [J/mm^3/K]
+//! @param dT temperature rise of the filament [K]
+//! @return power [W]
+inline float hotend_ff_power(float flow, float heat, float dT)
+{
+    return flow * heat * dT;
+}
+
+#endif /* HOTEND_FF_H */
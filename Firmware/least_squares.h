@@ -0,0 +1,103 @@
+//! @file
+//! @brief Small least squares problems solved by the normal equations
+//!
+//! The problems of the bed calibration have 3 or 4 unknowns and 4 to 9 points, so the normal
+//! equations are accumulated row by row into a fixed size matrix and solved by the Cholesky
+//! decomposition, without allocating the full system.
+
+#ifndef LEAST_SQUARES_H
+#define LEAST_SQUARES_H
+
+#include <math.h>
+#include <stdint.h>
+
+//! @brief Add a row @p j of the system, with the right side @p f and the weight @p w
+//!
+//! A += w * j * j^T, b += w * j * f
+template <uint8_t N, typename T>
+inline void ls_add_row(T A[N][N], T b[N], const T j[N], T f, T w)
+{
+    for (uint8_t r = 0; r < N; ++r)
+    {
+        T wj = w * j[r];
+        for (uint8_t c = 0; c <= r; ++c)
+            A[r][c] += wj * j[c];
+        b[r] += wj * f;
+    }
+}
+
+//! @brief Solve the normal equations A x = b
+//!
+//! Only the lower triangle of @p A is used, it's overwritten by the Cholesky factor.
+//! @param b receives the solution
+//! @return false if A isn't positive definite, within the rounding errors
+template <uint8_t N, typename T>
+inline bool ls_solve(T A[N][N], T b[N])
+{
+    for (uint8_t c = 0; c < N; ++c)
+    {
+        T d = A[c][c];
+        for (uint8_t k = 0; k < c; ++k)
+            d -= A[c][k] * A[c][k];
+        if (!(d > A[c][c] * T(1e-5)))
+            return false;
+        d = sqrt(d);
+        A[c][c] = d;
+        for (uint8_t r = c + 1; r < N; ++r)
+        {
+            T v = A[r][c];
+            for (uint8_t k = 0; k < c; ++k)
+                v -= A[r][k] * A[c][k];
+            A[r][c] = v / d;
+        }
+    }
+    // L y = b
+    for (uint8_t r = 0; r < N; ++r)
+    {
+        for (uint8_t k = 0; k < r; ++k)
+            b[r] -= A[r][k] * b[k];
+        b[r] /= A[r][r];
+    }
+    // L^T x = y
+    for (int8_t r = N - 1; r >= 0; --r)
+    {
+        for (uint8_t k = r + 1; k < N; ++k)
+            b[r] -= A[k][r] * b[k];
+        b[r] /= A[r][r];
+    }
+    return true;
+}
+
+//! @brief Gauss-Newton step of the fit of the machine axes to the bed
+//!
+//! The machine axes are rotated by @p a1 and @p a2 from the bed axes and scaled by @p scale_x and
+//! @p scale_y, the @p measured points are moved by them and by @p cntr onto the @p target points.
+//! @param measured, target npts x, y pairs
+//! @param wx, wy weights of the residua in x and y of each point
+//! @param h receives the correction of cntr[0], cntr[1], a1 and a2
+//! @return false if the normal equations are singular
+inline bool ls_skew_offset_step(const float *measured, const float *target, const float *wx, const float *wy, uint8_t npts,
+    float scale_x, float scale_y, const float cntr[2], float a1, float a2, float h[4])
+{
+    float c1 = cos(a1) * scale_x;
+    float s1 = sin(a1) * scale_x;
+    float c2 = cos(a2) * scale_y;
+    float s2 = sin(a2) * scale_y;
+    float A[4][4] = {};
+    for (uint8_t i = 0; i < 4; ++i)
+        h[i] = 0;
+    for (uint8_t i = 0; i < npts; ++i)
+    {
+        float x = measured[2 * i];
+        float y = measured[2 * i + 1];
+        const float jx[4] = { 1.f, 0.f, -s1 * x, -c2 * y };
+        float fx = c1 * x - s2 * y + cntr[0] - target[2 * i];
+        ls_add_row<4>(A, h, jx, -fx, wx[i]);
+        const float jy[4] = { 0.f, 1.f, c1 * x, -s2 * y };
+        float fy = s1 * x + c2 * y + cntr[1] - target[2 * i + 1];
+        ls_add_row<4>(A, h, jy, -fy, wy[i]);
+    }
+    return ls_solve<4>(A, h);
+}
+
+#endif /* LEAST_SQUARES_H */
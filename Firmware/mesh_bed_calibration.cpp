@@ -6,6 +6,7 @@
 #include "stepper.h"
 #include "ultralcd.h"
 #include "temperature.h"
+#include "least_squares.h"
 
 #ifdef TMC2130
 #include "tmc2130.h"
@@ -244,87 +245,20 @@ BedSkewOffsetDetectionResultType calculate_machine_skew_and_offset_LS(
     float a1 = 0;
     // Rotation of the machine Y axis from the bed Y axis.
     float a2 = 0;
+    // The weights only depend on the measured points, the targets are read from the flash once.
+    float wx[9], wy[9], target[2 * 9];
+    for (uint8_t i = 0; i < npts; ++i) {
+        wx[i] = point_weight_x(i, measured_pts[2 * i + 1]);
+        wy[i] = point_weight_y(i, measured_pts[2 * i + 1]);
+        target[2 * i] = pgm_read_float(true_pts + i * 2);
+        target[2 * i + 1] = pgm_read_float(true_pts + i * 2 + 1);
+    }
     for (int8_t iter = 0; iter < 100; ++iter) {
-        float c1 = cos(a1) * MACHINE_AXIS_SCALE_X;
-        float s1 = sin(a1) * MACHINE_AXIS_SCALE_X;
-        float c2 = cos(a2) * MACHINE_AXIS_SCALE_Y;
-        float s2 = sin(a2) * MACHINE_AXIS_SCALE_Y;
-        // Prepare the Normal equation for the Gauss-Newton method.
-        float A[4][4] = { 0.f };
-        float b[4] = { 0.f };
-        float acc;
 		delay_keep_alive(0); //manage heater, reset watchdog, manage inactivity
-        for (uint8_t r = 0; r < 4; ++r) {
-            for (uint8_t c = 0; c < 4; ++c) {
-                acc = 0;
-                // J^T times J
-                for (uint8_t i = 0; i < npts; ++i) {
-                    // First for the residuum in the x axis:
-                    if (r != 1 && c != 1) {
-                        float a = 
-                             (r == 0) ? 1.f :
-                            ((r == 2) ? (-s1 * measured_pts[2 * i]) :
-                                        (-c2 * measured_pts[2 * i + 1]));
-                        float b = 
-                             (c == 0) ? 1.f :
-                            ((c == 2) ? (-s1 * measured_pts[2 * i]) :
-                                        (-c2 * measured_pts[2 * i + 1]));
-                        float w = point_weight_x(i, measured_pts[2 * i + 1]);
-                        acc += a * b * w;
-                    }
-                    // Second for the residuum in the y axis. 
-                    // The first row of the points have a low weight, because their position may not be known
-                    // with a sufficient accuracy.
-                    if (r != 0 && c != 0) {
-                        float a = 
-                             (r == 1) ? 1.f :
-                            ((r == 2) ? ( c1 * measured_pts[2 * i]) :
-                                        (-s2 * measured_pts[2 * i + 1]));
-                        float b = 
-                             (c == 1) ? 1.f :
-                            ((c == 2) ? ( c1 * measured_pts[2 * i]) :
-                                        (-s2 * measured_pts[2 * i + 1]));
-                        float w = point_weight_y(i, measured_pts[2 * i + 1]);
-                        acc += a * b * w;
-                    }
-                }
-                A[r][c] = acc;
-            }
-            // J^T times f(x)
-            acc = 0.f;
-            for (uint8_t i = 0; i < npts; ++i) {
-                {
-                    float j = 
-                         (r == 0) ? 1.f :
-                        ((r == 1) ? 0.f :
-                        ((r == 2) ? (-s1 * measured_pts[2 * i]) :
-                                    (-c2 * measured_pts[2 * i + 1])));
-                    float fx = c1 * measured_pts[2 * i] - s2 * measured_pts[2 * i + 1] + cntr[0] - pgm_read_float(true_pts + i * 2);
-                    float w = point_weight_x(i, measured_pts[2 * i + 1]);
-                    acc += j * fx * w;
-                }
-                {
-                    float j = 
-                         (r == 0) ? 0.f :
-                        ((r == 1) ? 1.f :
-                        ((r == 2) ? ( c1 * measured_pts[2 * i]) :
-                                    (-s2 * measured_pts[2 * i + 1])));
-                    float fy = s1 * measured_pts[2 * i] + c2 * measured_pts[2 * i + 1] + cntr[1] - pgm_read_float(true_pts + i * 2 + 1);
-                    float w = point_weight_y(i, measured_pts[2 * i + 1]);
-                    acc += j * fy * w;
-                }
-            }
-            b[r] = -acc;
-        }
-
-        // Solve for h by a Gauss iteration method.
-        float h[4] = { 0.f };
-        for (uint8_t gauss_iter = 0; gauss_iter < 100; ++gauss_iter) {
-            h[0] = (b[0] - A[0][1] * h[1] - A[0][2] * h[2] - A[0][3] * h[3]) / A[0][0];
-            h[1] = (b[1] - A[1][0] * h[0] - A[1][2] * h[2] - A[1][3] * h[3]) / A[1][1];
-            h[2] = (b[2] - A[2][0] * h[0] - A[2][1] * h[1] - A[2][3] * h[3]) / A[2][2];
-            h[3] = (b[3] - A[3][0] * h[0] - A[3][1] * h[1] - A[3][2] * h[2]) / A[3][3];
-        }
+        // Solve the Normal equation for the Gauss-Newton step h.
+        float h[4];
+        if (!ls_skew_offset_step(measured_pts, target, wx, wy, npts, MACHINE_AXIS_SCALE_X, MACHINE_AXIS_SCALE_Y, cntr, a1, a2, h))
+            break;
 
         // and update the current position with h.
         // It may be better to use the Levenberg-Marquart method here,
@@ -360,6 +294,9 @@ BedSkewOffsetDetectionResultType calculate_machine_skew_and_offset_LS(
             SERIAL_ECHOLNPGM("");
         }
 		#endif // SUPPORT_VERBOSITY
+        // Converged to well below a micron.
+        if (fabs(h[0]) < 1e-4f && fabs(h[1]) < 1e-4f && fabs(h[2]) < 1e-6f && fabs(h[3]) < 1e-6f)
+            break;
     }
 
     vec_x[0] =  cos(a1) * MACHINE_AXIS_SCALE_X;
@@ -3198,3 +3135,56 @@ void mbl_interpolation(uint8_t meas_points) {
 		}
 	}
 }
+
+#ifdef MBL_STORED_MESH
+static_assert(MESH_NUM_X_POINTS * MESH_NUM_Y_POINTS * 2 + 1 == EEPROM_MBL_STORED_SIZEOF, "The stored mesh doesn't match EEPROM_MBL_STORED_SIZEOF.");
+
+static uint8_t *mbl_stored_slot(uint8_t sheet)
+{
+	return (uint8_t*)EEPROM_MBL_STORED_MESH + sheet * EEPROM_MBL_STORED_SIZEOF;
+}
+
+static uint8_t *mbl_stored_slot()
+{
+	return mbl_stored_slot(eeprom_read_byte(&(EEPROM_Sheets_base->active_sheet)));
+}
+
+//! PINDA temperature the mesh is stored with, 0 without the PINDA thermistor
+static uint8_t mbl_stored_pinda()
+{
+#ifdef PINDA_THERMISTOR
+	return (current_temperature_pinda > 0) ? uint8_t(current_temperature_pinda + 0.5f) : 0;
+#else
+	return 0;
+#endif //PINDA_THERMISTOR
+}
+
+//! store the mesh bed leveling points for the active sheet
+void mbl_stored_save() {
+	uint8_t *slot = mbl_stored_slot();
+	uint8_t *pinda = slot + EEPROM_MBL_STORED_SIZEOF - 1;
+	eeprom_update_byte(pinda, EEPROM_EMPTY_VALUE); //invalid until all the points are written
+	for (uint8_t iy = 0; iy < MESH_NUM_Y_POINTS; ++ iy)
+		for (uint8_t ix = 0; ix < MESH_NUM_X_POINTS; ++ ix)
+			eeprom_update_word((uint16_t*)slot + iy * MESH_NUM_X_POINTS + ix, int16_t(lround(mbl.z_values[iy][ix] * 1000)));
+	eeprom_update_byte(pinda, mbl_stored_pinda());
+}
+
+//! @return true if the active sheet has a stored mesh, probed at a PINDA temperature close to the current one
+bool mbl_stored_valid() {
+	uint8_t sheet = eeprom_read_byte(&(EEPROM_Sheets_base->active_sheet));
+	if (sheet >= MAX_SHEETS || !eeprom_is_sheet_initialized(sheet)) return false;
+	uint8_t pinda = eeprom_read_byte(mbl_stored_slot(sheet) + EEPROM_MBL_STORED_SIZEOF - 1);
+	if (pinda == EEPROM_EMPTY_VALUE) return false;
+	return abs(int16_t(pinda) - mbl_stored_pinda()) <= MBL_STORED_MESH_PINDA_RANGE;
+}
+
+//! stored mesh bed leveling point of the active sheet [mm]
+float mbl_stored_z(uint8_t ix, uint8_t iy) {
+	return int16_t(eeprom_read_word((uint16_t*)mbl_stored_slot() + iy * MESH_NUM_X_POINTS + ix)) * 0.001f;
+}
+
+void mbl_stored_invalidate(uint8_t sheet) {
+	eeprom_update_byte(mbl_stored_slot(sheet) + EEPROM_MBL_STORED_SIZEOF - 1, EEPROM_EMPTY_VALUE);
+}
+#endif //MBL_STORED_MESH
@@ -214,3 +214,10 @@ extern void mbl_settings_init();
 
 extern bool mbl_point_measurement_valid(uint8_t ix, uint8_t iy, uint8_t meas_points, bool zigzag);
 extern void mbl_interpolation(uint8_t meas_points);
+
+#ifdef MBL_STORED_MESH
+extern void mbl_stored_save();
+extern bool mbl_stored_valid();
+extern float mbl_stored_z(uint8_t ix, uint8_t iy);
+extern void mbl_stored_invalidate(uint8_t sheet);
+#endif //MBL_STORED_MESH
@@ -10,7 +10,11 @@ mesh_bed_leveling::mesh_bed_leveling() { reset(); }
 
 void mesh_bed_leveling::reset() {
     active = 0;
+#ifdef MBL_PROBE_AREA
+    full = false;
+#endif //MBL_PROBE_AREA
     memset(z_values, 0, sizeof(float) * MESH_NUM_X_POINTS * MESH_NUM_Y_POINTS);
+    update();
 }
 
 static inline bool vec_undef(const float v[2])
@@ -99,6 +103,7 @@ void mesh_bed_leveling::upsample_3x3()
         }
     }
 */
+    update();
 }
 #endif
 
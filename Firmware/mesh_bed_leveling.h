@@ -1,4 +1,8 @@
 #include "Marlin.h"
+#include "mesh_bilinear.h"
+#ifdef MBL_BICUBIC
+#include "mesh_bicubic.h"
+#endif //MBL_BICUBIC
 
 #ifdef MESH_BED_LEVELING
 
@@ -8,10 +12,24 @@
 #define MESH_X_DIST (float(MESH_MAX_X - MESH_MIN_X)/float(MESH_NUM_X_POINTS - 1))
 #define MESH_Y_DIST (float(MESH_MAX_Y - MESH_MIN_Y)/float(MESH_NUM_Y_POINTS - 1))
 
+// The correction is bilinear in the cells of this grid, the moves are split at its lines.
+#ifdef MBL_BICUBIC
+#define MESH_GRID_FACTOR MBL_BICUBIC_FACTOR
+#else
+#define MESH_GRID_FACTOR 1
+#endif //MBL_BICUBIC
+#define MESH_GRID_X_DIST (MESH_X_DIST / MESH_GRID_FACTOR)
+#define MESH_GRID_Y_DIST (MESH_Y_DIST / MESH_GRID_FACTOR)
+#define MESH_GRID_NUM_X_POINTS ((MESH_NUM_X_POINTS - 1) * MESH_GRID_FACTOR + 1)
+#define MESH_GRID_NUM_Y_POINTS ((MESH_NUM_Y_POINTS - 1) * MESH_GRID_FACTOR + 1)
+
 class mesh_bed_leveling {
 public:
     uint8_t active;
     float z_values[MESH_NUM_Y_POINTS][MESH_NUM_X_POINTS];
+#ifdef MBL_PROBE_AREA
+    bool full; //!< z_values hold a complete mesh, G80 of a print area merges into it
+#endif //MBL_PROBE_AREA
     
     mesh_bed_leveling();
     
@@ -24,7 +42,19 @@ public:
     static float get_x(int i) { return float(MESH_MIN_X) + float(MESH_X_DIST) * float(i); }
     static float get_y(int i) { return float(MESH_MIN_Y) + float(MESH_Y_DIST) * float(i); }
     
+#if defined(MBL_BICUBIC)
+    // The surface is sampled again by update() once the mesh is complete.
+    void set_z(uint8_t ix, uint8_t iy, float z) { z_values[iy][ix] = z; }
+    //! Samples the surface after z_values were written.
+    void update() { bicubic.update(z_values); }
+#elif defined(MBL_CELL_COEFFICIENTS)
+    void set_z(uint8_t ix, uint8_t iy, float z) { z_values[iy][ix] = z; cells.update(z_values, ix, iy); }
+    //! Rebuilds the coefficients after z_values were written directly.
+    void update() { cells.update(z_values); }
+#else
     void set_z(uint8_t ix, uint8_t iy, float z) { z_values[iy][ix] = z; }
+    void update() {}
+#endif //MBL_CELL_COEFFICIENTS
     
     int select_x_index(float x) {
         int i = 1;
@@ -39,80 +69,27 @@ public:
     }
     
     float get_z(float x, float y) {
-        int   i, j;
+#ifdef MBL_BICUBIC
+        return bicubic.get((x - MESH_MIN_X) * (1.f / MESH_X_DIST), (y - MESH_MIN_Y) * (1.f / MESH_Y_DIST));
+#else
         float s, t;
-        
-#if MESH_NUM_X_POINTS==3 && MESH_NUM_Y_POINTS==3
-#define MESH_MID_X (0.5f*(MESH_MIN_X+MESH_MAX_X))
-#define MESH_MID_Y (0.5f*(MESH_MIN_Y+MESH_MAX_Y))
-        if (x < MESH_MID_X) {
-            i = 0;
-            s = (x - MESH_MIN_X) / MESH_X_DIST;
-            if (s > 1.f)
-                s = 1.f;
-        } else {
-            i = 1;
-            s = (x - MESH_MID_X) / MESH_X_DIST;
-            if (s < 0)
-                s = 0;
-        }
-        if (y < MESH_MID_Y) {
-            j = 0;
-            t = (y - MESH_MIN_Y) / MESH_Y_DIST;
-            if (t > 1.f)
-                t = 1.f;
-        } else {
-            j = 1;
-            t = (y - MESH_MID_Y) / MESH_Y_DIST;
-            if (t < 0)
-                t = 0;
-        }
+        uint8_t i = mesh_cell<MESH_NUM_X_POINTS>((x - MESH_MIN_X) * (1.f / MESH_X_DIST), s);
+        uint8_t j = mesh_cell<MESH_NUM_Y_POINTS>((y - MESH_MIN_Y) * (1.f / MESH_Y_DIST), t);
+#ifdef MBL_CELL_COEFFICIENTS
+        return cells.get(i, j, s, t);
 #else
-        i = int(floor((x - MESH_MIN_X) / MESH_X_DIST));
-        if (i < 0) {
-            i = 0;
-            s = (x - MESH_MIN_X) / MESH_X_DIST;
-            if (s > 1.f)
-                s = 1.f;
-        }
-        else if (i > MESH_NUM_X_POINTS - 2) {
-            i = MESH_NUM_X_POINTS - 2;
-            s = (x - get_x(i)) / MESH_X_DIST;
-            if (s < 0)
-                s = 0;
-        } else {
-            s = (x - get_x(i)) / MESH_X_DIST;
-            if (s < 0)
-                s = 0;
-            else if (s > 1.f)
-                s = 1.f;
-        }
-        j = int(floor((y - MESH_MIN_Y) / MESH_Y_DIST));
-        if (j < 0) {
-            j = 0;
-            t = (y - MESH_MIN_Y) / MESH_Y_DIST;
-            if (t > 1.f)
-                t = 1.f;
-        } else if (j > MESH_NUM_Y_POINTS - 2) {
-            j = MESH_NUM_Y_POINTS - 2;
-            t = (y - get_y(j)) / MESH_Y_DIST;
-            if (t < 0)
-                t = 0;
-        } else {
-            t = (y - get_y(j)) / MESH_Y_DIST;
-            if (t < 0)
-                t = 0;
-            else if (t > 1.f)
-                t = 1.f;
-        }
-#endif /* MESH_NUM_X_POINTS==3 && MESH_NUM_Y_POINTS==3 */
-        
-        float si = 1.f-s;
-        float z0 = si * z_values[j  ][i] + s * z_values[j  ][i+1];
-        float z1 = si * z_values[j+1][i] + s * z_values[j+1][i+1];
-        return (1.f-t) * z0 + t * z1;
+        return mesh_interpolate<MESH_NUM_X_POINTS, MESH_NUM_Y_POINTS>(z_values, i, j, s, t);
+#endif //MBL_CELL_COEFFICIENTS
+#endif //MBL_BICUBIC
     }
-    
+
+#if defined(MBL_BICUBIC)
+private:
+    MeshBicubic<MESH_NUM_X_POINTS, MESH_NUM_Y_POINTS, MBL_BICUBIC_FACTOR> bicubic;
+#elif defined(MBL_CELL_COEFFICIENTS)
+private:
+    MeshCells<MESH_NUM_X_POINTS, MESH_NUM_Y_POINTS> cells;
+#endif
 };
 
 extern mesh_bed_leveling mbl;
@@ -0,0 +1,90 @@
+//! @file
+//! @brief Bicubic interpolation of the bed mesh
+//!
+//! A Catmull-Rom surface passes through the mesh points and is smooth across the cells, so it
+//! follows a warped bed better than the bilinear cells. It is sampled into a denser grid when the
+//! mesh changes, a lookup interpolates the grid bilinearly.
+
+#ifndef MESH_BICUBIC_H
+#define MESH_BICUBIC_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "mesh_bilinear.h"
+
+//! @tparam NX, NY number of mesh points, at least 3
+//! @tparam F number of grid cells per mesh cell
+template <uint8_t NX, uint8_t NY, uint8_t F>
+class MeshBicubic
+{
+public:
+    //! size of the grid
+    enum : uint8_t { GX = (NX - 1) * F + 1, GY = (NY - 1) * F + 1 };
+
+    //! sample the surface through the mesh points @p z
+    void update(const float z[NY][NX])
+    {
+        float w[F + 1][4];
+        for (uint8_t k = 0; k <= F; ++k)
+            weights(float(k) / F, w[k]);
+        for (uint8_t gj = 0; gj < GY; ++gj)
+        {
+            uint8_t j = (gj / F < NY - 1) ? gj / F : NY - 2;
+            const float *wy = w[gj - j * F];
+            for (uint8_t gi = 0; gi < GX; ++gi)
+            {
+                uint8_t i = (gi / F < NX - 1) ? gi / F : NX - 2;
+                const float *wx = w[gi - i * F];
+                float v = 0;
+                for (int8_t b = 0; b < 4; ++b)
+                    for (int8_t a = 0; a < 4; ++a)
+                        v += wy[b] * wx[a] * at(z, i + a - 1, j + b - 1);
+                long q = lround(v * 1000.f);
+                m_grid[gj][gi] = (q > INT16_MAX) ? INT16_MAX : (q < INT16_MIN) ? INT16_MIN : q;
+            }
+        }
+    }
+
+    //! @param u, v position in the units of the mesh spacing
+    //! @return z [mm]
+    float get(float u, float v) const
+    {
+        float s, t;
+        uint8_t i = mesh_cell<GX>(u * F, s);
+        uint8_t j = mesh_cell<GY>(v * F, t);
+        const int16_t *p = &m_grid[j][i];
+        float z0 = p[0] + s * (p[1] - p[0]);
+        float z1 = p[GX] + s * (p[GX + 1] - p[GX]);
+        return (z0 + t * (z1 - z0)) * 0.001f;
+    }
+
+private:
+    //! Catmull-Rom weights of the points i-1 to i+2 at the position @p s between the points i and i+1
+    static void weights(float s, float *w)
+    {
+        float s2 = s * s, s3 = s2 * s;
+        w[0] = 0.5f * (-s3 + 2.f * s2 - s);
+        w[1] = 0.5f * (3.f * s3 - 5.f * s2 + 2.f);
+        w[2] = 0.5f * (-3.f * s3 + 4.f * s2 + s);
+        w[3] = 0.5f * (s3 - s2);
+    }
+
+    //! mesh point, extrapolated past the edges by the parabola through the last three points
+    static float at(const float z[NY][NX], int8_t i, int8_t j)
+    {
+        if (i < 0)
+            return 3.f * (at(z, 0, j) - at(z, 1, j)) + at(z, 2, j);
+        if (i >= NX)
+            return 3.f * (at(z, NX - 1, j) - at(z, NX - 2, j)) + at(z, NX - 3, j);
+        if (j < 0)
+            return 3.f * (at(z, i, 0) - at(z, i, 1)) + at(z, i, 2);
+        if (j >= NY)
+            return 3.f * (at(z, i, NY - 1) - at(z, i, NY - 2)) + at(z, i, NY - 3);
+        return z[j][i];
+    }
+
+    int16_t m_grid[GY][GX]; //!< [um]
+};
+
+#endif /* MESH_BICUBIC_H */
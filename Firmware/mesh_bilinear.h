@@ -0,0 +1,87 @@
+//! @file
+//! @brief Bilinear interpolation of the bed mesh
+//!
+//! The position is given in the units of the mesh spacing, (x - MESH_MIN_X) / MESH_X_DIST, so the
+//! lookup doesn't divide. Outside of the mesh the edge cells are extrapolated.
+
+#ifndef MESH_BILINEAR_H
+#define MESH_BILINEAR_H
+
+#include <stdint.h>
+
+//! @brief Cell of a mesh row or column
+//! @tparam N number of mesh points
+//! @param u position in the units of the mesh spacing
+//! @param s receives the position in the cell, from 0 to 1 inside of the mesh
+//! @return index of the cell
+template <uint8_t N>
+inline uint8_t mesh_cell(float u, float &s)
+{
+    uint8_t i = 0;
+    if (u >= N - 2)
+        i = N - 2;
+    else if (u > 0)
+        i = uint8_t(u);
+    s = u - i;
+    return i;
+}
+
+//! interpolate the cell @p i, @p j of the mesh points @p z
+template <uint8_t NX, uint8_t NY>
+inline float mesh_interpolate(const float z[NY][NX], uint8_t i, uint8_t j, float s, float t)
+{
+    float si = 1.f - s;
+    float z0 = si * z[j  ][i] + s * z[j  ][i+1];
+    float z1 = si * z[j+1][i] + s * z[j+1][i+1];
+    return (1.f - t) * z0 + t * z1;
+}
+
+//! @brief Coefficients of the interpolation in each cell of the mesh
+//!
+//! z = a + b * s + t * (c + d * s), so a lookup takes three multiplications.
+//! Takes 16 bytes of RAM per cell.
+template <uint8_t NX, uint8_t NY>
+class MeshCells
+{
+public:
+    //! rebuild all the cells
+    void update(const float z[NY][NX])
+    {
+        for (uint8_t j = 0; j < NY - 1; ++j)
+            for (uint8_t i = 0; i < NX - 1; ++i)
+                update_cell(z, i, j);
+    }
+
+    //! rebuild the cells sharing the mesh point @p ix, @p iy
+    void update(const float z[NY][NX], uint8_t ix, uint8_t iy)
+    {
+        for (uint8_t j = (iy ? iy - 1 : 0); j <= iy && j < NY - 1; ++j)
+            for (uint8_t i = (ix ? ix - 1 : 0); i <= ix && i < NX - 1; ++i)
+                update_cell(z, i, j);
+    }
+
+    float get(uint8_t i, uint8_t j, float s, float t) const
+    {
+        const Cell &c = m_cells[j][i];
+        return c.a + c.b * s + t * (c.c + c.d * s);
+    }
+
+private:
+    struct Cell
+    {
+        float a, b, c, d;
+    };
+
+    void update_cell(const float z[NY][NX], uint8_t i, uint8_t j)
+    {
+        Cell &c = m_cells[j][i];
+        c.a = z[j][i];
+        c.b = z[j][i+1] - z[j][i];
+        c.c = z[j+1][i] - z[j][i];
+        c.d = z[j+1][i+1] - z[j+1][i] - c.b;
+    }
+
+    Cell m_cells[NY - 1][NX - 1];
+};
+
+#endif /* MESH_BILINEAR_H */
@@ -0,0 +1,66 @@
+//! @file
+//! @brief Split of a move where it crosses the lines of the bed mesh
+//!
+//! The planner corrects the ends of a segment and the correction is bilinear in each cell of the
+//! mesh, or of the denser grid sampled from the bicubic surface, so a move is split where it crosses
+//! the cell boundaries. The edge lines aren't split, the bed correction extrapolates the edge cells
+//! past them.
+
+#ifndef MESH_LINE_WALK_H
+#define MESH_LINE_WALK_H
+
+#include <math.h>
+#include <stdint.h>
+
+//! Walks the inner lines of the mesh along one axis which a move crosses, from its start to its end.
+class mesh_line_walk {
+public:
+    mesh_line_walk(float p0, float d, float origin, float dist, int8_t points) :
+        p0(p0), d(d), origin(origin), dist(dist), last(points - 2) {
+        if (d > 0) {
+            k = int16_t(floor((p0 - origin) / dist)) + 1;
+            if (k < 1) k = 1;
+            step = 1;
+        } else {
+            k = int16_t(ceil((p0 - origin) / dist)) - 1;
+            if (k > last) k = last;
+            step = -1;
+        }
+    }
+    // Parameter of the next line crossed [0-1), 1 if the move doesn't cross any more lines.
+    float t() const {
+        if (d == 0 || k < 1 || k > last)
+            return 1.f;
+        float t = (origin + dist * k - p0) / d;
+        return (t < 1.f) ? t : 1.f;
+    }
+    void next() { k += step; }
+
+private:
+    float p0, d, origin, dist;
+    int16_t k, last;
+    int8_t step;
+};
+
+//! Merges the walks along X and Y in the order of the move.
+class mesh_line_split {
+public:
+    mesh_line_split(const mesh_line_walk &lx, const mesh_line_walk &ly) : lx(lx), ly(ly) {}
+    // Parameter of the next breakpoint of the move [0-1), false at the end of the move.
+    bool next(float &t) {
+        float tx = lx.t();
+        float ty = ly.t();
+        t = (tx < ty) ? tx : ty;
+        if (t >= 1.f)
+            return false;
+        // a crossing of both lines at once ends a single segment
+        if (tx == t) lx.next();
+        if (ty == t) ly.next();
+        return true;
+    }
+
+private:
+    mesh_line_walk lx, ly;
+};
+
+#endif /* MESH_LINE_WALK_H */
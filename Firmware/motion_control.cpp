@@ -23,6 +23,9 @@
 #include "Marlin.h"
 #include "stepper.h"
 #include "planner.h"
+#ifdef ARC_CHORD_ERROR
+#include "arc_chords.h"
+#endif //ARC_CHORD_ERROR
 
 // The arc is approximated by generating a huge number of tiny, linear segments. The length of each 
 // segment is configured in settings.mm_per_arc_segment.  
@@ -40,13 +43,14 @@ void mc_arc(const float* position, float* target, const float* offset, float fee
     float rt_y = target[Y_AXIS] - center_axis_y;
     // 20200419 - Add a variable that will be used to hold the arc segment length
     float mm_per_arc_segment = cs.mm_per_arc_segment;
-    // 20210109 - Add a variable to hold the n_arc_correction value
-    unsigned char n_arc_correction = cs.n_arc_correction;
-
     // CCW angle between start_position and target from circle center. Only one atan2() trig computation required.
     float angular_travel_total = atan2(r_axis_x * rt_y - r_axis_y * rt_x, r_axis_x * rt_x + r_axis_y * rt_y);
     if (angular_travel_total < 0) { angular_travel_total += 2 * M_PI; }
 
+#ifdef ARC_CHORD_ERROR
+    // The segments deviate from the arc by ARC_CHORD_ERROR at most, within the segment length limits
+    mm_per_arc_segment = arc_chord_length(radius, ARC_CHORD_ERROR, cs.min_mm_per_arc_segment, ARC_CHORD_MAX_LENGTH);
+#else
     if (cs.min_arc_segments > 0)
     {
         // 20200417 - FormerLurker - Implement MIN_ARC_SEGMENTS if it is defined - from Marlin 2.0 implementation
@@ -73,6 +77,7 @@ void mc_arc(const float* position, float* target, const float* offset, float fee
         // 20200417 - FormerLurker - Implement MIN_MM_PER_ARC_SEGMENT if it is defined
         mm_per_arc_segment = cs.mm_per_arc_segment;
     }
+#endif //ARC_CHORD_ERROR
 
     // Adjust the angular travel if the direction is clockwise
     if (isclockwise) { angular_travel_total -= 2 * M_PI; }
@@ -122,13 +127,25 @@ void mc_arc(const float* position, float* target, const float* offset, float fee
         // as well as the small angle approximation for sin and cos.
         const float theta_per_segment = angular_travel_total / segments,
             linear_per_segment = travel_z / (segments),
-            segment_extruder_travel = (target[E_AXIS] - start_position[E_AXIS]) / (segments),
-            sq_theta_per_segment = theta_per_segment * theta_per_segment,
+            segment_extruder_travel = (target[E_AXIS] - start_position[E_AXIS]) / (segments);
+#ifdef ARC_CHORD_ERROR
+        // Rotation by the exact angle of a segment, the radius is corrected periodically
+        ArcChords chords(r_axis_x, r_axis_y, theta_per_segment);
+#else
+        const float sq_theta_per_segment = theta_per_segment * theta_per_segment,
             sin_T = theta_per_segment - sq_theta_per_segment * theta_per_segment / 6,
             cos_T = 1 - 0.5f * sq_theta_per_segment;
+        // 20210109 - Add a variable to hold the n_arc_correction value
+        unsigned char n_arc_correction = cs.n_arc_correction;
+#endif //ARC_CHORD_ERROR
         // Loop through all but one of the segments.  The last one can be done simply
         // by moving to the target.
         for (uint16_t i = 1; i < segments; i++) {
+#ifdef ARC_CHORD_ERROR
+            chords.next();
+            r_axis_x = chords.x;
+            r_axis_y = chords.y;
+#else
             if (n_arc_correction-- == 0) {
                 // Calculate the actual position for r_axis_x and r_axis_y
                 const float cos_Ti = cos(i * theta_per_segment), sin_Ti = sin(i * theta_per_segment);
@@ -143,6 +160,7 @@ void mc_arc(const float* position, float* target, const float* offset, float fee
                 r_axis_x = r_axis_x * cos_T - r_axis_y * sin_T;
                 r_axis_y = r_axisi;
             }
+#endif //ARC_CHORD_ERROR
 
             // Update Position
             start_position[X_AXIS] = center_axis_x + r_axis_x;
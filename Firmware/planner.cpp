@@ -59,6 +59,12 @@
 #include "ultralcd.h"
 #include "language.h"
 #include "ConfigurationStore.h"
+#ifdef HOTEND_FEEDFORWARD
+#include "hotend_ff.h"
+#endif //HOTEND_FEEDFORWARD
+#ifdef SD_CHECKPOINTS
+#include "sd_checkpoints.h"
+#endif //SD_CHECKPOINTS
 
 #ifdef MESH_BED_LEVELING
 #include "mesh_bed_leveling.h"
@@ -116,6 +122,10 @@ unsigned char g_uc_extruder_last_move[3] = {0,0,0};
 block_t block_buffer[BLOCK_BUFFER_SIZE];    // A ring buffer for motion instfructions
 volatile uint8_t block_buffer_head;         // Index of the next block to be pushed
 volatile uint8_t block_buffer_tail;         // Index of the block to process now
+#ifdef SD_CHECKPOINTS
+// Lengths of the planned commands for the power panic, in place of block_t::sdlen
+static SdCheckpoints<SD_CHECKPOINTS, BLOCK_BUFFER_SIZE> sd_checkpoints;
+#endif //SD_CHECKPOINTS
 
 #ifdef PLANNER_DIAGNOSTICS
 // Diagnostic function: Minimum number of planned moves since the last 
@@ -459,6 +469,9 @@ void planner_recalculate(const float &safe_final_speed)
 void plan_init() {
   block_buffer_head = 0;
   block_buffer_tail = 0;
+#ifdef SD_CHECKPOINTS
+  sd_checkpoints.reset();
+#endif //SD_CHECKPOINTS
   memset(position, 0, sizeof(position)); // clear position
   #ifdef LIN_ADVANCE
   memset(position_float, 0, sizeof(position_float)); // clear position
@@ -736,8 +749,17 @@ void plan_buffer_line(float x, float y, float z, const float &e, float feed_rate
   // Mark block as not busy (Not executed by the stepper interrupt, could be still tinkered with.)
   block->busy = false;
 
+#ifdef SD_CHECKPOINTS
+  {
+    // The checkpoints of the executed blocks have to go before their index is reused.
+    CRITICAL_SECTION_START;
+    sd_checkpoints.prune(block_buffer_tail, block_buffer_head);
+    CRITICAL_SECTION_END;
+  }
+#else //SD_CHECKPOINTS
   // Set sdlen for calculating sd position
   block->sdlen = 0;
+#endif //SD_CHECKPOINTS
 
   // Save original start position of the move
   if (gcode_start_position)
@@ -1489,7 +1511,13 @@ void planner_add_sd_length(uint16_t sdlen)
   if (block_buffer_head != block_buffer_tail) {
     // The planner buffer is not empty. Get the index of the last buffer line entered,
     // which is (block_buffer_head - 1) modulo BLOCK_BUFFER_SIZE.
+#ifdef SD_CHECKPOINTS
+    // Called with the interrupts disabled.
+    sd_checkpoints.prune(block_buffer_tail, block_buffer_head);
+    sd_checkpoints.add(sdlen, prev_block_index(block_buffer_head));
+#else //SD_CHECKPOINTS
     block_buffer[prev_block_index(block_buffer_head)].sdlen += sdlen;
+#endif //SD_CHECKPOINTS
   } else {
     // There is no line stored in the planner buffer, which means the last command does not need to be revertible,
     // at a power panic, so the length of this command may be forgotten.
@@ -1498,6 +1526,9 @@ void planner_add_sd_length(uint16_t sdlen)
 
 uint16_t planner_calc_sd_length()
 {
+#ifdef SD_CHECKPOINTS
+	return sd_checkpoints.length(block_buffer_tail, block_buffer_head);
+#else //SD_CHECKPOINTS
 	uint8_t _block_buffer_head = block_buffer_head;
 	uint8_t _block_buffer_tail = block_buffer_tail;
 	uint16_t sdlen = 0;
@@ -1507,4 +1538,27 @@ uint16_t planner_calc_sd_length()
 	    _block_buffer_tail = (_block_buffer_tail + 1) & (BLOCK_BUFFER_SIZE - 1);  
 	}
 	return sdlen;
+#endif //SD_CHECKPOINTS
+}
+
+#ifdef HOTEND_FEEDFORWARD
+float planner_extrusion_flow()
+{
+    const float area = M_PI * sq(DEFAULT_NOMINAL_FILAMENT_DIA * 0.5f);
+    HotendFFEstimator estimator(HOTEND_FF_HORIZON);
+    // Walk the queue from the block being executed: the tail may only advance meanwhile,
+    // in which case the estimate just covers a block which has already finished.
+    uint8_t block_index = block_buffer_tail;
+    while (block_index != block_buffer_head)
+    {
+        const block_t *block = &block_buffer[block_index];
+        float e_mm = 0;
+        if (!(block->direction_bits & (1<<E_AXIS))) // retractions don't need any melting power
+            e_mm = block->steps_e.wide / cs.axis_steps_per_unit[E_AXIS];
+        if (!estimator.add(e_mm, block->millimeters, block->nominal_speed, area))
+            break;
+        block_index = next_block_index(block_index);
+    }
+    return estimator.flow();
 }
+#endif //HOTEND_FEEDFORWARD
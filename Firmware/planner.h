@@ -125,7 +125,9 @@ typedef struct {
   float gcode_start_position[NUM_AXIS]; // Start (abs mm) of the original Gcode instruction
   uint16_t segment_idx;             // The index of the for loop that generates segments
   uint16_t gcode_feedrate;          // Default and/or move feedrate
+#ifndef SD_CHECKPOINTS
   uint16_t sdlen;                   // Length of the Gcode instruction
+#endif //SD_CHECKPOINTS
 } block_t;
 
 #ifdef LIN_ADVANCE
@@ -288,3 +290,8 @@ extern void planner_queue_min_reset();
 extern void planner_add_sd_length(uint16_t sdlen);
 
 extern uint16_t planner_calc_sd_length();
+
+#ifdef HOTEND_FEEDFORWARD
+// Mean volumetric flow [mm^3/s] of the moves queued for the next HOTEND_FF_HORIZON seconds.
+extern float planner_extrusion_flow();
+#endif //HOTEND_FEEDFORWARD
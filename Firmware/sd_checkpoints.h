@@ -0,0 +1,103 @@
+//! @file
+//! @brief File position checkpoints of the planned SD commands
+//!
+//! The length of each SD command leaving the command queue is attached to the last planner block
+//! queued at that time. A power panic resumes the print at the start of the commands whose blocks
+//! haven't all been executed, which is the position of the last command read minus the lengths
+//! still attached to the queued blocks.
+
+#ifndef SD_CHECKPOINTS_H
+#define SD_CHECKPOINTS_H
+
+#include <stdint.h>
+
+//! @brief Ring of (command length, planner block) checkpoints
+//!
+//! Only the blocks which end a command get a checkpoint, the following commands which don't plan
+//! a block are merged into it. The total length of the ring is kept up to date, so length() only
+//! has to subtract the checkpoints of the blocks executed since the last prune().
+//!
+//! With N = BLOCKS the lengths are exact. With fewer checkpoints, the commands of several
+//! consecutive blocks share the newest checkpoint while the ring is full, and a power panic
+//! may resume the print less than a planner queue of commands earlier than needed.
+//!
+//! @tparam N number of checkpoints, a power of two
+//! @tparam BLOCKS size of the planner block ring, a power of two
+template <uint8_t N, uint8_t BLOCKS>
+class SdCheckpoints
+{
+    static_assert(N >= 2 && !(N & (N - 1)), "N must be a power of two");
+    static_assert(!(BLOCKS & (BLOCKS - 1)), "BLOCKS must be a power of two");
+public:
+    SdCheckpoints() : m_first(0), m_count(0), m_length(0) {}
+
+    void reset() { m_count = 0; m_length = 0; }
+
+    //! @brief Attach the length of a command to the last queued block
+    //!
+    //! If the ring is full, the newest checkpoint is moved to the block and takes the command.
+    //! Its commands are then released with the later block and the resume position moves back
+    //! over them, they are never skipped. All the checkpoints are of queued blocks when the ring
+    //! is full (prune() is called first), so the commands moved are of queued blocks too and the
+    //! resume position goes back by less than the commands of a full planner queue.
+    void add(uint16_t sdlen, uint8_t block)
+    {
+        m_length += sdlen;
+        if (m_count && (at(m_count - 1).block == block || m_count == N))
+        {
+            at(m_count - 1).sdlen += sdlen;
+            at(m_count - 1).block = block;
+            return;
+        }
+        Checkpoint &c = at(m_count++);
+        c.sdlen = sdlen;
+        c.block = block;
+    }
+
+    //! @brief Drop the checkpoints of the executed blocks
+    //!
+    //! Has to be called before a block index is reused, the block at @p head counts as executed.
+    void prune(uint8_t tail, uint8_t head)
+    {
+        while (m_count && !queued(at(0).block, tail, head))
+        {
+            m_length -= at(0).sdlen;
+            pop();
+        }
+    }
+
+    //! @return length of the commands not executed completely, doesn't modify the ring
+    uint16_t length(uint8_t tail, uint8_t head) const
+    {
+        uint16_t sdlen = m_length;
+        for (uint8_t i = 0; i < m_count && !queued(at(i).block, tail, head); ++i)
+            sdlen -= at(i).sdlen;
+        return sdlen;
+    }
+
+private:
+    struct Checkpoint
+    {
+        uint16_t sdlen; //!< length of the commands ending with the block
+        uint8_t block;  //!< planner block index
+    };
+
+    static bool queued(uint8_t block, uint8_t tail, uint8_t head)
+    {
+        return ((block - tail) & (BLOCKS - 1)) < ((head - tail) & (BLOCKS - 1));
+    }
+    Checkpoint &at(uint8_t i) { return m_ring[(m_first + i) & (N - 1)]; }
+    const Checkpoint &at(uint8_t i) const { return m_ring[(m_first + i) & (N - 1)]; }
+    void pop()
+    {
+        m_first = (m_first + 1) & (N - 1);
+        --m_count;
+    }
+
+    Checkpoint m_ring[N];
+    uint8_t m_first;
+    uint8_t m_count;
+    uint16_t m_length; //!< sum of the checkpoint lengths
+};
+
+#endif /* SD_CHECKPOINTS_H */
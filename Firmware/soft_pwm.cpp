@@ -0,0 +1,56 @@
+//! @file
+
+#include "soft_pwm.h"
+
+//! @brief Schedule outputs to change at the PWM counter value tick
+//!
+//! Edges at the same tick are merged.
+//! @param tick PWM counter value
+//! @param set mask of the outputs to be turned on
+//! @param clr mask of the outputs to be turned off
+//! @retval true edge scheduled
+//! @retval false schedule is full
+bool SoftPwmSchedule::add(uint8_t tick, uint8_t set, uint8_t clr)
+{
+    // the edges are mostly added in order, so search from the end
+    uint8_t i = m_count;
+    while (i && m_edges[i - 1].tick > tick)
+        --i;
+    if (i && m_edges[i - 1].tick == tick)
+    {
+        Edge &e = m_edges[i - 1];
+        e.set = (e.set & ~clr) | set;
+        e.clr = (e.clr & ~set) | clr;
+        return true;
+    }
+    if (m_count == max_edges)
+        return false;
+    for (uint8_t j = m_count; j > i; --j)
+        m_edges[j] = m_edges[j - 1];
+    m_edges[i].tick = tick;
+    m_edges[i].set = set;
+    m_edges[i].clr = clr;
+    ++m_count;
+    return true;
+}
+
+//! @brief Schedule a single PWM period
+//!
+//! The output is always written at the start of the period, so that it can't get stuck in a wrong
+//! state. There is no trailing edge for a full duty.
+//! @param start PWM counter value at the start of the period
+//! @param on_ticks duty in PWM counter ticks
+//! @param period length of the period in PWM counter ticks
+//! @param mask output mask
+//! @retval true period scheduled
+//! @retval false schedule is full
+bool SoftPwmSchedule::add_pwm(uint8_t start, uint8_t on_ticks, uint8_t period, uint8_t mask)
+{
+    if (!on_ticks)
+        return add(start, 0, mask);
+    if (!add(start, mask, 0))
+        return false;
+    if (on_ticks < period)
+        return add(start + on_ticks, 0, mask);
+    return true;
+}
@@ -0,0 +1,75 @@
+//! @file
+//! @brief Edge scheduled soft PWM
+//!
+//! Instead of comparing every output with the PWM counter on each soft PWM tick, the duties are
+//! latched once per PWM frame and turned into a sorted list of output edges. The tick then only
+//! compares the counter with the next pending edge and touches the outputs when they change.
+
+#ifndef SOFT_PWM_H
+#define SOFT_PWM_H
+
+#include <stdint.h>
+
+//! @brief Output edges of a single soft PWM frame, sorted by the PWM counter
+class SoftPwmSchedule
+{
+public:
+    struct Edge
+    {
+        uint8_t tick; //!< PWM counter value of the edge
+        uint8_t set;  //!< mask of the outputs turned on
+        uint8_t clr;  //!< mask of the outputs turned off
+    };
+
+    //! heaters turned off at most once per frame, the fan switched twice in each of its periods
+    static const uint8_t max_edges = 20;
+
+    SoftPwmSchedule() : m_count(0), m_next(0) {}
+
+    void clear() { m_count = m_next = 0; }
+    //! replay the schedule from the start of the frame
+    void rewind() { m_next = 0; }
+    bool add(uint8_t tick, uint8_t set, uint8_t clr);
+    bool add_pwm(uint8_t start, uint8_t on_ticks, uint8_t period, uint8_t mask);
+
+    //! @return edge to be applied at the PWM counter value tick, nullptr if there is none
+    const Edge *due(uint8_t tick)
+    {
+        if (m_next < m_count && m_edges[m_next].tick == tick)
+            return &m_edges[m_next++];
+        return nullptr;
+    }
+
+    uint8_t size() const { return m_count; }
+    const Edge &operator[](uint8_t i) const { return m_edges[i]; }
+
+private:
+    Edge m_edges[max_edges];
+    uint8_t m_count; //!< number of scheduled edges
+    uint8_t m_next;  //!< next edge to be applied
+};
+
+//! @brief First order sigma-delta modulator
+//!
+//! Quantizes the duty to a coarser resolution while carrying the quantization error over to the
+//! next period, so that the mean output keeps the full resolution of the input.
+class SigmaDelta
+{
+public:
+    SigmaDelta() : m_acc(0) {}
+
+    //! @param value duty in units of (1 << shift) of the output
+    //! @param shift number of bits dropped by the quantization (max 8)
+    //! @return quantized duty
+    uint8_t step(uint16_t value, uint8_t shift)
+    {
+        uint16_t sum = value + m_acc;
+        m_acc = sum & ((1 << shift) - 1);
+        return sum >> shift;
+    }
+
+private:
+    uint8_t m_acc; //!< quantization error carried over
+};
+
+#endif /* SOFT_PWM_H */
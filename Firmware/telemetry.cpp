@@ -0,0 +1,98 @@
+//! @file
+
+#include "telemetry.h"
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static inline uint16_t zigzag(int16_t v)
+{
+    return ((uint16_t)v << 1) ^ (uint16_t)(v >> 15);
+}
+
+static char base64_char(uint8_t v)
+{
+    if (v < 26) return 'A' + v;
+    if (v < 52) return 'a' + (v - 26);
+    if (v < 62) return '0' + (v - 52);
+    return (v == 62) ? '+' : '/';
+}
+
+//! @param keyframe_interval number of frames between the key frames
+TelemetryEncoder::TelemetryEncoder(uint8_t keyframe_interval)
+    : m_time(0), m_keyframe_interval(keyframe_interval), m_keyframe(0), m_mask(0), m_seq(0)
+{
+}
+
+//! @brief Encode a frame
+//!
+//! A key frame is sent when the interval elapses or the channel mask changes.
+//! @param time current time [ms]
+//! @param mask channels present in the frame
+//! @param values values of all channels, indexed by the channel number
+//! @param frame output buffer of max_frame bytes
+//! @return frame length
+uint8_t TelemetryEncoder::encode(uint32_t time, uint8_t mask, const int16_t *values, uint8_t *frame)
+{
+    bool key = (m_keyframe == 0 || mask != m_mask);
+    uint8_t *p = frame;
+
+    *p++ = (key ? 0x80 : 0) | (m_seq++ & 0x7f);
+    if (key)
+    {
+        *p++ = mask;
+        p = put_varint(p, time);
+        m_mask = mask;
+        m_keyframe = m_keyframe_interval;
+    }
+    else
+        p = put_varint(p, time - m_time);
+    --m_keyframe;
+    m_time = time;
+
+    for (uint8_t i = 0; i < TELEMETRY_CHANNELS; ++i)
+    {
+        if (!(mask & (1 << i)))
+            continue;
+        int16_t v = key ? values[i] : (int16_t)(values[i] - m_prev[i]);
+        p = put_varint(p, zigzag(v));
+        m_prev[i] = values[i];
+    }
+
+    uint8_t checksum = 0;
+    for (uint8_t *c = frame; c != p; ++c)
+        checksum ^= *c;
+    *p++ = checksum;
+
+    return p - frame;
+}
+
+//! @brief Base64 encoding of a frame
+//! @param data frame
+//! @param len frame length
+//! @param out output buffer of max_line characters, zero terminated
+//! @return length of the encoded line
+uint8_t TelemetryEncoder::base64(const uint8_t *data, uint8_t len, char *out)
+{
+    char *o = out;
+    for (uint8_t i = 0; i < len; i += 3)
+    {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) v |= (uint16_t)data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        *o++ = base64_char((v >> 18) & 0x3f);
+        *o++ = base64_char((v >> 12) & 0x3f);
+        *o++ = (i + 1 < len) ? base64_char((v >> 6) & 0x3f) : '=';
+        *o++ = (i + 2 < len) ? base64_char(v & 0x3f) : '=';
+    }
+    *o = 0;
+    return o - out;
+}
@@ -0,0 +1,61 @@
+//! @file
+//! @brief Compact thermal telemetry frames
+//!
+//! Each frame carries a timestamp and a set of fixed-point channels. A key frame holds absolute
+//! values, the following frames only the differences to the previous frame. All fields are
+//! zigzag varints, so that a steady channel takes a single byte. The frame is terminated by the XOR
+//! checksum of all its bytes and sent as a base64 line prefixed with "TLM:", so it doesn't break
+//! the line protocol of the host.
+//!
+//! Frame layout:
+//! - header: bit 7 key frame, bits 0-6 sequence number
+//! - key frame only: channel mask
+//! - time: key frame _millis(), otherwise milliseconds since the previous frame
+//! - value of each channel present in the mask, lowest bit first
+//! - checksum
+//!
+//! See tools/telemetry_decode for the decoder.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+//! @name Telemetry channels
+//! @{
+#define TELEMETRY_HOTEND       0 //!< hotend temperature [1/16 C]
+#define TELEMETRY_HOTEND_TGT   1 //!< hotend target [1/16 C]
+#define TELEMETRY_HOTEND_PWM   2 //!< hotend heater duty [0-127]
+#define TELEMETRY_BED          3 //!< bed temperature [1/16 C]
+#define TELEMETRY_BED_TGT      4 //!< bed target [1/16 C]
+#define TELEMETRY_BED_PWM      5 //!< bed heater duty [0-127]
+#define TELEMETRY_MODEL_ERR    6 //!< temperature model error [1/256 K/s]
+#define TELEMETRY_AMBIENT      7 //!< ambient temperature [1/16 C]
+#define TELEMETRY_CHANNELS     8
+//! @}
+
+class TelemetryEncoder
+{
+public:
+    //! header, mask, time, channels and checksum
+    static const uint8_t max_frame = 1 + 1 + 5 + TELEMETRY_CHANNELS * 3 + 1;
+    //! base64 encoded max_frame including the terminating zero
+    static const uint8_t max_line = (max_frame + 2) / 3 * 4 + 1;
+
+    explicit TelemetryEncoder(uint8_t keyframe_interval);
+
+    //! start the next frame with a key frame
+    void reset() { m_keyframe = 0; }
+    uint8_t encode(uint32_t time, uint8_t mask, const int16_t *values, uint8_t *frame);
+    static uint8_t base64(const uint8_t *data, uint8_t len, char *out);
+
+private:
+    int16_t m_prev[TELEMETRY_CHANNELS]; //!< values of the previous frame
+    uint32_t m_time;                    //!< time of the previous frame
+    uint8_t m_keyframe_interval;
+    uint8_t m_keyframe;                 //!< frames until the next key frame
+    uint8_t m_mask;                     //!< channel mask of the current key frame
+    uint8_t m_seq;                      //!< frame sequence number
+};
+
+#endif /* TELEMETRY_H */
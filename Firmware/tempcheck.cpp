@@ -0,0 +1,130 @@
+//! @file
+
+#include "tempcheck.h"
+
+TempRunawayCheck::TempRunawayCheck()
+    : m_timer(0), m_target(0), m_preheat_start(0), m_error_counter(0), m_state(INACTIVE),
+      m_preheat_counter(0), m_preheat_errors(0)
+{
+}
+
+//! @brief Evaluate the heater state
+//! @param now current time [ms]
+//! @param target target temperature
+//! @param current current temperature
+//! @param output current heater output
+//! @param isbed the heater is a heatbed
+//! @param hysteresis allowed deviation from the target once it has been reached
+//! @param timeout time out of the hysteresis until a runaway is reported [s]
+//! @return detected error
+TempRunawayCheck::Result TempRunawayCheck::step(uint32_t now, float target, float current, float output, bool isbed, float hysteresis, uint16_t timeout)
+{
+    Result result = Result::ok;
+    bool check_active = false;
+
+    if (now - m_timer <= 2000)
+        return result;
+    m_timer = now;
+
+    if (output == 0)
+    {
+        check_active = false;
+        m_error_counter = 0;
+    }
+
+    if (m_target != target)
+    {
+        if (target > 0)
+        {
+            m_state = PREHEAT;
+            m_target = target;
+            m_preheat_start = current;
+            m_preheat_counter = 0;
+        }
+        else
+        {
+            m_state = INACTIVE;
+            m_target = target;
+        }
+    }
+
+    if ((current < target) && (m_state == PREHEAT))
+    {
+        m_preheat_counter++;
+        if (m_preheat_counter > (isbed ? 16 : 8)) // periodically check if current temperature changes
+        {
+            float delta = 2.0;
+            if (isbed)
+            {
+                delta = 3.0;
+                if (current > 90.0) delta = 2.0;
+                if (current > 105.0) delta = 0.6;
+            }
+            if (current - m_preheat_start < delta)
+                m_preheat_errors++;
+            else
+                m_preheat_errors = 0;
+
+            if (m_preheat_errors > (isbed ? 3 : 5))
+                result = Result::preheat;
+
+            m_preheat_start = current;
+            m_preheat_counter = 0;
+        }
+    }
+
+    if ((current > (target - hysteresis)) && (m_state == PREHEAT))
+    {
+        m_state = ACTIVE;
+        check_active = false;
+        m_error_counter = 0;
+    }
+
+    if (output > 0)
+        check_active = true;
+
+    if (check_active)
+    {
+        // we are in range
+        if ((current > (target - hysteresis)) && (current < (target + hysteresis)))
+        {
+            check_active = false;
+            m_error_counter = 0;
+        }
+        else if (m_state > PREHEAT)
+        {
+            m_error_counter++;
+            if (m_error_counter * 2 > timeout && result == Result::ok)
+                result = Result::runaway;
+        }
+    }
+
+    return result;
+}
+
+//! @param now current time [ms]
+//! @param heating the heater target is above its MINTEMP limit
+//! @param above_mintemp the current temperature is above MINTEMP including the hysteresis
+//! @param delay delay of the check after the heater has been turned on [ms]
+//! @retval true the minimal temperature should be checked now
+bool TempMinCheckGate::active(uint16_t now, bool heating, bool above_mintemp, uint16_t delay)
+{
+    if (!heating)
+    {
+        m_started = now;
+        m_running = true;
+        m_checking = false;
+        return false;
+    }
+
+    // the temperature is or was over MINTEMP, so there is no need to wait for the delay
+    m_checking = m_checking || above_mintemp;
+    if (m_running && (uint16_t)(now - m_started) >= delay)
+        m_running = false;
+    if (!m_running || m_checking)
+    {
+        m_checking = true;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,63 @@
+//! @file
+//! @brief Thermal fault detection used by the temperature manager
+//!
+//! The state machines are kept free of any hardware dependency, so that they can be exercised by
+//! the host test bench. temperature.cpp feeds them from temp_mgr_isr and raises the resulting
+//! errors via set_temp_error.
+
+#ifndef TEMPCHECK_H
+#define TEMPCHECK_H
+
+#include <stdint.h>
+
+//! @brief Preheat and thermal runaway detection for a single heater
+//!
+//! Called on every temp_mgr cycle, the state is evaluated every 2 seconds.
+class TempRunawayCheck
+{
+public:
+    enum State : uint8_t
+    {
+        INACTIVE = 0, //!< heater is off
+        PREHEAT = 1,  //!< heating up to the target, temperature must keep rising
+        ACTIVE = 2,   //!< target reached, temperature must stay within the hysteresis
+    };
+
+    enum class Result : uint8_t
+    {
+        ok,
+        preheat, //!< temperature doesn't rise while preheating
+        runaway, //!< temperature out of the hysteresis for longer than the timeout
+    };
+
+    TempRunawayCheck();
+    Result step(uint32_t now, float target, float current, float output, bool isbed, float hysteresis, uint16_t timeout);
+    State state() const { return (State)m_state; }
+
+private:
+    uint32_t m_timer;          //!< last evaluation [ms]
+    float m_target;            //!< target temperature of the current state
+    float m_preheat_start;     //!< temperature at the start of the preheat check period
+    uint16_t m_error_counter;  //!< number of evaluations out of the hysteresis
+    uint8_t m_state;
+    uint8_t m_preheat_counter; //!< evaluations since the start of the preheat check period
+    uint8_t m_preheat_errors;  //!< consecutive preheat check periods without a temperature rise
+};
+
+//! @brief Delays the minimal temperature check after the heater has been turned on
+//!
+//! A cold heater can be below its MINTEMP limit, so the check is enabled only once the
+//! temperature has risen above the limit or when the delay has elapsed.
+class TempMinCheckGate
+{
+public:
+    TempMinCheckGate() : m_started(0), m_running(false), m_checking(false) {}
+    bool active(uint16_t now, bool heating, bool above_mintemp, uint16_t delay);
+
+private:
+    uint16_t m_started; //!< time the heater was turned on [ms]
+    bool m_running;     //!< the delay is running
+    bool m_checking;    //!< the check is active
+};
+
+#endif /* TEMPCHECK_H */
@@ -44,7 +44,20 @@
 #include "adc.h"
 #include "ConfigurationStore.h"
 #include "Timer.h"
+#include "tempcheck.h"
+#ifdef SOFT_PWM_EDGES
+#include "soft_pwm.h"
+#endif //SOFT_PWM_EDGES
+#if defined(SOFT_PWM_DITHER) && !defined(SOFT_PWM_EDGES)
+#error "SOFT_PWM_DITHER requires SOFT_PWM_EDGES"
+#endif
 #include "Configuration_prusa.h"
+#ifdef HOTEND_FEEDFORWARD
+#include "hotend_ff.h"
+#endif //HOTEND_FEEDFORWARD
+#ifdef THERMAL_TELEMETRY
+#include "telemetry.h"
+#endif //THERMAL_TELEMETRY
 
 #if (ADC_OVRSAMPL != OVERSAMPLENR)
 #error "ADC_OVRSAMPL oversampling must match OVERSAMPLENR"
@@ -147,6 +160,9 @@ float current_temperature_bed = 0.0;
 #endif //PIDTEMP
   
 unsigned char soft_pwm_bed;
+#ifdef SOFT_PWM_DITHER
+uint16_t soft_pwm_bed_fine; //!< bed PID output in 8.8 fixed point, dithered by the bed PWM
+#endif //SOFT_PWM_DITHER
 
 #ifdef BABYSTEPPING
   volatile int babystepsTodo[3]={0,0,0};
@@ -168,6 +184,9 @@ static volatile bool temp_meas_ready = false;
   static float iState_sum_min[EXTRUDERS];
   static float iState_sum_max[EXTRUDERS];
   static bool pid_reset[EXTRUDERS];
+#ifdef HOTEND_FEEDFORWARD
+  static volatile uint8_t hotend_ff_output; // feed-forward term for the active hotend (PID_MAX units)
+#endif //HOTEND_FEEDFORWARD
 #endif //PIDTEMP
 #ifdef PIDTEMPBED
   //static cannot be external:
@@ -228,13 +247,6 @@ static float analog2tempAmbient(int raw);
 #endif
 static void updateTemperatures();
 
-enum TempRunawayStates : uint8_t
-{
-	TempRunaway_INACTIVE = 0,
-	TempRunaway_PREHEAT = 1,
-	TempRunaway_ACTIVE = 2,
-};
-
 #ifndef SOFT_PWM_SCALE
 #define SOFT_PWM_SCALE 0
 #endif
@@ -244,10 +256,7 @@ enum TempRunawayStates : uint8_t
 //===========================================================================
 
 #if (defined (TEMP_RUNAWAY_BED_HYSTERESIS) && TEMP_RUNAWAY_BED_TIMEOUT > 0) || (defined (TEMP_RUNAWAY_EXTRUDER_HYSTERESIS) && TEMP_RUNAWAY_EXTRUDER_TIMEOUT > 0)
-static uint8_t temp_runaway_status[1 + EXTRUDERS];
-static float temp_runaway_target[1 + EXTRUDERS];
-static uint32_t temp_runaway_timer[1 + EXTRUDERS];
-static uint16_t temp_runaway_error_counter[1 + EXTRUDERS];
+static TempRunawayCheck temp_runaway[1 + EXTRUDERS];
 
 static void temp_runaway_check(uint8_t _heater_id, float _target_temperature, float _current_temperature, float _output, bool _isbed);
 static void temp_runaway_stop(bool isPreheat, bool isBed);
@@ -558,12 +567,42 @@ bool get_temp_error()
 
 void handle_temp_error();
 
+#if defined(PIDTEMP) && defined(HOTEND_FEEDFORWARD)
+//! estimate the melting power of the queued moves and pass it to temp_mgr as a PID offset
+static void update_hotend_ff()
+{
+    float dT = target_temperature[active_extruder] - HOTEND_FF_AMBIENT;
+    float power = 0;
+    if (dT > 0)
+        power = hotend_ff_power(planner_extrusion_flow(), HOTEND_FF_HEAT, dT);
+    float output = power * (PID_MAX / HOTEND_FF_HEATER_P);
+    hotend_ff_output = (uint8_t)constrain(output, 0, HOTEND_FF_MAX);
+}
+#endif
+
+#ifdef THERMAL_TELEMETRY
+static void thermal_telemetry();
+#endif //THERMAL_TELEMETRY
+#ifdef SOFT_PWM_EDGES
+static void soft_pwm_prepare();
+#endif //SOFT_PWM_EDGES
+
 void manage_heater()
 {
 #ifdef WATCHDOG
     wdt_reset();
 #endif //WATCHDOG
 
+#ifdef SOFT_PWM_EDGES
+    // the schedule of the next soft PWM frame, keeps the tick ISR free of the sorting
+    soft_pwm_prepare();
+#endif //SOFT_PWM_EDGES
+
+#ifdef THERMAL_TELEMETRY
+    // stream at its own rate, independently of temp_mgr
+    thermal_telemetry();
+#endif //THERMAL_TELEMETRY
+
     // limit execution to the same rate as temp_mgr (low-level fault handling is already handled -
     // any remaining error handling is just user-facing and can wait one extra cycle)
     if(!temp_meas_ready)
@@ -582,6 +621,11 @@ void manage_heater()
     if(temp_error_state.v)
         handle_temp_error();
 
+#if defined(PIDTEMP) && defined(HOTEND_FEEDFORWARD)
+    // pre-boost the hotend by the melting power needed for the upcoming extrusion
+    update_hotend_ff();
+#endif
+
     // periodically check fans
     checkFans();
 
@@ -891,132 +935,34 @@ void soft_pwm_init()
 #if (defined (TEMP_RUNAWAY_BED_HYSTERESIS) && TEMP_RUNAWAY_BED_TIMEOUT > 0) || (defined (TEMP_RUNAWAY_EXTRUDER_HYSTERESIS) && TEMP_RUNAWAY_EXTRUDER_TIMEOUT > 0)
 static void temp_runaway_check(uint8_t _heater_id, float _target_temperature, float _current_temperature, float _output, bool _isbed)
 {
-	float __delta;
 	float __hysteresis = 0;
 	uint16_t __timeout = 0;
-	bool temp_runaway_check_active = false;
-	static float __preheat_start[2] = { 0,0}; //currently just bed and one extruder
-	static uint8_t __preheat_counter[2] = { 0,0};
-	static uint8_t __preheat_errors[2] = { 0,0};
-
-	if (_millis() - temp_runaway_timer[_heater_id] > 2000)
-	{
 
 #ifdef 	TEMP_RUNAWAY_BED_TIMEOUT
-          if (_isbed)
-          {
-               __hysteresis = TEMP_RUNAWAY_BED_HYSTERESIS;
-               __timeout = TEMP_RUNAWAY_BED_TIMEOUT;
-          }
+	if (_isbed)
+	{
+		__hysteresis = TEMP_RUNAWAY_BED_HYSTERESIS;
+		__timeout = TEMP_RUNAWAY_BED_TIMEOUT;
+	}
 #endif
 #ifdef 	TEMP_RUNAWAY_EXTRUDER_TIMEOUT
-          if (!_isbed)
-          {
-               __hysteresis = TEMP_RUNAWAY_EXTRUDER_HYSTERESIS;
-               __timeout = TEMP_RUNAWAY_EXTRUDER_TIMEOUT;
-          }
+	if (!_isbed)
+	{
+		__hysteresis = TEMP_RUNAWAY_EXTRUDER_HYSTERESIS;
+		__timeout = TEMP_RUNAWAY_EXTRUDER_TIMEOUT;
+	}
 #endif
 
-		temp_runaway_timer[_heater_id] = _millis();
-		if (_output == 0)
-		{
-			temp_runaway_check_active = false;
-			temp_runaway_error_counter[_heater_id] = 0;
-		}
-
-		if (temp_runaway_target[_heater_id] != _target_temperature)
-		{
-			if (_target_temperature > 0)
-			{
-				temp_runaway_status[_heater_id] = TempRunaway_PREHEAT;
-				temp_runaway_target[_heater_id] = _target_temperature;
-				__preheat_start[_heater_id] = _current_temperature;
-				__preheat_counter[_heater_id] = 0;
-			}
-			else
-			{
-				temp_runaway_status[_heater_id] = TempRunaway_INACTIVE;
-				temp_runaway_target[_heater_id] = _target_temperature;
-			}
-		}
-
-		if ((_current_temperature < _target_temperature)  && (temp_runaway_status[_heater_id] == TempRunaway_PREHEAT))
-		{
-			__preheat_counter[_heater_id]++;
-			if (__preheat_counter[_heater_id] > ((_isbed) ? 16 : 8)) // periodicaly check if current temperature changes
-			{
-				/*SERIAL_ECHOPGM("Heater:");
-				MYSERIAL.print(_heater_id);
-				SERIAL_ECHOPGM(" T:");
-				MYSERIAL.print(_current_temperature);
-				SERIAL_ECHOPGM(" Tstart:");
-				MYSERIAL.print(__preheat_start[_heater_id]);
-				SERIAL_ECHOPGM(" delta:");
-				MYSERIAL.print(_current_temperature-__preheat_start[_heater_id]);*/
-				
-//-//				if (_current_temperature - __preheat_start[_heater_id] < 2) {
-//-//				if (_current_temperature - __preheat_start[_heater_id] < ((_isbed && (_current_temperature>105.0))?0.6:2.0)) {
-                    __delta=2.0;
-                    if(_isbed)
-                         {
-                         __delta=3.0;
-                         if(_current_temperature>90.0) __delta=2.0;
-                         if(_current_temperature>105.0) __delta=0.6;
-                         }
-				if (_current_temperature - __preheat_start[_heater_id] < __delta) {
-					__preheat_errors[_heater_id]++;
-					/*SERIAL_ECHOPGM(" Preheat errors:");
-					MYSERIAL.println(__preheat_errors[_heater_id]);*/
-				}
-				else {
-					//SERIAL_ECHOLNPGM("");
-					__preheat_errors[_heater_id] = 0;
-				}
-
-				if (__preheat_errors[_heater_id] > ((_isbed) ? 3 : 5)) 
-                    set_temp_error((_isbed?TempErrorSource::bed:TempErrorSource::hotend), _heater_id, TempErrorType::preheat);
-
-				__preheat_start[_heater_id] = _current_temperature;
-				__preheat_counter[_heater_id] = 0;
-			}
-		}
-
-//-//		if (_current_temperature >= _target_temperature  && temp_runaway_status[_heater_id] == TempRunaway_PREHEAT)
-		if ((_current_temperature > (_target_temperature - __hysteresis))  && temp_runaway_status[_heater_id] == TempRunaway_PREHEAT)
-		{
-			/*SERIAL_ECHOPGM("Heater:");
-			MYSERIAL.print(_heater_id);
-			MYSERIAL.println(" ->tempRunaway");*/
-			temp_runaway_status[_heater_id] = TempRunaway_ACTIVE;
-			temp_runaway_check_active = false;
-			temp_runaway_error_counter[_heater_id] = 0;
-		}
-
-		if (_output > 0)
-		{
-			temp_runaway_check_active = true;
-		}
-
-
-		if (temp_runaway_check_active)
-		{			
-			//	we are in range
-			if ((_current_temperature > (_target_temperature - __hysteresis)) && (_current_temperature < (_target_temperature + __hysteresis)))
-			{
-				temp_runaway_check_active = false;
-				temp_runaway_error_counter[_heater_id] = 0;
-			}
-			else
-			{
-				if (temp_runaway_status[_heater_id] > TempRunaway_PREHEAT)
-				{
-					temp_runaway_error_counter[_heater_id]++;
-					if (temp_runaway_error_counter[_heater_id] * 2 > __timeout)
-                        set_temp_error((_isbed?TempErrorSource::bed:TempErrorSource::hotend), _heater_id, TempErrorType::runaway);
-				}
-			}
-		}
-
+	switch (temp_runaway[_heater_id].step(_millis(), _target_temperature, _current_temperature, _output, _isbed, __hysteresis, __timeout))
+	{
+	case TempRunawayCheck::Result::preheat:
+		set_temp_error((_isbed?TempErrorSource::bed:TempErrorSource::hotend), _heater_id, TempErrorType::preheat);
+		break;
+	case TempRunawayCheck::Result::runaway:
+		set_temp_error((_isbed?TempErrorSource::bed:TempErrorSource::hotend), _heater_id, TempErrorType::runaway);
+		break;
+	case TempRunawayCheck::Result::ok:
+		break;
 	}
 }
 
@@ -1205,6 +1151,122 @@ FORCE_INLINE static void applyBabysteps() {
 }
 #endif //BABYSTEPPING
 
+#ifdef SOFT_PWM_EDGES
+#if SOFT_PWM_SCALE != 0
+#error "SOFT_PWM_EDGES requires SOFT_PWM_SCALE 0"
+#endif
+#ifdef SLOW_PWM_HEATERS
+#error "SOFT_PWM_EDGES can't be used with SLOW_PWM_HEATERS"
+#endif
+
+// soft PWM output mask
+#define SOFT_PWM_HEATER(e) (1 << (e))
+#define SOFT_PWM_FAN (1 << 3)
+
+#ifdef FAN_SOFT_PWM
+static_assert(SoftPwmSchedule::max_edges >= 2 * EXTRUDERS + 2 * (128 >> FAN_SOFT_PWM_BITS), "soft PWM schedule too short");
+#endif //FAN_SOFT_PWM
+
+//! Schedules swapped by the PWM frames, the ISR plays one while the other one is built
+static SoftPwmSchedule soft_pwm_edges[2];
+static volatile uint8_t soft_pwm_active = 0;
+//! the other schedule is built and waits for the next frame
+static volatile bool soft_pwm_pending = false;
+#if defined(SOFT_PWM_DITHER) && defined(FAN_SOFT_PWM)
+static SigmaDelta soft_pwm_fan_dither;
+#endif
+
+//! @brief Build the edge schedule of the next PWM frame from the current duties
+//!
+//! Called from the main loop, the ISR only swaps the schedules. A schedule which isn't played yet
+//! is kept, so that the fan dithering advances by one frame per frame played.
+//! As with the counter compare, a heater with a non-zero duty d is on for d+1 ticks of the 128 tick
+//! frame, the fan for soft_pwm_fan+1 ticks of each of its periods.
+static void soft_pwm_prepare()
+{
+  if (soft_pwm_pending)
+    return;
+  SoftPwmSchedule &edges = soft_pwm_edges[soft_pwm_active ^ 1];
+  edges.clear();
+  for (uint8_t e = 0; e < EXTRUDERS; ++e)
+    if (!edges.add_pwm(0, soft_pwm[e] ? soft_pwm[e] + 1 : 0, 128, SOFT_PWM_HEATER(e)))
+      return;
+#ifdef FAN_SOFT_PWM
+  const uint8_t fan_period = (1 << FAN_SOFT_PWM_BITS);
+  const uint8_t fan_speed = fanSpeedSoftPwm;
+  soft_pwm_fan = fan_speed / (1 << (8 - FAN_SOFT_PWM_BITS));
+  for (uint8_t start = 0; start < 128; start += fan_period)
+  {
+#ifdef SOFT_PWM_DITHER
+    // 255 is kept as full on, fan check measures the RPM without modulation
+    uint8_t on_ticks = (fan_speed == 255) ? fan_period : soft_pwm_fan_dither.step(fan_speed, 8 - FAN_SOFT_PWM_BITS);
+#else
+    uint8_t on_ticks = soft_pwm_fan ? soft_pwm_fan + 1 : 0;
+#endif //SOFT_PWM_DITHER
+    if (!edges.add_pwm(start, on_ticks, fan_period, SOFT_PWM_FAN))
+      return;
+  }
+#endif //FAN_SOFT_PWM
+  soft_pwm_pending = true;
+}
+
+FORCE_INLINE static void soft_pwm_write(uint8_t set, uint8_t clr)
+{
+  if (set & SOFT_PWM_HEATER(0))
+  {
+    WRITE(HEATER_0_PIN,1);
+#ifdef HEATERS_PARALLEL
+    WRITE(HEATER_1_PIN,1);
+#endif
+  }
+  else if (clr & SOFT_PWM_HEATER(0))
+  {
+    WRITE(HEATER_0_PIN,0);
+#ifdef HEATERS_PARALLEL
+    WRITE(HEATER_1_PIN,0);
+#endif
+  }
+#if EXTRUDERS > 1
+  if (set & SOFT_PWM_HEATER(1)) WRITE(HEATER_1_PIN,1); else if (clr & SOFT_PWM_HEATER(1)) WRITE(HEATER_1_PIN,0);
+#endif
+#if EXTRUDERS > 2
+  if (set & SOFT_PWM_HEATER(2)) WRITE(HEATER_2_PIN,1); else if (clr & SOFT_PWM_HEATER(2)) WRITE(HEATER_2_PIN,0);
+#endif
+#ifdef FAN_SOFT_PWM
+  if (set & SOFT_PWM_FAN) WRITE(FAN_PIN,1); else if (clr & SOFT_PWM_FAN) WRITE(FAN_PIN,0);
+#endif
+}
+
+FORCE_INLINE static void soft_pwm_core()
+{
+  static uint8_t pwm_count = 0;
+  static uint8_t enabled = 0;
+
+  if (pwm_count == 0)
+  {
+    if (soft_pwm_pending)
+    {
+      soft_pwm_active ^= 1;
+      soft_pwm_pending = false;
+    }
+    soft_pwm_edges[soft_pwm_active].rewind();
+    // the schedule may lag the duties, an output turned off in the meantime isn't turned on
+    enabled = 0;
+    for (uint8_t e = 0; e < EXTRUDERS; ++e)
+      if (soft_pwm[e]) enabled |= SOFT_PWM_HEATER(e);
+#ifdef FAN_SOFT_PWM
+    if (fanSpeedSoftPwm) enabled |= SOFT_PWM_FAN;
+#endif //FAN_SOFT_PWM
+  }
+  const SoftPwmSchedule::Edge *edge = soft_pwm_edges[soft_pwm_active].due(pwm_count);
+  if (edge)
+    soft_pwm_write(edge->set & enabled, edge->clr | (edge->set & ~enabled));
+
+  pwm_count = (pwm_count + 1) & 0x7f;
+}
+
+#else //SOFT_PWM_EDGES
+
 FORCE_INLINE static void soft_pwm_core()
 {
   static uint8_t pwm_count = (1 << SOFT_PWM_SCALE);
@@ -1542,6 +1604,7 @@ FORCE_INLINE static void soft_pwm_core()
   
 #endif //ifndef SLOW_PWM_HEATERS
 }
+#endif //SOFT_PWM_EDGES
 
 FORCE_INLINE static void soft_pwm_isr()
 {
@@ -1917,6 +1980,10 @@ static void pid_heater(uint8_t e, const float current, const int target)
 #define K2 (1.0-PID_K1)
         dTerm[e] = (cs.Kd * (pid_input - dState_last[e]))*K2 + (PID_K1 * dTerm[e]); // e.g. digital filtration of derivative term changes
         pid_output = pTerm[e] + iTerm[e] - dTerm[e]; // subtraction due to "Derivative on Measurement" method (i.e. derivative of input instead derivative of error is used)
+#ifdef HOTEND_FEEDFORWARD
+        if (e == active_extruder)
+            pid_output += hotend_ff_output;
+#endif //HOTEND_FEEDFORWARD
         if (pid_output > PID_MAX) {
             if (pid_error[e] > 0 ) iState_sum[e] -= pid_error[e]; // conditional un-integration
             pid_output=PID_MAX;
@@ -1930,6 +1997,10 @@ static void pid_heater(uint8_t e, const float current, const int target)
         iState_sum[e] = constrain(iState_sum[e], 0, PID_INTEGRAL_DRIVE_MAX);
         dTerm[e] = cs.Kd * (pid_input - dState_last[e]);
         pid_output = iState_sum[e] - dTerm[e];  // subtraction due to "Derivative on Measurement" method (i.e. derivative of input instead derivative of error is used)
+#ifdef HOTEND_FEEDFORWARD
+        if (e == active_extruder)
+            pid_output += hotend_ff_output;
+#endif //HOTEND_FEEDFORWARD
         pid_output = constrain(pid_output, 0, PID_MAX);
 #endif // PonM
     }
@@ -2011,11 +2082,21 @@ static void pid_bed(const float current, const int target)
 
     if(current < BED_MAXTEMP)
     {
+#ifdef SOFT_PWM_DITHER
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            soft_pwm_bed_fine = pid_output * 256;
+        }
+#endif //SOFT_PWM_DITHER
         soft_pwm_bed = (int)pid_output >> 1;
         timer02_set_pwm0(soft_pwm_bed << 1);
     }
     else
     {
+#ifdef SOFT_PWM_DITHER
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            soft_pwm_bed_fine = 0;
+        }
+#endif //SOFT_PWM_DITHER
         soft_pwm_bed = 0;
         timer02_set_pwm0(soft_pwm_bed << 1);
     }
@@ -2247,10 +2328,8 @@ void disable_heater()
 
 static void check_min_temp_raw()
 {
-    static bool bCheckingOnHeater = false; // state variable, which allows to short no-checking delay (is set, when temperature is (first time) over heaterMintemp)
-    static bool bCheckingOnBed    = false; // state variable, which allows to short no-checking delay (is set, when temperature is (first time) over bedMintemp)
-    static ShortTimer oTimer4minTempHeater;
-    static ShortTimer oTimer4minTempBed;
+    static TempMinCheckGate minTempGateHeater; // delays the check after the heater is turned on, unless the temperature is (first time) over heaterMintemp
+    static TempMinCheckGate minTempGateBed;    // delays the check after the bed is turned on, unless the temperature is (first time) over bedMintemp
 
 #ifdef AMBIENT_THERMISTOR
 #ifdef AMBIENT_MINTEMP
@@ -2267,32 +2346,16 @@ static void check_min_temp_raw()
 #endif //AMBIENT_THERMISTOR
         // *** 'common' part of code for MK2.5 & MK3
         // * nozzle checking
-        if(target_temperature_isr[active_extruder]>minttemp[active_extruder]) {
-            // ~ nozzle heating is on
-            bCheckingOnHeater=bCheckingOnHeater||(current_temperature_isr[active_extruder]>(minttemp[active_extruder]+TEMP_HYSTERESIS)); // for eventually delay cutting
-            if(oTimer4minTempHeater.expired(HEATER_MINTEMP_DELAY)||(!oTimer4minTempHeater.running())||bCheckingOnHeater) {
-                bCheckingOnHeater=true;   // not necessary
-                check_min_temp_heater0(); // delay is elapsed or temperature is/was over minTemp => periodical checking is active
-            }
-        }
-        else {
-            // ~ nozzle heating is off
-            oTimer4minTempHeater.start();
-            bCheckingOnHeater=false;
+        if(minTempGateHeater.active(_millis(), target_temperature_isr[active_extruder]>minttemp[active_extruder],
+                                    current_temperature_isr[active_extruder]>(minttemp[active_extruder]+TEMP_HYSTERESIS),
+                                    HEATER_MINTEMP_DELAY)) {
+            check_min_temp_heater0(); // delay is elapsed or temperature is/was over minTemp => periodical checking is active
         }
         // * bed checking
-        if(target_temperature_bed_isr>BED_MINTEMP) {
-            // ~ bed heating is on
-            bCheckingOnBed=bCheckingOnBed||(current_temperature_bed_isr>(BED_MINTEMP+TEMP_HYSTERESIS)); // for eventually delay cutting
-            if(oTimer4minTempBed.expired(BED_MINTEMP_DELAY)||(!oTimer4minTempBed.running())||bCheckingOnBed) {
-                bCheckingOnBed=true;  // not necessary
-                check_min_temp_bed(); // delay is elapsed or temperature is/was over minTemp => periodical checking is active
-            }
-        }
-        else {
-            // ~ bed heating is off
-            oTimer4minTempBed.start();
-            bCheckingOnBed=false;
+        if(minTempGateBed.active(_millis(), target_temperature_bed_isr>BED_MINTEMP,
+                                 current_temperature_bed_isr>(BED_MINTEMP+TEMP_HYSTERESIS),
+                                 BED_MINTEMP_DELAY)) {
+            check_min_temp_bed(); // delay is elapsed or temperature is/was over minTemp => periodical checking is active
         }
         // *** end of 'common' part
 #ifdef AMBIENT_THERMISTOR
@@ -2897,3 +2960,69 @@ void temp_model_log_enable(bool enable)
 }
 #endif
 #endif
+
+#ifdef THERMAL_TELEMETRY
+static TelemetryEncoder telemetry(THERMAL_TELEMETRY_KEYFRAME);
+static ShortTimer telemetry_timer;
+static uint16_t telemetry_period; //!< [ms], 0 disabled
+
+//! @brief Start or stop the thermal telemetry stream
+//! @param hz frame rate, 0 to stop the stream
+void thermal_telemetry_set_rate(uint8_t hz)
+{
+    telemetry_period = hz ? 1000 / hz : 0;
+    telemetry.reset();
+    if (hz)
+        telemetry_timer.start();
+    else
+        telemetry_timer.stop();
+}
+
+//! @brief Send a telemetry frame when due
+//!
+//! The values are refreshed by temp_mgr, so frames sent faster than TEMP_MGR_INTV repeat the
+//! last sample, which costs a single byte per channel.
+static void thermal_telemetry()
+{
+    if (!telemetry_period || !telemetry_timer.expired(telemetry_period))
+        return;
+    telemetry_timer.start();
+
+    int16_t values[TELEMETRY_CHANNELS];
+    uint8_t mask = 0;
+
+#if defined(TEMP_0_PIN) && TEMP_0_PIN > -1
+    values[TELEMETRY_HOTEND] = current_temperature[0] * 16;
+    values[TELEMETRY_HOTEND_TGT] = target_temperature[0] * 16;
+    values[TELEMETRY_HOTEND_PWM] = soft_pwm[0];
+    mask |= _BV(TELEMETRY_HOTEND) | _BV(TELEMETRY_HOTEND_TGT) | _BV(TELEMETRY_HOTEND_PWM);
+#endif
+#if defined(TEMP_BED_PIN) && TEMP_BED_PIN > -1
+    values[TELEMETRY_BED] = current_temperature_bed * 16;
+    values[TELEMETRY_BED_TGT] = target_temperature_bed * 16;
+    values[TELEMETRY_BED_PWM] = soft_pwm_bed;
+    mask |= _BV(TELEMETRY_BED) | _BV(TELEMETRY_BED_TGT) | _BV(TELEMETRY_BED_PWM);
+#endif
+#ifdef TEMP_MODEL
+    if (temp_model::enabled) {
+        float dT_err;
+        {
+            TempMgrGuard temp_mgr_guard;
+            dT_err = temp_model::data.dT_err_prev;
+        }
+        values[TELEMETRY_MODEL_ERR] = constrain(dT_err * (256 / TEMP_MGR_INTV), INT16_MIN, INT16_MAX);
+        mask |= _BV(TELEMETRY_MODEL_ERR);
+    }
+#endif
+#ifdef AMBIENT_THERMISTOR
+    values[TELEMETRY_AMBIENT] = current_temperature_ambient * 16;
+    mask |= _BV(TELEMETRY_AMBIENT);
+#endif
+
+    uint8_t frame[TelemetryEncoder::max_frame];
+    char line[TelemetryEncoder::max_line];
+    TelemetryEncoder::base64(frame, telemetry.encode(_millis(), mask, values, frame), line);
+    SERIAL_PROTOCOLPGM("TLM:");
+    SERIAL_PROTOCOLLN(line);
+}
+#endif //THERMAL_TELEMETRY
@@ -234,6 +234,10 @@ void temp_model_log_enable(bool enable);
 #endif
 #endif
 
+#ifdef THERMAL_TELEMETRY
+void thermal_telemetry_set_rate(uint8_t hz);
+#endif //THERMAL_TELEMETRY
+
 #ifdef FAN_SOFT_PWM
 extern unsigned char fanSpeedSoftPwm;
 #endif
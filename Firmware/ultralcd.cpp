@@ -5798,6 +5798,9 @@ static void lcd_reset_sheet()
     eeprom_default_sheet_name(selected_sheet, sheetName);
 	eeprom_update_word(reinterpret_cast<uint16_t *>(&(EEPROM_Sheets_base->s[selected_sheet].z_offset)),EEPROM_EMPTY_VALUE16);
 	eeprom_update_block(sheetName.c,EEPROM_Sheets_base->s[selected_sheet].name,sizeof(Sheet::name));
+#ifdef MBL_STORED_MESH
+	mbl_stored_invalidate(selected_sheet);
+#endif //MBL_STORED_MESH
 	if (selected_sheet == eeprom_read_byte(&(EEPROM_Sheets_base->active_sheet)))
 	{
         eeprom_switch_to_next_sheet();
@@ -6438,6 +6441,16 @@ void lcd_sdcard_menu()
 	static_assert(sizeof(menu_data)>= sizeof(_menu_data_sdcard_t),"_menu_data_sdcard_t doesn't fit into menu_data");
 	_menu_data_sdcard_t* _md = (_menu_data_sdcard_t*)&(menu_data[0]);
 	
+#ifdef SDSORT_INDEX
+	// build the sort index of the directory a step at a time, the listing is shown unsorted meanwhile
+	if (card.presort_busy())
+	{
+		card.presort_step();
+		_md->scrollPointer = NULL; // the step overwrote the name of the selected file
+		if (!card.presort_busy())
+			lcd_draw_update = 1;
+	}
+#endif //SDSORT_INDEX
 	switch(_md->menuState)
 	{
 		case _uninitialized: //Initialize menu data
@@ -7811,6 +7824,10 @@ static bool check_file(const char* filename) {
 	cmdqueue_serial_disabled = true;
 
 	menu_progressbar_init(bytesToCheck, _i("Checking file"));////MSG_CHECKING_FILE c=17
+#ifdef SD_BINARY_GCODE
+	// the converter writes the binary files at once, they aren't read as text
+	result = card.binary;
+#endif //SD_BINARY_GCODE
 	while (!card.eof() && !result) {
 		menu_progressbar_update(card.get_sdpos() - startPos);
 		card.sdprinting = true;
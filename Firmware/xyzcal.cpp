@@ -4,6 +4,7 @@
 #ifdef NEW_XYZCAL
 
 #include "xyzcal.h"
+#include "xyzcal_image.h"
 #include <avr/wdt.h>
 #include "stepper.h"
 #include "temperature.h"
@@ -551,152 +552,123 @@ void go_manhattan(int16_t x, int16_t y, int16_t z, int16_t acc, uint16_t min_del
 	// DBG(_n("\n"));
 }
 
-void xyzcal_scan_pixels_32x32_Zhop(int16_t cx, int16_t cy, int16_t min_z, int16_t max_z, uint16_t delay_us, uint8_t *pixels){
-	if (!pixels)
-		return;
+/// position of the scan of xyzcal_probe_pixel()
+static int16_t xyzcal_scan_cx;
+static int16_t xyzcal_scan_cy;
+static int16_t xyzcal_scan_min_z;
+static int16_t xyzcal_scan_max_z;
+static uint16_t xyzcal_scan_delay_us;
+/// row and direction the head moves along, 0xff at the start of the scan
+static uint8_t xyzcal_scan_row;
+static bool xyzcal_scan_back;
+
+/// Measures the pixel c, r of the scan: moves to it along the row and Z up diagonally (if needed),
+/// then up to un-trigger the PINDA and down until it triggers
+/// \returns height of the trigger above min_z
+static uint16_t xyzcal_probe_pixel(uint8_t c, uint8_t r, bool back){
 	int16_t z_trig;
-	uint16_t line_buffer[32];
 	uint16_t current_delay_us = MAX_DELAY; ///< defines current speed
 	int16_t start_z;
 	uint16_t steps_to_go;
+	const int16_t min_z = xyzcal_scan_min_z;
+	const int16_t max_z = xyzcal_scan_max_z;
+	const int16_t end_x = xyzcal_scan_cx + 64 * c - 992;
+
+	if (r != xyzcal_scan_row || back != xyzcal_scan_back){
+		/// start the row on its first pixel (cx -+ 992 for the full rows)
+		const int16_t y = xyzcal_scan_cy - 992 + r * 64;
+		go_manhattan(end_x, y, _Z, Z_ACCEL, Z_MIN_DELAY);
+		xyzcal_lineXYZ_to(end_x, y, _Z, xyzcal_scan_delay_us, 0);
+		sm4_set_dir(X_AXIS, back);
+		//@size=242
+		DBG(_n("%d\n"), 64 - (r * 2 + back)); ///< to keep OctoPrint connection alive
+		xyzcal_scan_row = r;
+		xyzcal_scan_back = back;
+	}
 
-	DBG(_n("Scan countdown: "));
-
-	for (uint8_t r = 0; r < 32; r++){ ///< Y axis
-		for (uint8_t d = 0; d < 2; ++d){
-			go_manhattan((d & 1) ? (cx + 992) : (cx - 992), cy - 992 + r * 64, _Z, Z_ACCEL, Z_MIN_DELAY);
-			xyzcal_lineXYZ_to((d & 1) ? (cx + 992) : (cx - 992), cy - 992 + r * 64, _Z, delay_us, 0);
-			sm4_set_dir(X_AXIS, d);
-            //@size=242
-			DBG(_n("%d\n"), 64 - (r * 2 + d)); ///< to keep OctoPrint connection alive
-
-			for (uint8_t c = 0; c < 32; c++){ ///< X axis
-				/// move to the next point and move Z up diagonally (if needed)
-				current_delay_us = MAX_DELAY;
-				const int16_t end_x = ((d & 1) ? 1 : -1) * (64 * (16 - c) - 32) + cx;
-				const int16_t length_x = ABS(end_x - _X);
-				const int16_t half_x = length_x / 2;
-				/// don't go up if PINDA not triggered (optimization)
-				const bool up = _PINDA;
-				const uint8_t axes = up ? X_AXIS_MASK | Z_AXIS_MASK : X_AXIS_MASK;
-				const uint8_t dir = Z_PLUS_MASK | (d & 1 ? X_MINUS_MASK : X_PLUS_MASK);
-
-				accelerate(axes, dir, Z_ACCEL, current_delay_us, Z_MIN_DELAY, half_x);
-				go_and_stop(axes, dir, Z_ACCEL, current_delay_us, length_x - half_x);
-				
-				
-				z_trig = min_z;
-
-				/// move up to un-trigger (surpress hysteresis)
-				sm4_set_dir(Z_AXIS, Z_PLUS);
-				/// speed up from stop, go half the way
-				current_delay_us = MAX_DELAY;
-				for (start_z = _Z; _Z < (max_z + start_z) / 2; ++_Z_){
-					if (!_PINDA){
-						break;
-					}
-					accelerate_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, Z_MIN_DELAY);
-				}
-
-				if (_PINDA){
-					steps_to_go = MAX(0, max_z - _Z);
-					while (_PINDA && _Z < max_z){
-						go_and_stop_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, steps_to_go);
-						++_Z_;
-					}
-				}
-				stop_smoothly(Z_AXIS_MASK, Z_PLUS_MASK, Z_ACCEL, current_delay_us);
-
-				/// move down to trigger
-				sm4_set_dir(Z_AXIS, Z_MINUS);
-				/// speed up
-				current_delay_us = MAX_DELAY;
-				for (start_z = _Z; _Z > (min_z + start_z) / 2; --_Z_){
-					if (_PINDA){
-						z_trig = _Z;
-						break;
-					}
-					accelerate_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, Z_MIN_DELAY);
-				}
-				/// slow down
-				if (!_PINDA){
-					steps_to_go = MAX(0, _Z - min_z);
-					while (!_PINDA && _Z > min_z){
-						go_and_stop_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, steps_to_go);
-						--_Z_;
-					}
-					z_trig = _Z;
-				}
-				/// slow down to stop but not lower than min_z
-				while (_Z > min_z && current_delay_us < MAX_DELAY){
-					accelerate_1_step(Z_AXIS_MASK, -Z_ACCEL, current_delay_us, Z_MIN_DELAY);
-					--_Z_;
-				}
-
-				if (d == 0){
-					line_buffer[c] = (uint16_t)(z_trig - min_z);
-				} else {
-					/// !!! data reversed in X
-					// DBG(_n("%04x"), ((uint32_t)line_buffer[31 - c] + (z_trig - min_z)) / 2);
-					/// save average of both directions (filters effect of hysteresis)
-					pixels[(uint16_t)r * 32 + (31 - c)] = (uint8_t)MIN((uint32_t)255, ((uint32_t)line_buffer[31 - c] + (z_trig - min_z)) / 2);
-				}
-			}
+	/// move to the next point and move Z up diagonally (if needed)
+	const int16_t length_x = ABS(end_x - _X);
+	const int16_t half_x = length_x / 2;
+	/// don't go up if PINDA not triggered (optimization)
+	const bool up = _PINDA;
+	const uint8_t axes = up ? X_AXIS_MASK | Z_AXIS_MASK : X_AXIS_MASK;
+	const uint8_t dir = Z_PLUS_MASK | (back ? X_MINUS_MASK : X_PLUS_MASK);
+
+	accelerate(axes, dir, Z_ACCEL, current_delay_us, Z_MIN_DELAY, half_x);
+	go_and_stop(axes, dir, Z_ACCEL, current_delay_us, length_x - half_x);
+
+	z_trig = min_z;
+
+	/// move up to un-trigger (surpress hysteresis)
+	sm4_set_dir(Z_AXIS, Z_PLUS);
+	/// speed up from stop, go half the way
+	current_delay_us = MAX_DELAY;
+	for (start_z = _Z; _Z < (max_z + start_z) / 2; ++_Z_){
+		if (!_PINDA){
+			break;
 		}
+		accelerate_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, Z_MIN_DELAY);
 	}
-	DBG(endl);
-}
 
-/// Returns rate of match
-/// max match = 132, min match = 0
-uint8_t xyzcal_match_pattern_12x12_in_32x32(uint16_t* pattern, uint8_t* pixels, uint8_t c, uint8_t r){
-	uint8_t thr = 16;
-	uint8_t match = 0;
-	for (uint8_t i = 0; i < 12; ++i){
-		for (uint8_t j = 0; j < 12; ++j){
-			/// skip corners (3 pixels in each)
-			if (((i == 0) || (i == 11)) && ((j < 2) || (j >= 10))) continue;
-			if (((j == 0) || (j == 11)) && ((i < 2) || (i >= 10))) continue;
-			const uint16_t idx = (c + j) + 32 * ((uint16_t)r + i);
-			const bool high_pix = pixels[idx] > thr;
-			const bool high_pat = pattern[i] & (1 << j);
-			if (high_pix == high_pat)
-				match++;
+	if (_PINDA){
+		steps_to_go = MAX(0, max_z - _Z);
+		while (_PINDA && _Z < max_z){
+			go_and_stop_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, steps_to_go);
+			++_Z_;
 		}
 	}
-	return match;
-}
-
-/// Searches for best match of pattern by shifting it
-/// Returns rate of match and the best location
-/// max match = 132, min match = 0
-uint8_t xyzcal_find_pattern_12x12_in_32x32(uint8_t* pixels, uint16_t* pattern, uint8_t* pc, uint8_t* pr){
-	if (!pixels || !pattern || !pc || !pr)
-		return -1;
-	uint8_t max_c = 0;
-	uint8_t max_r = 0;
-	uint8_t max_match = 0;
-
-	// DBG(_n("Matching:\n"));
-	/// pixel precision
-	for (uint8_t r = 0; r < (32 - 12); ++r){
-		for (uint8_t c = 0; c < (32 - 12); ++c){
-			const uint8_t match = xyzcal_match_pattern_12x12_in_32x32(pattern, pixels, c, r);
-			if (max_match < match){
-				max_c = c;
-				max_r = r;
-				max_match = match;
-			}
-			// DBG(_n("%d "), match);
+	stop_smoothly(Z_AXIS_MASK, Z_PLUS_MASK, Z_ACCEL, current_delay_us);
+
+	/// move down to trigger
+	sm4_set_dir(Z_AXIS, Z_MINUS);
+	/// speed up
+	current_delay_us = MAX_DELAY;
+	for (start_z = _Z; _Z > (min_z + start_z) / 2; --_Z_){
+		if (_PINDA){
+			z_trig = _Z;
+			break;
+		}
+		accelerate_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, Z_MIN_DELAY);
+	}
+	/// slow down
+	if (!_PINDA){
+		steps_to_go = MAX(0, _Z - min_z);
+		while (!_PINDA && _Z > min_z){
+			go_and_stop_1_step(Z_AXIS_MASK, Z_ACCEL, current_delay_us, steps_to_go);
+			--_Z_;
 		}
-		// DBG(_n("\n"));
+		z_trig = _Z;
+	}
+	/// slow down to stop but not lower than min_z
+	while (_Z > min_z && current_delay_us < MAX_DELAY){
+		accelerate_1_step(Z_AXIS_MASK, -Z_ACCEL, current_delay_us, Z_MIN_DELAY);
+		--_Z_;
 	}
-    //@size=278
-	DBG(_n("Pattern center [%f %f], match %f%%\n"), max_c + 5.5f, max_r + 5.5f, max_match / 1.32f);
 
-	*pc = max_c;
-	*pr = max_r;
-	return max_match;
+	return (uint16_t)(z_trig - min_z);
+}
+
+/// Scans 32x32 pixels around cx, cy, see xyzcal_image.h
+/// The patterns are needed by XYZCAL_COARSE_TO_FINE only.
+void xyzcal_scan_pixels_32x32_Zhop(int16_t cx, int16_t cy, int16_t min_z, int16_t max_z, uint16_t delay_us, uint8_t *pixels, uint16_t *pattern08, uint16_t *pattern10){
+	if (!pixels)
+		return;
+	xyzcal_scan_cx = cx;
+	xyzcal_scan_cy = cy;
+	xyzcal_scan_min_z = min_z;
+	xyzcal_scan_max_z = max_z;
+	xyzcal_scan_delay_us = delay_us;
+	xyzcal_scan_row = 0xff;
+
+	DBG(_n("Scan countdown: "));
+#ifdef XYZCAL_COARSE_TO_FINE
+	xyzcal_scan_coarse_to_fine(xyzcal_probe_pixel, pixels, pattern08, pattern10);
+#else
+	(void)pattern08;
+	(void)pattern10;
+	xyzcal_scan_32x32(xyzcal_probe_pixel, pixels);
+#endif //XYZCAL_COARSE_TO_FINE
+	DBG(endl);
 }
 
 const uint16_t xyzcal_point_pattern_10[12] PROGMEM = {0x000, 0x0f0, 0x1f8, 0x3fc, 0x7fe, 0x7fe, 0x7fe, 0x7fe, 0x3fc, 0x1f8, 0x0f0, 0x000};
@@ -729,148 +701,6 @@ bool xyzcal_searchZ(void) {
 	return false;
 }
 
-/// returns value of any location within data
-/// uses bilinear interpolation
-float get_value(uint8_t * matrix_32x32, float c, float r){
-	if (c <= 0 || r <= 0 || c >= 31 || r >= 31)
-		return 0;
-
-	/// calculate weights of nearby points
-	const float wc1 = c - floor(c);
-	const float wr1 = r - floor(r);
-	const float wc0 = 1 - wc1;
-	const float wr0 = 1 - wr1;
-
-	const float w00 = wc0 * wr0;
-	const float w01 = wc0 * wr1;
-	const float w10 = wc1 * wr0;
-	const float w11 = wc1 * wr1;
-
-	const uint16_t c0 = c;
-	const uint16_t c1 = c0 + 1;
-	const uint16_t r0 = r;
-	const uint16_t r1 = r0 + 1;
-
-	const uint16_t idx00 = c0 + 32 * r0;
-	const uint16_t idx01 = c0 + 32 * r1;
-	const uint16_t idx10 = c1 + 32 * r0;
-	const uint16_t idx11 = c1 + 32 * r1;
-
-	/// bilinear resampling
-	return w00 * matrix_32x32[idx00] + w01 * matrix_32x32[idx01] + w10 * matrix_32x32[idx10] + w11 * matrix_32x32[idx11];
-}
-
-const constexpr float m_infinity = -1000.f;
-
-/// replaces the highest number by m_infinity
-void remove_highest(float *points, const uint8_t num_points){
-	if (num_points <= 0)
-		return;
-
-	float max = points[0];
-	uint8_t max_i = 0;
-	for (uint8_t i = 0; i < num_points; ++i){
-		if (max < points[i]){
-			max = points[i];
-			max_i = i;
-		}
-	}
-	points[max_i] = m_infinity;
-}
-
-/// return the highest number in the list
-float highest(float *points, const uint8_t num_points){
-	if (num_points <= 0)
-		return 0;
-
-	float max = points[0];
-	for (uint8_t i = 0; i < num_points; ++i){
-		if (max < points[i]){
-			max = points[i];
-		}
-	}
-	return max;
-}
-
-/// slow bubble sort but short
-void sort(float *points, const uint8_t num_points){
-	/// one direction bubble sort
-	for (uint8_t i = 0; i < num_points; ++i){
-		for (uint8_t j = 0; j < num_points - i - 1; ++j){
-			if (points[j] > points[j + 1])
-				SWAP(points[j], points[j + 1]);
-		}
-	}
-	
-	// DBG(_n("Sorted: "));
-	// for (uint8_t i = 0; i < num_points; ++i)
-	// 	DBG(_n("%f "), points[i]);
-	// DBG(_n("\n"));
-}
-
-
-/// sort array and returns median value
-/// don't send empty array or nullptr
-float median(float *points, const uint8_t num_points){
-	sort(points, num_points);
-	return points[num_points / 2];
-}
-
-float __attribute__ ((noinline)) CLAMP_median(float *shifts, uint8_t blocks, float norm){
-    const constexpr float max_change = 0.5f; ///< avoids too fast changes (avoid oscillation)
-    return CLAMP( median(shifts, blocks) * norm, -max_change, max_change);
-}
-
-/// Searches for circle iteratively
-/// Uses points on the perimeter. If point is high it pushes circle out of the center (shift or change of radius),
-/// otherwise to the center.
-/// Algorithm is stopped after fixed number of iterations. Move is limited to 0.5 px per iteration.
-void dynamic_circle(uint8_t *matrix_32x32, float &x, float &y, float &r, uint8_t iterations){
-	/// circle of 10.5 diameter has 33 in circumference, don't go much above
-	const constexpr uint8_t num_points = 33;
-	const float pi_2_div_num_points = 2 * M_PI / num_points;
-	const constexpr uint8_t target_z = 32; ///< target z height of the circle
-	const uint8_t blocks = num_points;
-	float shifts_x[blocks];
-	float shifts_y[blocks];	
-	float shifts_r[blocks];	
-
-	// DBG(_n(" [%f, %f][%f] start circle\n"), x, y, r);
-
-	for (int8_t i = iterations; i > 0; --i){
-	
-        //@size=128B
-		// DBG(_n(" [%f, %f][%f] circle\n"), x, y, r);
-
-		/// read points on the circle
-		for (uint8_t p = 0; p < num_points; ++p){
-			const float angle = p * pi_2_div_num_points;
-			const float height = get_value(matrix_32x32, r * cos(angle) + x, r * sin(angle) + y) - target_z;
-			// DBG(_n("%f "), point);
-
-			shifts_x[p] = cos(angle) * height;
-			shifts_y[p] = sin(angle) * height;
-			shifts_r[p] = height;
-		}
-		// DBG(_n(" points\n"));
-
-		const float reducer = 32.f; ///< reduces speed of convergency to avoid oscillation
-		const float norm = 1.f / reducer;
-//		x += CLAMP(median(shifts_x, blocks) * norm, -max_change, max_change);
-//		y += CLAMP(median(shifts_y, blocks) * norm, -max_change, max_change);
-//		r += CLAMP(median(shifts_r, blocks) * norm * .5f, -max_change, max_change);
-        //104B down
-        x += CLAMP_median(shifts_x, blocks, norm);
-        y += CLAMP_median(shifts_y, blocks, norm);
-        r += CLAMP_median(shifts_r, blocks, norm * .5f);
-
-		r = MAX(2, r);
-
-	}
-    //@size=118
-	DBG(_n(" [%f, %f][%f] final circle\n"), x, y, r);
-}
-
 /// Prints matrix in hex to debug output (serial line)
 void print_image(const uint8_t *matrix_32x32){
 	for (uint8_t y = 0; y < 32; ++y){
@@ -883,60 +713,6 @@ void print_image(const uint8_t *matrix_32x32){
 	DBG(endl);
 }
 
-/// Takes two patterns and searches them in matrix32
-/// \returns best match
-uint8_t find_patterns(uint8_t *matrix32, uint16_t *pattern08, uint16_t *pattern10, uint8_t &col, uint8_t &row){
-	uint8_t c08 = 0;
-	uint8_t r08 = 0;
-	uint8_t match08 = 0;
-	uint8_t c10 = 0;
-	uint8_t r10 = 0;
-	uint8_t match10 = 0;
-
-	match08 = xyzcal_find_pattern_12x12_in_32x32(matrix32, pattern08, &c08, &r08);
-	match10 = xyzcal_find_pattern_12x12_in_32x32(matrix32, pattern10, &c10, &r10);
-
-	if (match08 > match10){
-		col = c08;
-		row = r08;
-		return match08;
-	}
-	
-	col = c10;
-	row = r10;
-	return match10;
-}
-
-/// Scan should include normal data.
-/// If it's too extreme (00, FF) it could be caused by biased sensor.
-/// \return true if data looks normal
-bool check_scan(uint8_t *matrix32){
-	/// magic constants that define normality
-	const int16_t threshold_total = 900;
-	const int threshold_extreme = 50;
-
-	int16_t mins = 0;
-	int16_t maxs = 0;
-
-	for (int16_t i = 0; i < 32*32;++i){
-		if (matrix32[i] == 0) {
-			++mins;
-		} else if (matrix32[i] == 0xFF){
-			++maxs;
-		}
-	}
-	const int16_t rest = 1024 - mins - maxs;
-
-	if (mins + maxs > threshold_total
-		&& mins > threshold_extreme
-		&& maxs > threshold_extreme
-		&& mins > rest
-		&& maxs > rest)
-		return false;
-
-	return true;
-}
-
 /// scans area around the current head location and
 /// searches for the center of the calibration pin
 BedSkewOffsetDetectionResultType xyzcal_scan_and_process(){
@@ -956,7 +732,7 @@ BedSkewOffsetDetectionResultType xyzcal_scan_and_process(){
 		pattern10[i] = pgm_read_word((uint16_t*)(xyzcal_point_pattern_10 + i));
 	}
 
-	xyzcal_scan_pixels_32x32_Zhop(x, y, z, 2400, 200, matrix32);
+	xyzcal_scan_pixels_32x32_Zhop(x, y, z, 2400, 200, matrix32, pattern08, pattern10);
 	print_image(matrix32);
 	if (!check_scan(matrix32))
 		return BED_SKEW_OFFSET_DETECTION_POINT_SCAN_FAILED;
@@ -966,20 +742,20 @@ BedSkewOffsetDetectionResultType xyzcal_scan_and_process(){
 	uint8_t ur = 0;
 
 	/// max match = 132, 1/2 good = 66, 2/3 good = 88
-	if (find_patterns(matrix32, pattern08, pattern10, uc, ur) >= 88){
+	const uint8_t match = find_patterns(matrix32, pattern08, pattern10, uc, ur);
+	//@size=278
+	DBG(_n("Pattern center [%f %f], match %f%%\n"), uc + 5.5f, ur + 5.5f, match / 1.32f);
+	if (match >= 88){
 		/// find precise circle
-		/// move to the center of the pattern (+5.5)
-		float xf = uc + 5.5f;
-		float yf = ur + 5.5f;
-		float radius = 4.5f; ///< default radius
-		constexpr const uint8_t iterations = 20;
-		dynamic_circle(matrix32, xf, yf, radius, iterations);
-		if (fabs(xf - (uc + 5.5f)) > 3 || fabs(yf - (ur + 5.5f)) > 3 || fabs(radius - 5) > 3){
+		float xf;
+		float yf;
+		float radius;
+		const bool converged = xyzcal_point_center(matrix32, uc, ur, xf, yf, radius);
+		//@size=118
+		DBG(_n(" [%f, %f][%f] final circle\n"), xf, yf, radius);
+		if (!converged){
 			//@size=88
-            DBG(_n(" [%f %f][%f] mm divergence\n"), xf - (uc + 5.5f), yf - (ur + 5.5f), radius - 5);
-			/// dynamic algorithm diverged, use original position instead
-			xf = uc + 5.5f;
-			yf = ur + 5.5f;
+			DBG(_n(" divergence, pattern center used\n"));
 		}
 
 		/// move to the center of area and convert to position
@@ -0,0 +1,346 @@
+//! @file
+
+#include "xyzcal_image.h"
+#include <math.h>
+
+#ifndef M_PI
+const constexpr float M_PI = 3.1415926535897932384626433832795f;
+#endif
+
+/// Thresholds the pixels into bits, bit c of rows[r] is set if the pixel c, r is high
+void xyzcal_pack_32x32(const uint8_t* pixels, uint32_t* rows){
+	const uint8_t thr = 16;
+	for (uint8_t r = 0; r < 32; ++r){
+		uint32_t bits = 0;
+		for (uint8_t c = 32; c-- > 0;)
+			bits = (bits << 1) | (pixels[(uint16_t)r * 32 + c] > thr);
+		rows[r] = bits;
+	}
+}
+
+/// Bits of the pattern row i to compare, skips corners (3 pixels in each)
+static uint16_t xyzcal_pattern_mask(uint8_t i){
+	return ((i == 0) || (i == 11)) ? 0x3fc : (((i == 1) || (i == 10)) ? 0x7fe : 0xfff);
+}
+
+/// Returns rate of match of 12 packed rows, aligned with the pattern
+static uint8_t xyzcal_match_rows(const uint16_t* pattern, const uint16_t* mask, const uint32_t* rows){
+	uint8_t mismatch = 0;
+	for (uint8_t i = 0; i < 12; ++i)
+		mismatch += __builtin_popcount((uint16_t)(((uint16_t)rows[i] ^ pattern[i]) & mask[i]));
+	return 132 - mismatch;
+}
+
+/// Returns rate of match
+/// max match = 132, min match = 0
+uint8_t xyzcal_match_pattern_12x12_in_32x32(uint16_t* pattern, uint32_t* rows, uint8_t c, uint8_t r){
+	uint16_t mask[12];
+	uint32_t shifted[12];
+	for (uint8_t i = 0; i < 12; ++i){
+		mask[i] = xyzcal_pattern_mask(i);
+		shifted[i] = rows[r + i] >> c;
+	}
+	return xyzcal_match_rows(pattern, mask, shifted);
+}
+
+/// Searches for best match of pattern by shifting it
+/// Each row of the pattern is compared with 12 pixels of a packed row at once (XOR and popcount)
+/// Returns rate of match and the best location
+/// max match = 132, min match = 0
+uint8_t xyzcal_find_pattern_12x12_in_32x32(uint32_t* rows, uint16_t* pattern, uint8_t* pc, uint8_t* pr){
+	if (!rows || !pattern || !pc || !pr)
+		return -1;
+	uint8_t max_c = 0;
+	uint8_t max_r = 0;
+	uint8_t max_match = 0;
+	uint16_t mask[12];
+	for (uint8_t i = 0; i < 12; ++i)
+		mask[i] = xyzcal_pattern_mask(i);
+
+	/// pixel precision
+	for (uint8_t r = 0; r < (32 - 12); ++r){
+		/// the rows under the pattern, shifted by one pixel for each column
+		uint32_t shifted[12];
+		for (uint8_t i = 0; i < 12; ++i)
+			shifted[i] = rows[r + i];
+		for (uint8_t c = 0; c < (32 - 12); ++c){
+			const uint8_t match = xyzcal_match_rows(pattern, mask, shifted);
+			if (max_match < match){
+				max_c = c;
+				max_r = r;
+				max_match = match;
+			}
+			for (uint8_t i = 0; i < 12; ++i)
+				shifted[i] >>= 1;
+		}
+	}
+
+	*pc = max_c;
+	*pr = max_r;
+	return max_match;
+}
+
+/// Takes two patterns and searches them in matrix32
+/// \returns best match
+uint8_t find_patterns(uint8_t *matrix32, uint16_t *pattern08, uint16_t *pattern10, uint8_t &col, uint8_t &row){
+	uint8_t c08 = 0;
+	uint8_t r08 = 0;
+	uint8_t match08 = 0;
+	uint8_t c10 = 0;
+	uint8_t r10 = 0;
+	uint8_t match10 = 0;
+
+	uint32_t rows[32];
+	xyzcal_pack_32x32(matrix32, rows);
+	match08 = xyzcal_find_pattern_12x12_in_32x32(rows, pattern08, &c08, &r08);
+	match10 = xyzcal_find_pattern_12x12_in_32x32(rows, pattern10, &c10, &r10);
+
+	if (match08 > match10){
+		col = c08;
+		row = r08;
+		return match08;
+	}
+
+	col = c10;
+	row = r10;
+	return match10;
+}
+
+/// returns value of any location within data
+/// uses bilinear interpolation
+float get_value(uint8_t * matrix_32x32, float c, float r){
+	if (c <= 0 || r <= 0 || c >= 31 || r >= 31)
+		return 0;
+
+	/// calculate weights of nearby points
+	const float wc1 = c - floor(c);
+	const float wr1 = r - floor(r);
+	const float wc0 = 1 - wc1;
+	const float wr0 = 1 - wr1;
+
+	const float w00 = wc0 * wr0;
+	const float w01 = wc0 * wr1;
+	const float w10 = wc1 * wr0;
+	const float w11 = wc1 * wr1;
+
+	const uint16_t c0 = c;
+	const uint16_t c1 = c0 + 1;
+	const uint16_t r0 = r;
+	const uint16_t r1 = r0 + 1;
+
+	const uint16_t idx00 = c0 + 32 * r0;
+	const uint16_t idx01 = c0 + 32 * r1;
+	const uint16_t idx10 = c1 + 32 * r0;
+	const uint16_t idx11 = c1 + 32 * r1;
+
+	/// bilinear resampling
+	return w00 * matrix_32x32[idx00] + w01 * matrix_32x32[idx01] + w10 * matrix_32x32[idx10] + w11 * matrix_32x32[idx11];
+}
+
+const constexpr float m_infinity = -1000.f;
+
+/// replaces the highest number by m_infinity
+void remove_highest(float *points, const uint8_t num_points){
+	if (num_points <= 0)
+		return;
+
+	float max = points[0];
+	uint8_t max_i = 0;
+	for (uint8_t i = 0; i < num_points; ++i){
+		if (max < points[i]){
+			max = points[i];
+			max_i = i;
+		}
+	}
+	points[max_i] = m_infinity;
+}
+
+/// return the highest number in the list
+float highest(float *points, const uint8_t num_points){
+	if (num_points <= 0)
+		return 0;
+
+	float max = points[0];
+	for (uint8_t i = 0; i < num_points; ++i){
+		if (max < points[i]){
+			max = points[i];
+		}
+	}
+	return max;
+}
+
+/// slow bubble sort but short
+void sort(float *points, const uint8_t num_points){
+	/// one direction bubble sort
+	for (uint8_t i = 0; i < num_points; ++i){
+		for (uint8_t j = 0; j < num_points - i - 1; ++j){
+			if (points[j] > points[j + 1]){
+				const float swap = points[j];
+				points[j] = points[j + 1];
+				points[j + 1] = swap;
+			}
+		}
+	}
+	
+	// DBG(_n("Sorted: "));
+	// for (uint8_t i = 0; i < num_points; ++i)
+	// 	DBG(_n("%f "), points[i]);
+	// DBG(_n("\n"));
+}
+
+
+/// sort array and returns median value
+/// don't send empty array or nullptr
+float median(float *points, const uint8_t num_points){
+	sort(points, num_points);
+	return points[num_points / 2];
+}
+
+float __attribute__ ((noinline)) CLAMP_median(float *shifts, uint8_t blocks, float norm){
+    const constexpr float max_change = 0.5f; ///< avoids too fast changes (avoid oscillation)
+    const float change = median(shifts, blocks) * norm;
+    return change < -max_change ? -max_change : (change <= max_change ? change : max_change);
+}
+
+/// Searches for circle iteratively
+/// Uses points on the perimeter. If point is high it pushes circle out of the center (shift or change of radius),
+/// otherwise to the center.
+/// Algorithm is stopped after fixed number of iterations. Move is limited to 0.5 px per iteration.
+void dynamic_circle(uint8_t *matrix_32x32, float &x, float &y, float &r, uint8_t iterations){
+	/// circle of 10.5 diameter has 33 in circumference, don't go much above
+	const constexpr uint8_t num_points = 33;
+	const float pi_2_div_num_points = 2 * M_PI / num_points;
+	const constexpr uint8_t target_z = 32; ///< target z height of the circle
+	const uint8_t blocks = num_points;
+	float shifts_x[blocks];
+	float shifts_y[blocks];	
+	float shifts_r[blocks];	
+
+	// DBG(_n(" [%f, %f][%f] start circle\n"), x, y, r);
+
+	for (int8_t i = iterations; i > 0; --i){
+	
+        //@size=128B
+		// DBG(_n(" [%f, %f][%f] circle\n"), x, y, r);
+
+		/// read points on the circle
+		for (uint8_t p = 0; p < num_points; ++p){
+			const float angle = p * pi_2_div_num_points;
+			const float height = get_value(matrix_32x32, r * cos(angle) + x, r * sin(angle) + y) - target_z;
+			// DBG(_n("%f "), point);
+
+			shifts_x[p] = cos(angle) * height;
+			shifts_y[p] = sin(angle) * height;
+			shifts_r[p] = height;
+		}
+		// DBG(_n(" points\n"));
+
+		const float reducer = 32.f; ///< reduces speed of convergency to avoid oscillation
+		const float norm = 1.f / reducer;
+//		x += CLAMP(median(shifts_x, blocks) * norm, -max_change, max_change);
+//		y += CLAMP(median(shifts_y, blocks) * norm, -max_change, max_change);
+//		r += CLAMP(median(shifts_r, blocks) * norm * .5f, -max_change, max_change);
+        //104B down
+        x += CLAMP_median(shifts_x, blocks, norm);
+        y += CLAMP_median(shifts_y, blocks, norm);
+        r += CLAMP_median(shifts_r, blocks, norm * .5f);
+
+		if (r < 2)
+			r = 2;
+
+	}
+}
+
+/// Searches for the precise circle of the point around the pattern found at uc, ur
+/// \returns false if the dynamic algorithm diverged, the center of the pattern is used instead
+bool xyzcal_point_center(uint8_t *matrix32, uint8_t uc, uint8_t ur, float &xf, float &yf, float &radius){
+	/// move to the center of the pattern (+5.5)
+	xf = uc + 5.5f;
+	yf = ur + 5.5f;
+	radius = 4.5f; ///< default radius
+	constexpr const uint8_t iterations = 20;
+	dynamic_circle(matrix32, xf, yf, radius, iterations);
+	if (fabs(xf - (uc + 5.5f)) > 3 || fabs(yf - (ur + 5.5f)) > 3 || fabs(radius - 5) > 3){
+		xf = uc + 5.5f;
+		yf = ur + 5.5f;
+		return false;
+	}
+	return true;
+}
+
+/// Scan should include normal data.
+/// If it's too extreme (00, FF) it could be caused by biased sensor.
+/// \return true if data looks normal
+bool check_scan(uint8_t *matrix32){
+	/// magic constants that define normality
+	const int16_t threshold_total = 900;
+	const int threshold_extreme = 50;
+
+	int16_t mins = 0;
+	int16_t maxs = 0;
+
+	for (int16_t i = 0; i < 32*32;++i){
+		if (matrix32[i] == 0) {
+			++mins;
+		} else if (matrix32[i] == 0xFF){
+			++maxs;
+		}
+	}
+	const int16_t rest = 1024 - mins - maxs;
+
+	if (mins + maxs > threshold_total
+		&& mins > threshold_extreme
+		&& maxs > threshold_extreme
+		&& mins > rest
+		&& maxs > rest)
+		return false;
+
+	return true;
+}
+
+/// Scans the n x n pixels from the column c0 and row r0
+/// Each row is measured forth and back, the pixel is the average of both directions (filters effect of hysteresis)
+static void xyzcal_scan_window(xyzcal_probe_t probe, uint8_t *pixels, uint8_t c0, uint8_t r0, uint8_t n){
+	uint16_t line_buffer[32];
+	for (uint8_t r = r0; r < r0 + n; ++r){
+		for (uint8_t c = c0; c < c0 + n; ++c)
+			line_buffer[c - c0] = probe(c, r, false);
+		for (uint8_t c = c0 + n; c-- > c0;){
+			const uint32_t z = ((uint32_t)line_buffer[c - c0] + probe(c, r, true)) / 2;
+			pixels[(uint16_t)r * 32 + c] = (uint8_t)(z < 255 ? z : 255);
+		}
+	}
+}
+
+/// Scans all the 32x32 pixels
+void xyzcal_scan_32x32(xyzcal_probe_t probe, uint8_t *pixels){
+	xyzcal_scan_window(probe, pixels, 0, 0, 32);
+}
+
+/// Scans every other pixel of every other row in a serpentine, in one direction only, and fills
+/// the 2x2 pixels around each of them. Then scans the 16x16 pixels around the pattern found in this
+/// coarse image like xyzcal_scan_32x32(), which takes 768 pixel measurements instead of 2048.
+/// The whole 32x32 pixels are scanned if no pattern is found.
+void xyzcal_scan_coarse_to_fine(xyzcal_probe_t probe, uint8_t *pixels, uint16_t *pattern08, uint16_t *pattern10){
+	for (uint8_t r = 0; r < 32; r += 2){
+		const bool back = r & 2;
+		for (uint8_t i = 0; i < 32; i += 2){
+			const uint8_t c = back ? 30 - i : i;
+			const uint16_t z = probe(c, r, back);
+			uint8_t *p = pixels + (uint16_t)r * 32 + c;
+			p[0] = p[1] = p[32] = p[33] = (uint8_t)(z < 255 ? z : 255);
+		}
+	}
+
+	uint8_t uc = 0;
+	uint8_t ur = 0;
+	/// max match = 132, 2/3 good = 88
+	if (find_patterns(pixels, pattern08, pattern10, uc, ur) < 88){
+		xyzcal_scan_32x32(probe, pixels);
+		return;
+	}
+	/// the 12x12 pattern with a margin of 2 pixels, the coarse position is off by a pixel at most
+	const uint8_t c0 = uc < 2 ? 0 : (uc > 18 ? 16 : uc - 2);
+	const uint8_t r0 = ur < 2 ? 0 : (ur > 18 ? 16 : ur - 2);
+	xyzcal_scan_window(probe, pixels, c0, r0, 16);
+}
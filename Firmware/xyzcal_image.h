@@ -0,0 +1,33 @@
+//! @file
+//! @brief Image of the calibration point scanned by xyzcal
+//!
+//! The area around the point is scanned as 32x32 pixels, 64 steps apart, each pixel holding the
+//! height where the PINDA triggers above the bottom of the scan. The point is found in the image by
+//! matching 12x12 binary patterns of the circle. The pixels are thresholded into a 32 bit word per row
+//! first, so that a row of the pattern is compared with the image by a XOR and a popcount.
+//!
+//! The scan is independent of the motion, the pixels are measured by a probe callback, so that it can
+//! run on the host with a simulated sensor.
+
+#ifndef XYZCAL_IMAGE_H
+#define XYZCAL_IMAGE_H
+
+#include <stdint.h>
+
+//! @brief Measure the pixel @p c, @p r
+//!
+//! The head moves along the row @p r, to the higher columns unless @p back.
+//! @return height of the trigger above the bottom of the scan [steps]
+typedef uint16_t (*xyzcal_probe_t)(uint8_t c, uint8_t r, bool back);
+
+void xyzcal_pack_32x32(const uint8_t* pixels, uint32_t* rows);
+uint8_t xyzcal_match_pattern_12x12_in_32x32(uint16_t* pattern, uint32_t* rows, uint8_t c, uint8_t r);
+uint8_t xyzcal_find_pattern_12x12_in_32x32(uint32_t* rows, uint16_t* pattern, uint8_t* pc, uint8_t* pr);
+uint8_t find_patterns(uint8_t *matrix32, uint16_t *pattern08, uint16_t *pattern10, uint8_t &col, uint8_t &row);
+bool xyzcal_point_center(uint8_t *matrix32, uint8_t uc, uint8_t ur, float &xf, float &yf, float &radius);
+bool check_scan(uint8_t *matrix32);
+
+void xyzcal_scan_32x32(xyzcal_probe_t probe, uint8_t *pixels);
+void xyzcal_scan_coarse_to_fine(xyzcal_probe_t probe, uint8_t *pixels, uint16_t *pattern08, uint16_t *pattern10);
+
+#endif /* XYZCAL_IMAGE_H */
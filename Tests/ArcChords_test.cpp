@@ -0,0 +1,168 @@
+/**
+ * @file
+ * @brief Arc segmentation by the chord error compared with the segment length of M214
+ */
+
+#include "catch.hpp"
+#include <math.h>
+#include <stdint.h>
+
+#include "../Firmware/arc_chords.h"
+
+namespace {
+
+// the defaults of the MK3
+const float mm_per_arc_segment = 1.0f;
+const float min_mm_per_arc_segment = 0.5f;
+const unsigned min_arc_segments = 20;
+const unsigned char n_arc_correction = 25;
+
+const float max_error = 0.01f;
+const float max_length = 10.f;
+
+//! segment length of mc_arc() without ARC_CHORD_ERROR
+float previous_length(float radius)
+{
+    float length = radius * ((2.0f * M_PI) / min_arc_segments);
+    if (length < min_mm_per_arc_segment)
+        length = min_mm_per_arc_segment;
+    else if (length > mm_per_arc_segment)
+        length = mm_per_arc_segment;
+    return length;
+}
+
+//! deviation of the chord of the @p length from the arc of the @p radius
+double sagitta(double radius, double length)
+{
+    return radius - sqrt(radius * radius - length * length / 4);
+}
+
+//! @brief Largest distance of the segment ends from the arc
+//!
+//! The arc of the @p angle from the vector @p r_x, @p r_y is split into @p segments like mc_arc(),
+//! by the rotation of ArcChords or the small angle approximation corrected by trig.
+double path_error(float r_x, float r_y, float angle, uint16_t segments, bool chords)
+{
+    const float theta = angle / segments;
+    const float sin_T = theta - theta * theta * theta / 6, cos_T = 1 - 0.5f * theta * theta;
+    unsigned char correction = n_arc_correction;
+    ArcChords rotation(r_x, r_y, theta);
+    float x = r_x, y = r_y;
+    double error = 0;
+    for (uint16_t i = 1; i < segments; ++i)
+    {
+        if (chords)
+        {
+            rotation.next();
+            x = rotation.x;
+            y = rotation.y;
+        }
+        else if (correction-- == 0)
+        {
+            const float cos_Ti = cos(i * theta), sin_Ti = sin(i * theta);
+            x = r_x * cos_Ti - r_y * sin_Ti;
+            y = r_x * sin_Ti + r_y * cos_Ti;
+            correction = n_arc_correction;
+        }
+        else
+        {
+            const float t = x * sin_T + y * cos_T;
+            x = x * cos_T - y * sin_T;
+            y = t;
+        }
+        double a = double(i) * angle / segments;
+        double ex = r_x * cos(a) - r_y * sin(a), ey = r_x * sin(a) + r_y * cos(a);
+        double d = hypot(x - ex, y - ey);
+        if (d > error)
+            error = d;
+    }
+    return error;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Arc chord length", "[arc]" )
+{
+    SECTION( "deviation within the error" )
+    {
+        for (float radius = 0.5f; radius < 1000.f; radius *= 1.1f)
+        {
+            float length = arc_chord_length(radius, max_error, min_mm_per_arc_segment, max_length);
+            INFO( "radius " << radius << " length " << length );
+            CHECK( length >= min_mm_per_arc_segment );
+            CHECK( length <= max_length );
+            if (length > min_mm_per_arc_segment && length < max_length)
+                CHECK( sagitta(radius, length) == Approx(max_error).epsilon(1e-3) );
+            else if (length == max_length)
+                CHECK( sagitta(radius, length) <= max_error );
+        }
+    }
+
+    SECTION( "radius within the error" )
+    {
+        // no chord deviates more than the radius
+        CHECK( arc_chord_length(0.005f, max_error, min_mm_per_arc_segment, max_length) == max_length );
+    }
+
+    SECTION( "fewer segments on large radii" )
+    {
+        for (float radius : {20.f, 50.f, 100.f, 300.f})
+        {
+            float length = arc_chord_length(radius, max_error, min_mm_per_arc_segment, max_length);
+            INFO( "radius " << radius );
+            CHECK( length > 1.25f * previous_length(radius) );
+            CHECK( sagitta(radius, length) <= max_error * 1.001f );
+        }
+    }
+}
+
+TEST_CASE( "Arc chords rotation", "[arc]" )
+{
+    SECTION( "full circle" )
+    {
+        for (float radius : {1.f, 10.f, 100.f})
+            for (uint16_t segments : {7, 100, 2000, 20000})
+            {
+                INFO( "radius " << radius << " segments " << segments );
+                float r_x = radius * 0.6f, r_y = -radius * 0.8f;
+                CHECK( path_error(r_x, r_y, 2 * M_PI, segments, true) < radius * 2e-5f );
+            }
+    }
+
+    SECTION( "more accurate than the small angle approximation" )
+    {
+        // a few long segments of a small circle
+        for (uint16_t segments : {8, 12, 20})
+            CHECK( path_error(2.f, 0.f, 2 * M_PI, segments, true) < path_error(2.f, 0.f, 2 * M_PI, segments, false) / 10 );
+    }
+
+    SECTION( "radius stays on the circle" )
+    {
+        ArcChords rotation(30.f, 40.f, -0.001f);
+        for (unsigned i = 0; i < 60000; ++i)
+            rotation.next();
+        CHECK( hypot(rotation.x, rotation.y) == Approx(50.f).margin(1e-4) );
+    }
+}
+
+TEST_CASE( "Arc segments of arc-fitted G-code", "[.][arc]" )
+{
+    unsigned arcs = 0, previous = 0, chords = 0;
+    double previous_error = 0, chords_error = 0;
+    for (float radius = 1.f; radius <= 200.f; radius *= 1.05f)
+    {
+        // quarter circles, the usual arcs of a fitted curve
+        float travel = radius * M_PI / 2;
+        unsigned n = ceil(travel / previous_length(radius));
+        unsigned m = ceil(travel / arc_chord_length(radius, max_error, min_mm_per_arc_segment, max_length));
+        ++arcs;
+        previous += n;
+        chords += m;
+        previous_error += sagitta(radius, travel / n);
+        chords_error += sagitta(radius, travel / m);
+    }
+    WARN( "segments of quarter circles of 1 to 200 mm radius: M214 " << previous << ", mean deviation "
+        << previous_error * 1000 / arcs << " um; chord error " << chords << ", mean deviation "
+        << chords_error * 1000 / arcs << " um" );
+    CHECK( chords < previous );
+}
@@ -0,0 +1,121 @@
+/**
+ * @file
+ * @brief Decoding of the move records of the binary G-code container
+ */
+
+#include "catch.hpp"
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "../Firmware/gcode_binary.h"
+
+namespace {
+
+//! little endian payload of a move record
+struct Payload
+{
+    Payload &i16(int16_t v) { put(&v, sizeof(v)); return *this; }
+    Payload &i32(int32_t v) { put(&v, sizeof(v)); return *this; }
+    Payload &u16(uint16_t v) { put(&v, sizeof(v)); return *this; }
+    void put(const void *v, size_t n)
+    {
+        const uint8_t *p = (const uint8_t *)v;
+        data.insert(data.end(), p, p + n);
+    }
+    std::vector<uint8_t> data;
+};
+
+} // anonymous namespace
+
+TEST_CASE( "Binary G-code moves", "[gcode_binary]" )
+{
+    GcodeBinaryPosition pos;
+    float current[4] = {10.f, 20.f, 0.2f, 5.f};
+    float target[4];
+
+    SECTION( "payload size" )
+    {
+        CHECK( gcode_binary_move_size(GB_X) == 2 );
+        CHECK( gcode_binary_move_size(GB_X | GB_Y | GB_E | GB_F) == 8 );
+        CHECK( gcode_binary_move_size(GB_X | GB_Z | GB_WIDE) == 8 );
+        CHECK( gcode_binary_move_size(GB_X | GB_Y | GB_Z | GB_E | GB_ABS | GB_F) == 18 );
+    }
+
+    SECTION( "deltas from the printer position" )
+    {
+        Payload p;
+        p.i16(1500).i16(-250).i16(400).u16(1800);
+        CHECK( pos.move(GB_X | GB_Y | GB_E | GB_F, p.data.data(), current, target) == 1800 );
+        CHECK( target[0] == Approx(11.5f) );
+        CHECK( target[1] == Approx(19.75f) );
+        CHECK( target[2] == current[2] );
+        CHECK( target[3] == Approx(5.04f) );
+    }
+
+    SECTION( "XYZ deltas accumulate without rounding errors" )
+    {
+        Payload p;
+        p.i16(1).i16(1);
+        for (unsigned i = 0; i < 10000; ++i)
+        {
+            CHECK( pos.move(GB_X | GB_E, p.data.data(), current, target) == 0 );
+            current[0] = target[0];
+            current[3] = target[3];
+        }
+        CHECK( current[0] == Approx(20.f).margin(1e-6) );
+        // E adds up in the printer position, like relative G1 moves
+        CHECK( current[3] == Approx(6.f).epsilon(1e-3) );
+    }
+
+    SECTION( "wide and absolute" )
+    {
+        Payload wide;
+        wide.i32(100000).i32(-50000);
+        pos.move(GB_X | GB_E | GB_WIDE, wide.data.data(), current, target);
+        CHECK( target[0] == Approx(110.f) );
+        CHECK( target[3] == Approx(0.f).margin(1e-6) );
+
+        // X and Z are positions, E stays relative to the printer
+        Payload abs;
+        abs.i32(123456).i32(300).i32(2500);
+        pos.move(GB_X | GB_Z | GB_E | GB_ABS, abs.data.data(), current, target);
+        CHECK( target[0] == Approx(123.456f) );
+        CHECK( target[1] == current[1] );
+        CHECK( target[2] == Approx(0.3f) );
+        CHECK( target[3] == Approx(5.25f) );
+
+        // the deltas continue from the absolute position
+        Payload delta;
+        delta.i16(-456);
+        pos.move(GB_X, delta.data.data(), current, target);
+        CHECK( target[0] == Approx(123.f) );
+    }
+
+    SECTION( "E is relative to the printer" )
+    {
+        Payload p;
+        p.i16(1000);
+        pos.move(GB_E, p.data.data(), current, target);
+        CHECK( target[3] == Approx(5.1f) );
+        // the printer E position differs from the file, e.g. after G92 E0 or an extrusion multiplier
+        current[3] = 0.f;
+        pos.move(GB_E, p.data.data(), current, target);
+        CHECK( target[3] == Approx(0.1f) );
+    }
+
+    SECTION( "position taken over after invalidate" )
+    {
+        Payload p;
+        p.i16(1000);
+        pos.move(GB_X, p.data.data(), current, target);
+        CHECK( target[0] == Approx(11.f) );
+        // a command moved the printer
+        current[0] = 50.f;
+        pos.move(GB_X, p.data.data(), current, target);
+        CHECK( target[0] == Approx(12.f) );
+        pos.invalidate();
+        pos.move(GB_X, p.data.data(), current, target);
+        CHECK( target[0] == Approx(51.f) );
+    }
+}
@@ -0,0 +1,171 @@
+/**
+ * @file
+ * @brief Hotend feed-forward estimator and a co-simulation of the planner queue with a simple
+ * hotend thermal model, comparing the temperature sag with and without the feed-forward term.
+ */
+
+#include "catch.hpp"
+#include <algorithm>
+#include <cmath>
+
+#include "../Firmware/hotend_ff.h"
+
+static const float area = M_PI * 1.75f * 1.75f / 4;
+
+TEST_CASE( "Hotend feed-forward estimator", "[hotend_ff]" )
+{
+    SECTION( "empty queue" )
+    {
+        HotendFFEstimator est(2.f);
+        CHECK( est.flow() == 0 );
+    }
+
+    SECTION( "travel moves and degenerated blocks" )
+    {
+        HotendFFEstimator est(2.f);
+        CHECK( est.add(0, 50, 100, area) );
+        CHECK( est.add(1, 0, 100, area) );
+        CHECK( est.add(1, 10, 0, area) );
+        CHECK( est.flow() == 0 );
+    }
+
+    SECTION( "queue shorter than the window" )
+    {
+        // 1s of extrusion, 1s of idle
+        HotendFFEstimator est(2.f);
+        CHECK( est.add(2, 40, 40, area) );
+        CHECK( est.flow() == Approx(2 * area / 2.f) );
+    }
+
+    SECTION( "window clips the last block" )
+    {
+        // 4s long block of 3mm/s filament, only 2s are accounted
+        HotendFFEstimator est(2.f);
+        CHECK_FALSE( est.add(12, 200, 50, area) );
+        CHECK( est.flow() == Approx(3 * area) );
+    }
+
+    SECTION( "mixed blocks" )
+    {
+        HotendFFEstimator est(2.f);
+        CHECK( est.add(0, 50, 100, area) );  // 0.5s travel
+        CHECK( est.add(1, 20, 40, area) );   // 0.5s extrusion, 2mm/s
+        CHECK_FALSE( est.add(4, 80, 40, area) ); // 2s extrusion, 2mm/s, 1s accounted
+        CHECK_FALSE( est.add(4, 80, 40, area) ); // beyond the window
+        CHECK( est.flow() == Approx((1 + 2) * area / 2.f) );
+    }
+}
+
+namespace {
+
+//! planned move with constant volumetric flow
+struct Move
+{
+    float duration; //!< [s]
+    float flow;     //!< [mm^3/s]
+};
+
+//! 60s warm-up, a perimeter at low flow, then a long high-flow infill section
+static const Move moves[] = {
+    {60, 0}, {5, 2}, {0.5, 0}, {20, 15}, {0.5, 0}, {10, 3},
+};
+
+static const float heat = 0.0022f;   // J/mm^3/K
+static const float t_amb = 25;      // C
+static const float target = 215;    // C
+static const float heater_p = 38;   // W
+static const float C = 11;          // J/K
+static const float R = 25;          // K/W
+static const float sensor_tau = 2;  // s
+static const float horizon = 2;     // s
+static const float dt = 0.01f;      // s, simulation step
+static const float ctrl_dt = 0.27f; // s, temp_mgr period
+static const unsigned queue_depth = 16;
+
+//! split the moves into 0.25s planner blocks
+static unsigned build_queue(Move *blocks, unsigned max)
+{
+    unsigned n = 0;
+    for (const Move &m : moves)
+        for (float t = 0; t < m.duration && n < max; t += 0.25f)
+            blocks[n++] = { std::min(0.25f, m.duration - t), m.flow };
+    return n;
+}
+
+//! @return maximum deviation below the target during the extrusion
+static float simulate(bool feedforward, float *overshoot)
+{
+    static Move blocks[1024];
+    const unsigned n = build_queue(blocks, 1024);
+
+    // start from the steady state, so that the warm-up is just a settling period
+    float t_heater = target;
+    float t_sensor = target;
+    float i_state = (target - t_amb) / R;
+    float out = i_state;
+    float ctrl_timer = 0;
+    float sag = 0;
+    *overshoot = 0;
+
+    unsigned idx = 0;
+    float block_left = blocks[0].duration;
+    float time = 0;
+    while (idx < n)
+    {
+        // temp_mgr: PI regulator with optional feed-forward from the planner queue
+        ctrl_timer += dt;
+        if (ctrl_timer >= ctrl_dt)
+        {
+            ctrl_timer -= ctrl_dt;
+            float err = target - t_sensor;
+            i_state += 0.1f * err * ctrl_dt;
+            float ff = 0;
+            if (feedforward)
+            {
+                HotendFFEstimator est(horizon);
+                float left = block_left;
+                for (unsigned j = idx; j < n && j < idx + queue_depth; ++j)
+                {
+                    float d = (j == idx ? left : blocks[j].duration);
+                    if (!est.add(blocks[j].flow / area * d, 100 * d, 100, area))
+                        break;
+                }
+                ff = hotend_ff_power(est.flow(), heat, target - t_amb);
+            }
+            out = std::max(0.f, std::min(heater_p, 2.4f * err + i_state + ff));
+        }
+
+        // plant: heat block, melting losses and a lagging thermistor
+        float flow = blocks[idx].flow;
+        float p_loss = (t_heater - t_amb) / R + flow * heat * (t_heater - t_amb);
+        t_heater += (out - p_loss) / C * dt;
+        t_sensor += (t_heater - t_sensor) / sensor_tau * dt;
+
+        if (time > 50)
+        {
+            sag = std::max(sag, target - t_sensor);
+            *overshoot = std::max(*overshoot, t_sensor - target);
+        }
+
+        time += dt;
+        block_left -= dt;
+        if (block_left <= 0 && ++idx < n)
+            block_left += blocks[idx].duration;
+    }
+    return sag;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Hotend feed-forward thermal co-simulation", "[hotend_ff]" )
+{
+    float overshoot_pid, overshoot_ff;
+    float sag_pid = simulate(false, &overshoot_pid);
+    float sag_ff = simulate(true, &overshoot_ff);
+
+    INFO( "PID only: sag " << sag_pid << "K, overshoot " << overshoot_pid << "K" );
+    INFO( "with FF:  sag " << sag_ff << "K, overshoot " << overshoot_ff << "K" );
+    CHECK( sag_pid > 2.f );
+    CHECK( sag_ff < sag_pid / 2 );
+    CHECK( overshoot_ff < 1.f );
+}
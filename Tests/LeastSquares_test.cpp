@@ -0,0 +1,276 @@
+/**
+ * @file
+ * @brief Least squares solvers of the bed calibration compared with the ones they replaced
+ */
+
+#include "catch.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../Firmware/least_squares.h"
+
+namespace {
+
+float noise(float amplitude)
+{
+    return amplitude * (rand() % 2001 - 1000) / 1000.f;
+}
+
+//! the machine axes and offset of the skew calibration
+struct Skew
+{
+    float cntr[2];
+    float a1, a2;
+};
+
+//! @brief Calibration points of the bed measured by a skewed machine
+//!
+//! The 4 points of the MK3 or the 9 points of the MK2, the first row of the MK2 has a low weight in y.
+struct Probe
+{
+    Probe(uint8_t npts, const Skew &skew, float amplitude) : npts(npts)
+    {
+        static const float points_4[] = { 12.f, 4.f, 220.f, 4.f, 220.f, 196.f, 12.f, 196.f };
+        static const float points_9[] = {
+            12.f, 0.f, 114.f, 0.f, 215.f, 0.f,
+            215.f, 96.f, 114.f, 96.f, 12.f, 96.f,
+            12.f, 194.f, 114.f, 194.f, 215.f, 194.f,
+        };
+        const float *points = (npts == 4) ? points_4 : points_9;
+        float c1 = cosf(skew.a1), s1 = sinf(skew.a1), c2 = cosf(skew.a2), s2 = sinf(skew.a2);
+        float det = c1 * c2 + s1 * s2;
+        for (uint8_t i = 0; i < npts; ++i)
+        {
+            target[2 * i] = points[2 * i];
+            target[2 * i + 1] = points[2 * i + 1];
+            // invert target = [c1 -s2; s1 c2] * measured + cntr
+            float x = target[2 * i] - skew.cntr[0], y = target[2 * i + 1] - skew.cntr[1];
+            measured[2 * i] = (c2 * x + s2 * y) / det + noise(amplitude);
+            measured[2 * i + 1] = (-s1 * x + c1 * y) / det + noise(amplitude);
+            wx[i] = 1.f;
+            wy[i] = (npts == 9 && i < 3) ? 0.3f : 1.f;
+        }
+    }
+
+    //! the Gauss-Newton iterations of calculate_machine_skew_and_offset_LS()
+    uint8_t fit(Skew &skew) const
+    {
+        skew.cntr[0] = skew.cntr[1] = skew.a1 = skew.a2 = 0;
+        for (uint8_t iter = 0; iter < 100;)
+        {
+            ++iter;
+            float h[4];
+            if (!ls_skew_offset_step(measured, target, wx, wy, npts, 1.f, 1.f, skew.cntr, skew.a1, skew.a2, h))
+                return 0;
+            skew.cntr[0] += h[0];
+            skew.cntr[1] += h[1];
+            skew.a1 += h[2];
+            skew.a2 += h[3];
+            if (fabsf(h[0]) < 1e-4f && fabsf(h[1]) < 1e-4f && fabsf(h[2]) < 1e-6f && fabsf(h[3]) < 1e-6f)
+                return iter;
+        }
+        return 100;
+    }
+
+    //! the previous fit: 100 iterations, each solving the normal equations by 100 Gauss-Seidel iterations
+    void reference(Skew &skew) const
+    {
+        const float *measured_pts = measured;
+        skew.cntr[0] = skew.cntr[1] = 0;
+        float a1 = 0, a2 = 0;
+        for (int8_t iter = 0; iter < 100; ++iter) {
+            float c1 = cos(a1);
+            float s1 = sin(a1);
+            float c2 = cos(a2);
+            float s2 = sin(a2);
+            float A[4][4] = { { 0.f } };
+            float b[4] = { 0.f };
+            float acc;
+            for (uint8_t r = 0; r < 4; ++r) {
+                for (uint8_t c = 0; c < 4; ++c) {
+                    acc = 0;
+                    for (uint8_t i = 0; i < npts; ++i) {
+                        if (r != 1 && c != 1) {
+                            float a = (r == 0) ? 1.f : ((r == 2) ? (-s1 * measured_pts[2 * i]) : (-c2 * measured_pts[2 * i + 1]));
+                            float b = (c == 0) ? 1.f : ((c == 2) ? (-s1 * measured_pts[2 * i]) : (-c2 * measured_pts[2 * i + 1]));
+                            acc += a * b * wx[i];
+                        }
+                        if (r != 0 && c != 0) {
+                            float a = (r == 1) ? 1.f : ((r == 2) ? (c1 * measured_pts[2 * i]) : (-s2 * measured_pts[2 * i + 1]));
+                            float b = (c == 1) ? 1.f : ((c == 2) ? (c1 * measured_pts[2 * i]) : (-s2 * measured_pts[2 * i + 1]));
+                            acc += a * b * wy[i];
+                        }
+                    }
+                    A[r][c] = acc;
+                }
+                acc = 0.f;
+                for (uint8_t i = 0; i < npts; ++i) {
+                    {
+                        float j = (r == 0) ? 1.f : ((r == 1) ? 0.f : ((r == 2) ? (-s1 * measured_pts[2 * i]) : (-c2 * measured_pts[2 * i + 1])));
+                        float fx = c1 * measured_pts[2 * i] - s2 * measured_pts[2 * i + 1] + skew.cntr[0] - target[i * 2];
+                        acc += j * fx * wx[i];
+                    }
+                    {
+                        float j = (r == 0) ? 0.f : ((r == 1) ? 1.f : ((r == 2) ? (c1 * measured_pts[2 * i]) : (-s2 * measured_pts[2 * i + 1])));
+                        float fy = s1 * measured_pts[2 * i] + c2 * measured_pts[2 * i + 1] + skew.cntr[1] - target[i * 2 + 1];
+                        acc += j * fy * wy[i];
+                    }
+                }
+                b[r] = -acc;
+            }
+            float h[4] = { 0.f };
+            for (uint8_t gauss_iter = 0; gauss_iter < 100; ++gauss_iter) {
+                h[0] = (b[0] - A[0][1] * h[1] - A[0][2] * h[2] - A[0][3] * h[3]) / A[0][0];
+                h[1] = (b[1] - A[1][0] * h[0] - A[1][2] * h[2] - A[1][3] * h[3]) / A[1][1];
+                h[2] = (b[2] - A[2][0] * h[0] - A[2][1] * h[1] - A[2][3] * h[3]) / A[2][2];
+                h[3] = (b[3] - A[3][0] * h[0] - A[3][1] * h[1] - A[3][2] * h[2]) / A[3][3];
+            }
+            skew.cntr[0] += h[0];
+            skew.cntr[1] += h[1];
+            a1 += h[2];
+            a2 += h[3];
+        }
+        skew.a1 = a1;
+        skew.a2 = a2;
+    }
+
+    uint8_t npts;
+    float measured[2 * 9];
+    float target[2 * 9];
+    float wx[9], wy[9];
+};
+
+Skew random_skew()
+{
+    Skew skew;
+    skew.cntr[0] = noise(2.f);
+    skew.cntr[1] = noise(2.f);
+    skew.a1 = noise(0.01f);
+    skew.a2 = noise(0.01f);
+    return skew;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Least squares normal equations", "[least_squares]" )
+{
+    srand(1);
+
+    SECTION( "4x4 system" )
+    {
+        // A = M^T M of a full rank M
+        const float M[5][4] = { {1, 2, 0, 1}, {0, 1, 3, 1}, {2, 0, 1, 0}, {1, 1, 1, 4}, {0, 2, 1, 1} };
+        const float x[4] = { 0.5f, -1.f, 2.f, 0.25f };
+        float A[4][4] = {}, b[4] = {};
+        for (uint8_t i = 0; i < 5; ++i)
+        {
+            float f = 0;
+            for (uint8_t k = 0; k < 4; ++k)
+                f += M[i][k] * x[k];
+            ls_add_row<4>(A, b, M[i], f, 1.f);
+        }
+        REQUIRE( ls_solve<4>(A, b) );
+        for (uint8_t k = 0; k < 4; ++k)
+            CHECK( b[k] == Approx(x[k]).margin(1e-5) );
+    }
+
+    SECTION( "singular system" )
+    {
+        const float row[3] = { 1, 2, 1 };
+        float A[3][3] = {}, b[3] = {};
+        ls_add_row<3>(A, b, row, 1.f, 1.f);
+        ls_add_row<3>(A, b, row, 2.f, 1.f);
+        CHECK_FALSE( ls_solve<3>(A, b) );
+    }
+
+    SECTION( "plane of the auto bed leveling grid" )
+    {
+        for (uint8_t grid = 2; grid <= 3; ++grid)
+            for (unsigned n = 0; n < 1000; ++n)
+            {
+                float a = noise(0.01f), b = noise(0.01f), d = noise(1.f);
+                float A[3][3] = {}, x[3] = {};
+                float rows[9][3], z[9];
+                uint8_t m = grid * grid;
+                for (uint8_t i = 0; i < m; ++i)
+                {
+                    rows[i][0] = 15 + (i % grid) * 155 / (grid - 1);
+                    rows[i][1] = 20 + (i / grid) * 150 / (grid - 1);
+                    rows[i][2] = 1;
+                    z[i] = a * rows[i][0] + b * rows[i][1] + d + noise(0.05f);
+                    ls_add_row<3>(A, x, rows[i], z[i], 1.f);
+                }
+                REQUIRE( ls_solve<3>(A, x) );
+                // the residuum is orthogonal to the columns
+                for (uint8_t k = 0; k < 3; ++k)
+                {
+                    double dot = 0;
+                    for (uint8_t i = 0; i < m; ++i)
+                        dot += rows[i][k] * (z[i] - (x[0] * rows[i][0] + x[1] * rows[i][1] + x[2]));
+                    REQUIRE( dot == Approx(0).margin(2e-3) );
+                }
+            }
+    }
+}
+
+TEST_CASE( "Bed skew and offset fit", "[least_squares]" )
+{
+    srand(2);
+
+    SECTION( "exact points" )
+    {
+        for (uint8_t npts : {4, 9})
+        {
+            Skew skew = random_skew(), fit;
+            Probe probe(npts, skew, 0);
+            CHECK( probe.fit(fit) < 10 );
+            CHECK( fit.cntr[0] == Approx(skew.cntr[0]).margin(1e-3) );
+            CHECK( fit.cntr[1] == Approx(skew.cntr[1]).margin(1e-3) );
+            CHECK( fit.a1 == Approx(skew.a1).margin(1e-5) );
+            CHECK( fit.a2 == Approx(skew.a2).margin(1e-5) );
+        }
+    }
+
+    SECTION( "same as the previous solver" )
+    {
+        for (unsigned n = 0; n < 200; ++n)
+        {
+            uint8_t npts = (n & 1) ? 9 : 4;
+            Skew skew = random_skew(), fit, reference;
+            Probe probe(npts, skew, 0.1f);
+            REQUIRE( probe.fit(fit) );
+            probe.reference(reference);
+            INFO( "points " << int(npts) );
+            REQUIRE( fit.cntr[0] == Approx(reference.cntr[0]).margin(1e-3) );
+            REQUIRE( fit.cntr[1] == Approx(reference.cntr[1]).margin(1e-3) );
+            REQUIRE( fit.a1 == Approx(reference.a1).margin(1e-5) );
+            REQUIRE( fit.a2 == Approx(reference.a2).margin(1e-5) );
+        }
+    }
+}
+
+TEST_CASE( "Bed skew and offset fit benchmark", "[.][least_squares]" )
+{
+    srand(3);
+    Skew skew = random_skew(), fit;
+    Probe probe(9, skew, 0.1f);
+    float sum = 0;
+    BENCHMARK( "previous solver" )
+    {
+        for (unsigned i = 0; i < 100; ++i)
+        {
+            probe.reference(fit);
+            sum += fit.a1;
+        }
+    }
+    BENCHMARK( "Cholesky, stopped when converged" )
+    {
+        for (unsigned i = 0; i < 100; ++i)
+        {
+            probe.fit(fit);
+            sum += fit.a1;
+        }
+    }
+    CHECK( sum == sum );
+}
@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief Bicubic bed mesh interpolation compared with the bilinear one on a warped bed
+ */
+
+#include "catch.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../Firmware/mesh_bicubic.h"
+
+namespace {
+
+// the mesh of the MK3
+const uint8_t points = 7;
+const float dist = 34;
+
+typedef float Surface(float x, float y);
+
+//! bed in the units of the mesh spacing, z [mm]
+struct Bed
+{
+    Bed(Surface *f) : f(f)
+    {
+        for (uint8_t j = 0; j < points; ++j)
+            for (uint8_t i = 0; i < points; ++i)
+                z[j][i] = f(i, j);
+        bicubic.update(z);
+    }
+
+    float bilinear(float u, float v) const
+    {
+        float s, t;
+        uint8_t i = mesh_cell<points>(u, s);
+        uint8_t j = mesh_cell<points>(v, t);
+        return mesh_interpolate<points, points>(z, i, j, s, t);
+    }
+
+    Surface *f;
+    float z[points][points];
+    MeshBicubic<points, points, 3> bicubic;
+};
+
+float plane(float u, float v)
+{
+    return 0.1f + 0.02f * u - 0.03f * v;
+}
+
+//! a bed sagging by 0.3 mm in the middle
+float bowl(float u, float v)
+{
+    float x = (u - 3) * dist, y = (v - 3) * dist;
+    return 0.3f * (x * x + y * y) / (2 * 102 * 102);
+}
+
+//! a bed twisted by the frame
+float warp(float u, float v)
+{
+    return 0.15f * sinf(u * 0.7f) * cosf(v * 0.5f) + 0.01f * u * v;
+}
+
+float random_position(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() % 100001) / 100000.f;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Mesh bed leveling bicubic interpolation", "[mesh_bicubic]" )
+{
+    srand(1);
+
+    SECTION( "grid size" )
+    {
+        CHECK( (MeshBicubic<7, 7, 3>::GX) == 19 );
+        CHECK( sizeof(MeshBicubic<7, 7, 3>) == 19 * 19 * 2 );
+    }
+
+    SECTION( "passes through the mesh points" )
+    {
+        Bed bed(warp);
+        for (uint8_t j = 0; j < points; ++j)
+            for (uint8_t i = 0; i < points; ++i)
+                CHECK( bed.bicubic.get(i, j) == Approx(bed.z[j][i]).margin(0.0005) );
+    }
+
+    SECTION( "a plane is kept on the bed and past the mesh" )
+    {
+        Bed bed(plane);
+        for (unsigned n = 0; n < 10000; ++n)
+        {
+            float u = random_position(-1, 7), v = random_position(-1, 7);
+            REQUIRE( bed.bicubic.get(u, v) == Approx(plane(u, v)).margin(0.001) );
+        }
+    }
+
+    SECTION( "closer to a warped bed than the bilinear cells" )
+    {
+        for (Surface *f : {bowl, warp})
+        {
+            Bed bed(f);
+            float bilinear = 0, bicubic = 0;
+            for (unsigned n = 0; n < 10000; ++n)
+            {
+                float u = random_position(0, 6), v = random_position(0, 6);
+                bilinear = fmaxf(bilinear, fabsf(bed.bilinear(u, v) - f(u, v)));
+                bicubic = fmaxf(bicubic, fabsf(bed.bicubic.get(u, v) - f(u, v)));
+            }
+            INFO( "max error bilinear " << bilinear << " bicubic " << bicubic );
+            CHECK( bicubic < bilinear / 2 );
+        }
+    }
+}
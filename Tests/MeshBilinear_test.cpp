@@ -0,0 +1,191 @@
+/**
+ * @file
+ * @brief Bed mesh interpolation compared with the lookup it replaced
+ */
+
+#include "catch.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../Firmware/mesh_bilinear.h"
+
+namespace {
+
+// the mesh of the MK3
+const uint8_t points = 7;
+const float min_x = 24, max_x = 228, min_y = 6, max_y = 210;
+const float dist_x = (max_x - min_x) / (points - 1);
+const float dist_y = (max_y - min_y) / (points - 1);
+
+struct Mesh
+{
+    Mesh(unsigned seed)
+    {
+        srand(seed);
+        for (uint8_t j = 0; j < points; ++j)
+            for (uint8_t i = 0; i < points; ++i)
+                z[j][i] = (rand() % 2001 - 1000) * 0.0005f;
+        cells.update(z);
+    }
+
+    //! mesh_bed_leveling::get_z() before the cell lookup
+    float reference(float x, float y) const
+    {
+        int i = int(floor((x - min_x) / dist_x));
+        float s;
+        if (i < 0) {
+            i = 0;
+            s = (x - min_x) / dist_x;
+            if (s > 1.f)
+                s = 1.f;
+        } else if (i > points - 2) {
+            i = points - 2;
+            s = (x - (min_x + dist_x * i)) / dist_x;
+            if (s < 0)
+                s = 0;
+        } else {
+            s = (x - (min_x + dist_x * i)) / dist_x;
+            if (s < 0)
+                s = 0;
+            else if (s > 1.f)
+                s = 1.f;
+        }
+        int j = int(floor((y - min_y) / dist_y));
+        float t;
+        if (j < 0) {
+            j = 0;
+            t = (y - min_y) / dist_y;
+            if (t > 1.f)
+                t = 1.f;
+        } else if (j > points - 2) {
+            j = points - 2;
+            t = (y - (min_y + dist_y * j)) / dist_y;
+            if (t < 0)
+                t = 0;
+        } else {
+            t = (y - (min_y + dist_y * j)) / dist_y;
+            if (t < 0)
+                t = 0;
+            else if (t > 1.f)
+                t = 1.f;
+        }
+        float si = 1.f - s;
+        float z0 = si * z[j][i] + s * z[j][i + 1];
+        float z1 = si * z[j + 1][i] + s * z[j + 1][i + 1];
+        return (1.f - t) * z0 + t * z1;
+    }
+
+    float interpolate(float x, float y) const
+    {
+        float s, t;
+        uint8_t i = mesh_cell<points>((x - min_x) * (1.f / dist_x), s);
+        uint8_t j = mesh_cell<points>((y - min_y) * (1.f / dist_y), t);
+        return mesh_interpolate<points, points>(z, i, j, s, t);
+    }
+
+    float coefficients(float x, float y) const
+    {
+        float s, t;
+        uint8_t i = mesh_cell<points>((x - min_x) * (1.f / dist_x), s);
+        uint8_t j = mesh_cell<points>((y - min_y) * (1.f / dist_y), t);
+        return cells.get(i, j, s, t);
+    }
+
+    float z[points][points];
+    MeshCells<points, points> cells;
+};
+
+float random_position(float lo, float hi)
+{
+    return lo + (hi - lo) * (rand() % 100001) / 100000.f;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Mesh bed leveling interpolation", "[mesh_bilinear]" )
+{
+    Mesh mesh(1);
+
+    SECTION( "cells" )
+    {
+        float s;
+        CHECK( mesh_cell<points>(-0.5f, s) == 0 );
+        CHECK( s == -0.5f );
+        CHECK( mesh_cell<points>(0.f, s) == 0 );
+        CHECK( mesh_cell<points>(2.25f, s) == 2 );
+        CHECK( s == 0.25f );
+        CHECK( mesh_cell<points>(5.f, s) == 5 );
+        CHECK( s == 0.f );
+        CHECK( mesh_cell<points>(6.5f, s) == 5 );
+        CHECK( s == 1.5f );
+    }
+
+    SECTION( "mesh points" )
+    {
+        for (uint8_t j = 0; j < points; ++j)
+            for (uint8_t i = 0; i < points; ++i)
+            {
+                float x = min_x + dist_x * i, y = min_y + dist_y * j;
+                CHECK( mesh.interpolate(x, y) == Approx(mesh.z[j][i]).margin(1e-6) );
+                CHECK( mesh.coefficients(x, y) == Approx(mesh.z[j][i]).margin(1e-6) );
+            }
+    }
+
+    SECTION( "same as the previous lookup, on the bed and past the mesh" )
+    {
+        for (unsigned n = 0; n < 100000; ++n)
+        {
+            float x = random_position(-5, 255), y = random_position(-5, 215);
+            float z = mesh.reference(x, y);
+            INFO( "x " << x << " y " << y );
+            REQUIRE( mesh.interpolate(x, y) == Approx(z).margin(1e-6) );
+            REQUIRE( mesh.coefficients(x, y) == Approx(z).margin(1e-6) );
+        }
+    }
+
+    SECTION( "a point updates its cells" )
+    {
+        Mesh full(2);
+        for (uint8_t j = 0; j < points; ++j)
+            for (uint8_t i = 0; i < points; ++i)
+            {
+                mesh.z[j][i] = full.z[j][i];
+                mesh.cells.update(mesh.z, i, j);
+            }
+        for (unsigned n = 0; n < 10000; ++n)
+        {
+            float x = random_position(0, 250), y = random_position(0, 210);
+            REQUIRE( mesh.coefficients(x, y) == full.coefficients(x, y) );
+        }
+    }
+}
+
+TEST_CASE( "Mesh bed leveling interpolation benchmark", "[.][mesh_bilinear]" )
+{
+    Mesh mesh(3);
+    const unsigned n = 1000000;
+    float x[64], y[64];
+    for (uint8_t i = 0; i < 64; ++i)
+    {
+        x[i] = random_position(0, 250);
+        y[i] = random_position(0, 210);
+    }
+    float sum = 0;
+    BENCHMARK( "previous lookup" )
+    {
+        for (unsigned i = 0; i < n; ++i)
+            sum += mesh.reference(x[i & 63], y[i & 63]);
+    }
+    BENCHMARK( "reciprocal spacing" )
+    {
+        for (unsigned i = 0; i < n; ++i)
+            sum += mesh.interpolate(x[i & 63], y[i & 63]);
+    }
+    BENCHMARK( "cell coefficients" )
+    {
+        for (unsigned i = 0; i < n; ++i)
+            sum += mesh.coefficients(x[i & 63], y[i & 63]);
+    }
+    CHECK( sum == sum );
+}
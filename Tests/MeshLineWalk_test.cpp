@@ -0,0 +1,107 @@
+/**
+ * @file
+ * @brief Split of the moves at the lines of the bed mesh
+ */
+
+#include "catch.hpp"
+#include <vector>
+
+#include "../Firmware/mesh_line_walk.h"
+
+namespace {
+
+// mesh of 7x7 points 10 mm apart from the origin, the inner lines are at 10 to 50 mm
+const float mesh_min = 0.f;
+const float mesh_dist = 10.f;
+const int8_t mesh_points = 7;
+
+//! breakpoints of the move from @p x0, @p y0 to @p x1, @p y1
+std::vector<float> breakpoints(float x0, float y0, float x1, float y1)
+{
+    mesh_line_split split(
+        mesh_line_walk(x0, x1 - x0, mesh_min, mesh_dist, mesh_points),
+        mesh_line_walk(y0, y1 - y0, mesh_min, mesh_dist, mesh_points));
+    std::vector<float> result;
+    float t;
+    while (split.next(t))
+    {
+        REQUIRE( result.size() < 20 );
+        result.push_back(t);
+    }
+    return result;
+}
+
+void check_breakpoints(const std::vector<float> &actual, const std::vector<float> &expected)
+{
+    REQUIRE( actual.size() == expected.size() );
+    for (size_t i = 0; i < actual.size(); ++i)
+    {
+        INFO( "breakpoint " << i );
+        CHECK( actual[i] == Approx(expected[i]).margin(1e-6) );
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Mesh line walk", "[mbl]" )
+{
+    SECTION( "single cell boundary" )
+    {
+        check_breakpoints(breakpoints(5, 5, 15, 5), {0.5f});
+        check_breakpoints(breakpoints(5, 5, 5, 15), {0.5f});
+    }
+
+    SECTION( "several boundaries diagonally" )
+    {
+        // x crosses 10, 20, 30 and y crosses 10, 20
+        check_breakpoints(breakpoints(5, 5, 35, 25), {1.f / 6, 0.25f, 0.5f, 0.75f, 5.f / 6});
+    }
+
+    SECTION( "through the mesh points" )
+    {
+        // both lines crossed at once end a single segment
+        check_breakpoints(breakpoints(5, 5, 25, 25), {0.25f, 0.75f});
+    }
+
+    SECTION( "within a cell" )
+    {
+        check_breakpoints(breakpoints(12, 12, 18, 17), {});
+        check_breakpoints(breakpoints(12, 12, 12, 12), {});
+    }
+
+    SECTION( "reverse direction" )
+    {
+        check_breakpoints(breakpoints(15, 5, 5, 5), {0.5f});
+        check_breakpoints(breakpoints(35, 25, 5, 5), {1.f / 6, 0.25f, 0.5f, 0.75f, 5.f / 6});
+    }
+
+    SECTION( "start or end on a line" )
+    {
+        // the line at the start isn't a breakpoint, the one at the end is the end of the move
+        check_breakpoints(breakpoints(10, 5, 25, 5), {2.f / 3});
+        check_breakpoints(breakpoints(20, 5, 5, 5), {2.f / 3});
+        check_breakpoints(breakpoints(5, 5, 20, 5), {1.f / 3});
+    }
+
+    SECTION( "edge cells" )
+    {
+        // the edge lines aren't split, the correction extrapolates the edge cells
+        check_breakpoints(breakpoints(-5, 5, 5, 5), {});
+        check_breakpoints(breakpoints(65, 5, 55, 5), {});
+        check_breakpoints(breakpoints(-10, 5, 70, 5), {0.25f, 0.375f, 0.5f, 0.625f, 0.75f});
+    }
+
+    SECTION( "dense grid" )
+    {
+        // the bicubic surface sampled 3 times denser, lines every 10/3 mm
+        const int8_t factor = 3;
+        mesh_line_split split(
+            mesh_line_walk(5, 10, mesh_min, mesh_dist / factor, (mesh_points - 1) * factor + 1),
+            mesh_line_walk(5, 0, mesh_min, mesh_dist / factor, (mesh_points - 1) * factor + 1));
+        std::vector<float> actual;
+        float t;
+        while (split.next(t) && actual.size() < 20)
+            actual.push_back(t);
+        check_breakpoints(actual, {1.f / 6, 0.5f, 5.f / 6});
+    }
+}
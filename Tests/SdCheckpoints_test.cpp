@@ -0,0 +1,171 @@
+/**
+ * @file
+ * @brief SD command checkpoints compared with the lengths kept in each planner block
+ */
+
+#include "catch.hpp"
+#include <stdint.h>
+
+#include "../Firmware/sd_checkpoints.h"
+
+namespace {
+
+const uint8_t blocks = 16;
+
+//! planner block ring with the per block lengths the checkpoints replace
+template <uint8_t N>
+struct Planner
+{
+    Planner() : head(0), tail(0), seed(1), steps(0) {}
+
+    uint32_t random(uint32_t n)
+    {
+        seed = seed * 1103515245 + 12345;
+        return (seed >> 16) % n;
+    }
+    //! plan_buffer_line()
+    bool plan()
+    {
+        uint8_t next = (head + 1) & (blocks - 1);
+        if (next == tail)
+            return false;
+        checkpoints.prune(tail, head);
+        sdlen[head] = 0;
+        head = next;
+        return true;
+    }
+    //! planner_add_sd_length()
+    void add(uint16_t len)
+    {
+        if (head == tail)
+            return;
+        uint8_t last = (head - 1) & (blocks - 1);
+        checkpoints.prune(tail, head);
+        checkpoints.add(len, last);
+        sdlen[last] += len;
+    }
+    //! the stepper finishes a block
+    bool step()
+    {
+        if (head == tail)
+            return false;
+        done[steps++ % (blocks - 1)] = sdlen[tail];
+        tail = (tail + 1) & (blocks - 1);
+        return true;
+    }
+    //! planner_calc_sd_length() of the per block lengths
+    uint16_t expected() const
+    {
+        uint16_t len = 0;
+        for (uint8_t i = tail; i != head; i = (i + 1) & (blocks - 1))
+            len += sdlen[i];
+        return len;
+    }
+    //! length of the commands of the last blocks executed, up to a full planner queue of them
+    uint16_t executed() const
+    {
+        uint16_t len = 0;
+        for (uint8_t i = 0; i < blocks - 1 && i < steps; ++i)
+            len += done[i];
+        return len;
+    }
+    //! a command which plans up to @p segments blocks
+    void command(uint8_t segments)
+    {
+        for (uint8_t i = 0; i < segments; ++i)
+            while (!plan())
+                step();
+        add(20 + random(60));
+    }
+
+    SdCheckpoints<N, blocks> checkpoints;
+    uint16_t sdlen[blocks];
+    uint16_t done[blocks - 1];
+    uint8_t head, tail;
+    uint32_t seed;
+    uint32_t steps;
+};
+
+} // anonymous namespace
+
+TEST_CASE( "SD checkpoints", "[sd_checkpoints]" )
+{
+    SECTION( "empty" )
+    {
+        SdCheckpoints<4, blocks> c;
+        CHECK( c.length(0, 0) == 0 );
+        c.add(10, 3);
+        CHECK( c.length(3, 4) == 10 );
+        CHECK( c.length(4, 4) == 0 );
+        c.reset();
+        CHECK( c.length(3, 4) == 0 );
+    }
+
+    SECTION( "commands without blocks are merged into the last block" )
+    {
+        Planner<blocks> p;
+        p.command(1);
+        p.command(0);
+        p.command(0);
+        p.command(2);
+        CHECK( p.checkpoints.length(p.tail, p.head) == p.expected() );
+        p.step();
+        CHECK( p.checkpoints.length(p.tail, p.head) == p.expected() );
+        p.step();
+        p.step();
+        CHECK( p.checkpoints.length(p.tail, p.head) == 0 );
+    }
+
+    SECTION( "same lengths as the planner blocks" )
+    {
+        Planner<blocks> p;
+        for (unsigned i = 0; i < 20000; ++i)
+        {
+            uint32_t op = p.random(100);
+            if (op < 50)
+                p.command(p.random(4));
+            else if (op < 99)
+                p.step();
+            else
+                p.tail = p.head; // planner_abort_hard()
+            REQUIRE( p.checkpoints.length(p.tail, p.head) == p.expected() );
+        }
+    }
+
+    SECTION( "fewer checkpoints than blocks resume earlier" )
+    {
+        Planner<4> p;
+        bool merged = false;
+        for (unsigned i = 0; i < 20000; ++i)
+        {
+            if (p.random(2))
+                p.command(p.random(3));
+            else
+                p.step();
+            uint16_t len = p.checkpoints.length(p.tail, p.head);
+            REQUIRE( len >= p.expected() );
+            REQUIRE( len <= p.expected() + p.executed() );
+            merged |= (len > p.expected());
+        }
+        CHECK( merged );
+        while (p.step())
+            ;
+        CHECK( p.checkpoints.length(p.tail, p.head) == 0 );
+    }
+
+    SECTION( "fewer checkpoints than blocks of a full planner" )
+    {
+        // The stepper only frees the blocks for the new commands, the checkpoints stay full.
+        Planner<8> p;
+        for (unsigned i = 0; i < 20000; ++i)
+        {
+            p.command(1 + p.random(2));
+            uint16_t len = p.checkpoints.length(p.tail, p.head);
+            REQUIRE( len >= p.expected() );
+            REQUIRE( len <= p.expected() + p.executed() );
+        }
+        while (p.step())
+            ;
+        CHECK( p.checkpoints.length(p.tail, p.head) == 0 );
+    }
+}
@@ -0,0 +1,1086 @@
+/**
+ * @file
+ * @brief CardReader on an emulated SD card
+ */
+
+#include "catch.hpp"
+#include <algorithm>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+#include "sdemu/sdemu_prelude.h"
+#include "cardreader.h"
+#include "cmdqueue.h"
+#include "planner.h"
+#include "sdemu/fatimage.h"
+#include "sdemu/sdemu.h"
+
+namespace {
+
+//! the test binaries of the SD option variants may run in parallel, each uses its own image
+struct Image
+{
+    Image() : name("sdemu_test_" + std::to_string(getpid()) + ".img") {}
+    ~Image() { unlink(name.c_str()); }
+    const std::string name;
+} image_file;
+const char *const image = image_file.name.c_str();
+
+std::string gcode(unsigned lines, bool comments)
+{
+    std::string s;
+    for (unsigned i = 0; i < lines; ++i)
+    {
+        if (comments && i % 7 == 0)
+            s += ";LAYER:" + std::to_string(i) + "\n;comment\n";
+        s += "G1 X" + std::to_string(i % 250) + " Y" + std::to_string(i * 7 % 210) + " E0.0" + std::to_string(i % 10) + "\n";
+    }
+    return s;
+}
+
+//! the filter returns a run of comment lines as a single empty line
+std::string strip_comments(const std::string &s)
+{
+    std::string out;
+    bool comment = false;
+    for (size_t pos = 0, end; pos < s.size(); pos = end)
+    {
+        end = s.find('\n', pos) + 1;
+        if (s[pos] != ';')
+            out += s.substr(pos, end - pos);
+        else if (!comment)
+            out += '\n';
+        comment = (s[pos] == ';');
+    }
+    out.pop_back();
+    return out;
+}
+
+//! @brief Select a file and read it the way the print does
+//!
+//! The newline terminating the file is not returned, the end of file is reported instead.
+std::string print_file(const char *name)
+{
+    card.openFileReadFilteredGcode(name);
+    REQUIRE( card.isFileOpen() );
+    std::string s;
+    while (!card.eof())
+    {
+        int16_t c = card.getFilteredGcodeChar();
+        if (c < 0)
+            break;
+        s += (char)c;
+    }
+    card.closefile();
+    CHECK( SdEmu::card.stats.rejected == 0 );
+    return s;
+}
+
+void mount(FatImage &img)
+{
+    REQUIRE( img.close() );
+    REQUIRE( SdEmu::card.insert(image) );
+    card.initsd(false);
+    REQUIRE( card.cardOK );
+    MYSERIAL.take();
+}
+
+//! sort the current directory the way the SD menu does
+void presort()
+{
+    card.presort();
+#ifdef SDSORT_INDEX
+    while (card.presort_busy())
+        card.presort_step();
+#endif //SDSORT_INDEX
+}
+
+} // anonymous namespace
+
+TEST_CASE( "SD emulation directory listing", "[sdemu]" )
+{
+  for (uint8_t fat : {16, 32})
+  {
+    INFO( "FAT" << (int)fat );
+    FatImage img;
+    REQUIRE( img.create(image, fat == 16 ? 64 * 2048 : 256 * 2048, fat) );
+    const std::string data = gcode(10, false);
+    REQUIRE( img.add_file(FatImage::root, "BENCHY.GCO", data.data(), data.size()) );
+    REQUIRE( img.add_file(FatImage::root, "Long name of a print.gcode", data.data(), data.size()) );
+    REQUIRE( img.add_file(FatImage::root, "notes.txt", data.data(), data.size()) );
+    int dir = img.mkdir(FatImage::root, "Folder");
+    REQUIRE( dir > 0 );
+    REQUIRE( img.add_file(dir, "inner.gcode", data.data(), data.size()) );
+    mount(img);
+
+    CHECK( card.getnrfilenames() == 3 );
+    card.getfilename(0);
+    CHECK( std::string(card.filename) == "BENCHY.GCO" );
+    card.getfilename(1);
+    CHECK( std::string(card.longFilename) == "Long name of a print.gcode" );
+    CHECK( std::string(card.filename) == "LONGNA~1.GCO" );
+    card.getfilename(2);
+    CHECK( card.filenameIsDir );
+
+    card.ls(CardReader::ls_param(true, false));
+    std::string ls = MYSERIAL.take();
+    const std::string size = " " + std::to_string(data.size()) + " ";
+    CHECK( ls.find("BENCHY.GCO" + size + "\"BENCHY.GCO\"") != std::string::npos );
+    CHECK( ls.find("/FOLDER/INNER~1.GCO" + size + "\"inner.gcode\"") != std::string::npos );
+    CHECK( ls.find("NOTES") == std::string::npos );
+
+    SdEmu::card.eject();
+  }
+}
+
+TEST_CASE( "SD emulation print streaming", "[sdemu]" )
+{
+  for (uint8_t fragment : {0, 1})
+  {
+    INFO( "fragment " << (int)fragment );
+    FatImage img;
+    img.fragment = fragment;
+    REQUIRE( img.create(image, 64 * 2048, 16) );
+    const std::string plain = gcode(5000, false);
+    const std::string commented = gcode(5000, true);
+    REQUIRE( img.add_file(FatImage::root, "PLAIN.GCO", plain.data(), plain.size()) );
+    REQUIRE( img.add_file(FatImage::root, "COMMENT.GCO", commented.data(), commented.size()) );
+    mount(img);
+
+    SdEmu::card.command_latency = 100;
+    SdEmu::card.block_latency = 400;
+    SdEmu::card.reset_stats();
+    uint64_t start = SdEmu::card.now();
+    CHECK( print_file("PLAIN.GCO") == plain.substr(0, plain.size() - 1) );
+    const uint32_t blocks = (plain.size() + 511) / 512;
+    CHECK( SdEmu::card.stats.blocks_read >= blocks );
+#ifdef SD_FAT_CACHE
+    // the data blocks are read once and each FAT block about once
+    CHECK( SdEmu::card.stats.blocks_read <= blocks + 8 );
+    if (fragment)
+        CHECK( card.fatCacheHits() > 4 * card.fatCacheMisses() );
+#endif //SD_FAT_CACHE
+    CHECK( SdEmu::card.now() - start ==
+        SdEmu::card.stats.commands * 100ull + SdEmu::card.stats.blocks_read * 400ull );
+#ifdef SD_MULTIBLOCK_READ
+    // a command per FAT block instead of per data block
+    if (!fragment)
+        CHECK( SdEmu::card.stats.commands < blocks / 8 );
+#endif //SD_MULTIBLOCK_READ
+
+    CHECK( print_file("COMMENT.GCO") == strip_comments(commented) );
+    CHECK( print_file("/COMMENT.GCO") == strip_comments(commented) );
+
+    SdEmu::card.command_latency = SdEmu::card.block_latency = 0;
+    SdEmu::card.eject();
+  }
+}
+
+TEST_CASE( "SD emulation stream read error", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 64 * 2048, 16) );
+    const std::string plain = gcode(5000, false);
+    REQUIRE( img.add_file(FatImage::root, "PLAIN.GCO", plain.data(), plain.size()) );
+    mount(img);
+
+    // a single CRC error in the middle of the file
+    const uint32_t blocks = (plain.size() + 511) / 512;
+    SdEmu::card.reset_stats();
+    SdEmu::card.crc_error_countdown = blocks / 2;
+    CHECK( print_file("PLAIN.GCO") == plain.substr(0, plain.size() - 1) );
+#ifdef SD_MULTIBLOCK_READ
+    CHECK( SdEmu::card.stats.crc_errors == 1 );
+    // the block is read again alone and the stream restarted after it
+    CHECK( SdEmu::card.stats.blocks_read >= blocks + 1 );
+    CHECK( SdEmu::card.stats.commands < blocks / 8 + 3 );
+#else
+    CHECK( SdEmu::card.stats.crc_errors == 0 );
+#endif //SD_MULTIBLOCK_READ
+
+    SdEmu::card.crc_error_countdown = 0;
+    SdEmu::card.eject();
+}
+
+TEST_CASE( "SD emulation access during print", "[sdemu]" )
+{
+    FatImage img;
+    img.fragment = 1;
+    REQUIRE( img.create(image, 64 * 2048, 16) );
+    const std::string data = gcode(5000, false);
+    REQUIRE( img.add_file(FatImage::root, "PRINT.GCO", data.data(), data.size()) );
+    REQUIRE( img.add_file(FatImage::root, "OTHER.GCO", data.data(), 1000) );
+    mount(img);
+
+    // the listing reads the directory in the middle of the print
+    card.openFileReadFilteredGcode("PRINT.GCO");
+    REQUIRE( card.isFileOpen() );
+    std::string s;
+    for (int16_t c; !card.eof() && (c = card.getFilteredGcodeChar()) >= 0;)
+    {
+        s += (char)c;
+        if (s.size() % 20000 == 0)
+        {
+            const uint32_t pos = card.get_sdpos();
+            CHECK( card.getnrfilenames() == 2 );
+            card.ls(CardReader::ls_param(false, false));
+            card.setIndex(pos);
+        }
+    }
+    CHECK( s == data.substr(0, data.size() - 1) );
+    CHECK( SdEmu::card.stats.rejected == 0 );
+
+    // the print file is replaced without closing it
+    card.openFileReadFilteredGcode("PRINT.GCO");
+    for (int i = 0; i < 3000; ++i)
+        card.getFilteredGcodeChar();
+    card.removeFile("OTHER.GCO");
+    CHECK( SdEmu::card.stats.rejected == 0 );
+    CHECK( SdEmu::card.stats.blocks_written > 0 );
+    CHECK( card.getnrfilenames() == 1 );
+    MYSERIAL.take();
+
+    SdEmu::card.eject();
+}
+
+TEST_CASE( "SD emulation power panic position", "[sdemu]" )
+{
+    // The print goes through the command queue into the planner, the test executes the blocks.
+    // A command is done when the block planned last before it has been executed, the commands
+    // passed to an empty planner are done at once.
+    struct Command
+    {
+        uint32_t start; //!< end of the previous command, the comments before it are part of it
+        bool move;
+        uint32_t block; //!< number of the block it waits for, 0 if done when passed
+    };
+    std::string text;
+    std::vector<Command> commands;
+    for (unsigned i = 0; i < 600; ++i)
+    {
+        commands.push_back({(uint32_t)text.size(), i % 4 != 3, 0});
+        if (i % 13 == 0)
+            text += ";LAYER:" + std::to_string(i) + "\n;comment\n";
+        text += commands.back().move ? "G1 X" + std::to_string(i % 200) + " Y10\n" : "M117 " + std::to_string(i) + "\n";
+    }
+
+    FatImage img;
+    REQUIRE( img.create(image, 16 * 2048, 16) );
+    REQUIRE( img.add_file(FatImage::root, "PRINT.GCO", text.data(), text.size()) );
+    mount(img);
+    card.openFileReadFilteredGcode("PRINT.GCO");
+    REQUIRE( card.isFileOpen() );
+    card.startFileprint();
+    plan_init();
+    sdpos_atomic = 0;
+
+    size_t next = 0;
+    uint32_t planned = 0, executed = 0;
+    bool merged = false;
+    auto check = [&]()
+    {
+        // the start of the first command not done
+        size_t done = 0;
+        while (done < next && commands[done].block <= executed)
+            ++done;
+        const uint32_t exact = done < commands.size() ? commands[done].start : text.size();
+        const uint32_t resume = sdpos_atomic - planner_calc_sd_length() - cmdqueue_calc_sd_length();
+#ifdef SD_CHECKPOINTS
+        // back by the commands of less than a full planner queue of the blocks executed
+        size_t first = 0;
+        while (first < next && commands[first].block + BLOCK_BUFFER_SIZE - 1 <= executed)
+            ++first;
+        REQUIRE( resume <= exact );
+        REQUIRE( resume >= commands[first].start );
+        merged |= (resume < exact);
+#else //SD_CHECKPOINTS
+        REQUIRE( resume == exact );
+#endif //SD_CHECKPOINTS
+    };
+    auto step = [&]()
+    {
+        plan_discard_current_block();
+        ++executed;
+        check();
+    };
+
+    while (next < commands.size())
+    {
+        get_command();
+        if (!buflen)
+            continue; // stopped at the comments
+        REQUIRE( CMDBUFFER_CURRENT_TYPE == CMDBUFFER_CURRENT_TYPE_SDCARD );
+        // a shallow planner queue for the first half of the print, a full one for the rest
+        const uint8_t depth = next < commands.size() / 2 ? 4 : BLOCK_BUFFER_SIZE - 1;
+        if (commands[next].move)
+        {
+            while (moves_planned() >= depth)
+                step();
+            plan_buffer_line(next % 200, 10, 0.2, 0, 50, 0);
+            REQUIRE( moves_planned() == planned - executed + 1 );
+            ++planned;
+        }
+        if (moves_planned())
+            commands[next].block = planned;
+        cmdqueue_pass_sd_length();
+        cmdqueue_pop_front();
+        ++next;
+        check();
+    }
+    while (moves_planned())
+        step();
+    CHECK( sdpos_atomic - planner_calc_sd_length() - cmdqueue_calc_sd_length() == text.size() );
+#ifdef SD_CHECKPOINTS
+    CHECK( merged );
+#endif //SD_CHECKPOINTS
+
+    card.closefile();
+    card.sdprinting = false;
+    MYSERIAL.take();
+    SdEmu::card.eject();
+}
+
+TEST_CASE( "SD emulation file writing", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 256 * 2048, 32) );
+    mount(img);
+
+    card.openFileWrite("UPLOAD.GCO");
+    REQUIRE( card.saving );
+    std::vector<std::string> lines;
+    for (unsigned i = 0; i < 2000; ++i)
+    {
+        lines.push_back("G1 X" + std::to_string(i % 200) + " F1500");
+        card.write_command(&lines.back()[0]);
+    }
+    card.closefile();
+    CHECK( SdEmu::card.stats.blocks_written > 0 );
+
+    // read back from a fresh mount
+    card.initsd(false);
+    std::string expected;
+    for (const std::string &l : lines)
+        expected += l + "\r\n";
+    expected.pop_back();
+    CHECK( print_file("UPLOAD.GCO") == expected );
+
+    SdEmu::card.eject();
+    card.initsd(false);
+    CHECK_FALSE( card.cardOK );
+}
+
+#ifdef SD_MULTIBLOCK_WRITE
+//! size of the blocks written by write_command_no_newline()
+const size_t chunk_size = 64;
+
+//! write the file the way the PRUSA M28 upload does
+void upload(const char *name, const std::string &data, uint32_t announced)
+{
+    card.openFileWrite(name);
+    REQUIRE( card.saving );
+    REQUIRE( card.reserveFileWrite(announced) );
+    for (size_t pos = 0; pos < data.size(); pos += chunk_size)
+    {
+        std::string chunk = data.substr(pos, chunk_size);
+        chunk.resize(chunk_size, '\n');
+        card.write_command_no_newline(&chunk[0]);
+    }
+    card.closefile();
+}
+
+TEST_CASE( "SD emulation reserved upload", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 256 * 2048, 32) );
+    mount(img);
+    std::string data = gcode(8000, false);
+    data.resize(data.size() / chunk_size * chunk_size - 1);
+    data += '\n';
+    const uint32_t blocks = data.size() / 512;
+
+    SECTION( "announced size" )
+    {
+        SdEmu::card.reset_stats();
+        upload("UPLOAD.GCO", data, data.size());
+        CHECK( SdEmu::card.stats.rejected == 0 );
+        CHECK( SdEmu::card.stats.blocks_written >= blocks );
+        // the data goes in a single multiple block write, only the FAT and the directory are
+        // written in single blocks
+        CHECK( SdEmu::card.stats.commands < 30 );
+    }
+    SECTION( "larger than announced" )
+    {
+        // the rest of the file is written block by block
+        upload("UPLOAD.GCO", data, data.size() / 3);
+    }
+    SECTION( "smaller than announced" )
+    {
+        // the unused clusters are freed when the file is closed, so the card has room for
+        // another reservation of most of its size
+        upload("UPLOAD.GCO", data, 200ul << 20);
+        card.openFileWrite("EMPTY.GCO");
+        REQUIRE( card.reserveFileWrite(200ul << 20) );
+        card.closefile();
+        card.openFileWrite("SECOND.GCO");
+        CHECK( card.reserveFileWrite(200ul << 20) );
+        card.closefile();
+    }
+    SECTION( "closed through the base class" )
+    {
+        // the reservation is released by SdBaseFile::close(), also from the destructor
+        Sd2Card sd;
+        REQUIRE( sd.init() );
+        SdVolume volume;
+        REQUIRE( volume.init(&sd) );
+        SdFile root;
+        REQUIRE( root.openRoot(&volume) );
+        {
+            SdFile f;
+            REQUIRE( f.open(&root, "UPLOAD.GCO", O_CREAT | O_WRITE | O_TRUNC) );
+            REQUIRE( f.reserve(200ul << 20) );
+            for (size_t pos = 0; pos < data.size(); pos += 512)
+            {
+                const uint16_t n = std::min<size_t>(512, data.size() - pos);
+                REQUIRE( f.write(data.data() + pos, n) == n );
+            }
+            SdBaseFile &base = f;
+            CHECK( base.close() );
+        }
+        {
+            SdFile f;
+            REQUIRE( f.open(&root, "EMPTY.GCO", O_CREAT | O_WRITE | O_TRUNC) );
+            REQUIRE( f.reserve(200ul << 20) );
+        }
+        card.openFileWrite("SECOND.GCO");
+        CHECK( card.reserveFileWrite(200ul << 20) );
+        card.closefile();
+    }
+
+    card.initsd(false);
+    CHECK( print_file("UPLOAD.GCO") == data.substr(0, data.size() - 1) );
+    CHECK( card.getFileSize() == data.size() );
+    CHECK( SdEmu::card.stats.rejected == 0 );
+}
+#endif //SD_MULTIBLOCK_WRITE
+
+TEST_CASE( "SD emulation presort", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 256 * 2048, 32) );
+    const unsigned files = 2000;
+    for (unsigned i = 0; i < files; ++i)
+    {
+        // the names are created out of order
+        std::string name = "print_" + std::to_string(i * 7919 % files) + ".gcode";
+        REQUIRE( img.add_file(FatImage::root, name.c_str(), "G28\n", 4, FAT_DEFAULT_DATE, FAT_TIME(i / 3600, i / 60 % 60, i % 60)) );
+    }
+    mount(img);
+    CHECK( card.getnrfilenames() == files );
+
+    // a walk over the directory item by item, as the pass does it
+    SdEmu::card.reset_stats();
+    card.getfilename(0);
+    for (unsigned i = 1; i < files; ++i)
+        card.getfilename_next(card.position);
+    const uint32_t dir_blocks = SdEmu::card.stats.blocks_read;
+
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_ALPHA;
+    presort();
+    // a page is selected by a pass reading the directory in order, its items aren't reread
+    SdEmu::card.reset_stats();
+    card.getfilename_sorted(files - 1, SD_SORT_ALPHA);
+    CHECK( SdEmu::card.stats.blocks_read <= dir_blocks + 4 );
+
+    // the listing is shown in the reverse order
+    std::string prev;
+    std::vector<std::string> listing(files);
+    for (unsigned i = files; i--;)
+    {
+        card.getfilename_sorted(i, SD_SORT_ALPHA);
+        std::string name = card.longFilename;
+        CHECK( strcasecmp(prev.c_str(), name.c_str()) < 0 );
+        prev = listing[i] = name;
+    }
+    // scrolling up and jumping around the listing
+    for (unsigned i = 0; i < files; ++i)
+    {
+        card.getfilename_sorted(i, SD_SORT_ALPHA);
+        CHECK( listing[i] == card.longFilename );
+    }
+    for (unsigned i = 0; i < 50; ++i)
+    {
+        const unsigned nr = i * 7919 % files;
+        card.getfilename_sorted(nr, SD_SORT_ALPHA);
+        CHECK( listing[nr] == card.longFilename );
+    }
+
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_TIME;
+    presort();
+    uint16_t prev_time = 0;
+    for (unsigned i = 0; i < files; ++i)
+    {
+        card.getfilename_sorted(i, SD_SORT_TIME);
+        CHECK( card.crmodTime >= prev_time );
+        prev_time = card.crmodTime;
+    }
+    eeprom_mem[EEPROM_SD_SORT] = 0;
+
+    SdEmu::card.eject();
+}
+
+TEST_CASE( "SD emulation presort of folders and files", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 256 * 2048, 32) );
+    const unsigned files = 3 * SDSORT_LIMIT + 17;
+    for (unsigned i = 0; i < files; ++i)
+    {
+        // the names share a long prefix, the folders and the last file break it
+        std::string name = "Print of the part " + std::to_string(i * 7919 % files) + ".gcode";
+        REQUIRE( img.add_file(FatImage::root, name.c_str(), "G28\n", 4, FAT_DEFAULT_DATE, FAT_TIME(i / 3600, i / 60 % 60, i % 60)) );
+        if (i % 100 == 50)
+            REQUIRE( img.mkdir(FatImage::root, ("Folder " + std::to_string(i)).c_str()) > 0 );
+    }
+    REQUIRE( img.add_file(FatImage::root, "notes.txt", "x", 1) );
+    const unsigned dirs = (files + 49) / 100;
+    // the listing skips the non gcode file
+    const unsigned count = files + dirs;
+    mount(img);
+    REQUIRE( card.getnrfilenames() == count );
+
+    // the menu shows the folders on top, then the files, both alphabetically
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_ALPHA;
+    presort();
+    std::string prev;
+    for (unsigned i = count; i--;)
+    {
+        card.getfilename_sorted(i, SD_SORT_ALPHA);
+        const std::string name = card.longFilename[0] ? card.longFilename : card.filename;
+        INFO( "item " << i << " " << name );
+        CHECK( card.filenameIsDir == (i >= count - dirs) );
+        if (i == count - dirs - 1)
+            prev.clear();
+        CHECK( strcasecmp(prev.c_str(), name.c_str()) < 0 );
+        prev = name;
+    }
+
+    // the folders follow the files oldest first
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_TIME;
+    presort();
+    uint32_t prev_time = 0;
+    for (unsigned i = 0; i < count; ++i)
+    {
+        card.getfilename_sorted(i, SD_SORT_TIME);
+        INFO( "item " << i << " " << card.longFilename );
+        CHECK( card.filenameIsDir == (i >= count - dirs) );
+        const uint32_t time = (uint32_t)card.crmodDate << 16 | card.crmodTime;
+        if (!card.filenameIsDir)
+            CHECK( time >= prev_time );
+        prev_time = time;
+    }
+    eeprom_mem[EEPROM_SD_SORT] = 0;
+    MYSERIAL.take();
+
+    SdEmu::card.eject();
+}
+
+#ifdef SDSORT_INDEX
+TEST_CASE( "SD emulation sort index", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 256 * 2048, 32) );
+    const int dir = img.mkdir(FatImage::root, "GCODE");
+    REQUIRE( dir > 0 );
+    const unsigned files = 2 * SDSORT_LIMIT + 17;
+    for (unsigned i = 0; i < files; ++i)
+    {
+        std::string name = "Part " + std::to_string(i * 7919 % files) + ".gcode";
+        REQUIRE( img.add_file(dir, name.c_str(), "G28\n", 4, FAT_DEFAULT_DATE, FAT_TIME(i / 3600, i / 60 % 60, i % 60)) );
+    }
+    for (const char *name : {"Zeta", "alpha", "Mid"})
+        REQUIRE( img.mkdir(dir, name) > 0 );
+    REQUIRE( img.add_file(dir, "notes.txt", "x", 1) );
+    mount(img);
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_ALPHA;
+
+    // the menu shows the folders on top, then the files, both alphabetically
+    auto check_alpha = [](unsigned count) {
+        REQUIRE( card.getnrfilenames() == count );
+        std::string prev;
+        bool dirs = true;
+        for (unsigned i = count; i--;)
+        {
+            card.getfilename_sorted(i, SD_SORT_ALPHA);
+            const std::string name = card.longFilename[0] ? card.longFilename : card.filename;
+            INFO( "item " << i << " " << name );
+            if (dirs && !card.filenameIsDir)
+            {
+                CHECK( i == count - 4 );
+                dirs = false;
+                prev.clear();
+            }
+            CHECK( card.filenameIsDir == dirs );
+            CHECK( strcasecmp(prev.c_str(), name.c_str()) < 0 );
+            prev = name;
+        }
+    };
+
+    // the index is built in steps of limited duration
+    SdEmu::card.command_latency = 400;
+    SdEmu::card.block_latency = 1600;
+    REQUIRE( card.chdir("GCODE", true) );
+    CHECK( card.presort_busy() );
+    unsigned steps = 0;
+    while (card.presort_busy())
+    {
+        const uint64_t start = SdEmu::card.now();
+        card.presort_step();
+        CHECK( SdEmu::card.now() - start < 2 * SDSORT_INDEX_STEP * 1000ull );
+        ++steps;
+    }
+    CHECK( steps > 10 );
+    SdEmu::card.command_latency = SdEmu::card.block_latency = 0;
+    check_alpha(files + 3);
+
+    // a revisited directory is sorted from the index without reading it, nothing is written
+    card.updir();
+    SdEmu::card.reset_stats();
+    REQUIRE( card.chdir("GCODE", true) );
+    CHECK_FALSE( card.presort_busy() );
+    CHECK( SdEmu::card.stats.blocks_read <= 4 );
+    CHECK( SdEmu::card.stats.blocks_written == 0 );
+    check_alpha(files + 3);
+
+    // the card init drops the index
+    card.initsd(false);
+    REQUIRE( card.chdir("GCODE", true) );
+#ifdef SDSORT_INDEX_FILE
+    // but not the one stored on the card
+    CHECK_FALSE( card.presort_busy() );
+#else
+    CHECK( card.presort_busy() );
+#endif //SDSORT_INDEX_FILE
+    presort();
+    check_alpha(files + 3);
+
+    // a new file drops it
+    card.openFileWrite("NEW.GCO");
+    REQUIRE( card.saving );
+    card.write_command((char*)"G28");
+    card.closefile();
+    card.presort();
+    CHECK( card.presort_busy() );
+    presort();
+    check_alpha(files + 4);
+
+    // the other sort order needs another index
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_TIME;
+    card.presort();
+    CHECK( card.presort_busy() );
+    presort();
+    uint32_t prev = 0;
+    for (unsigned i = 0; i < files + 4; ++i)
+    {
+        card.getfilename_sorted(i, SD_SORT_TIME);
+        INFO( "item " << i << " " << card.longFilename );
+        CHECK( card.filenameIsDir == (i >= files + 1) );
+        const uint32_t time = (uint32_t)card.crmodDate << 16 | card.crmodTime;
+        if (!card.filenameIsDir)
+            CHECK( time >= prev );
+        prev = time;
+    }
+    eeprom_mem[EEPROM_SD_SORT] = 0;
+    MYSERIAL.take();
+
+    SdEmu::card.eject();
+}
+
+TEST_CASE( "SD emulation sort index of several directories", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 64 * 2048, 16) );
+    // the big directory takes most of the index
+    const unsigned sizes[] = {5, 6, SDSORT_INDEX_SIZE - 8, 7, 3, 4, 5, 6};
+    const unsigned dirs = sizeof(sizes) / sizeof(sizes[0]);
+    for (unsigned d = 0; d < dirs; ++d)
+    {
+        const std::string dir_name = "DIR" + std::to_string(d);
+        const int dir = img.mkdir(FatImage::root, dir_name.c_str());
+        REQUIRE( dir > 0 );
+        for (unsigned i = 0; i < sizes[d]; ++i)
+        {
+            std::string name = "Print " + std::to_string(i * 7919 % sizes[d]) + ".gcode";
+            REQUIRE( img.add_file(dir, name.c_str(), "G28\n", 4) );
+        }
+    }
+    mount(img);
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_ALPHA;
+
+    // visit a directory and go back to the root the way the menu does, @return it was sorted
+    // from the index
+    auto visit = [&](unsigned d) {
+        INFO( "directory " << d );
+        REQUIRE( card.chdir(("DIR" + std::to_string(d)).c_str(), true) );
+        const bool indexed = !card.presort_busy();
+        presort();
+        std::vector<std::string> names;
+        for (unsigned i = 0; i < sizes[d]; ++i)
+            names.push_back("Print " + std::to_string(i) + ".gcode");
+        std::sort(names.rbegin(), names.rend());
+        for (unsigned i = 0; i < sizes[d]; ++i)
+        {
+            card.getfilename_sorted(i, SD_SORT_ALPHA);
+            CHECK( card.longFilename == names[i] );
+        }
+        card.updir();
+        presort();
+        for (unsigned i = 0; i < dirs; ++i)
+        {
+            card.getfilename_sorted(i, SD_SORT_ALPHA);
+            CHECK( std::string(card.filename) == "DIR" + std::to_string(dirs - 1 - i) );
+        }
+        return indexed;
+    };
+
+    // the oldest directories are dropped from the index to make room for the visited one
+    for (unsigned pass = 0; pass < 2; ++pass)
+    {
+        INFO( "pass " << pass );
+        for (unsigned d = 0; d < dirs; ++d)
+        {
+#ifdef SDSORT_INDEX_FILE
+            // the order of a dropped directory is read back from the card
+            CHECK( visit(d) == (pass > 0) );
+#else
+            CHECK_FALSE( visit(d) );
+#endif //SDSORT_INDEX_FILE
+            CHECK( visit(d) );
+        }
+    }
+    eeprom_mem[EEPROM_SD_SORT] = 0;
+    MYSERIAL.take();
+
+    SdEmu::card.eject();
+}
+
+#ifdef SDSORT_INDEX_FILE
+namespace {
+
+//! delete the item of the short name @p sfn from the ejected card the way a PC does
+bool delete_item(const char *sfn)
+{
+    char name[11];
+    memset(name, ' ', sizeof(name));
+    const char *dot = strchr(sfn, '.');
+    memcpy(name, sfn, dot - sfn);
+    memcpy(name + 8, dot + 1, strlen(dot + 1));
+    FILE *f = fopen(image, "r+b");
+    if (!f)
+        return false;
+    uint8_t block[512];
+    bool found = false;
+    for (long pos = 0; !found && fread(block, sizeof(block), 1, f) == 1; pos += sizeof(block))
+    {
+        for (unsigned e = 0; e < sizeof(block); e += 32)
+        {
+            if (memcmp(block + e, name, sizeof(name)) != 0)
+                continue;
+            block[e] = DIR_NAME_DELETED;
+            fseek(f, pos, SEEK_SET);
+            found = fwrite(block, sizeof(block), 1, f) == 1;
+            break;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "SD emulation sort index file", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 64 * 2048, 16) );
+    const int dir = img.mkdir(FatImage::root, "GCODE");
+    REQUIRE( dir > 0 );
+    // more items than the index in RAM takes, with short names only
+    const unsigned files = SDSORT_INDEX_SIZE + 2 * SDSORT_LIMIT + 17;
+    for (unsigned i = 0; i < files; ++i)
+    {
+        std::string name = "P" + std::to_string(i * 7919 % files) + ".GCO";
+        REQUIRE( img.add_file(dir, name.c_str(), "G28\n", 4) );
+    }
+    mount(img);
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_ALPHA;
+
+    auto check_alpha = [](unsigned count) {
+        REQUIRE( card.getnrfilenames() == count );
+        std::string prev;
+        for (unsigned i = count; i--;)
+        {
+            card.getfilename_sorted(i, SD_SORT_ALPHA);
+            INFO( "item " << i << " " << card.filename );
+            CHECK( strcasecmp(prev.c_str(), card.filename) < 0 );
+            prev = card.filename;
+        }
+    };
+    // reinsert the card and open the directory, @return it's sorted from the index
+    auto reopen = [](bool inserted) {
+        if (!inserted)
+            REQUIRE( SdEmu::card.insert(image) );
+        card.initsd(false);
+        REQUIRE( card.cardOK );
+        SdEmu::card.reset_stats();
+        REQUIRE( card.chdir("GCODE", true) );
+        return !card.presort_busy();
+    };
+
+    // the first visit builds the index
+    CHECK_FALSE( reopen(true) );
+    presort();
+    check_alpha(files);
+
+    // it's looked up and checked by a read of the directory after the card init, nothing is written
+    CHECK( reopen(true) );
+    CHECK( SdEmu::card.stats.blocks_read <= files / 16 + 10 );
+    CHECK( SdEmu::card.stats.blocks_written == 0 );
+    check_alpha(files);
+
+    // an item deleted in the first block of the directory drops it
+    SdEmu::card.eject();
+    REQUIRE( delete_item(("P" + std::to_string(3 * 7919 % files) + ".GCO").c_str()) );
+    CHECK_FALSE( reopen(false) );
+    presort();
+    check_alpha(files - 1);
+
+    // an item deleted further in the directory is found when it's listed
+    SdEmu::card.eject();
+    REQUIRE( delete_item(("P" + std::to_string(files / 2 * 7919 % files) + ".GCO").c_str()) );
+    CHECK( reopen(false) );
+    for (unsigned i = 0; i < files && !card.presort_busy(); ++i)
+        card.getfilename_sorted(i, SD_SORT_ALPHA);
+    CHECK( card.presort_busy() );
+    presort();
+    check_alpha(files - 2);
+    CHECK( reopen(true) );
+
+    eeprom_mem[EEPROM_SD_SORT] = 0;
+    MYSERIAL.take();
+
+    SdEmu::card.eject();
+}
+#endif //SDSORT_INDEX_FILE
+#endif //SDSORT_INDEX
+
+#ifdef SD_NAME_CACHE
+TEST_CASE( "SD emulation name cache", "[sdemu]" )
+{
+    FatImage img;
+    REQUIRE( img.create(image, 64 * 2048, 16) );
+    const unsigned files = 40;
+    for (unsigned i = 0; i < files; ++i)
+    {
+        std::string name = "Long name of print " + std::to_string(i) + ".gcode";
+        REQUIRE( img.add_file(FatImage::root, name.c_str(), "G28\n", 4) );
+    }
+    mount(img);
+    eeprom_mem[EEPROM_SD_SORT] = SD_SORT_ALPHA;
+    presort();
+
+    auto window = [](unsigned top) {
+        std::string s;
+        for (unsigned i = top; i > top - 4; --i)
+        {
+            card.getfilename_sorted(i, SD_SORT_ALPHA);
+            s += std::string(card.longFilename) + "\n";
+        }
+        return s;
+    };
+    const std::string first = window(20);
+    CHECK( first.find("print 27.gcode\n") != std::string::npos );
+
+    // redrawing the menu and scrolling back and forth by a row
+    SdEmu::card.reset_stats();
+    CHECK( window(20) == first );
+    CHECK( SdEmu::card.stats.commands == 0 );
+    const std::string scrolled = window(19);
+    CHECK( SdEmu::card.stats.commands > 0 );
+    SdEmu::card.reset_stats();
+    CHECK( window(20) == first );
+    CHECK( window(19) == scrolled );
+    CHECK( SdEmu::card.stats.commands == 0 );
+
+    // the directory changes
+    card.getfilename_sorted(20, SD_SORT_ALPHA);
+    const std::string removed = card.filename;
+    card.removeFile(removed.c_str());
+    presort();
+    CHECK( window(20) != first );
+    card.getfilename_sorted(20, SD_SORT_ALPHA);
+    CHECK( removed != card.filename );
+    eeprom_mem[EEPROM_SD_SORT] = 0;
+    MYSERIAL.take();
+
+    SdEmu::card.eject();
+}
+#endif //SD_NAME_CACHE
+
+TEST_CASE( "SD emulation seek", "[sdemu]" )
+{
+    FatImage img;
+    // runs of 16 clusters, more than the extent map holds
+    img.fragment = 4;
+    img.fragment_run = 16;
+    REQUIRE( img.create(image, 16 * 2048, 16, 1) );
+    const std::string data = gcode(20000, false);
+    REQUIRE( data.size() > 40 * 16 * 512 );
+    REQUIRE( img.add_file(FatImage::root, "RESUME.GCO", data.data(), data.size()) );
+    mount(img);
+
+    card.openFileReadFilteredGcode("RESUME.GCO");
+    REQUIRE( card.isFileOpen() );
+    // resume in every run of clusters, backwards and at the cluster boundaries
+    std::vector<uint32_t> positions;
+    for (uint32_t pos = 0; pos < data.size(); pos += 16 * 512 + 77)
+        positions.push_back(pos);
+    for (uint32_t pos = data.size() / 512 * 512; pos >= 16 * 512; pos -= 16 * 512)
+        positions.push_back(pos);
+    for (uint32_t pos : positions)
+    {
+        // start on a line, the way the print is resumed
+        const size_t line = (pos == 0) ? 0 : data.rfind('\n', pos - 1) + 1;
+        INFO( "position " << line );
+        SdEmu::card.reset_stats();
+        card.setIndex(line);
+        std::string s;
+        for (int16_t c; s.size() < 100 && !card.eof() && (c = card.getFilteredGcodeChar()) >= 0;)
+            s += (char)c;
+        CHECK( s.size() == std::min<size_t>(100, data.size() - line - 1) );
+        CHECK( s == data.substr(line, s.size()) );
+#ifdef SD_EXTENT_MAP
+        // the mapped part of the file is located without reading the FAT
+        if (line < 8 * 16 * 512)
+            CHECK( SdEmu::card.stats.blocks_read <= 2 );
+#endif //SD_EXTENT_MAP
+    }
+
+    // a seek past the end fails at a cluster boundary without moving the file
+    card.setIndex(0);
+    while (card.get_sdpos() < 3 * 512)
+        card.getFilteredGcodeChar();
+    REQUIRE( card.get_sdpos() == 3 * 512 );
+    card.setIndex(data.size() + 1);
+    CHECK( card.getFilteredGcodeChar() == data[3 * 512] );
+    CHECK( card.get_sdpos() == 3 * 512 + 1 );
+    card.closefile();
+
+    SdEmu::card.eject();
+}
+
+#ifdef SD_BINARY_GCODE
+TEST_CASE( "SD emulation binary G-code", "[sdemu]" )
+{
+    // header, the index of 3 layers and the records: a layer of a command and moves per 100 records
+    std::string records;
+    std::vector<uint32_t> layers;
+    const uint32_t data = sizeof(GcodeBinaryHeader) + 3 * 4;
+    for (unsigned i = 0; i < 300; ++i)
+    {
+        if (i % 100 == 0)
+        {
+            layers.push_back(data + records.size());
+            records += (char)GB_LAYER;
+            const std::string cmd = "M117 layer " + std::to_string(i / 100);
+            records += (char)GB_COMMAND;
+            records += (char)cmd.size();
+            records += cmd;
+        }
+        const int16_t d[2] = {(int16_t)(i % 2 ? 1000 : -1000), 20};
+        records += (char)(GB_X | GB_E);
+        records.append((const char *)d, sizeof(d));
+    }
+    GcodeBinaryHeader header;
+    memcpy(header.magic, GCODE_BINARY_MAGIC, sizeof(header.magic));
+    header.version = GCODE_BINARY_VERSION;
+    header.flags = 0;
+    header.layers = layers.size();
+    header.print_time = 600;
+    header.index = sizeof(header);
+    header.data = data;
+    std::string file((const char *)&header, sizeof(header));
+    file.append((const char *)layers.data(), layers.size() * 4);
+    file += records;
+    REQUIRE( file.size() == data + records.size() );
+
+    FatImage img;
+    REQUIRE( img.create(image, 16 * 2048, 16, 1) );
+    REQUIRE( img.add_file(FatImage::root, "PRINT.GCO", file.data(), file.size()) );
+    REQUIRE( img.add_file(FatImage::root, "TEXT.GCO", "G1 X1\n", 6) );
+    mount(img);
+
+    card.openFileReadFilteredGcode("TEXT.GCO");
+    REQUIRE( card.isFileOpen() );
+    CHECK_FALSE( card.binary );
+    card.closefile();
+
+    card.openFileReadFilteredGcode("PRINT.GCO");
+    REQUIRE( card.isFileOpen() );
+    REQUIRE( card.binary );
+    uint8_t payload[MAX_CMD_SIZE];
+
+    SECTION( "records" )
+    {
+        unsigned moves = 0, commands = 0, layer_records = 0;
+        while (!card.eof())
+        {
+            int16_t tag = card.readBinaryRecord(payload);
+            REQUIRE( tag >= 0 );
+            if (tag == GB_LAYER)
+                ++layer_records;
+            else if (tag == GB_COMMAND)
+                CHECK( std::string((const char *)payload) == "M117 layer " + std::to_string(commands++) );
+            else
+            {
+                CHECK( tag == (GB_X | GB_E) );
+                int16_t d[2];
+                memcpy(d, payload, sizeof(d));
+                CHECK( d[0] == (moves % 2 ? 1000 : -1000) );
+                ++moves;
+            }
+        }
+        CHECK( moves == 300 );
+        CHECK( commands == 3 );
+        CHECK( layer_records == 3 );
+    }
+
+    SECTION( "layer positions" )
+    {
+        uint32_t pos;
+        for (uint16_t layer = 0; layer < 3; ++layer)
+        {
+            REQUIRE( card.binaryLayerPosition(layer, &pos) );
+            CHECK( pos == layers[layer] );
+        }
+        CHECK_FALSE( card.binaryLayerPosition(3, &pos) );
+        // M26 L
+        REQUIRE( card.binaryLayerPosition(2, &pos) );
+        card.setIndex(pos);
+        CHECK( card.readBinaryRecord(payload) == GB_LAYER );
+        CHECK( card.readBinaryRecord(payload) == GB_COMMAND );
+        CHECK( std::string((const char *)payload) == "M117 layer 2" );
+    }
+
+    SECTION( "damaged file" )
+    {
+        // the E delta of the last move read as a Z and F record, past the end of the file
+        card.setIndex(file.size() - 2);
+        CHECK( card.readBinaryRecord(payload) < 0 );
+        CHECK( card.eof() );
+    }
+
+    card.closefile();
+    SdEmu::card.eject();
+}
+#endif //SD_BINARY_GCODE
@@ -0,0 +1,159 @@
+/**
+ * @file
+ * @brief Edge scheduled soft PWM compared with the counter compare engine, sigma-delta dithering
+ */
+
+#include "catch.hpp"
+#include <algorithm>
+
+#include "../Firmware/soft_pwm.h"
+
+namespace {
+
+static const uint8_t heater = 1 << 0;
+static const uint8_t fan = 1 << 3;
+
+//! output of the counter compare engine at each tick of the frame, for a constant duty
+static void counter_compare(uint8_t heater_duty, uint8_t fan_duty, uint8_t *out)
+{
+    uint8_t state = 0;
+    for (uint8_t pwm_count = 0; pwm_count < 128; ++pwm_count)
+    {
+        if (pwm_count == 0)
+        {
+            if (heater_duty > 0) state |= heater; else state &= ~heater;
+        }
+        if ((pwm_count & 15) == 0)
+        {
+            if (fan_duty > 0) state |= fan; else state &= ~fan;
+        }
+        if (heater_duty < pwm_count) state &= ~heater;
+        if (fan_duty < (pwm_count & 15)) state &= ~fan;
+        out[pwm_count] = state;
+    }
+}
+
+//! output of the edge scheduled engine at each tick of the frame
+//! @return number of ticks with an output change
+static unsigned edge_schedule(SoftPwmSchedule &s, uint8_t *out)
+{
+    unsigned edges = 0;
+    uint8_t state = 0;
+    for (uint8_t pwm_count = 0; pwm_count < 128; ++pwm_count)
+    {
+        const SoftPwmSchedule::Edge *e = s.due(pwm_count);
+        if (e)
+        {
+            state = (state & ~e->clr) | e->set;
+            ++edges;
+        }
+        out[pwm_count] = state;
+    }
+    return edges;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Soft PWM edge schedule", "[soft_pwm]" )
+{
+    SECTION( "equivalent to the counter compare" )
+    {
+        for (unsigned h = 0; h < 128; ++h)
+            for (unsigned f = 0; f < 16; ++f)
+            {
+                SoftPwmSchedule s;
+                REQUIRE( s.add_pwm(0, h ? h + 1 : 0, 128, heater) );
+                for (uint8_t start = 0; start < 128; start += 16)
+                    REQUIRE( s.add_pwm(start, f ? f + 1 : 0, 16, fan) );
+                const unsigned max_edges = SoftPwmSchedule::max_edges;
+                REQUIRE( s.size() <= max_edges );
+
+                uint8_t expected[128], actual[128];
+                counter_compare(h, f, expected);
+                unsigned edges = edge_schedule(s, actual);
+                INFO( "heater " << h << " fan " << f );
+                REQUIRE( std::equal(expected, expected + 128, actual) );
+                CHECK( edges <= 17 );
+            }
+    }
+
+    SECTION( "edges at the same tick are merged" )
+    {
+        SoftPwmSchedule s;
+        CHECK( s.add(10, 0, fan) );
+        CHECK( s.add(5, heater, 0) );
+        CHECK( s.add(10, 0, heater) );
+        CHECK( s.add(10, fan, 0) ); // the later edge wins
+        REQUIRE( s.size() == 2 );
+        CHECK( s[0].tick == 5 );
+        CHECK( s[1].tick == 10 );
+        CHECK( s[1].set == fan );
+        CHECK( s[1].clr == heater );
+    }
+
+    SECTION( "full schedule" )
+    {
+        SoftPwmSchedule s;
+        for (uint8_t i = 0; i < SoftPwmSchedule::max_edges; ++i)
+            CHECK( s.add(i * 2, heater, 0) );
+        CHECK_FALSE( s.add(1, heater, 0) );
+        CHECK( s.add(2, 0, fan) );
+    }
+
+    SECTION( "replayed frame" )
+    {
+        SoftPwmSchedule s;
+        REQUIRE( s.add_pwm(0, 40, 128, heater) );
+        for (uint8_t start = 0; start < 128; start += 16)
+            REQUIRE( s.add_pwm(start, 5, 16, fan) );
+        uint8_t first[128], second[128];
+        unsigned edges = edge_schedule(s, first);
+        CHECK( edge_schedule(s, second) == 0 );
+        s.rewind();
+        CHECK( edge_schedule(s, second) == edges );
+        CHECK( std::equal(first, first + 128, second) );
+    }
+
+    SECTION( "no work on the ticks without an edge" )
+    {
+        SoftPwmSchedule s;
+        s.add_pwm(0, 128, 128, heater);
+        uint8_t out[128];
+        CHECK( edge_schedule(s, out) == 1 );
+    }
+}
+
+TEST_CASE( "Sigma-delta dithering", "[soft_pwm]" )
+{
+    SECTION( "fan duty keeps its 8bit resolution on average" )
+    {
+        for (unsigned value = 0; value < 255; ++value)
+        {
+            SigmaDelta sd;
+            unsigned on = 0;
+            for (unsigned period = 0; period < 256; ++period)
+            {
+                uint8_t ticks = sd.step(value, 4);
+                REQUIRE( ticks <= 16 );
+                on += ticks;
+            }
+            // 256 periods of 16 ticks
+            CHECK( on == value * 16 );
+        }
+    }
+
+    SECTION( "8.8 bed duty" )
+    {
+        SigmaDelta sd;
+        const uint16_t fine = 100.25f * 256;
+        unsigned sum = 0;
+        for (unsigned i = 0; i < 4; ++i)
+        {
+            uint8_t pwm = sd.step(fine, 8);
+            CHECK( (pwm == 100 || pwm == 101) );
+            sum += pwm;
+        }
+        CHECK( sum == 401 );
+        CHECK( sd.step(255 << 8, 8) == 255 );
+    }
+}
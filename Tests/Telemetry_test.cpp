@@ -0,0 +1,136 @@
+/**
+ * @file
+ * @brief Thermal telemetry frame encoding
+ */
+
+#include "catch.hpp"
+#include <string>
+
+#include "../Firmware/telemetry.h"
+
+namespace {
+
+static uint32_t get_varint(const uint8_t *&p)
+{
+    uint32_t v = 0;
+    for (uint8_t shift = 0;; shift += 7)
+    {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+}
+
+//! reference decoder, see tools/telemetry_decode
+struct Decoder
+{
+    uint8_t mask = 0;
+    uint32_t time = 0;
+    int16_t values[TELEMETRY_CHANNELS] = {};
+
+    bool decode(const uint8_t *frame, uint8_t len)
+    {
+        uint8_t checksum = 0;
+        for (uint8_t i = 0; i < len; ++i)
+            checksum ^= frame[i];
+        if (checksum)
+            return false;
+
+        const uint8_t *p = frame;
+        bool key = *p++ & 0x80;
+        if (key)
+        {
+            mask = *p++;
+            time = get_varint(p);
+        }
+        else
+            time += get_varint(p);
+        for (uint8_t i = 0; i < TELEMETRY_CHANNELS; ++i)
+        {
+            if (!(mask & (1 << i)))
+                continue;
+            uint16_t z = get_varint(p);
+            int16_t v = (z >> 1) ^ -(int16_t)(z & 1);
+            values[i] = key ? v : (int16_t)(values[i] + v);
+        }
+        return p == frame + len - 1;
+    }
+};
+
+} // anonymous namespace
+
+TEST_CASE( "Telemetry frames", "[telemetry]" )
+{
+    TelemetryEncoder enc(4);
+    Decoder dec;
+    uint8_t frame[TelemetryEncoder::max_frame];
+    const uint8_t mask = 0x3f;
+
+    SECTION( "round trip" )
+    {
+        int16_t values[TELEMETRY_CHANNELS] = { 215 * 16, 215 * 16, 60, 60 * 16, 60 * 16, 40, 0, 0 };
+        uint32_t time = 123456;
+        for (unsigned i = 0; i < 100; ++i)
+        {
+            uint8_t len = enc.encode(time, mask, values, frame);
+            REQUIRE( len <= (unsigned)TelemetryEncoder::max_frame );
+            CHECK( bool(frame[0] & 0x80) == (i % 4 == 0) );
+            CHECK( (frame[0] & 0x7f) == (i & 0x7f) );
+            REQUIRE( dec.decode(frame, len) );
+            CHECK( dec.time == time );
+            for (uint8_t c = 0; c < 6; ++c)
+                CHECK( dec.values[c] == values[c] );
+
+            time += 100;
+            values[0] += (i % 3) - 1;
+            values[2] = (i * 37) % 128;
+            values[3] = (i & 1) ? INT16_MAX : INT16_MIN; // deltas wrap around
+        }
+    }
+
+    SECTION( "steady values take a byte per channel" )
+    {
+        int16_t values[TELEMETRY_CHANNELS] = { 3000, 3440, 127, 960, 960, 127, 0, 0 };
+        enc.encode(0, mask, values, frame);
+        CHECK( enc.encode(100, mask, values, frame) == 1 + 1 + 6 + 1 );
+    }
+
+    SECTION( "mask change forces a key frame" )
+    {
+        int16_t values[TELEMETRY_CHANNELS] = {};
+        enc.encode(0, mask, values, frame);
+        enc.encode(100, 0xff, values, frame);
+        CHECK( (frame[0] & 0x80) );
+        CHECK( frame[1] == 0xff );
+        enc.reset();
+        enc.encode(200, 0xff, values, frame);
+        CHECK( (frame[0] & 0x80) );
+    }
+
+    SECTION( "corrupted frame" )
+    {
+        int16_t values[TELEMETRY_CHANNELS] = {};
+        uint8_t len = enc.encode(0, mask, values, frame);
+        frame[2] ^= 0x10;
+        CHECK_FALSE( dec.decode(frame, len) );
+    }
+}
+
+TEST_CASE( "Telemetry base64", "[telemetry]" )
+{
+    char line[TelemetryEncoder::max_line];
+    const uint8_t data[] = { 'f', 'o', 'o', 'b', 'a', 'r' };
+    CHECK( TelemetryEncoder::base64(data, 6, line) == 8 );
+    CHECK( std::string(line) == "Zm9vYmFy" );
+    TelemetryEncoder::base64(data, 4, line);
+    CHECK( std::string(line) == "Zm9vYg==" );
+    TelemetryEncoder::base64(data, 5, line);
+    CHECK( std::string(line) == "Zm9vYmE=" );
+    const uint8_t bin[] = { 0xfb, 0xff, 0x3e };
+    TelemetryEncoder::base64(bin, 3, line);
+    CHECK( std::string(line) == "+/8+" );
+
+    uint8_t frame[TelemetryEncoder::max_frame] = {};
+    CHECK( TelemetryEncoder::base64(frame, TelemetryEncoder::max_frame, line) < (unsigned)TelemetryEncoder::max_line );
+}
@@ -0,0 +1,360 @@
+/**
+ * @file
+ * @brief Temperature manager test bench with fault injection
+ *
+ * Simulates a hotend and a heatbed read through NTC thermistors and feeds the synthetic ADC stream
+ * to the temperature manager of the firmware (temperature.cpp built by tempemu) at the temp_mgr
+ * rate. The heaters are driven by the firmware PID output. Faults are injected at random times and
+ * the error reported to the LCD and its detection latency are checked against the expected bound.
+ *
+ * The firmware state is reset only by a reboot, so every scenario runs in a forked process.
+ */
+
+#include "catch.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../Firmware/tempcheck.h"
+#include "tempemu/tempemu.h"
+
+namespace {
+
+// MK3S configuration
+const uint32_t temp_mgr_intv = 270;      // ms
+const uint16_t hotend_runaway_tmo = 45;  // TEMP_RUNAWAY_EXTRUDER_TIMEOUT
+const float bed_offset = 10;             // BED_OFFSET, added to the bed readings over 100C
+const float ambient = 25;
+
+//! 100k NTC (beta model) with a 4.7k pull-up, ADC value oversampled 16x
+struct Thermistor
+{
+    float beta;
+
+    int raw(float t) const
+    {
+        const float r = 100000.f * expf(beta * (1.f / (t + 273.15f) - 1.f / 298.15f));
+        return (int)(16 * 1023 * r / (r + 4700.f) + 0.5f);
+    }
+};
+
+// beta fitted to the tables of the sensors in their working range
+const Thermistor hotend_ntc = { 4380 };  // TEMP_SENSOR_0 5
+const Thermistor bed_ntc = { 4050 };     // TEMP_SENSOR_BED 1
+const Thermistor ambient_ntc = { 4250 }; // TEMP_SENSOR_AMBIENT 2000
+
+//! run @p f in a forked process on a freshly booted firmware, returns its result
+template <class T, class F>
+T isolated(F f)
+{
+    int fd[2];
+    REQUIRE( pipe(fd) == 0 );
+    const pid_t pid = fork();
+    REQUIRE( pid >= 0 );
+    if (pid == 0)
+    {
+        close(fd[0]);
+        TempEmu::boot();
+        const T result = f();
+        const bool sent = write(fd[1], &result, sizeof(result)) == sizeof(result);
+        _exit(sent ? 0 : 1);
+    }
+    close(fd[1]);
+    T result;
+    const ssize_t received = read(fd[0], &result, sizeof(result));
+    close(fd[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    REQUIRE( received == (ssize_t)sizeof(result) );
+    REQUIRE( WIFEXITED(status) );
+    REQUIRE( WEXITSTATUS(status) == 0 );
+    return result;
+}
+
+enum class Fault
+{
+    none,
+    heater_open,     //!< heater or its wiring failed, no power
+    heater_stuck_on, //!< MOSFET shorted, full power
+    sensor_open,     //!< thermistor disconnected
+    sensor_short,    //!< thermistor shorted
+    fan_stall,       //!< print fan stopped, hotend cools less
+};
+
+enum class Error { none, min, max, preheat, runaway, other };
+
+//! lumped thermal model of a heater
+struct Heater
+{
+    float C;    //!< heat capacity [J/K]
+    float R;    //!< thermal resistance to ambient [K/W]
+    float P;    //!< heater power [W]
+    float T;
+
+    Heater(float C, float R, float P) : C(C), R(R), P(P), T(ambient) {}
+
+    void step(float duty, float dt)
+    {
+        T += (P * duty - (T - ambient) / R) / C * dt;
+    }
+};
+
+struct Scenario
+{
+    bool bed;          //!< fault injected into the bed instead of the hotend
+    Fault fault;
+    float fault_time;  //!< [s]
+    float target;      //!< target temperature of the faulty heater
+    bool preheated;    //!< the faulty heater starts at the target temperature
+    uint32_t seed;
+};
+
+struct Outcome
+{
+    Error error;
+    bool bed;   //!< the error was reported for the bed
+    float time; //!< detection time [s]
+};
+
+//! error of the first LCD alert
+Outcome outcome()
+{
+    static const struct { const char *alert; Error error; bool bed; } alerts[] = {
+        { "Err: MINTEMP", Error::min, false },
+        { "Err: MINTEMP BED", Error::min, true },
+        { "Err: MAXTEMP", Error::max, false },
+        { "Err: MAXTEMP BED", Error::max, true },
+        { "PREHEAT ERROR", Error::preheat, false },
+        { "BED PREHEAT ERROR", Error::preheat, true },
+        { "THERMAL RUNAWAY", Error::runaway, false },
+        { "BED THERMAL RUNAWAY", Error::runaway, true },
+    };
+    Outcome o = { Error::none, false, TempEmu::alert_time / 1000.f };
+    if (!TempEmu::alert)
+        return o;
+    o.error = Error::other;
+    for (const auto &a : alerts)
+        if (!strcmp(TempEmu::alert, a.alert)) { o.error = a.error; o.bed = a.bed; }
+    return o;
+}
+
+Outcome simulate(const Scenario &s, float duration)
+{
+    std::mt19937 rng(s.seed);
+    std::uniform_int_distribution<int> noise(-8, 8);
+
+    Heater hotend(11, 25, 38);
+    Heater bed(600, 1.1f, 200);
+    const float target_hotend = s.bed ? 215 : s.target;
+    const float target_bed = s.bed ? s.target : 60;
+    if (s.preheated) {
+        hotend.T = target_hotend;
+        bed.T = target_bed;
+    }
+    TempEmu::set_targets(target_hotend, target_bed);
+
+    const float dt = temp_mgr_intv / 1000.f;
+    for (uint32_t now = temp_mgr_intv; now < duration * 1000; now += temp_mgr_intv)
+    {
+        const float t = now / 1000.f;
+        const bool faulty = t >= s.fault_time;
+        TempEmu::now = now;
+
+        // plant driven by the soft PWM duty of the last cycle
+        float duty_hotend = TempEmu::hotend_pwm() / 127.f;
+        float duty_bed = TempEmu::bed_pwm() / 127.f;
+        float &victim_duty = s.bed ? duty_bed : duty_hotend;
+        if (faulty && s.fault == Fault::heater_open) victim_duty = 0;
+        if (faulty && s.fault == Fault::heater_stuck_on) victim_duty = 1;
+        hotend.R = (faulty && s.fault == Fault::fan_stall) ? 32 : 25;
+        hotend.step(duty_hotend, dt);
+        bed.step(duty_bed, dt);
+
+        // synthetic ADC stream
+        int raw_hotend = hotend_ntc.raw(hotend.T) + noise(rng);
+        int raw_bed = bed_ntc.raw(bed.T) + noise(rng);
+        int &victim_raw = s.bed ? raw_bed : raw_hotend;
+        if (faulty && s.fault == Fault::sensor_open) victim_raw = 16 * 1023;
+        if (faulty && s.fault == Fault::sensor_short) victim_raw = 0;
+
+        // temp_mgr interrupt, then the main loop handles its errors
+        TempEmu::adc_cycle(raw_hotend, raw_bed, ambient_ntc.raw(ambient));
+        manage_heater();
+        if (TempEmu::alert)
+            break;
+    }
+    return outcome();
+}
+
+Outcome run(const Scenario &s, float duration)
+{
+    return isolated<Outcome>([&]() { return simulate(s, duration); });
+}
+
+//! run @p count random scenarios and check every outcome
+template <class Check>
+void sweep(Fault fault, bool bed, bool preheated, unsigned count, float duration, Check check)
+{
+    std::mt19937 rng(bed * 1000 + (int)fault);
+    std::uniform_real_distribution<float> fault_time(preheated ? 10 : 5, preheated ? 60 : 15);
+    std::uniform_real_distribution<float> target(bed ? 50.f : 180.f, bed ? 110.f : 290.f);
+    for (unsigned i = 0; i < count; ++i)
+    {
+        Scenario s = { bed, fault, fault_time(rng), target(rng), preheated, (uint32_t)rng() };
+        Outcome o = run(s, duration);
+        INFO( "scenario " << i << ": fault at " << s.fault_time << "s, target " << s.target
+            << ", error " << (int)o.error << (o.bed ? " bed" : "") << " at " << o.time << "s" );
+        check(s, o);
+    }
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Thermistor model", "[temp_mgr]" )
+{
+    // temperatures converted by the firmware from the raw values of the model
+    struct Readings { float hotend[11], bed[11], ambient; };
+    const Readings r = isolated<Readings>([]() {
+        Readings r;
+        for (int i = 0; i < 11; ++i)
+        {
+            const float t = 25 * i + 20;
+            TempEmu::now += temp_mgr_intv;
+            TempEmu::adc_cycle(hotend_ntc.raw(t), bed_ntc.raw(std::min(t, 120.f)), ambient_ntc.raw(ambient));
+            manage_heater();
+            r.hotend[i] = TempEmu::hotend_temp();
+            r.bed[i] = TempEmu::bed_temp();
+        }
+        r.ambient = TempEmu::ambient_temp();
+        return r;
+    });
+
+    for (int i = 0; i < 11; ++i)
+    {
+        const float t = 25 * i + 20;
+        INFO( t << "C" );
+        CHECK( r.hotend[i] == Approx(t).margin(3) );
+        if (t <= 40)
+            CHECK( r.bed[i] == Approx(t).margin(3) );
+        else if (t >= 100)
+            CHECK( r.bed[i] == Approx(std::min(t, 120.f) + bed_offset).margin(3) );
+    }
+    CHECK( r.ambient == Approx(ambient).margin(1) );
+}
+
+TEST_CASE( "Temperature manager fault detection", "[temp_mgr]" )
+{
+    SECTION( "no fault, no false positive" )
+    {
+        for (bool bed : { false, true })
+            for (bool preheated : { false, true })
+                sweep(Fault::none, bed, preheated, 50, 900, [](const Scenario &, const Outcome &o) {
+                    CHECK( o.error == Error::none );
+                });
+    }
+
+    SECTION( "print fan stall is not a thermal error" )
+    {
+        sweep(Fault::fan_stall, false, true, 200, 600, [](const Scenario &, const Outcome &o) {
+            CHECK( o.error == Error::none );
+        });
+    }
+
+    SECTION( "hotend heater failure while preheating" )
+    {
+        // 6 failed periods of 9 evaluations, one evaluation each 2s
+        sweep(Fault::heater_open, false, false, 500, 300, [](const Scenario &s, const Outcome &o) {
+            CHECK( o.error == Error::preheat );
+            CHECK_FALSE( o.bed );
+            CHECK( o.time - s.fault_time < 6 * 9 * 2.3f + 20 );
+        });
+    }
+
+    SECTION( "hotend heater failure at temperature" )
+    {
+        // cool down by the hysteresis, then TEMP_RUNAWAY_EXTRUDER_TIMEOUT
+        sweep(Fault::heater_open, false, true, 500, 300, [](const Scenario &s, const Outcome &o) {
+            CHECK( o.error == Error::runaway );
+            CHECK_FALSE( o.bed );
+            CHECK( o.time - s.fault_time < 40 + hotend_runaway_tmo * 1.2f );
+        });
+    }
+
+    SECTION( "hotend heater stuck on" )
+    {
+        sweep(Fault::heater_stuck_on, false, true, 500, 300, [](const Scenario &s, const Outcome &o) {
+            CHECK( (o.error == Error::max || o.error == Error::runaway) );
+            CHECK_FALSE( o.bed );
+            CHECK( o.time - s.fault_time < 60 );
+        });
+    }
+
+    SECTION( "hotend thermistor open or shorted" )
+    {
+        for (Fault f : { Fault::sensor_open, Fault::sensor_short })
+            for (bool preheated : { false, true })
+                sweep(f, false, preheated, 250, 100, [f](const Scenario &s, const Outcome &o) {
+                    CHECK( o.error == (f == Fault::sensor_open ? Error::min : Error::max) );
+                    CHECK_FALSE( o.bed );
+                    CHECK( o.time - s.fault_time <= temp_mgr_intv / 1000.f );
+                });
+    }
+
+    SECTION( "bed heater failure while preheating" )
+    {
+        // 4 failed periods of 17 evaluations
+        sweep(Fault::heater_open, true, false, 200, 600, [](const Scenario &s, const Outcome &o) {
+            CHECK( o.error == Error::preheat );
+            CHECK( o.bed );
+            CHECK( o.time - s.fault_time < 4 * 17 * 2.3f + 40 );
+        });
+    }
+
+    SECTION( "bed thermistor open or shorted" )
+    {
+        for (Fault f : { Fault::sensor_open, Fault::sensor_short })
+            sweep(f, true, true, 250, 100, [f](const Scenario &s, const Outcome &o) {
+                CHECK( o.error == (f == Fault::sensor_open ? Error::min : Error::max) );
+                CHECK( o.bed );
+                CHECK( o.time - s.fault_time <= temp_mgr_intv / 1000.f );
+            });
+    }
+}
+
+TEST_CASE( "Temperature manager fault detection throughput", "[.][temp_mgr][bench]" )
+{
+    const unsigned scenarios = 1000;
+    const auto started = std::chrono::steady_clock::now();
+    sweep(Fault::sensor_open, false, true, scenarios, 100, [](const Scenario &, const Outcome &o) {
+        CHECK( o.error == Error::min );
+    });
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    INFO( scenarios << " scenarios in " << elapsed << "s" );
+    WARN( scenarios / elapsed << " scenarios/s" );
+}
+
+TEST_CASE( "Min temp check delay", "[temp_mgr]" )
+{
+    TempMinCheckGate gate;
+    CHECK_FALSE( gate.active(0, false, false, 15000) );
+    CHECK_FALSE( gate.active(1000, true, false, 15000) );
+    CHECK_FALSE( gate.active(14999, true, false, 15000) );
+    CHECK( gate.active(15000, true, false, 15000) );
+    CHECK( gate.active(15270, true, false, 15000) );
+
+    // the heater is turned off and on again, the delay restarts
+    CHECK_FALSE( gate.active(20000, false, false, 15000) );
+    CHECK_FALSE( gate.active(20270, true, false, 15000) );
+    // once above mintemp the check is immediately active
+    CHECK( gate.active(20540, true, true, 15000) );
+    CHECK( gate.active(20810, true, false, 15000) );
+
+    // 16-bit time wrap around
+    CHECK_FALSE( gate.active(60000, false, false, 15000) );
+    CHECK_FALSE( gate.active(65000, true, false, 15000) );
+    CHECK_FALSE( gate.active(2000, true, false, 15000) );
+    CHECK( gate.active(9464, true, false, 15000) );
+}
@@ -0,0 +1,470 @@
+/**
+ * @file
+ * @brief XYZ calibration of a simulated PINDA over a parametric bed
+ *
+ * The scan and the image processing of xyzcal run against a model of the sensor, so that the speed and
+ * the accuracy of the calibration are measured on the host.
+ */
+
+#include "catch.hpp"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "../Firmware/xyzcal_image.h"
+#include "../Firmware/least_squares.h"
+
+namespace {
+
+uint16_t pattern_10[12] = {0x000, 0x0f0, 0x1f8, 0x3fc, 0x7fe, 0x7fe, 0x7fe, 0x7fe, 0x3fc, 0x1f8, 0x0f0, 0x000};
+uint16_t pattern_08[12] = {0x000, 0x000, 0x0f0, 0x1f8, 0x3fc, 0x3fc, 0x3fc, 0x3fc, 0x1f8, 0x0f0, 0x000, 0x000};
+
+//! @brief PINDA above the calibration point
+//!
+//! The trigger height rises smoothly over the circle of the point, the hysteresis shifts the image in
+//! the direction of the move. The noise depends on the pixel and the direction only, so that two scans
+//! measure the same pixel equally. The motion is counted in steps of the head.
+struct Pinda
+{
+    Pinda(float cx, float cy, float height = 64) : cx(cx), cy(cy), height(height) {}
+
+    uint16_t measure(uint8_t c, uint8_t r, bool back)
+    {
+        float dx = c - cx + (back ? -hysteresis : hysteresis);
+        float dy = r - cy;
+        float z = 4 + height / (1 + expf((sqrtf(dx * dx + dy * dy) - radius) / 0.6f));
+        z += (int(((c * 31 + r) * 17 + back) * 2654435761u >> 24) % 7) - 3;
+        uint16_t v = (z > 0) ? uint16_t(z) : 0;
+
+        ++probes;
+        if (r != row)
+            motion += labs(long(r) - row) * 64 + labs(long(c) - col) * 64;
+        else
+            motion += labs(long(c) - col) * 64;
+        motion += 2 * (v + 20); // up to un-trigger and down to trigger
+        row = r;
+        col = c;
+        trace.push_back({ c, r, back });
+        return v;
+    }
+
+    float cx, cy, height;
+    float radius = 4.5f;
+    float hysteresis = 0.3f;
+    unsigned probes = 0;
+    long motion = 0;
+    uint8_t row = 0, col = 0;
+    struct Probe { uint8_t c, r; bool back; };
+    std::vector<Probe> trace;
+};
+
+Pinda *pinda;
+
+uint16_t probe(uint8_t c, uint8_t r, bool back)
+{
+    return pinda->measure(c, r, back);
+}
+
+//! centroid of the pixels above the threshold of the pattern in the 12x12 area at @p c, @p r
+void centroid(const uint8_t *pixels, uint8_t c, uint8_t r, float &x, float &y)
+{
+    float sum = 0, sx = 0, sy = 0;
+    for (uint8_t i = r; i < r + 12; ++i)
+        for (uint8_t j = c; j < c + 12; ++j)
+        {
+            float w = pixels[i * 32 + j] > 16 ? pixels[i * 32 + j] - 16 : 0;
+            sum += w;
+            sx += w * j;
+            sy += w * i;
+        }
+    x = sx / sum;
+    y = sy / sum;
+}
+
+float position()
+{
+    return 8 + (rand() % 1601) / 100.f;
+}
+
+//! the previous matcher, comparing the pattern with the image pixel by pixel
+uint8_t reference_match(const uint16_t *pattern, const uint8_t *pixels, uint8_t c, uint8_t r)
+{
+    uint8_t thr = 16;
+    uint8_t match = 0;
+    for (uint8_t i = 0; i < 12; ++i)
+        for (uint8_t j = 0; j < 12; ++j)
+        {
+            if (((i == 0) || (i == 11)) && ((j < 2) || (j >= 10))) continue;
+            if (((j == 0) || (j == 11)) && ((i < 2) || (i >= 10))) continue;
+            const uint16_t idx = (c + j) + 32 * ((uint16_t)r + i);
+            const bool high_pix = pixels[idx] > thr;
+            const bool high_pat = pattern[i] & (1 << j);
+            if (high_pix == high_pat)
+                match++;
+        }
+    return match;
+}
+
+uint8_t reference_find(const uint8_t *pixels, const uint16_t *pattern, uint8_t &pc, uint8_t &pr)
+{
+    uint8_t max_match = 0;
+    pc = pr = 0;
+    for (uint8_t r = 0; r < (32 - 12); ++r)
+        for (uint8_t c = 0; c < (32 - 12); ++c)
+        {
+            const uint8_t match = reference_match(pattern, pixels, c, r);
+            if (max_match < match)
+            {
+                pc = c;
+                pr = r;
+                max_match = match;
+            }
+        }
+    return max_match;
+}
+
+uint8_t reference_find_patterns(const uint8_t *pixels, uint8_t &col, uint8_t &row)
+{
+    uint8_t c08, r08, c10, r10;
+    uint8_t match08 = reference_find(pixels, pattern_08, c08, r08);
+    uint8_t match10 = reference_find(pixels, pattern_10, c10, r10);
+    col = (match08 > match10) ? c08 : c10;
+    row = (match08 > match10) ? r08 : r10;
+    return (match08 > match10) ? match08 : match10;
+}
+
+//! scan of a random point, or noise around the threshold
+void random_image(uint8_t *pixels)
+{
+    if (rand() % 4)
+    {
+        Pinda sensor(position(), position(), 20 + rand() % 200);
+        sensor.radius = 3 + (rand() % 400) / 100.f;
+        pinda = &sensor;
+        xyzcal_scan_32x32(probe, pixels);
+    }
+    else
+        for (uint16_t i = 0; i < 32 * 32; ++i)
+            pixels[i] = 8 + rand() % 17;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Xyzcal pattern matcher", "[xyzcal]" )
+{
+    srand(3);
+    uint8_t pixels[32 * 32];
+    uint32_t rows[32];
+
+    SECTION( "same rate of match at each position" )
+    {
+        for (unsigned n = 0; n < 50; ++n)
+        {
+            random_image(pixels);
+            xyzcal_pack_32x32(pixels, rows);
+            for (uint8_t r = 0; r < 32 - 12; ++r)
+                for (uint8_t c = 0; c < 32 - 12; ++c)
+                {
+                    REQUIRE( xyzcal_match_pattern_12x12_in_32x32(pattern_08, rows, c, r) == reference_match(pattern_08, pixels, c, r) );
+                    REQUIRE( xyzcal_match_pattern_12x12_in_32x32(pattern_10, rows, c, r) == reference_match(pattern_10, pixels, c, r) );
+                }
+        }
+    }
+
+    SECTION( "same best match" )
+    {
+        for (unsigned n = 0; n < 1000; ++n)
+        {
+            random_image(pixels);
+            uint8_t uc, ur, ref_c, ref_r;
+            uint8_t match = find_patterns(pixels, pattern_08, pattern_10, uc, ur);
+            REQUIRE( match == reference_find_patterns(pixels, ref_c, ref_r) );
+            REQUIRE( uc == ref_c );
+            REQUIRE( ur == ref_r );
+        }
+    }
+}
+
+TEST_CASE( "Xyzcal pattern matcher benchmark", "[.][xyzcal]" )
+{
+    srand(4);
+    uint8_t pixels[32 * 32];
+    random_image(pixels);
+    unsigned sum = 0;
+    uint8_t uc, ur;
+    BENCHMARK( "pixel by pixel" )
+    {
+        for (unsigned i = 0; i < 100; ++i)
+            sum += reference_find_patterns(pixels, uc, ur);
+    }
+    BENCHMARK( "packed rows" )
+    {
+        for (unsigned i = 0; i < 100; ++i)
+            sum += find_patterns(pixels, pattern_08, pattern_10, uc, ur);
+    }
+    CHECK( sum > 0 );
+}
+
+TEST_CASE( "Xyzcal full scan", "[xyzcal]" )
+{
+    Pinda sensor(15.5f, 15.5f);
+    pinda = &sensor;
+    uint8_t pixels[32 * 32];
+    xyzcal_scan_32x32(probe, pixels);
+
+    REQUIRE( sensor.probes == 2048 );
+    // each row forth, then back
+    for (uint16_t i = 0; i < 2048; ++i)
+    {
+        uint8_t r = i / 64, k = i % 64;
+        bool back = k >= 32;
+        REQUIRE( sensor.trace[i].r == r );
+        REQUIRE( sensor.trace[i].back == back );
+        REQUIRE( sensor.trace[i].c == (back ? 63 - k : k) );
+    }
+    // average of both directions
+    Pinda again(15.5f, 15.5f);
+    for (uint8_t r = 0; r < 32; ++r)
+        for (uint8_t c = 0; c < 32; ++c)
+            REQUIRE( pixels[r * 32 + c] == (again.measure(c, r, false) + again.measure(c, r, true)) / 2 );
+
+    uint8_t uc, ur;
+    CHECK( find_patterns(pixels, pattern_08, pattern_10, uc, ur) >= 120 );
+    CHECK( uc == 10 );
+    CHECK( ur == 10 );
+}
+
+TEST_CASE( "Xyzcal coarse to fine scan", "[xyzcal]" )
+{
+    srand(1);
+
+    SECTION( "same point as the full scan" )
+    {
+        for (unsigned n = 0; n < 200; ++n)
+        {
+            float cx = position(), cy = position();
+            INFO( "point " << cx << " " << cy );
+            uint8_t full[32 * 32], fast[32 * 32];
+            Pinda sensor_full(cx, cy), sensor_fast(cx, cy);
+            pinda = &sensor_full;
+            xyzcal_scan_32x32(probe, full);
+            pinda = &sensor_fast;
+            xyzcal_scan_coarse_to_fine(probe, fast, pattern_08, pattern_10);
+            REQUIRE( sensor_fast.probes == 768 );
+
+            uint8_t uc_full, ur_full, uc_fast, ur_fast;
+            uint8_t match_full = find_patterns(full, pattern_08, pattern_10, uc_full, ur_full);
+            uint8_t match_fast = find_patterns(fast, pattern_08, pattern_10, uc_fast, ur_fast);
+            INFO( "full " << int(uc_full) << " " << int(ur_full) << " fast " << int(uc_fast) << " " << int(ur_fast) );
+            REQUIRE( match_full >= 88 );
+            REQUIRE( match_fast == match_full );
+            REQUIRE( uc_fast == uc_full );
+            REQUIRE( ur_fast == ur_full );
+
+            // the pixels of the pattern are scanned at the full resolution
+            for (uint8_t r = ur_full; r < ur_full + 12; ++r)
+                for (uint8_t c = uc_full; c < uc_full + 12; ++c)
+                    REQUIRE( fast[r * 32 + c] == full[r * 32 + c] );
+        }
+    }
+
+    SECTION( "no point falls back to the full scan" )
+    {
+        Pinda sensor(15.5f, 15.5f, 0);
+        pinda = &sensor;
+        uint8_t pixels[32 * 32];
+        xyzcal_scan_coarse_to_fine(probe, pixels, pattern_08, pattern_10);
+        CHECK( sensor.probes == 256 + 2048 );
+        for (uint16_t i = 0; i < 32 * 32; ++i)
+            REQUIRE( pixels[i] <= 16 );
+    }
+}
+
+TEST_CASE( "Xyzcal scan benchmark", "[.][xyzcal]" )
+{
+    srand(2);
+    const unsigned points = 1000;
+    double error_full = 0, error_fast = 0;
+    long motion_full = 0, motion_fast = 0;
+    unsigned probes_full = 0, probes_fast = 0;
+    for (unsigned n = 0; n < points; ++n)
+    {
+        float cx = position(), cy = position();
+        uint8_t pixels[32 * 32];
+        uint8_t uc, ur;
+        float x, y;
+
+        Pinda sensor_full(cx, cy);
+        pinda = &sensor_full;
+        xyzcal_scan_32x32(probe, pixels);
+        find_patterns(pixels, pattern_08, pattern_10, uc, ur);
+        centroid(pixels, uc, ur, x, y);
+        error_full += hypotf(x - cx, y - cy);
+        motion_full += sensor_full.motion;
+        probes_full += sensor_full.probes;
+
+        Pinda sensor_fast(cx, cy);
+        pinda = &sensor_fast;
+        xyzcal_scan_coarse_to_fine(probe, pixels, pattern_08, pattern_10);
+        find_patterns(pixels, pattern_08, pattern_10, uc, ur);
+        centroid(pixels, uc, ur, x, y);
+        error_fast += hypotf(x - cx, y - cy);
+        motion_fast += sensor_fast.motion;
+        probes_fast += sensor_fast.probes;
+    }
+    WARN( "full scan: " << probes_full / points << " probes, " << motion_full / points
+        << " steps of motion, center error " << error_full / points << " px" );
+    WARN( "coarse to fine: " << probes_fast / points << " probes, " << motion_fast / points
+        << " steps of motion, center error " << error_fast / points << " px" );
+    CHECK( motion_fast < motion_full * 6 / 10 );
+}
+
+namespace {
+
+//! size of a pixel of the scan [mm]
+const float pixel = 0.64f;
+
+//! @brief Skewed bed with the 4 calibration points of the MK3
+//!
+//! The machine axes are rotated by a1 and a2 and shifted by cntr from the bed, like in
+//! calculate_machine_skew_and_offset_LS(). Each point is scanned around its nominal position.
+struct Bed
+{
+    Bed(float cx, float cy, float a1, float a2) : a1(a1), a2(a2)
+    {
+        cntr[0] = cx;
+        cntr[1] = cy;
+        static const float points[] = { 37.f, 18.4f, 245.f, 18.4f, 245.f, 210.4f, 37.f, 210.4f };
+        float c1 = cosf(a1), s1 = sinf(a1), c2 = cosf(a2), s2 = sinf(a2);
+        float det = c1 * c2 + s1 * s2;
+        for (uint8_t i = 0; i < 8; i += 2)
+        {
+            target[i] = points[i];
+            target[i + 1] = points[i + 1];
+            // invert target = [c1 -s2; s1 c2] * machine + cntr
+            float x = target[i] - cntr[0], y = target[i + 1] - cntr[1];
+            machine[i] = (c2 * x + s2 * y) / det;
+            machine[i + 1] = (-s1 * x + c1 * y) / det;
+        }
+    }
+
+    //! @brief Find the points like xyzcal_scan_and_process()
+    //! @param found receives the machine positions of the points
+    //! @return false if a point isn't found
+    bool calibrate(bool coarse_to_fine, float *found)
+    {
+        for (uint8_t i = 0; i < 8; i += 2)
+        {
+            Pinda sensor(15.5f + (machine[i] - target[i]) / pixel, 15.5f + (machine[i + 1] - target[i + 1]) / pixel);
+            sensor.radius = radius;
+            sensor.hysteresis = hysteresis;
+            pinda = &sensor;
+            uint8_t pixels[32 * 32];
+            if (coarse_to_fine)
+                xyzcal_scan_coarse_to_fine(probe, pixels, pattern_08, pattern_10);
+            else
+                xyzcal_scan_32x32(probe, pixels);
+            probes += sensor.probes;
+            motion += sensor.motion;
+            if (!check_scan(pixels))
+                return false;
+            uint8_t uc, ur;
+            if (find_patterns(pixels, pattern_08, pattern_10, uc, ur) < 88)
+                return false;
+            float xf, yf, r;
+            xyzcal_point_center(pixels, uc, ur, xf, yf, r);
+            found[i] = target[i] + (xf - 15.5f) * pixel;
+            found[i + 1] = target[i + 1] + (yf - 15.5f) * pixel;
+        }
+        return true;
+    }
+
+    //! fit of the machine axes to the found points, like calculate_machine_skew_and_offset_LS()
+    void fit(const float *found, float *fit_cntr, float &fit_a1, float &fit_a2) const
+    {
+        const float w[4] = { 1.f, 1.f, 1.f, 1.f };
+        fit_cntr[0] = fit_cntr[1] = fit_a1 = fit_a2 = 0;
+        for (uint8_t iter = 0; iter < 100; ++iter)
+        {
+            float h[4];
+            if (!ls_skew_offset_step(found, target, w, w, 4, 1.f, 1.f, fit_cntr, fit_a1, fit_a2, h))
+                return;
+            fit_cntr[0] += h[0];
+            fit_cntr[1] += h[1];
+            fit_a1 += h[2];
+            fit_a2 += h[3];
+            if (fabsf(h[0]) < 1e-4f && fabsf(h[1]) < 1e-4f && fabsf(h[2]) < 1e-6f && fabsf(h[3]) < 1e-6f)
+                return;
+        }
+    }
+
+    float cntr[2], a1, a2;
+    float radius = 4.5f;
+    float hysteresis = 0.3f;
+    float target[8];  //!< points on the bed [mm]
+    float machine[8]; //!< points in the machine coordinates [mm]
+    unsigned probes = 0;
+    long motion = 0;
+};
+
+Bed random_bed()
+{
+    Bed bed((rand() % 801 - 400) / 100.f, (rand() % 801 - 400) / 100.f, (rand() % 2001 - 1000) / 1e5f, (rand() % 2001 - 1000) / 1e5f);
+    bed.radius = 4.f + (rand() % 101) / 100.f;
+    return bed;
+}
+
+} // anonymous namespace
+
+TEST_CASE( "Xyzcal calibration of a skewed bed", "[xyzcal]" )
+{
+    srand(5);
+    for (unsigned n = 0; n < 50; ++n)
+    {
+        Bed bed = random_bed();
+        INFO( "bed " << bed.cntr[0] << " " << bed.cntr[1] << " " << bed.a1 << " " << bed.a2 << " radius " << bed.radius );
+        for (bool coarse_to_fine : {false, true})
+        {
+            float found[8];
+            REQUIRE( bed.calibrate(coarse_to_fine, found) );
+            for (uint8_t i = 0; i < 8; ++i)
+                REQUIRE( found[i] == Approx(bed.machine[i]).margin(0.05f) );
+            float cntr[2], a1, a2;
+            bed.fit(found, cntr, a1, a2);
+            CHECK( cntr[0] == Approx(bed.cntr[0]).margin(0.05f) );
+            CHECK( cntr[1] == Approx(bed.cntr[1]).margin(0.05f) );
+            CHECK( a1 == Approx(bed.a1).margin(3e-4f) );
+            CHECK( a2 == Approx(bed.a2).margin(3e-4f) );
+        }
+    }
+}
+
+TEST_CASE( "Xyzcal calibration benchmark", "[.][xyzcal]" )
+{
+    for (bool coarse_to_fine : {false, true})
+    {
+        srand(6);
+        const unsigned beds = 200;
+        double error_point = 0, error_cntr = 0, error_angle = 0;
+        unsigned probes = 0;
+        long motion = 0;
+        for (unsigned n = 0; n < beds; ++n)
+        {
+            Bed bed = random_bed();
+            float found[8];
+            REQUIRE( bed.calibrate(coarse_to_fine, found) );
+            for (uint8_t i = 0; i < 8; i += 2)
+                error_point += hypotf(found[i] - bed.machine[i], found[i + 1] - bed.machine[i + 1]) / 4;
+            float cntr[2], a1, a2;
+            bed.fit(found, cntr, a1, a2);
+            error_cntr += hypotf(cntr[0] - bed.cntr[0], cntr[1] - bed.cntr[1]);
+            error_angle += (fabsf(a1 - bed.a1) + fabsf(a2 - bed.a2)) / 2;
+            probes += bed.probes;
+            motion += bed.motion;
+        }
+        WARN( (coarse_to_fine ? "coarse to fine" : "full scan") << ": " << probes / beds << " probes, "
+            << motion / beds << " steps of motion per bed, point error " << error_point / beds << " mm, offset error "
+            << error_cntr / beds << " mm, skew error " << error_angle / beds << " rad" );
+    }
+}
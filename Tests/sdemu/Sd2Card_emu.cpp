@@ -0,0 +1,268 @@
+/**
+ * @file
+ * @brief Sd2Card backed by SdEmu::card
+ *
+ * Replaces Firmware/Sd2Card.cpp in the host build. The card always reports itself as SDHC, so
+ * the block numbers are passed through unchanged.
+ */
+
+#include "Sd2Card.h"
+#include "sdemu.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SdEmu SdEmu::card;
+
+SdEmu::SdEmu()
+    : command_latency(0), block_latency(0), real_time(false), stats(), stream_block(0),
+      streaming(false), stream_write(false), crc_error_countdown(0), m_fd(-1), m_read_only(false), m_blocks(0), m_now(0)
+{
+}
+
+//! @brief Insert a card
+//! @param image disk image, its size is rounded down to whole blocks
+//! @param read_only fail all the writes
+bool SdEmu::insert(const char *image, bool read_only)
+{
+    eject();
+    m_fd = open(image, read_only ? O_RDONLY : O_RDWR);
+    if (m_fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(m_fd, &st))
+    {
+        eject();
+        return false;
+    }
+    m_blocks = st.st_size / 512;
+    m_read_only = read_only;
+    streaming = false;
+    return true;
+}
+
+void SdEmu::eject()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+    m_fd = -1;
+    m_blocks = 0;
+}
+
+//! @brief Account for a command sent to the card
+void SdEmu::command()
+{
+    ++stats.commands;
+    advance(command_latency);
+    if (real_time && command_latency)
+        usleep(command_latency);
+}
+
+//! @brief Check that no multiple block transfer is open before a command
+//!
+//! The card would interpret the command as a part of the transfer, the emulation rejects it.
+bool SdEmu::idle()
+{
+    if (!streaming)
+        return true;
+    ++stats.rejected;
+    return false;
+}
+
+bool SdEmu::read(uint32_t block, uint8_t *dst)
+{
+    if (block >= m_blocks)
+        return false;
+    ++stats.blocks_read;
+    advance(block_latency);
+    if (real_time && block_latency)
+        usleep(block_latency);
+    return pread(m_fd, dst, 512, (off_t)block * 512) == 512;
+}
+
+bool SdEmu::write(uint32_t block, const uint8_t *src)
+{
+    if (block >= m_blocks || m_read_only)
+        return false;
+    ++stats.blocks_written;
+    advance(block_latency);
+    if (real_time && block_latency)
+        usleep(block_latency);
+    return pwrite(m_fd, src, 512, (off_t)block * 512) == 512;
+}
+
+uint32_t Sd2Card::cardSize()
+{
+    return SdEmu::card.blocks();
+}
+
+bool Sd2Card::erase(uint32_t firstBlock, uint32_t lastBlock)
+{
+    static const uint8_t zero[512] = {};
+    SdEmu::card.command();
+    if (!SdEmu::card.idle())
+    {
+        error(SD_CARD_ERROR_ERASE);
+        return false;
+    }
+    for (uint32_t b = firstBlock; b <= lastBlock; ++b)
+    {
+        if (!SdEmu::card.write(b, zero))
+        {
+            error(SD_CARD_ERROR_ERASE);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Sd2Card::eraseSingleBlockEnable()
+{
+    return true;
+}
+
+bool Sd2Card::init(uint8_t sckRateID)
+{
+    errorCode_ = type_ = 0;
+    SdEmu::card.streaming = false;
+    if (!SdEmu::card.inserted())
+    {
+        error(SD_CARD_ERROR_CMD0);
+        return false;
+    }
+    type(SD_CARD_TYPE_SDHC);
+    return setSckRate(sckRateID);
+}
+
+bool Sd2Card::readBlock(uint32_t blockNumber, uint8_t *dst)
+{
+    SdEmu::card.command();
+    if (!SdEmu::card.idle())
+    {
+        error(SD_CARD_ERROR_CMD17);
+        return false;
+    }
+    if (!SdEmu::card.read(blockNumber, dst))
+    {
+        error(SD_CARD_ERROR_CMD17);
+        return false;
+    }
+    return true;
+}
+
+bool Sd2Card::readData(uint8_t *dst)
+{
+    if (SdEmu::card.streaming && !SdEmu::card.stream_write && SdEmu::card.crc_error_countdown
+        && --SdEmu::card.crc_error_countdown == 0)
+    {
+        // the card sends the block anyway and continues with the next one
+        ++SdEmu::card.stats.crc_errors;
+        ++SdEmu::card.stream_block;
+        error(SD_CARD_ERROR_CRC);
+        return false;
+    }
+    if (!SdEmu::card.streaming || SdEmu::card.stream_write || !SdEmu::card.read(SdEmu::card.stream_block++, dst))
+    {
+        error(SD_CARD_ERROR_READ);
+        return false;
+    }
+    return true;
+}
+
+bool Sd2Card::readStart(uint32_t blockNumber)
+{
+    SdEmu::card.command();
+    if (!SdEmu::card.idle())
+    {
+        error(SD_CARD_ERROR_CMD18);
+        return false;
+    }
+    if (blockNumber >= SdEmu::card.blocks())
+    {
+        error(SD_CARD_ERROR_CMD18);
+        return false;
+    }
+    SdEmu::card.stream_block = blockNumber;
+    SdEmu::card.streaming = true;
+    SdEmu::card.stream_write = false;
+    return true;
+}
+
+bool Sd2Card::readStop()
+{
+    SdEmu::card.command();
+    SdEmu::card.streaming = false;
+    return true;
+}
+
+bool Sd2Card::setSckRate(uint8_t sckRateID)
+{
+    if (sckRateID > 6)
+    {
+        error(SD_CARD_ERROR_SCK_RATE);
+        return false;
+    }
+    spiRate_ = sckRateID;
+    return true;
+}
+
+bool Sd2Card::writeBlock(uint32_t blockNumber, const uint8_t *src)
+{
+    SdEmu::card.command();
+    if (!SdEmu::card.idle())
+    {
+        error(SD_CARD_ERROR_CMD24);
+        return false;
+    }
+    if (!SdEmu::card.write(blockNumber, src))
+    {
+        error(SD_CARD_ERROR_CMD24);
+        return false;
+    }
+    return true;
+}
+
+bool Sd2Card::writeData(const uint8_t *src)
+{
+    if (!SdEmu::card.streaming || !SdEmu::card.stream_write || !SdEmu::card.write(SdEmu::card.stream_block++, src))
+    {
+        error(SD_CARD_ERROR_WRITE_MULTIPLE);
+        return false;
+    }
+    return true;
+}
+
+bool Sd2Card::writeStart(uint32_t blockNumber, uint32_t eraseCount)
+{
+    (void)eraseCount;
+    SdEmu::card.command(); // ACMD23
+    SdEmu::card.command(); // CMD25
+    if (!SdEmu::card.idle())
+    {
+        error(SD_CARD_ERROR_CMD25);
+        return false;
+    }
+    if (blockNumber >= SdEmu::card.blocks())
+    {
+        error(SD_CARD_ERROR_CMD25);
+        return false;
+    }
+    SdEmu::card.stream_block = blockNumber;
+    SdEmu::card.streaming = true;
+    SdEmu::card.stream_write = true;
+    return true;
+}
+
+bool Sd2Card::writeStop()
+{
+    SdEmu::card.streaming = false;
+    return true;
+}
+
+uint8_t Sd2Card::readExtMemory(uint8_t mio, uint8_t func, uint32_t addr, uint16_t count, uint8_t *dst)
+{
+    (void)mio; (void)func; (void)addr; (void)count; (void)dst;
+    // not a FlashAir card
+    return false;
+}
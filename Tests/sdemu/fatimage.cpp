@@ -0,0 +1,396 @@
+/**
+ * @file
+ * @brief FAT16/FAT32 disk image generator
+ */
+
+#include "fatimage.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <unistd.h>
+
+namespace {
+
+const uint32_t partition_start = 2048;
+
+//! store UCS-2 characters of a long name, zero terminated and padded with 0xffff
+void put_name_chars(uint8_t *dst, uint8_t n, const char *name, uint8_t &i, uint8_t len)
+{
+    for (uint8_t k = 0; k < n; ++k, ++i)
+    {
+        uint16_t c = (i < len) ? (uint8_t)name[i] : (i == len ? 0 : 0xffff);
+        memcpy(dst + 2 * k, &c, 2);
+    }
+}
+
+bool valid_short_char(char c)
+{
+    return isupper(c) || isdigit(c) || (c && strchr("$%'-_@~`!(){}^#&", c));
+}
+
+} // anonymous namespace
+
+FatImage::FatImage()
+    : fragment(0), fragment_run(1), root_entries(512), partitioned(true), m_fd(-1), m_fat_type(0),
+      m_cluster_blocks(0), m_blocks(0), m_volume_start(0), m_reserved(0), m_fat_blocks(0),
+      m_root_start(0), m_data_start(0), m_clusters(0), m_free_hint(2)
+{
+}
+
+FatImage::~FatImage()
+{
+    if (m_fd >= 0)
+        ::close(m_fd);
+}
+
+//! @brief Create an empty volume
+//! @param path image file, created sparse
+//! @param blocks size of the image in 512 B blocks
+//! @param fat_type 16 or 32
+//! @param cluster_blocks cluster size in blocks, 0 picks the smallest valid one for FAT16
+//!  and 4 KiB clusters for FAT32
+//! @return false if the cluster count doesn't fit the FAT type
+bool FatImage::create(const char *path, uint32_t blocks, uint8_t fat_type, uint8_t cluster_blocks)
+{
+    if (fat_type != 16 && fat_type != 32)
+        return false;
+    m_fat_type = fat_type;
+    m_blocks = blocks;
+    m_volume_start = partitioned ? partition_start : 0;
+    m_reserved = (fat_type == 32) ? 32 : 4;
+    uint32_t root_blocks = (fat_type == 32) ? 0 : (root_entries * 32 + 511) / 512;
+    if (blocks < m_volume_start + m_reserved + root_blocks + 100)
+        return false;
+
+    uint8_t spc = cluster_blocks ? cluster_blocks : (fat_type == 32 ? 8 : 1);
+    for (;;)
+    {
+        // the FAT size depends on the cluster count and vice versa
+        uint32_t fat_blocks = 1, clusters;
+        for (;;)
+        {
+            uint32_t meta = m_reserved + 2 * fat_blocks + root_blocks;
+            clusters = (blocks - m_volume_start - meta) / spc;
+            uint32_t needed = ((clusters + 2) * (fat_type / 8) + 511) / 512;
+            if (needed <= fat_blocks)
+                break;
+            fat_blocks = needed;
+        }
+        if (fat_type == 16 ? (clusters >= 4085 && clusters < 65525) : (clusters >= 65525))
+        {
+            m_cluster_blocks = spc;
+            m_fat_blocks = fat_blocks;
+            m_clusters = clusters;
+            break;
+        }
+        // FAT16 needs larger clusters, FAT32 smaller ones
+        if (cluster_blocks || spc == (fat_type == 16 ? 128 : 1))
+            return false;
+        spc = (fat_type == 16) ? spc << 1 : spc >> 1;
+    }
+
+    m_root_start = m_volume_start + m_reserved + 2 * m_fat_blocks;
+    m_data_start = m_root_start + root_blocks;
+    m_fat.assign(m_clusters + 2, 0);
+    m_fat[0] = (fat_type == 32) ? 0x0ffffff8 : 0xfff8;
+    m_fat[1] = (fat_type == 32) ? FAT32EOC : FAT16EOC;
+    m_free_hint = 2;
+
+    m_fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (m_fd < 0 || ftruncate(m_fd, (off_t)blocks * 512))
+        return false;
+
+    m_dirs.assign(1, Dir());
+    if (fat_type == 32)
+        m_dirs[root].chain.push_back(alloc(0));
+    return true;
+}
+
+//! @return handle of the new directory or -1
+int FatImage::mkdir(int dir, const char *name, uint16_t date, uint16_t time)
+{
+    uint32_t cluster = alloc(0);
+    if (!cluster || !add_entry(dir, name, DIR_ATT_DIRECTORY, cluster, 0, date, time))
+        return -1;
+    Dir sub;
+    sub.chain.push_back(cluster);
+    // the parent of a first level directory is 0 even on FAT32
+    uint32_t parent = (dir == root) ? 0 : m_dirs[dir].chain[0];
+    dir_t dot = {};
+    memset(dot.name, ' ', sizeof(dot.name));
+    dot.name[0] = '.';
+    dot.attributes = DIR_ATT_DIRECTORY;
+    dot.creationDate = dot.lastWriteDate = dot.lastAccessDate = date;
+    dot.creationTime = dot.lastWriteTime = time;
+    dot.firstClusterLow = cluster & 0xffff;
+    dot.firstClusterHigh = cluster >> 16;
+    sub.entries.insert(sub.entries.end(), (uint8_t *)&dot, (uint8_t *)(&dot + 1));
+    dot.name[1] = '.';
+    dot.firstClusterLow = parent & 0xffff;
+    dot.firstClusterHigh = parent >> 16;
+    sub.entries.insert(sub.entries.end(), (uint8_t *)&dot, (uint8_t *)(&dot + 1));
+    m_dirs.push_back(sub);
+    return m_dirs.size() - 1;
+}
+
+bool FatImage::add_file(int dir, const char *name, const void *data, uint32_t size, uint16_t date, uint16_t time)
+{
+    std::vector<uint32_t> chain;
+    const uint8_t *src = (const uint8_t *)data;
+    if (fragment)
+        m_free_hint = 2; // interleave with the previous files
+    for (uint32_t pos = 0; pos < size; pos += cluster_bytes())
+    {
+        uint32_t cluster = alloc((chain.size() + 1) % fragment_run ? 0 : fragment);
+        if (!cluster || !write_blocks(cluster_block(cluster), src + pos, std::min(size - pos, cluster_bytes())))
+            return false;
+        chain.push_back(cluster);
+    }
+    link(chain);
+    return add_entry(dir, name, DIR_ATT_ARCHIVE, chain.empty() ? 0 : chain[0], size, date, time);
+}
+
+//! @brief Write the directories, the FATs and the boot records
+bool FatImage::close()
+{
+    if (m_fd < 0)
+        return false;
+    bool ok = true;
+    for (size_t d = 0; d < m_dirs.size(); ++d)
+    {
+        std::vector<uint8_t> &entries = m_dirs[d].entries;
+        if (m_fat_type == 16 && d == root)
+        {
+            ok &= write_blocks(m_root_start, entries.data(), entries.size());
+            continue;
+        }
+        std::vector<uint32_t> &chain = m_dirs[d].chain;
+        while (chain.size() * cluster_bytes() < entries.size())
+        {
+            uint32_t cluster = alloc(0);
+            if (!cluster)
+                return false;
+            chain.push_back(cluster);
+        }
+        link(chain);
+        entries.resize(chain.size() * cluster_bytes());
+        for (size_t i = 0; i < chain.size(); ++i)
+            ok &= write_blocks(cluster_block(chain[i]), &entries[i * cluster_bytes()], cluster_bytes());
+    }
+
+    std::vector<uint8_t> fat(m_fat_blocks * 512);
+    for (size_t i = 0; i < m_fat.size(); ++i)
+    {
+        if (m_fat_type == 32)
+            memcpy(&fat[i * 4], &m_fat[i], 4);
+        else
+            memcpy(&fat[i * 2], &m_fat[i], 2);
+    }
+    for (uint8_t f = 0; f < 2; ++f)
+        ok &= write_blocks(m_volume_start + m_reserved + f * m_fat_blocks, fat.data(), fat.size());
+
+    fat32_boot_t fbs = {};
+    fbs.jump[0] = 0xeb;
+    fbs.jump[1] = 0x58;
+    fbs.jump[2] = 0x90;
+    memcpy(fbs.oemId, "SDEMU   ", 8);
+    fbs.bytesPerSector = 512;
+    fbs.sectorsPerCluster = m_cluster_blocks;
+    fbs.reservedSectorCount = m_reserved;
+    fbs.fatCount = 2;
+    fbs.mediaType = 0xf8;
+    fbs.sectorsPerTrack = 63;
+    fbs.headCount = 255;
+    fbs.hidddenSectors = m_volume_start;
+    uint32_t total = m_blocks - m_volume_start;
+    if (total < 0x10000 && m_fat_type == 16)
+        fbs.totalSectors16 = total;
+    else
+        fbs.totalSectors32 = total;
+    fbs.bootSectorSig0 = BOOTSIG0;
+    fbs.bootSectorSig1 = BOOTSIG1;
+    if (m_fat_type == 32)
+    {
+        fbs.sectorsPerFat32 = m_fat_blocks;
+        fbs.fat32RootCluster = m_dirs[root].chain[0];
+        fbs.fat32FSInfo = 1;
+        fbs.fat32BackBootBlock = 6;
+        fbs.driveNumber = 0x80;
+        fbs.bootSignature = EXTENDED_BOOT_SIG;
+        memcpy(fbs.volumeLabel, "NO NAME    ", 11);
+        memcpy(fbs.fileSystemType, "FAT32   ", 8);
+
+        fat32_fsinfo_t fsinfo = {};
+        fsinfo.leadSignature = FSINFO_LEAD_SIG;
+        fsinfo.structSignature = FSINFO_STRUCT_SIG;
+        fsinfo.freeCount = 0xffffffff;
+        fsinfo.nextFree = 0xffffffff;
+        fsinfo.tailSignature[2] = BOOTSIG0;
+        fsinfo.tailSignature[3] = BOOTSIG1;
+        ok &= write_blocks(m_volume_start + 1, &fsinfo, sizeof(fsinfo));
+        ok &= write_blocks(m_volume_start + 6, &fbs, sizeof(fbs));
+    }
+    else
+    {
+        // the FAT16 fields share the layout with the start of the FAT32 extension
+        fat_boot_t *fbs16 = (fat_boot_t *)&fbs;
+        fbs16->sectorsPerFat16 = m_fat_blocks;
+        fbs16->rootDirEntryCount = root_entries;
+        fbs16->driveNumber = 0x80;
+        fbs16->bootSignature = EXTENDED_BOOT_SIG;
+        memcpy(fbs16->volumeLabel, "NO NAME    ", 11);
+        memcpy(fbs16->fileSystemType, "FAT16   ", 8);
+    }
+    ok &= write_blocks(m_volume_start, &fbs, sizeof(fbs));
+
+    if (partitioned)
+    {
+        mbr_t mbr = {};
+        mbr.part[0].type = (m_fat_type == 32) ? 0x0c : 0x06;
+        mbr.part[0].firstSector = m_volume_start;
+        mbr.part[0].totalSectors = total;
+        mbr.mbrSig0 = BOOTSIG0;
+        mbr.mbrSig1 = BOOTSIG1;
+        ok &= write_blocks(0, &mbr, sizeof(mbr));
+    }
+
+    ::close(m_fd);
+    m_fd = -1;
+    return ok;
+}
+
+bool FatImage::add_entry(int dir, const char *name, uint8_t attributes, uint32_t cluster, uint32_t size,
+    uint16_t date, uint16_t time)
+{
+    if (dir < 0 || (size_t)dir >= m_dirs.size())
+        return false;
+    Dir &d = m_dirs[dir];
+    dir_t entry = {};
+    bool lfn;
+    short_name(d, name, entry.name, lfn);
+    uint8_t len = strlen(name);
+    uint8_t lfn_entries = lfn ? (len + 12) / 13 : 0;
+    if (m_fat_type == 16 && dir == root && d.entries.size() / 32 + lfn_entries + 1 > root_entries)
+        return false;
+
+    uint8_t checksum = 0;
+    for (uint8_t i = 0; i < 11; ++i)
+        checksum = ((checksum & 1) << 7) + (checksum >> 1) + entry.name[i];
+    for (uint8_t n = lfn_entries; n; --n)
+    {
+        vfat_t vfat = {};
+        vfat.sequenceNumber = n | (n == lfn_entries ? 0x40 : 0);
+        vfat.attributes = DIR_ATT_LONG_NAME;
+        vfat.checksum = checksum;
+        uint8_t i = (n - 1) * 13;
+        uint8_t *raw = (uint8_t *)&vfat;
+        put_name_chars(raw + offsetof(vfat_t, name1), 5, name, i, len);
+        put_name_chars(raw + offsetof(vfat_t, name2), 6, name, i, len);
+        put_name_chars(raw + offsetof(vfat_t, name3), 2, name, i, len);
+        d.entries.insert(d.entries.end(), (uint8_t *)&vfat, (uint8_t *)(&vfat + 1));
+    }
+
+    entry.attributes = attributes;
+    entry.creationDate = entry.lastWriteDate = entry.lastAccessDate = date;
+    entry.creationTime = entry.lastWriteTime = time;
+    entry.firstClusterLow = cluster & 0xffff;
+    entry.firstClusterHigh = cluster >> 16;
+    entry.fileSize = size;
+    d.entries.insert(d.entries.end(), (uint8_t *)&entry, (uint8_t *)(&entry + 1));
+    return true;
+}
+
+//! @brief Generate a unique short name
+//! @param sn 11 characters of the name and extension
+//! @param lfn set if the name needs a long name
+void FatImage::short_name(Dir &dir, const char *name, uint8_t *sn, bool &lfn)
+{
+    const char *dot = strrchr(name, '.');
+    if (dot == name)
+        dot = NULL;
+    size_t base_len = dot ? (size_t)(dot - name) : strlen(name);
+    size_t ext_len = dot ? strlen(dot + 1) : 0;
+
+    // a lossy conversion gets a numeric tail, a lower case one only the long name
+    bool lossy = (base_len == 0 || base_len > 8 || ext_len > 3);
+    lfn = false;
+    std::string base, ext;
+    for (size_t i = 0; i < base_len + (dot ? 1 + ext_len : 0); ++i)
+    {
+        char c = name[i];
+        std::string &part = (i < base_len) ? base : ext;
+        if (i == base_len)
+            continue; // the dot
+        if (c == ' ' || (c == '.' && i < base_len))
+        {
+            lossy = true;
+            continue;
+        }
+        char u = toupper(c);
+        if (!valid_short_char(u))
+        {
+            lossy = true;
+            u = '_';
+        }
+        else if (u != c)
+            lfn = true;
+        part += u;
+    }
+
+    std::string candidate = base.substr(0, 8) + "." + ext.substr(0, 3);
+    if (lossy || dir.names.count(candidate))
+    {
+        lfn = true;
+        ext = ext.substr(0, 3);
+        std::string prefix = base.substr(0, 6) + "." + ext;
+        uint32_t &n = dir.tails[prefix];
+        do
+        {
+            std::string tail = "~" + std::to_string(++n);
+            candidate = base.substr(0, 8 - tail.size()) + tail + "." + ext;
+        } while (dir.names.count(candidate));
+    }
+    dir.names.insert(candidate);
+
+    memset(sn, ' ', 11);
+    size_t split = candidate.find('.');
+    memcpy(sn, candidate.data(), split);
+    memcpy(sn + 8, candidate.data() + split + 1, candidate.size() - split - 1);
+    if (sn[0] == DIR_NAME_DELETED)
+        sn[0] = DIR_NAME_0XE5;
+}
+
+//! @brief Allocate a cluster
+//! @param skip number of free clusters to leave before the next allocation
+//! @return cluster number or 0 if the volume is full
+uint32_t FatImage::alloc(uint8_t skip)
+{
+    uint32_t c = m_free_hint;
+    while (c < m_fat.size() && m_fat[c])
+        ++c;
+    if (c >= m_fat.size())
+        return 0;
+    m_fat[c] = (m_fat_type == 32) ? FAT32EOC : FAT16EOC;
+    // the next allocation continues after the skipped clusters
+    uint32_t next = c + 1;
+    for (uint8_t s = 0; s < skip && next < m_fat.size(); ++next)
+        if (!m_fat[next])
+            ++s;
+    m_free_hint = skip ? next : c + 1;
+    if (m_free_hint >= m_fat.size())
+        m_free_hint = 2;
+    return c;
+}
+
+void FatImage::link(const std::vector<uint32_t> &chain)
+{
+    for (size_t i = 0; i + 1 < chain.size(); ++i)
+        m_fat[chain[i]] = chain[i + 1];
+    if (!chain.empty())
+        m_fat[chain.back()] = (m_fat_type == 32) ? FAT32EOC : FAT16EOC;
+}
+
+bool FatImage::write_blocks(uint32_t block, const void *data, uint32_t size)
+{
+    return pwrite(m_fd, data, size, (off_t)block * 512) == (ssize_t)size;
+}
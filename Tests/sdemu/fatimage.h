@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief FAT16/FAT32 disk image generator
+ *
+ * Builds the images for SdEmu without depending on mkfs and mtools. The file data is written as
+ * it is added, the directories and the FAT when the image is closed. Names which aren't valid
+ * upper case 8.3 names get a VFAT long name and a generated ~N short name.
+ */
+
+#ifndef TESTS_SDEMU_FATIMAGE_H_
+#define TESTS_SDEMU_FATIMAGE_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "SdBaseFile.h"
+
+class FatImage
+{
+public:
+    static const int root = 0;
+
+    FatImage();
+    ~FatImage();
+
+    bool create(const char *path, uint32_t blocks, uint8_t fat_type, uint8_t cluster_blocks = 0);
+    int mkdir(int dir, const char *name, uint16_t date = FAT_DEFAULT_DATE, uint16_t time = FAT_DEFAULT_TIME);
+    bool add_file(int dir, const char *name, const void *data, uint32_t size,
+        uint16_t date = FAT_DEFAULT_DATE, uint16_t time = FAT_DEFAULT_TIME);
+    bool close();
+
+    uint32_t cluster_bytes() const { return (uint32_t)m_cluster_blocks * 512; }
+    uint32_t cluster_count() const { return m_clusters; }
+    //! first block of a cluster relative to the start of the image
+    uint32_t cluster_block(uint32_t cluster) const { return m_data_start + (cluster - 2) * m_cluster_blocks; }
+
+    //! number of free clusters skipped after each run of fragment_run file clusters, the gaps
+    //! are filled by the following files
+    uint8_t fragment;
+    uint16_t fragment_run;
+    //! number of root directory entries of FAT16
+    uint16_t root_entries;
+    //! create a partition table, otherwise the volume starts at block 0
+    bool partitioned;
+
+private:
+    struct Dir
+    {
+        std::vector<uint8_t> entries;
+        std::vector<uint32_t> chain;
+        std::set<std::string> names;            //!< short names in use
+        std::map<std::string, uint32_t> tails;  //!< next ~N of a short name prefix
+    };
+
+    bool add_entry(int dir, const char *name, uint8_t attributes, uint32_t cluster, uint32_t size,
+        uint16_t date, uint16_t time);
+    void short_name(Dir &dir, const char *name, uint8_t *sn, bool &lfn);
+    uint32_t alloc(uint8_t skip);
+    void link(const std::vector<uint32_t> &chain);
+    bool write_blocks(uint32_t block, const void *data, uint32_t size);
+
+    int m_fd;
+    uint8_t m_fat_type;
+    uint8_t m_cluster_blocks;
+    uint32_t m_blocks;
+    uint32_t m_volume_start;
+    uint16_t m_reserved;
+    uint32_t m_fat_blocks;
+    uint32_t m_root_start;
+    uint32_t m_data_start;
+    uint32_t m_clusters;
+    uint32_t m_free_hint;
+    std::vector<uint32_t> m_fat;
+    std::vector<Dir> m_dirs;
+};
+
+#endif /* TESTS_SDEMU_FATIMAGE_H_ */
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief Host replacement of Marlin.h for planner.cpp in the SD card emulation build.
+ *
+ * Force-included (-include) into planner.cpp after sdemu_prelude.h. The planner is built with the
+ * configuration of the MK3S (Configuration_prusa.h of Tests/tempemu) and the stepper, the fans
+ * and the LCD stubbed out, so that the SD print can be followed into the planner queue for the
+ * power panic position. Everything with external linkage is defined in stubs.cpp.
+ */
+
+#ifndef TESTS_SDEMU_PLANNER_PRELUDE_H_
+#define TESTS_SDEMU_PLANNER_PRELUDE_H_
+
+#include "sdemu_prelude.h"
+#include <math.h>
+
+#ifdef __cplusplus
+
+// headers used by the planner, the SD code doesn't need them
+#undef stepper_h
+
+// the printer configuration, replacing the SD card setup of sdemu_prelude.h
+#undef SDCARDDETECT
+#undef SDPOWER
+#undef EEPROM_SD_SORT
+#pragma pack(push, 1)
+#include "Configuration.h"
+#pragma pack(pop)
+#include "pins.h"
+
+// registers
+extern uint8_t TIMSK1;
+enum { OCIE1A = 1 };
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_BLOCK(type) for (bool _done = false; !_done; _done = true)
+
+// temperatures and fans
+extern unsigned char fanSpeedSoftPwm;
+extern uint8_t fanSpeedBckp;
+float degHotend(uint8_t extruder);
+
+// Arduino macros
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define sq(x) ((x) * (x))
+inline double square(double x) { return x * x; }
+
+// steppers
+#define enable_x() do {} while (0)
+#define enable_y() do {} while (0)
+#define enable_z() do {} while (0)
+#define enable_e0() do {} while (0)
+#define enable_e1() do {} while (0)
+#define enable_e2() do {} while (0)
+#define disable_x() do {} while (0)
+#define disable_y() do {} while (0)
+#define disable_z() do {} while (0)
+#define disable_e0() do {} while (0)
+#define disable_e1() do {} while (0)
+#define disable_e2() do {} while (0)
+
+// printer state
+enum AxisEnum { X_AXIS = 0, Y_AXIS = 1, Z_AXIS = 2, E_AXIS = 3 };
+extern uint8_t active_extruder;
+extern int fanSpeed;
+extern float feedrate;
+void manage_inactivity(bool ignore_stepper_queue = false);
+inline void lcd_update(uint8_t) {}
+
+#endif //__cplusplus
+
+#endif /* TESTS_SDEMU_PLANNER_PRELUDE_H_ */
@@ -0,0 +1,69 @@
+/**
+ * @file
+ * @brief Firmware symbols used by the planner in the host build.
+ *
+ * The steppers never run, the test discards the planned blocks itself. The motion settings are
+ * the defaults of the printer configuration.
+ */
+
+#include "planner.h"
+#include "stepper.h"
+#include "ConfigurationStore.h"
+#include "mesh_bed_calibration.h"
+#include "fancheck.h"
+#include "tmc2130.h"
+
+uint8_t TIMSK1;
+M500_conf cs;
+uint8_t active_extruder;
+int fanSpeed;
+float feedrate;
+bool fan_measuring;
+unsigned char fanSpeedSoftPwm;
+uint8_t fanSpeedBckp;
+uint8_t tmc2130_mode;
+
+uint8_t world2machine_correction_mode;
+float world2machine_rotation_and_skew[2][2];
+float world2machine_rotation_and_skew_inv[2][2];
+float world2machine_shift[2];
+
+//! the extruder is hot, the planner doesn't drop the extrusion
+float degHotend(uint8_t) { return 215; }
+void manage_inactivity(bool) {}
+
+static long stepper_position[NUM_AXIS];
+void st_set_position(const long &x, const long &y, const long &z, const long &e)
+{
+    stepper_position[X_AXIS] = x;
+    stepper_position[Y_AXIS] = y;
+    stepper_position[Z_AXIS] = z;
+    stepper_position[E_AXIS] = e;
+}
+void st_set_e_position(const long &e) { stepper_position[E_AXIS] = e; }
+long st_get_position(uint8_t axis) { return stepper_position[axis]; }
+float st_get_position_mm(uint8_t axis) { return stepper_position[axis] / cs.axis_steps_per_unit[axis]; }
+void quickStop() {}
+
+//! the default motion settings, M502
+static struct MotionDefaults
+{
+    MotionDefaults()
+    {
+        const float steps[] = DEFAULT_AXIS_STEPS_PER_UNIT;
+        const float max_feedrate[] = DEFAULT_MAX_FEEDRATE;
+        const unsigned long max_acceleration[] = DEFAULT_MAX_ACCELERATION;
+        const float max_jerk[] = {DEFAULT_XJERK, DEFAULT_YJERK, DEFAULT_ZJERK, DEFAULT_EJERK};
+        memcpy(cs.axis_steps_per_unit, steps, sizeof(steps));
+        memcpy(cs.max_feedrate_normal, max_feedrate, sizeof(max_feedrate));
+        memcpy(cs.max_acceleration_units_per_sq_second_normal, max_acceleration, sizeof(max_acceleration));
+        memcpy(cs.max_jerk, max_jerk, sizeof(max_jerk));
+        cs.acceleration = DEFAULT_ACCELERATION;
+        cs.retract_acceleration = DEFAULT_RETRACT_ACCELERATION;
+        cs.travel_acceleration = DEFAULT_TRAVEL_ACCELERATION;
+        cs.minimumfeedrate = DEFAULT_MINIMUMFEEDRATE;
+        cs.mintravelfeedrate = DEFAULT_MINTRAVELFEEDRATE;
+        cs.minsegmenttime = DEFAULT_MINSEGMENTTIME;
+        reset_acceleration_rates();
+    }
+} motion_defaults;
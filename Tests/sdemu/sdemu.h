@@ -0,0 +1,70 @@
+/**
+ * @file
+ * @brief SD card emulated on top of a disk image file.
+ *
+ * Sd2Card of the host build forwards all the block transfers to SdEmu::card. The card keeps a
+ * simulated clock, which advances by the configured command and block latencies and drives
+ * _millis() of the host build, so the timing of the SD code can be measured without a card.
+ */
+
+#ifndef TESTS_SDEMU_SDEMU_H_
+#define TESTS_SDEMU_SDEMU_H_
+
+#include <stdint.h>
+
+class SdEmu
+{
+public:
+    struct Stats
+    {
+        uint32_t commands;       //!< commands (CMD12, CMD17, CMD18, CMD24, ACMD23, CMD25, CMD32)
+        uint32_t blocks_read;
+        uint32_t blocks_written;
+        uint32_t rejected;       //!< commands sent while a multiple block transfer was open
+        uint32_t crc_errors;     //!< blocks of a multiple block read failed by crc_error_countdown
+    };
+
+    //! the card accessed by Sd2Card
+    static SdEmu card;
+
+    SdEmu();
+    ~SdEmu() { eject(); }
+
+    bool insert(const char *image, bool read_only = false);
+    void eject();
+    bool inserted() const { return m_fd >= 0; }
+    uint32_t blocks() const { return m_blocks; }
+
+    bool read(uint32_t block, uint8_t *dst);
+    bool write(uint32_t block, const uint8_t *src);
+    void command();
+    bool idle();
+
+    //! simulated time [us]
+    uint64_t now() const { return m_now; }
+    void advance(uint32_t us) { m_now += us; }
+    void reset_stats() { stats = Stats(); }
+
+    uint32_t command_latency; //!< latency of a command [us]
+    uint32_t block_latency;   //!< transfer of a block [us]
+    bool real_time;           //!< also sleep for the simulated latencies
+    Stats stats;
+
+    //! @name multiple block transfer state
+    //! @{
+    uint32_t stream_block;
+    bool streaming;
+    bool stream_write;        //!< the transfer is a multiple block write
+    //! @}
+
+    //! the block of a multiple block read which counts this down to 0 fails its CRC, 0 for none
+    uint32_t crc_error_countdown;
+
+private:
+    int m_fd;
+    bool m_read_only;
+    uint32_t m_blocks;
+    uint64_t m_now;
+};
+
+#endif /* TESTS_SDEMU_SDEMU_H_ */
@@ -0,0 +1,180 @@
+/**
+ * @file
+ * @brief Benchmark of the SD card code on an emulated card
+ *
+ * Builds a card holding the requested number of G-code files (or uses an existing image) and
+ * measures the listing, the presort, opening a file, streaming it the way the print does and
+ * uploading a copy of it.
+ * The simulated time is derived from the per command and per block latencies of the card.
+ */
+
+#include <chrono>
+#include <string>
+#include <unistd.h>
+
+#include "sdemu_prelude.h"
+#include "cardreader.h"
+#include "fatimage.h"
+#include "sdemu.h"
+
+namespace {
+
+struct Measurement
+{
+    Measurement(const char *name) : m_name(name), m_start(std::chrono::steady_clock::now()),
+        m_sim_start(SdEmu::card.now())
+    {
+        SdEmu::card.reset_stats();
+    }
+    ~Measurement()
+    {
+        double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+        printf("%-10s %10.1f %10u %10u %10.1f\n", m_name, (SdEmu::card.now() - m_sim_start) / 1000.,
+            SdEmu::card.stats.commands, SdEmu::card.stats.blocks_read, wall);
+    }
+
+    const char *m_name;
+    std::chrono::steady_clock::time_point m_start;
+    uint64_t m_sim_start;
+};
+
+void usage()
+{
+    puts("usage: sdemu_bench [-n files] [-t 16|32] [-s size_kb] [-f fragment] [-F run] [-c command_us] "
+         "[-b block_us] [-o sort] [-d] [-r] [-v] [image]\n"
+         "  without -n an existing image is used, otherwise it is created\n"
+         "  -f, -F: leave fragment free clusters after each run of F clusters of a file\n"
+         "  -d: place the files in the GCODE directory, the FAT16 root holds 512 entries only\n"
+         "  -o: 0 time, 1 alpha, 2 none, -r: sleep for the simulated latencies, -v: echo the serial output");
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    unsigned files = 0, size_kb = 64;
+    uint8_t fat_type = 32, sort = SD_SORT_ALPHA;
+    bool subdir = false;
+    FatImage img;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:f:F:c:b:o:drvh")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n': files = atoi(optarg); break;
+        case 't': fat_type = atoi(optarg); break;
+        case 's': size_kb = atoi(optarg); break;
+        case 'f': img.fragment = atoi(optarg); break;
+        case 'F': img.fragment_run = atoi(optarg); break;
+        case 'c': SdEmu::card.command_latency = atoi(optarg); break;
+        case 'b': SdEmu::card.block_latency = atoi(optarg); break;
+        case 'o': sort = atoi(optarg); break;
+        case 'd': subdir = true; break;
+        case 'r': SdEmu::card.real_time = true; break;
+        case 'v': MYSERIAL.echo = true; break;
+        default: usage(); return 1;
+        }
+    }
+    const char *image = (optind < argc) ? argv[optind] : "sdemu_bench.img";
+
+    if (files)
+    {
+        // G-code of the requested size, with a comment block every few lines
+        std::string data;
+        for (unsigned line = 0; data.size() < size_kb * 1024; ++line)
+        {
+            if (line % 20 == 0)
+                data += ";LAYER_CHANGE\n;Z:" + std::to_string(line / 20) + "\n";
+            data += "G1 X" + std::to_string(line % 250) + ".123 Y" + std::to_string(line % 210) + ".456 E0.04321\n";
+        }
+        uint32_t blocks = (uint64_t)files * (size_kb + 4) * 2 + 128 * 2048;
+        blocks = std::max(blocks, fat_type == 32 ? 300u * 2048 : 64u * 2048);
+        if (!img.create(image, blocks, fat_type))
+        {
+            fprintf(stderr, "can't create FAT%d image of %u blocks\n", fat_type, blocks);
+            return 1;
+        }
+        int dir = subdir ? img.mkdir(FatImage::root, "GCODE") : FatImage::root;
+        for (unsigned i = 0; i < files; ++i)
+        {
+            std::string name = "Print " + std::to_string(i * 7919 % files) + " 0.15mm PETG.gcode";
+            if (!img.add_file(dir, name.c_str(), data.data(), data.size(), FAT_DEFAULT_DATE,
+                    FAT_TIME(i / 3600 % 24, i / 60 % 60, i % 60)))
+            {
+                fprintf(stderr, "can't add file %u\n", i);
+                return 1;
+            }
+        }
+        if (!img.close())
+            return 1;
+    }
+
+    if (!SdEmu::card.insert(image, !files))
+    {
+        fprintf(stderr, "can't open %s\n", image);
+        return 1;
+    }
+    eeprom_mem[EEPROM_SD_SORT] = sort;
+
+    printf("%-10s %10s %10s %10s %10s\n", "", "sim [ms]", "commands", "blocks", "wall [ms]");
+    {
+        Measurement m("mount");
+        card.initsd(false);
+    }
+    if (!card.cardOK || (subdir && !card.chdir("GCODE", false)))
+        return 1;
+    uint16_t count;
+    {
+        Measurement m("count");
+        count = card.getnrfilenames();
+    }
+    {
+        Measurement m("presort");
+        card.presort();
+#ifdef SDSORT_INDEX
+        while (card.presort_busy())
+            card.presort_step();
+    }
+    {
+        // the second visit of the directory uses the index
+        Measurement m("indexed");
+        card.presort();
+#endif //SDSORT_INDEX
+    }
+    {
+        Measurement m("listing");
+        for (uint16_t i = 0; i < count; ++i)
+            card.getfilename_sorted(i, sort);
+    }
+    if (!count)
+        return 0;
+    card.getfilename_sorted(count / 2, sort);
+    std::string name = card.filename;
+    {
+        Measurement m("open");
+        card.openFileReadFilteredGcode(name.c_str());
+    }
+    {
+        Measurement m("stream");
+        while (!card.eof() && card.getFilteredGcodeChar() >= 0)
+            ;
+    }
+    card.closefile();
+    {
+        // write a copy of the file the way the PRUSA M28 upload does
+        std::string data(card.getFileSize() / 64 * 64, 'G');
+        Measurement m("upload");
+        card.openFileWrite("UPLOAD.GCO");
+#ifdef SD_MULTIBLOCK_WRITE
+        card.reserveFileWrite(data.size());
+#endif //SD_MULTIBLOCK_WRITE
+        for (size_t pos = 0; pos < data.size(); pos += 64)
+            card.write_command_no_newline(&data[pos]);
+        card.closefile();
+    }
+#ifdef SD_FAT_CACHE
+    printf("FAT cache %u hits %u misses\n", card.fatCacheHits(), card.fatCacheMisses());
+#endif //SD_FAT_CACHE
+    printf("%u files, %s %u bytes\n", count, name.c_str(), card.getFileSize());
+    return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * @file
+ * @brief Host replacement of Marlin.h for the SD card emulation build.
+ *
+ * Force-included (-include) into the SdFat sources, cardreader.cpp and cmdqueue.cpp. The firmware
+ * headers which pull in the AVR environment are blocked by their include guards and the few
+ * symbols the SD code and the command queue use are provided here instead. Everything with
+ * external linkage is defined in stubs.cpp.
+ */
+
+#ifndef TESTS_SDEMU_PRELUDE_H_
+#define TESTS_SDEMU_PRELUDE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#ifdef __cplusplus
+
+// headers replaced by this file
+#define MARLIN_H
+#define ULTRALCD_H
+#define _CONV2STR_H
+#define _MENU_H
+#define stepper_h
+#define temperature_h
+#define LANGUAGE_H
+#define MarlinSerial_h
+
+#include "system_timer.h"
+#include "Timer.h"
+#include "Configuration_adv.h"
+
+#define SDSUPPORT
+#define SDCARDDETECT -1
+#define SDPOWER -1
+
+// program memory
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define strcpy_P strcpy
+#define strlen_P strlen
+#define strstr_P strstr
+#define sprintf_P sprintf
+#define printf_P MYSERIAL.printf
+#define puts_P(s) MYSERIAL.println(s)
+#define puts(s) MYSERIAL.println(s)
+
+// translations
+#define _I(s) (s)
+#define _i(s) (s)
+#define _T(s) (s)
+#define _N(s) (s)
+#define _n(s) (s)
+
+//! Serial port capturing the output into a buffer
+class HostSerial
+{
+public:
+    void write(uint8_t c);
+    void print(const char *str);
+    void print(char c) { write(c); }
+    void print(unsigned char v, int base = 10) { print((unsigned long)v, base); }
+    void print(int v, int base = 10) { print((long)v, base); }
+    void print(unsigned int v, int base = 10) { print((unsigned long)v, base); }
+    void print(long v, int base = 10);
+    void print(unsigned long v, int base = 10);
+    void println() { write('\n'); }
+    template <typename T> void println(T v) { print(v); println(); }
+    template <typename T> void println(T v, int base) { print(v, base); println(); }
+    void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    // nothing is received
+    int available() { return 0; }
+    int read() { return -1; }
+    void flush() {}
+
+    //! take the output captured so far
+    const char *take();
+
+    bool echo = false; //!< copy the output to stdout
+private:
+    char m_buffer[4096];
+    uint16_t m_len = 0;
+};
+
+extern HostSerial MYSERIAL;
+#define DEC 10
+#define HEX 16
+#define RX_BUFFER_SIZE 128
+
+#define SERIAL_PROTOCOL(x) (MYSERIAL.print(x))
+#define SERIAL_PROTOCOLPGM(x) (serialprintPGM(PSTR(x)))
+#define SERIAL_PROTOCOLRPGM(x) (serialprintPGM((x)))
+#define SERIAL_PROTOCOLLN(x) (MYSERIAL.println(x))
+#define SERIAL_PROTOCOLLNPGM(x) (serialprintlnPGM(PSTR(x)))
+#define SERIAL_PROTOCOLLNRPGM(x) (serialprintlnPGM((x)))
+#define SERIAL_ERROR_START (serialprintPGM(errormagic))
+#define SERIAL_ERRORLN(x) SERIAL_PROTOCOLLN(x)
+#define SERIAL_ERRORRPGM(x) SERIAL_PROTOCOLRPGM(x)
+#define SERIAL_ERRORLNRPGM(x) SERIAL_PROTOCOLLNRPGM(x)
+#define SERIAL_ERRORLNPGM(x) SERIAL_PROTOCOLLNPGM(x)
+#define SERIAL_ECHO_START (serialprintPGM(echomagic))
+#define SERIAL_ECHO(x) SERIAL_PROTOCOL(x)
+#define SERIAL_ECHOPGM(x) SERIAL_PROTOCOLPGM(x)
+#define SERIAL_ECHORPGM(x) SERIAL_PROTOCOLRPGM(x)
+#define SERIAL_ECHOLN(x) SERIAL_PROTOCOLLN(x)
+#define SERIAL_ECHOLNPGM(x) SERIAL_PROTOCOLLNPGM(x)
+#define SERIAL_ECHOLNRPGM(x) SERIAL_PROTOCOLLNRPGM(x)
+
+extern const char errormagic[];
+extern const char echomagic[];
+void serialprintPGM(const char *str);
+void serialprintlnPGM(const char *str);
+
+// EEPROM
+#define EEPROM_SD_SORT 0
+extern uint8_t eeprom_mem[4096];
+inline uint8_t eeprom_read_byte(const uint8_t *addr) { return eeprom_mem[(uintptr_t)addr]; }
+inline void eeprom_update_byte(uint8_t *addr, uint8_t value) { eeprom_mem[(uintptr_t)addr] = value; }
+
+// printer state
+typedef uint8_t byte;
+#define NUM_AXIS 4
+#define PRINTING_TYPE_SD 0
+#define KEEPALIVE_STATE(n) do {} while (0)
+extern uint8_t SREG;
+extern float current_position[NUM_AXIS];
+extern float destination[NUM_AXIS];
+extern unsigned long starttime;
+extern unsigned long stoptime;
+extern unsigned long pause_time;
+extern unsigned long total_filament_used;
+extern ShortTimer usb_timer;
+extern bool saved_printing;
+extern uint8_t saved_printing_type;
+extern bool isPrintPaused;
+extern uint8_t farm_mode;
+extern uint8_t scrollstuff;
+
+extern const char MSG_SD_ERR_WRITE_TO_FILE[];
+extern const char MSG_SD_OPEN_FILE_FAIL[];
+extern const char MSG_Enqueing[];
+extern const char MSG_M112_KILL[];
+
+void kill(const char *full_screen_message = NULL, unsigned char id = 0);
+void finishAndDisableSteppers();
+void st_synchronize();
+void manage_heater();
+inline void autotempShutdown() {}
+#define enquecommand_P(cmd) enquecommand(cmd, true)
+void process_commands();
+void gcode_binary_move(uint8_t tag, const uint8_t *payload);
+void FlushSerialRequestResend();
+void ClearToSend();
+void save_statistics(unsigned long _total_filament_used, unsigned long _total_print_time);
+void prusa_statistics(uint8_t _message, uint8_t _col_nr = 0);
+char *itostr2(const uint8_t &x);
+#define LCD_HEIGHT 4
+extern uint8_t lcd_draw_update;
+void lcd_setstatus(const char *message);
+void lcd_setstatuspgm(const char *message);
+enum class LcdCommands : uint_least8_t { Idle, FarmModeConfirm };
+extern LcdCommands lcd_commands_type;
+void lcd_show_fullscreen_message_and_wait_P(const char *msg);
+void menu_progressbar_init(uint16_t total, const char *title);
+void menu_progressbar_update(uint16_t newVal);
+void menu_progressbar_finish(void);
+
+#endif //__cplusplus
+
+#endif /* TESTS_SDEMU_PRELUDE_H_ */
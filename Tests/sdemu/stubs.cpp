@@ -0,0 +1,144 @@
+/**
+ * @file
+ * @brief Firmware symbols used by the SD code in the host build.
+ */
+
+#include <stdarg.h>
+
+#include "cardreader.h"
+#include "sdemu.h"
+
+HostSerial MYSERIAL;
+CardReader card;
+bool Stopped;
+uint8_t SREG;
+float current_position[NUM_AXIS];
+float destination[NUM_AXIS];
+
+uint8_t eeprom_mem[4096];
+unsigned long starttime;
+unsigned long stoptime;
+unsigned long pause_time;
+unsigned long total_filament_used;
+ShortTimer usb_timer;
+bool saved_printing;
+uint8_t saved_printing_type;
+bool isPrintPaused;
+uint8_t farm_mode;
+uint8_t scrollstuff;
+
+const char errormagic[] = "Error:";
+const char echomagic[] = "echo:";
+const char MSG_SD_ERR_WRITE_TO_FILE[] = "error writing to file";
+const char MSG_SD_OPEN_FILE_FAIL[] = "open failed, File: ";
+const char MSG_Enqueing[] = "enqueing \"";
+const char MSG_M112_KILL[] = "M112 called. Emergency Stop.";
+
+void HostSerial::write(uint8_t c)
+{
+    if (echo)
+        putchar(c);
+    // keep the tail of the output
+    if (m_len == sizeof(m_buffer) - 1)
+    {
+        memmove(m_buffer, m_buffer + sizeof(m_buffer) / 2, sizeof(m_buffer) / 2 - 1);
+        m_len = sizeof(m_buffer) / 2 - 1;
+    }
+    m_buffer[m_len++] = c;
+}
+
+void HostSerial::print(const char *str)
+{
+    while (*str)
+        write(*str++);
+}
+
+void HostSerial::print(long v, int base)
+{
+    if (v < 0)
+    {
+        write('-');
+        v = -v;
+    }
+    print((unsigned long)v, base);
+}
+
+void HostSerial::print(unsigned long v, int base)
+{
+    char buf[8 * sizeof(long) + 1];
+    char *p = buf + sizeof(buf) - 1;
+    *p = 0;
+    do
+    {
+        uint8_t digit = v % base;
+        *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        v /= base;
+    } while (v);
+    print(p);
+}
+
+void HostSerial::printf(const char *format, ...)
+{
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    print(buf);
+}
+
+const char *HostSerial::take()
+{
+    m_buffer[m_len] = 0;
+    m_len = 0;
+    return m_buffer;
+}
+
+void serialprintPGM(const char *str)
+{
+    MYSERIAL.print(str);
+}
+
+void serialprintlnPGM(const char *str)
+{
+    MYSERIAL.println(str);
+}
+
+//! simulated time of the card
+unsigned long millis2()
+{
+    return SdEmu::card.now() / 1000;
+}
+
+unsigned long millis()
+{
+    return millis2();
+}
+
+char *itostr2(const uint8_t &x)
+{
+    static char conv[3];
+    conv[0] = '0' + (x / 10) % 10;
+    conv[1] = '0' + x % 10;
+    conv[2] = 0;
+    return conv;
+}
+
+void kill(const char *, unsigned char) { abort(); }
+void finishAndDisableSteppers() {}
+void st_synchronize() {}
+void manage_heater() {}
+void process_commands() {}
+void gcode_binary_move(uint8_t, const uint8_t *) {}
+void FlushSerialRequestResend() {}
+void ClearToSend() {}
+void save_statistics(unsigned long, unsigned long) {}
+void prusa_statistics(uint8_t, uint8_t) {}
+uint8_t lcd_draw_update;
+LcdCommands lcd_commands_type;
+void lcd_setstatus(const char *) {}
+void lcd_setstatuspgm(const char *) {}
+void lcd_show_fullscreen_message_and_wait_P(const char *) {}
+void menu_progressbar_init(uint16_t, const char *) {}
+void menu_progressbar_update(uint16_t) {}
+void menu_progressbar_finish(void) {}
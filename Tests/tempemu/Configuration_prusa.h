@@ -0,0 +1,6 @@
+/**
+ * @file
+ * @brief Printer variant of the temperature manager host build, the MK3S
+ */
+
+#include "variants/1_75mm_MK3S-EINSy10a-E3Dv6full.h"
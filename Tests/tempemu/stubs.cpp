@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief Firmware symbols used by the temperature manager in the host build.
+ */
+
+#include "temperature.h"
+#include "planner.h"
+#include "adc.h"
+#include "fancheck.h"
+#include "messages.h"
+#include "tempemu.h"
+
+// registers
+uint8_t SREG, TIMSK2, TIMSK5, TIFR5, TCCR5A, TCCR5B, TCNT5H, TCNT5L, OCR2B;
+uint16_t TCNT5, OCR5A;
+
+static uint8_t pins[128];
+void host_pin_write(uint8_t pin, uint8_t v) { pins[pin] = v; }
+uint8_t host_pin_read(uint8_t pin) { return pins[pin]; }
+
+uint8_t eeprom_mem[4096];
+M500_conf cs;
+const char echomagic[] = "echo:";
+const char errormagic[] = "Error:";
+const char MSG_PAUSED_THERMAL_ERROR[] = "PAUSED THERMAL ERROR";
+const char MSG_THERMAL_ANOMALY[] = "THERMAL ANOMALY";
+const char MSG_WELCOME[] = CUSTOM_MENDEL_NAME " OK.";
+
+// printer state
+float current_position[NUM_AXIS];
+float destination[NUM_AXIS];
+uint8_t active_extruder;
+int fanSpeed;
+bool saved_printing;
+float saved_bed_temperature;
+float saved_extruder_temperature;
+int saved_fan_speed;
+uint8_t farm_mode;
+uint8_t menu_block_mask;
+bool bedPWMDisabled;
+block_t block_buffer[BLOCK_BUFFER_SIZE];
+volatile uint8_t block_buffer_head;
+volatile uint8_t block_buffer_tail;
+
+void kill(const char *, unsigned char) { abort(); }
+void ThermalStop(bool) { TempEmu::stopped = true; }
+bool IsStopped() { return TempEmu::stopped; }
+bool printer_active() { return false; }
+void host_keepalive() {}
+void host_autoreport() {}
+void stack_error() { abort(); }
+void prusa_statistics(uint8_t, uint8_t) {}
+void babystep(const uint8_t, const bool) {}
+
+// LCD
+static void alert(const char *message, uint8_t severity)
+{
+    if (severity == LCD_STATUS_CRITICAL && !TempEmu::alert)
+    {
+        // the messages are built on the stack
+        static char first[32];
+        strncpy(first, message, sizeof(first) - 1);
+        TempEmu::alert = first;
+        TempEmu::alert_time = TempEmu::now;
+    }
+}
+void lcd_setstatuspgm(const char *) {}
+void lcd_setalertstatus(const char *message, uint8_t severity) { alert(message, severity); }
+void lcd_setalertstatuspgm(const char *message, uint8_t severity) { alert(message, severity); }
+void lcd_return_to_status() {}
+
+// fans
+void readFanTach() {}
+void checkExtruderAutoFans() {}
+void checkFans() {}
+void hotendFanSetFullSpeed() {}
+
+// timers
+unsigned long millis2() { return TempEmu::now; }
+void timer0_init() {}
+void timer4_init() {}
+
+// ADC
+volatile uint16_t adc_values[ADC_CHAN_CNT];
+void adc_init() {}
+void adc_start_cycle() {}
+void adc_callback();
+
+// temperature manager interrupt, TEMP_TIM of the variant
+extern "C" void TIMER5_COMPA_vect(void);
+
+namespace TempEmu {
+
+uint32_t now;
+const char *alert;
+uint32_t alert_time;
+bool stopped;
+
+void boot()
+{
+    cs.Kp = DEFAULT_Kp;
+    cs.Ki = scalePID_i(DEFAULT_Ki);
+    cs.Kd = scalePID_d(DEFAULT_Kd);
+    cs.bedKp = DEFAULT_bedKp;
+    cs.bedKi = scalePID_i(DEFAULT_bedKi);
+    cs.bedKd = scalePID_d(DEFAULT_bedKd);
+    soft_pwm_init();
+    temp_mgr_init();
+}
+
+void adc_cycle(uint16_t hotend, uint16_t bed, uint16_t ambient)
+{
+    adc_values[ADC_PIN_IDX(TEMP_0_PIN)] = hotend;
+    adc_values[ADC_PIN_IDX(TEMP_BED_PIN)] = bed;
+    adc_values[ADC_PIN_IDX(TEMP_AMBIENT_PIN)] = ambient;
+    adc_callback();
+    TIMER5_COMPA_vect();
+}
+
+void set_targets(int hotend, int bed)
+{
+    target_temperature[0] = hotend;
+    target_temperature_bed = bed;
+}
+
+uint8_t hotend_pwm() { return getHeaterPower(0); }
+uint8_t bed_pwm() { return getHeaterPower(-1); }
+
+float hotend_temp() { return current_temperature[0]; }
+float bed_temp() { return current_temperature_bed; }
+float ambient_temp() { return current_temperature_ambient; }
+
+} // namespace TempEmu
@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief Temperature manager of the firmware driven by a simulated ADC and clock.
+ *
+ * temperature.cpp is built for the host with the I/O stubbed out (tempemu_prelude.h, stubs.cpp).
+ * The simulation completes the ADC cycles with the raw values of its thermistors and runs the
+ * temperature manager interrupt and manage_heater() on them. The errors end up at the LCD alert
+ * and ThermalStop() stubs, which record them.
+ *
+ * The firmware state is reset only by a reboot, so each run should boot a fresh process.
+ */
+
+#ifndef TESTS_TEMPEMU_TEMPEMU_H_
+#define TESTS_TEMPEMU_TEMPEMU_H_
+
+#include <stdint.h>
+
+namespace TempEmu {
+
+//! simulated time [ms], the value of _millis()
+extern uint32_t now;
+
+//! first critical LCD alert, nullptr if there was none
+extern const char *alert;
+//! time of the first alert [ms]
+extern uint32_t alert_time;
+//! ThermalStop() has been called
+extern bool stopped;
+
+//! setup of the temperature manager the way the firmware boots, with the default PID gains
+void boot();
+
+//! @brief Complete an ADC cycle and run the temperature manager interrupt on it
+//! @param hotend, bed, ambient raw values, 16x oversampled
+void adc_cycle(uint16_t hotend, uint16_t bed, uint16_t ambient);
+
+//! set the target temperatures, they are taken over by the next manage_heater()
+void set_targets(int hotend, int bed);
+
+//! heater duty of the temperature manager [0-127]
+uint8_t hotend_pwm();
+uint8_t bed_pwm();
+
+//! temperatures converted by the firmware
+float hotend_temp();
+float bed_temp();
+float ambient_temp();
+
+} // namespace TempEmu
+
+void manage_heater();
+
+#endif /* TESTS_TEMPEMU_TEMPEMU_H_ */
@@ -0,0 +1,178 @@
+/**
+ * @file
+ * @brief Host replacement of Marlin.h for the temperature manager build.
+ *
+ * Force-included (-include) into temperature.cpp. The firmware headers which pull in the AVR
+ * environment, the LCD and the motion are blocked by their include guards and the symbols the
+ * temperature manager uses are provided here instead. The configuration is the one of the MK3S
+ * (Configuration_prusa.h of this directory). Everything with external linkage is defined in
+ * stubs.cpp.
+ */
+
+#ifndef TESTS_TEMPEMU_PRELUDE_H_
+#define TESTS_TEMPEMU_PRELUDE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef __cplusplus
+#include <algorithm>
+#endif
+
+#ifdef __cplusplus
+
+// headers replaced by this file
+#define MARLIN_H
+#define stepper_h
+#define ULTRALCD_H
+#define _MENU_H
+#define SOUND_H
+#define LANGUAGE_H
+#define SdFatUtil_h
+
+// program memory and EEPROM
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define pgm_read_dword(p) (*(const uint32_t *)(p))
+#define pgm_read_float(p) (*(const float *)(p))
+#define pgm_read_ptr(p) (*(const void * const *)(p))
+
+#define strcpy_P strcpy
+#define strcat_P strcat
+#define printf_P printf
+
+// translations
+#define _I(s) (s)
+#define _i(s) (s)
+#define _T(s) (s)
+#define _N(s) (s)
+#define _n(s) (s)
+
+// EEPROM
+extern uint8_t eeprom_mem[4096];
+inline uint8_t eeprom_read_byte(const uint8_t *addr) { return eeprom_mem[(uintptr_t)addr]; }
+inline void eeprom_update_byte(uint8_t *addr, uint8_t value) { eeprom_mem[(uintptr_t)addr] = value; }
+inline float eeprom_read_float(const float *addr) { float v; memcpy(&v, eeprom_mem + (uintptr_t)addr, sizeof(v)); return v; }
+inline void eeprom_update_float(float *addr, float value) { memcpy(eeprom_mem + (uintptr_t)addr, &value, sizeof(value)); }
+
+// the AVR layout of the EEPROM structures
+#pragma pack(push, 1)
+#include "Configuration.h"
+#pragma pack(pop)
+#include "pins.h"
+#include "system_timer.h"
+#include "Timer.h"
+
+// registers and pins
+extern uint8_t SREG, TIMSK2, TIMSK5, TIFR5, TCCR5A, TCCR5B, TCNT5H, TCNT5L, OCR2B;
+extern uint16_t TCNT5, OCR5A;
+enum
+{
+    OCIE2B = 2, OCIE5A = 1, OCF5A = 1,
+    CS50 = 0, CS51 = 1, CS52 = 2, WGM50 = 0, WGM51 = 1, WGM52 = 3, WGM53 = 4, COM5A0 = 6, COM5B0 = 4,
+};
+#define cli()
+#define sei()
+#define ISR(vect) extern "C" void vect(void)
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define NONATOMIC_FORCEOFF
+#define ATOMIC_BLOCK(type) for (bool _done = false; !_done; _done = true)
+#define NONATOMIC_BLOCK(type) ATOMIC_BLOCK(type)
+#define wdt_reset()
+#define LOW 0
+#define HIGH 1
+#define WRITE(pin, v) host_pin_write(pin, v)
+#define READ(pin) host_pin_read(pin)
+#define TOGGLE(pin) host_pin_write(pin, !host_pin_read(pin))
+#define SET_OUTPUT(pin)
+#define SET_INPUT(pin)
+void host_pin_write(uint8_t pin, uint8_t v);
+uint8_t host_pin_read(uint8_t pin);
+typedef uint8_t byte;
+#define constrain(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+// Arduino macros
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+// serial port, the output is discarded
+#define SERIAL_PROTOCOL(x) host_serial_print(x)
+#define SERIAL_PROTOCOL_F(x, y) host_serial_print(x)
+#define SERIAL_PROTOCOLPGM(x) host_serial_print(x)
+#define SERIAL_PROTOCOLRPGM(x) host_serial_print(x)
+#define SERIAL_PROTOCOLLN(x) host_serial_print(x)
+#define SERIAL_PROTOCOLLNPGM(x) host_serial_print(x)
+#define SERIAL_PROTOCOLLNRPGM(x) host_serial_print(x)
+#define SERIAL_ERROR_START
+#define SERIAL_ERROR(x) SERIAL_PROTOCOL(x)
+#define SERIAL_ERRORPGM(x) SERIAL_PROTOCOLPGM(x)
+#define SERIAL_ERRORRPGM(x) SERIAL_PROTOCOLRPGM(x)
+#define SERIAL_ERRORLN(x) SERIAL_PROTOCOLLN(x)
+#define SERIAL_ERRORLNPGM(x) SERIAL_PROTOCOLLNPGM(x)
+#define SERIAL_ERRORLNRPGM(x) SERIAL_PROTOCOLLNRPGM(x)
+#define SERIAL_ECHO_START
+#define SERIAL_ECHO(x) SERIAL_PROTOCOL(x)
+#define SERIAL_ECHOPGM(x) SERIAL_PROTOCOLPGM(x)
+#define SERIAL_ECHORPGM(x) SERIAL_PROTOCOLRPGM(x)
+#define SERIAL_ECHOLN(x) SERIAL_PROTOCOLLN(x)
+#define SERIAL_ECHOLNPGM(x) SERIAL_PROTOCOLLNPGM(x)
+#define SERIAL_ECHOLNRPGM(x) SERIAL_PROTOCOLLNRPGM(x)
+template <typename T> inline void host_serial_print(T) {}
+extern const char echomagic[];
+extern const char errormagic[];
+
+// printer state
+enum AxisEnum { X_AXIS = 0, Y_AXIS = 1, Z_AXIS = 2, E_AXIS = 3 };
+#define IN_PROCESS 3
+#define KEEPALIVE_STATE(n) do {} while (0)
+extern float current_position[NUM_AXIS];
+extern float destination[NUM_AXIS];
+extern uint8_t active_extruder;
+extern int fanSpeed;
+extern bool saved_printing;
+extern float saved_bed_temperature;
+extern float saved_extruder_temperature;
+extern int saved_fan_speed;
+extern uint8_t farm_mode;
+void kill(const char *full_screen_message = NULL, unsigned char id = 0);
+void ThermalStop(bool allow_pause = false);
+bool IsStopped();
+bool printer_active();
+void host_keepalive();
+void host_autoreport();
+void stack_error();
+void prusa_statistics(uint8_t _message, uint8_t _col_nr = 0);
+void babystep(const uint8_t axis, const bool direction);
+namespace SdFatUtil { inline bool test_stack_integrity() { return true; } }
+
+// LCD
+#define LCD_STATUS_CRITICAL 3
+#define LCD_STATUS_ALERT 2
+#define LCD_STATUS_INFO 1
+void lcd_setstatuspgm(const char *message);
+void lcd_setalertstatus(const char *message, uint8_t severity = LCD_STATUS_ALERT);
+void lcd_setalertstatuspgm(const char *message, uint8_t severity = LCD_STATUS_ALERT);
+void lcd_return_to_status();
+inline void lcd_update(uint8_t) {}
+inline void lcd_buttons_update() {}
+enum ESeriousErrors
+{
+    MENU_BLOCK_NONE = 0,
+    MENU_BLOCK_THERMAL_ERROR = 0x01,
+#ifdef TEMP_MODEL
+    MENU_BLOCK_TEMP_MODEL_AUTOTUNE = 0x02,
+#endif
+};
+extern uint8_t menu_block_mask;
+#define menu_set_block(x) menu_block_mask |= x;
+#define menu_unset_block(x) menu_block_mask &= ~x;
+
+#endif //__cplusplus
+
+#endif /* TESTS_TEMPEMU_PRELUDE_H_ */
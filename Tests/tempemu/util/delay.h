@@ -0,0 +1,9 @@
+/**
+ * @file
+ * @brief Mock file to allow test compilation, the definitions are in tempemu_prelude.h.
+ */
+
+#ifndef TESTS_TEMPEMU_UTIL_DELAY_H_
+#define TESTS_TEMPEMU_UTIL_DELAY_H_
+
+#endif /* TESTS_TEMPEMU_UTIL_DELAY_H_ */